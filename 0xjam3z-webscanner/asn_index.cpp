@@ -0,0 +1,125 @@
+#include "asn_index.hpp"
+
+#include "common.hpp"
+#include "parsers.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+AsnIndex::AsnIndex() {
+    intern(std::string());
+}
+
+uint32_t AsnIndex::intern(std::string s) {
+    auto it = interned_.find(s);
+    if (it != interned_.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(strings_.size());
+    strings_.push_back(s);
+    interned_.emplace(std::move(s), id);
+    return id;
+}
+
+static std::string member_string(std::string_view object, std::string_view key) {
+    auto raw = json_member(object, key);
+    return raw ? json_string(*raw).value_or(std::string()) : std::string();
+}
+
+template <typename Range>
+static void fill_attributes(std::string_view object, Range &range, uint32_t country, uint32_t country_name,
+                            uint32_t as_name) {
+    if (auto asn = json_member(object, "asn")) {
+        std::string text = json_string(*asn).value_or(std::string(*asn));
+        size_t digits = text.find_first_of("0123456789");
+        if (digits != std::string::npos) {
+            range.asn = static_cast<uint32_t>(std::strtoul(text.c_str() + digits, nullptr, 10));
+        }
+    }
+    range.country = country;
+    range.country_name = country_name;
+    range.as_name = as_name;
+}
+
+void AsnIndex::add_object(std::string_view object) {
+    std::string start = member_string(object, "start_ip");
+    std::string end = member_string(object, "end_ip");
+    AsnRange range;
+    AsnRange6 range6;
+    bool v4 = parse_ipv4(start, range.start) && parse_ipv4(end, range.end) && range.start <= range.end;
+    if (!v4 && !(parse_ipv6(start, range6.range.start) && parse_ipv6(end, range6.range.end) &&
+                 range6.range.start <= range6.range.end)) {
+        return;
+    }
+    uint32_t country = intern(member_string(object, "country"));
+    uint32_t country_name = intern(member_string(object, "country_name"));
+    uint32_t as_name = intern(member_string(object, "as_name"));
+    if (v4) {
+        fill_attributes(object, range, country, country_name, as_name);
+        ranges_.push_back(range);
+    } else {
+        fill_attributes(object, range6, country, country_name, as_name);
+        ranges6_.push_back(range6);
+    }
+}
+
+bool AsnIndex::load_buffer(std::string_view content) {
+    size_t pos = content.find_first_not_of(" \t\r\n");
+    if (pos != std::string_view::npos && content[pos] == '[') {
+        size_t it = 0;
+        std::string_view element;
+        while (json_next_element(content, it, element)) {
+            add_object(element);
+        }
+    } else {
+        // One object per line (or simply concatenated).
+        while (pos != std::string_view::npos && pos < content.size()) {
+            size_t end = json_skip_value(content, pos);
+            if (end == std::string_view::npos) {
+                break;
+            }
+            if (content[pos] == '{') {
+                add_object(content.substr(pos, end - pos));
+            }
+            pos = content.find_first_not_of(" \t\r\n,", end);
+        }
+    }
+    std::sort(ranges_.begin(), ranges_.end(),
+              [](const AsnRange &a, const AsnRange &b) { return a.start < b.start; });
+    std::sort(ranges6_.begin(), ranges6_.end(),
+              [](const AsnRange6 &a, const AsnRange6 &b) { return a.range.start < b.range.start; });
+    trie6_ = Ipv6Trie();
+    for (size_t i = 0; i < ranges6_.size(); ++i) {
+        trie6_.insert_range(ranges6_[i].range, static_cast<uint32_t>(i));
+    }
+    return !ranges_.empty() || !ranges6_.empty();
+}
+
+bool AsnIndex::load(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return load_buffer(content);
+}
+
+const AsnRange *AsnIndex::lookup(uint32_t ip) const {
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), ip,
+                               [](uint32_t value, const AsnRange &r) { return value < r.start; });
+    if (it == ranges_.begin()) {
+        return nullptr;
+    }
+    --it;
+    return ip <= it->end ? &*it : nullptr;
+}
+
+const AsnRange6 *AsnIndex::lookup6(const Ipv6Addr &addr) const {
+    const uint32_t *index = trie6_.lookup(addr);
+    return index ? &ranges6_[*index] : nullptr;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ipv6.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct AsnRange {
+    uint32_t start = 0;
+    uint32_t end = 0;
+    uint32_t asn = 0;
+    // Indices into the index's interned string table.
+    uint32_t country = 0;
+    uint32_t country_name = 0;
+    uint32_t as_name = 0;
+};
+
+struct AsnRange6 {
+    Ipv6Range range;
+    uint32_t asn = 0;
+    uint32_t country = 0;
+    uint32_t country_name = 0;
+    uint32_t as_name = 0;
+};
+
+// IP -> ASN/country lookup over country_asn.json (JSON array or one object per
+// line). IPv4 ranges are kept sorted by start address and looked up by binary
+// search; IPv6 ranges, which nest far more often, go through a prefix trie so
+// the most specific one wins.
+class AsnIndex {
+public:
+    AsnIndex();
+
+    bool load(const std::filesystem::path &path);
+    bool load_buffer(std::string_view content);
+
+    const AsnRange *lookup(uint32_t ip) const;
+    const AsnRange6 *lookup6(const Ipv6Addr &addr) const;
+    std::string_view str(uint32_t id) const { return strings_[id]; }
+    const std::vector<AsnRange> &ranges() const { return ranges_; }
+    const std::vector<AsnRange6> &ranges6() const { return ranges6_; }
+    size_t size() const { return ranges_.size() + ranges6_.size(); }
+
+private:
+    uint32_t intern(std::string s);
+    void add_object(std::string_view object);
+
+    std::vector<AsnRange> ranges_;
+    std::vector<AsnRange6> ranges6_;
+    // Values index ranges6_.
+    Ipv6Trie trie6_;
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, uint32_t> interned_;
+};
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Generate a synthetic scan workload for benchmarks and PGO training.
+
+Writes masscan_results.txt, zgrab_results_80.json, zgrab_results_443.json and
+country_asn.json into the output directory. Body sizes follow a skewed
+distribution (mostly small pages, a few very large ones) and a share of
+targets time out, which is roughly what real sweeps look like.
+"""
+
+import argparse
+import json
+import os
+import random
+
+TITLES = [
+    "Welcome to nginx!",
+    "Apache2 Ubuntu Default Page: It works",
+    "IIS Windows Server",
+    "Login",
+    "Router Admin",
+    "Index of /",
+    "403 Forbidden",
+    "Grafana",
+    "Jenkins [Jenkins]",
+    "Site %d",
+]
+SERVERS = ["nginx", "Apache/2.4.41 (Ubuntu)", "Microsoft-IIS/10.0", "lighttpd", "cloudflare"]
+ERRORS = ["io-timeout", "connection-timeout", "unknown-error"]
+
+
+def ip_for(i):
+    return "10.%d.%d.%d" % ((i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF)
+
+
+def body_size(rng):
+    roll = rng.random()
+    if roll < 0.70:
+        return rng.randint(200, 4000)
+    if roll < 0.97:
+        return rng.randint(4000, 64000)
+    return rng.randint(64000, 1000000)
+
+
+def make_body(rng, i):
+    title = rng.choice(TITLES)
+    if "%d" in title:
+        title = title % (i % 997)
+    head = '<!DOCTYPE html>\n<html lang="en">\n<head>\n<meta charset="utf-8">\n'
+    filler = ('<div class="row"><a href="/p/%d">item</a> "quoted" \\ text\t</div>\n' % i)
+    size = body_size(rng)
+    body = head + ("<TITLE>%s</TITLE>\n" % title if i % 5 == 0 else "<title>%s</title>\n" % title)
+    body += "</head>\n<body>\n" + filler * max(1, size // len(filler)) + "</body>\n</html>\n"
+    return body
+
+
+def record(rng, i, port):
+    ip = ip_for(i)
+    if rng.random() < 0.12:
+        return {"ip": ip, "data": {"http": {"status": rng.choice(ERRORS), "protocol": "http",
+                                            "timestamp": "2024-05-01T00:00:00Z", "error": "timeout"}}}
+    scheme = "https" if port == 443 else "http"
+    request = {"url": {"scheme": scheme, "host": ip, "path": "/"}, "method": "GET",
+               "headers": {"user_agent": ["Mozilla/5.0 zgrab/0.x"]}}
+    if port == 443:
+        name = "host%d.example.com" % i
+        request["tls_log"] = {"handshake_log": {"server_certificates": {"certificate": {
+            "raw": "MII" + "A" * 1200,
+            "parsed": {"subject_dn": "CN=" + name, "issuer_dn": "C=US, O=Example CA, CN=Example R3",
+                       "fingerprint_sha256": "%064x" % (i * 2654435761),
+                       "validity": {"start": "2024-01-01T00:00:00Z", "end": "2025-01-01T00:00:00Z"},
+                       "extensions": {"subject_alt_name": {"dns_names": [name, "www." + name]}}}}}}}
+    headers = {"server": [rng.choice(SERVERS)], "content_type": ["text/html; charset=utf-8"],
+               "date": ["Wed, 01 May 2024 00:00:00 GMT"]}
+    if rng.random() < 0.2:
+        headers["unknown"] = [{"key": "x-powered-by", "value": ["PHP/7.4.3"]}]
+    response = {"status_line": "200 OK", "status_code": 200, "protocol": {"name": "HTTP/1.1"},
+                "headers": headers, "body": make_body(rng, i), "content_length": -1, "request": request}
+    return {"ip": ip, "data": {"http": {"status": "success", "protocol": "http",
+                                        "result": {"response": response},
+                                        "timestamp": "2024-05-01T00:00:00Z"}}}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--out", default="fixtures")
+    parser.add_argument("--records", type=int, default=3000, help="zgrab2 records per port")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    os.makedirs(args.out, exist_ok=True)
+
+    with open(os.path.join(args.out, "masscan_results.txt"), "w") as f:
+        f.write("#masscan\n")
+        for i in range(args.records * 10):
+            f.write("open tcp %d %s %d\n" % (rng.choice((80, 443, 8080, 22)), ip_for(i), 1714521600 + i // 100))
+        f.write("# end\n")
+
+    for port in (80, 443):
+        with open(os.path.join(args.out, "zgrab_results_%d.json" % port), "w") as f:
+            for i in range(args.records):
+                f.write(json.dumps(record(rng, i, port)) + "\n")
+
+    with open(os.path.join(args.out, "country_asn.json"), "w") as f:
+        for block in range(256):
+            f.write(json.dumps({"start_ip": "10.%d.0.0" % block, "end_ip": "10.%d.255.255" % block,
+                                "country": "US", "country_name": "United States",
+                                "asn": "AS%d" % (64512 + block), "as_name": "Example %d" % block}) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,131 @@
+// Micro-benchmark for HttpStreamParser and HttpResponseParser on canned
+// responses, fed whole and in 1460-byte segments (one TCP MSS each).
+//
+// Usage: http_parser_bench [--iterations <n>]
+// Built with -DJAM3Z_BUILD_BENCH=ON; compare builds on the same host only.
+
+#include "http.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct NullHandler : HttpHandler {
+    size_t bytes = 0;
+    bool on_head(int, const std::vector<HttpHeaderView> &headers) override {
+        bytes += headers.size();
+        return true;
+    }
+    bool on_body(std::string_view data) override {
+        bytes += data.size();
+        return true;
+    }
+};
+
+struct Workload {
+    const char *name;
+    std::string response;
+};
+
+static std::string head(const std::string &framing) {
+    return "HTTP/1.1 200 OK\r\n"
+           "Date: Sun, 18 Oct 2026 12:00:00 GMT\r\n"
+           "Server: nginx/1.25.3\r\n"
+           "Content-Type: text/html; charset=utf-8\r\n"
+           "Connection: keep-alive\r\n"
+           "Vary: Accept-Encoding\r\n"
+           "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+           "Pragma: no-cache\r\n"
+           "Expires: 0\r\n"
+           "X-Frame-Options: SAMEORIGIN\r\n"
+           "X-Content-Type-Options: nosniff\r\n"
+           "Strict-Transport-Security: max-age=31536000\r\n"
+           "Set-Cookie: session=0123456789abcdef; Path=/; HttpOnly\r\n" +
+           framing + "\r\n";
+}
+
+static std::vector<Workload> workloads() {
+    std::string body = "<html><head><title>Benchmark</title></head><body>";
+    while (body.size() < 16 * 1024) {
+        body += "<p>lorem ipsum dolor sit amet, consectetur adipiscing elit</p>\n";
+    }
+    body.resize(16 * 1024);
+    std::string chunked;
+    for (size_t off = 0; off < body.size(); off += 1024) {
+        chunked += "400\r\n" + body.substr(off, 1024) + "\r\n";
+    }
+    chunked += "0\r\n\r\n";
+    return {
+        {"16 KB body, Content-Length", head("Content-Length: " + std::to_string(body.size()) + "\r\n") + body},
+        {"16 x 1 KB chunks", head("Transfer-Encoding: chunked\r\n") + chunked},
+        {"head only, 14 headers", head("Content-Length: 0\r\n")},
+    };
+}
+
+template <typename Feed>
+static double seconds_per_response(const std::string &response, size_t segment, int iterations, Feed feed) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t off = 0; off < response.size(); off += segment) {
+            if (!feed(std::string_view(response).substr(off, segment), off == 0)) {
+                std::fprintf(stderr, "parse failed\n");
+                std::exit(1);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void report(const char *parser, const char *feeding, const Workload &w, double per) {
+    std::printf("  %-20s %-8s %9.0f ns/response %8.2f GB/s\n", parser, feeding, per * 1e9,
+                static_cast<double>(w.response.size()) / per / 1e9);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 200000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Usage: %s [--iterations <n>]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (const auto &w : workloads()) {
+        std::printf("%s (%zu bytes)\n", w.name, w.response.size());
+        std::vector<size_t> segments = {w.response.size()};
+        if (w.response.size() > 1460) {
+            segments.push_back(1460);
+        }
+        for (size_t segment : segments) {
+            const char *feeding = segment == w.response.size() ? "whole" : "1460 B";
+            HttpStreamParser stream;
+            NullHandler handler;
+            report("HttpStreamParser", feeding, w,
+                   seconds_per_response(w.response, segment, iterations, [&](std::string_view data, bool first) {
+                       if (first) {
+                           stream.reset();
+                       }
+                       return stream.feed(data, handler);
+                   }));
+            HttpResponseParser response;
+            report("HttpResponseParser", feeding, w,
+                   seconds_per_response(w.response, segment, iterations, [&](std::string_view data, bool first) {
+                       if (first) {
+                           response.reset();
+                       }
+                       return response.feed(data);
+                   }));
+            if (handler.bytes == 0 || !response.done()) {
+                std::fprintf(stderr, "unexpected parse result\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+# Builds the scanner in three configurations, benchmarks the parse stage of
+# each on the same synthetic workload and prints the comparison:
+#
+#   release  plain -O3 Release
+#   lto      Release + LTO + -march
+#   pgo      RelWithPGO: instrumented build, training run, LTO + -march + profile
+#
+# Usage: bench/pgo.sh [--march <arch>] [--records <n>] [--runs <n>] [--report <file>]
+# The final PGO binary is left in bench/build/pgo/0xjam3z-scanner.
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+WORK="$ROOT/bench/build"
+MARCH="native"
+RECORDS=3000
+RUNS=5
+REPORT=""
+JOBS="$(nproc 2>/dev/null || echo 4)"
+
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --march) MARCH="$2"; shift 2 ;;
+        --records) RECORDS="$2"; shift 2 ;;
+        --runs) RUNS="$2"; shift 2 ;;
+        --report) REPORT="$2"; shift 2 ;;
+        -h|--help) sed -n '2,11p' "$0"; exit 0 ;;
+        *) echo "Unknown option: $1" >&2; exit 1 ;;
+    esac
+done
+
+mkdir -p "$WORK"
+TRAIN="$WORK/train-fixtures"
+BENCH="$WORK/bench-fixtures"
+# Train and measure on different seeds so the profile is not fitted to the benchmark input.
+[[ -f "$TRAIN/zgrab_results_80.json" ]] || python3 "$ROOT/bench/gen_fixtures.py" --out "$TRAIN" --records "$RECORDS" --seed 1
+[[ -f "$BENCH/zgrab_results_80.json" ]] || python3 "$ROOT/bench/gen_fixtures.py" --out "$BENCH" --records "$RECORDS" --seed 2
+
+configure_build() {
+    local dir="$1"; shift
+    cmake -S "$ROOT" -B "$dir" -DJAM3Z_BUILD_EXAMPLE_PLUGINS=OFF -DJAM3Z_BUILD_SHARED_CORE=OFF "$@" >/dev/null
+    cmake --build "$dir" --target 0xjam3z-scanner -j"$JOBS" >/dev/null
+}
+
+# The workload both the training run and the benchmark execute.
+workload() {
+    local bin="$1" dir="$2" out="$3"
+    "$bin" parse "$dir/zgrab_results_80.json" "$dir/zgrab_results_443.json" "$dir/masscan_results.txt" \
+        --output "$out/opendomains" --out-dir "$out" >/dev/null
+}
+
+echo "== release"
+configure_build "$WORK/release" -DCMAKE_BUILD_TYPE=Release -DJAM3Z_LTO=OFF -DJAM3Z_MARCH=
+
+echo "== lto (-march=$MARCH)"
+configure_build "$WORK/lto" -DCMAKE_BUILD_TYPE=Release -DJAM3Z_LTO=ON -DJAM3Z_MARCH="$MARCH"
+
+echo "== pgo: instrumented build"
+PGO_DIR="$WORK/pgo-profiles"
+rm -rf "$PGO_DIR"
+mkdir -p "$PGO_DIR"
+configure_build "$WORK/pgo" -DCMAKE_BUILD_TYPE=RelWithPGO -DJAM3Z_PGO=generate -DJAM3Z_PGO_DIR="$PGO_DIR" \
+    -DJAM3Z_MARCH="$MARCH"
+
+echo "== pgo: training run"
+mkdir -p "$WORK/train-out"
+workload "$WORK/pgo/0xjam3z-scanner" "$TRAIN" "$WORK/train-out"
+if grep -qs 'CMAKE_CXX_COMPILER_ID "Clang"' "$WORK"/pgo/CMakeFiles/*/CMakeCXXCompiler.cmake; then
+    llvm-profdata merge -o "$PGO_DIR/default.profdata" "$PGO_DIR"/*.profraw
+fi
+
+echo "== pgo: optimized build"
+# Same build directory for both phases so GCC finds the .gcda files by object path.
+cmake --build "$WORK/pgo" --target clean >/dev/null
+configure_build "$WORK/pgo" -DCMAKE_BUILD_TYPE=RelWithPGO -DJAM3Z_PGO=use -DJAM3Z_PGO_DIR="$PGO_DIR" \
+    -DJAM3Z_MARCH="$MARCH"
+
+input_mb="$(du -cm "$BENCH"/zgrab_results_*.json "$BENCH"/masscan_results.txt | tail -1 | cut -f1)"
+
+# Median wall-clock milliseconds over $RUNS runs.
+measure() {
+    local bin="$1" out="$WORK/bench-out"
+    mkdir -p "$out"
+    workload "$bin" "$BENCH" "$out"  # warm the page cache
+    local times=()
+    for ((i = 0; i < RUNS; ++i)); do
+        local start end
+        start="$(date +%s%N)"
+        workload "$bin" "$BENCH" "$out"
+        end="$(date +%s%N)"
+        times+=($(((end - start) / 1000000)))
+    done
+    printf '%s\n' "${times[@]}" | sort -n | awk '{a[NR]=$1} END {print a[int((NR + 1) / 2)]}'
+}
+
+base_ms=""
+{
+    echo "Parse-stage benchmark: ${input_mb} MB input, median of $RUNS runs, $(nproc 2>/dev/null || echo ?) cores"
+    printf '%-10s %10s %10s %9s\n' config ms MB/s speedup
+    for cfg in release lto pgo; do
+        ms="$(measure "$WORK/$cfg/0xjam3z-scanner")"
+        [[ -n "$base_ms" ]] || base_ms="$ms"
+        awk -v c="$cfg" -v ms="$ms" -v mb="$input_mb" -v base="$base_ms" \
+            'BEGIN { printf "%-10s %10d %10.1f %8.2fx\n", c, ms, mb * 1000 / ms, base / ms }'
+    done
+} | tee ${REPORT:+"$REPORT"}
@@ -0,0 +1,198 @@
+#include "common.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::string trim(const std::string &s) {
+    size_t start = 0;
+    while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) {
+        ++start;
+    }
+    size_t end = s.size();
+    while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
+        --end;
+    }
+    return s.substr(start, end - start);
+}
+
+std::vector<std::string> split_ws(const std::string &line) {
+    std::istringstream iss(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (iss >> token) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+bool is_ipv4(const std::string &ip) {
+    uint32_t unused;
+    return parse_ipv4(ip, unused);
+}
+
+bool parse_ipv4(std::string_view s, uint32_t &out) {
+    uint32_t value = 0;
+    int parts = 0;
+    size_t i = 0;
+    while (parts < 4) {
+        size_t digits = 0;
+        uint32_t octet = 0;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9' && digits < 4) {
+            octet = octet * 10 + static_cast<uint32_t>(s[i] - '0');
+            ++i;
+            ++digits;
+        }
+        if (digits == 0 || digits > 3 || octet > 255) {
+            return false;
+        }
+        value = (value << 8) | octet;
+        ++parts;
+        if (parts < 4) {
+            if (i >= s.size() || s[i] != '.') {
+                return false;
+            }
+            ++i;
+        }
+    }
+    if (i != s.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+std::string format_ipv4(uint32_t ip) {
+    char buf[16];
+    int n = std::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+    return std::string(buf, static_cast<size_t>(n));
+}
+
+std::string quote_path(const std::string &path) {
+#ifdef _WIN32
+    return "\"" + path + "\"";
+#else
+    return "'" + path + "'";
+#endif
+}
+
+std::optional<std::string> find_in_path(const std::string &name) {
+    const char *path_env = std::getenv("PATH");
+    if (!path_env) {
+        return std::nullopt;
+    }
+#ifdef _WIN32
+    const char sep = ';';
+#else
+    const char sep = ':';
+#endif
+    std::string paths = path_env;
+    std::istringstream iss(paths);
+    std::string dir;
+    while (std::getline(iss, dir, sep)) {
+        if (dir.empty()) {
+            continue;
+        }
+        fs::path candidate = fs::path(dir) / name;
+        if (fs::exists(candidate)) {
+            return candidate.string();
+        }
+    }
+    return std::nullopt;
+}
+
+// Keeps [cmd] lines whole when tools are resolved from several threads.
+static std::mutex command_log_mutex;
+
+void log_command(const std::string &cmd) {
+    std::lock_guard<std::mutex> lock(command_log_mutex);
+    std::cout << "[cmd] " << cmd << std::endl;
+}
+
+bool run_command(const std::string &cmd) {
+    log_command(cmd);
+    int result = std::system(cmd.c_str());
+    return result == 0;
+}
+
+std::optional<std::string> capture_command(const std::string &cmd, bool require_success) {
+#ifdef _WIN32
+    FILE *pipe = _popen(cmd.c_str(), "r");
+#else
+    FILE *pipe = popen(cmd.c_str(), "r");
+#endif
+    if (!pipe) {
+        return std::nullopt;
+    }
+    std::string output;
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), pipe)) > 0) {
+        output.append(buf, n);
+    }
+#ifdef _WIN32
+    int status = _pclose(pipe);
+#else
+    int status = pclose(pipe);
+#endif
+    if (status != 0 && require_success) {
+        return std::nullopt;
+    }
+    return output;
+}
+
+bool run_command_with_input(const std::string &cmd, std::string_view input) {
+    return run_command_with_input(cmd, input.size(), [&](const std::function<bool(std::string_view)> &write) {
+        return write(input);
+    });
+}
+
+bool run_command_with_input(const std::string &cmd, uint64_t size, const InputSource &input) {
+    log_command(cmd + " < (" + std::to_string(size) + " bytes)");
+#ifdef _WIN32
+    FILE *pipe = _popen(cmd.c_str(), "wb");
+#else
+    FILE *pipe = popen(cmd.c_str(), "w");
+#endif
+    if (!pipe) {
+        return false;
+    }
+    bool written = true;
+    input([&](std::string_view chunk) {
+        written = std::fwrite(chunk.data(), 1, chunk.size(), pipe) == chunk.size();
+        return written;
+    });
+#ifdef _WIN32
+    int status = _pclose(pipe);
+#else
+    int status = pclose(pipe);
+#endif
+    return written && status == 0;
+}
+
+uint64_t fnv1a64(std::string_view data, uint64_t seed) {
+    uint64_t hash = seed;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string hex64(uint64_t value) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+    return buf;
+}
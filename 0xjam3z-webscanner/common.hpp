@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+std::string to_lower(std::string s);
+std::string trim(const std::string &s);
+std::vector<std::string> split_ws(const std::string &line);
+bool is_ipv4(const std::string &ip);
+// Dotted quad to host-order integer; rejects anything but four decimal octets.
+bool parse_ipv4(std::string_view s, uint32_t &out);
+std::string format_ipv4(uint32_t ip);
+
+std::string quote_path(const std::string &path);
+std::optional<std::string> find_in_path(const std::string &name);
+// Prints the "[cmd]" line for a command about to run.
+void log_command(const std::string &cmd);
+bool run_command(const std::string &cmd);
+// Runs cmd and returns its stdout, or nullopt when it cannot start (or exits
+// non-zero and require_success is set).
+std::optional<std::string> capture_command(const std::string &cmd, bool require_success = true);
+// Runs cmd with `input` written to its stdin.
+bool run_command_with_input(const std::string &cmd, std::string_view input);
+// Same, with stdin produced in pieces: `input` hands consecutive chunks to the
+// writer it is given and returns false on failure. `size` is only logged.
+using InputSource = std::function<bool(const std::function<bool(std::string_view)> &)>;
+bool run_command_with_input(const std::string &cmd, uint64_t size, const InputSource &input);
+// 64-bit FNV-1a, used for cache keys and content hashes.
+uint64_t fnv1a64(std::string_view data, uint64_t seed = 0xcbf29ce484222325ull);
+std::string hex64(uint64_t value);
@@ -0,0 +1,195 @@
+#include "content_decoder.hpp"
+
+#include "common.hpp"
+
+#include <string>
+
+#ifdef JAM3Z_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JAM3Z_HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+// Decoded bytes handed over per call; a page title is nearly always within the first.
+static constexpr size_t kWindow = 16 * 1024;
+
+ContentCoding parse_content_coding(std::string_view header) {
+    std::string coding = to_lower(trim(std::string(header)));
+    if (coding.empty() || coding == "identity") {
+        return ContentCoding::Identity;
+    }
+    if (coding == "gzip" || coding == "x-gzip") {
+        return ContentCoding::Gzip;
+    }
+    if (coding == "deflate") {
+        return ContentCoding::Deflate;
+    }
+    if (coding == "br") {
+        return ContentCoding::Brotli;
+    }
+    // Unknown codings and stacked ones ("gzip, br"), which servers only send unasked.
+    return ContentCoding::Unsupported;
+}
+
+std::string_view accepted_content_codings() {
+#if defined(JAM3Z_HAVE_ZLIB) && defined(JAM3Z_HAVE_BROTLI)
+    return "gzip, deflate, br";
+#elif defined(JAM3Z_HAVE_ZLIB)
+    return "gzip, deflate";
+#elif defined(JAM3Z_HAVE_BROTLI)
+    return "br";
+#else
+    return "";
+#endif
+}
+
+struct ContentDecoder::State {
+    ContentCoding coding = ContentCoding::Identity;
+    char window[kWindow];
+#ifdef JAM3Z_HAVE_ZLIB
+    z_stream zs{};
+    bool zlib_ready = false;
+    // "deflate" picks zlib or raw framing at its first byte.
+    bool zlib_started = false;
+#endif
+#ifdef JAM3Z_HAVE_BROTLI
+    BrotliDecoderState *brotli = nullptr;
+#endif
+
+    ~State() {
+#ifdef JAM3Z_HAVE_ZLIB
+        if (zlib_ready) {
+            inflateEnd(&zs);
+        }
+#endif
+#ifdef JAM3Z_HAVE_BROTLI
+        if (brotli) {
+            BrotliDecoderDestroyInstance(brotli);
+        }
+#endif
+    }
+};
+
+ContentDecoder::ContentDecoder() = default;
+ContentDecoder::ContentDecoder(ContentDecoder &&) noexcept = default;
+ContentDecoder &ContentDecoder::operator=(ContentDecoder &&) noexcept = default;
+ContentDecoder::~ContentDecoder() = default;
+
+#ifdef JAM3Z_HAVE_ZLIB
+// Window bits 15 + 32 accept both gzip and zlib headers; -15 is raw deflate.
+static bool start_inflate(z_stream &zs, bool &ready, int bits) {
+    if (ready) {
+        return inflateReset2(&zs, bits) == Z_OK;
+    }
+    zs = z_stream{};
+    ready = inflateInit2(&zs, bits) == Z_OK;
+    return ready;
+}
+
+static ContentDecoder::Result inflate_into(z_stream &zs, char *window, std::string_view in,
+                                           const std::function<bool(std::string_view)> &fn) {
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    for (;;) {
+        zs.next_out = reinterpret_cast<Bytef *>(window);
+        zs.avail_out = static_cast<uInt>(kWindow);
+        int rc = inflate(&zs, Z_NO_FLUSH);
+        size_t produced = kWindow - zs.avail_out;
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+            return ContentDecoder::Result::Error;
+        }
+        if (produced && !fn(std::string_view(window, produced))) {
+            return ContentDecoder::Result::Stopped;
+        }
+        if (rc == Z_STREAM_END) {
+            return ContentDecoder::Result::End;
+        }
+        if (zs.avail_in == 0 && zs.avail_out != 0) {
+            return ContentDecoder::Result::More;
+        }
+        if (rc == Z_BUF_ERROR && produced == 0) {
+            return ContentDecoder::Result::More;
+        }
+    }
+}
+#endif
+
+bool ContentDecoder::start(ContentCoding coding) {
+    if (!state_) {
+        state_ = std::make_unique<State>();
+    }
+    State &s = *state_;
+    s.coding = coding;
+    switch (coding) {
+#ifdef JAM3Z_HAVE_ZLIB
+    case ContentCoding::Gzip:
+        s.zlib_started = true;
+        return start_inflate(s.zs, s.zlib_ready, 15 + 32);
+    case ContentCoding::Deflate:
+        s.zlib_started = false;
+        return true;
+#endif
+#ifdef JAM3Z_HAVE_BROTLI
+    case ContentCoding::Brotli:
+        if (s.brotli) {
+            BrotliDecoderDestroyInstance(s.brotli);
+        }
+        s.brotli = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+        return s.brotli != nullptr;
+#endif
+    default:
+        return false;
+    }
+}
+
+ContentDecoder::Result ContentDecoder::feed(std::string_view in, const std::function<bool(std::string_view)> &fn) {
+    State &s = *state_;
+    if (in.empty()) {
+        return Result::More;
+    }
+    switch (s.coding) {
+#ifdef JAM3Z_HAVE_ZLIB
+    case ContentCoding::Gzip:
+    case ContentCoding::Deflate:
+        if (!s.zlib_started) {
+            // RFC 9110 deflate is zlib-wrapped, but some servers send raw deflate.
+            // A zlib header starts with compression method 8 and a window of at most 32K.
+            unsigned char first = static_cast<unsigned char>(in[0]);
+            bool zlib = (first & 0x0f) == 8 && (first >> 4) <= 7;
+            if (!start_inflate(s.zs, s.zlib_ready, zlib ? 15 + 32 : -15)) {
+                return Result::Error;
+            }
+            s.zlib_started = true;
+        }
+        return inflate_into(s.zs, s.window, in, fn);
+#endif
+#ifdef JAM3Z_HAVE_BROTLI
+    case ContentCoding::Brotli: {
+        size_t avail_in = in.size();
+        const uint8_t *next_in = reinterpret_cast<const uint8_t *>(in.data());
+        for (;;) {
+            size_t avail_out = kWindow;
+            uint8_t *next_out = reinterpret_cast<uint8_t *>(s.window);
+            BrotliDecoderResult rc =
+                BrotliDecoderDecompressStream(s.brotli, &avail_in, &next_in, &avail_out, &next_out, nullptr);
+            if (rc == BROTLI_DECODER_RESULT_ERROR) {
+                return Result::Error;
+            }
+            size_t produced = kWindow - avail_out;
+            if (produced && !fn(std::string_view(s.window, produced))) {
+                return Result::Stopped;
+            }
+            if (rc == BROTLI_DECODER_RESULT_SUCCESS) {
+                return Result::End;
+            }
+            if (rc == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+                return Result::More;
+            }
+        }
+    }
+#endif
+    default:
+        return Result::Error;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// Content-Encoding of a response body.
+enum class ContentCoding { Identity, Gzip, Deflate, Brotli, Unsupported };
+
+ContentCoding parse_content_coding(std::string_view header);
+// Accept-Encoding value listing the codings this build decodes; empty when none.
+std::string_view accepted_content_codings();
+
+// Streaming decoder for a compressed body. Input is fed as it arrives and
+// decoded through a small fixed window, so work stops as soon as the consumer
+// has seen enough rather than after inflating the whole body.
+class ContentDecoder {
+public:
+    enum class Result {
+        More,    // all input consumed, the stream goes on
+        End,     // end of the compressed stream
+        Stopped, // the consumer returned false
+        Error,   // corrupt input
+    };
+
+    ContentDecoder();
+    ContentDecoder(const ContentDecoder &) = delete;
+    ContentDecoder &operator=(const ContentDecoder &) = delete;
+    ContentDecoder(ContentDecoder &&) noexcept;
+    ContentDecoder &operator=(ContentDecoder &&) noexcept;
+    ~ContentDecoder();
+
+    // False when this build cannot decode the coding.
+    bool start(ContentCoding coding);
+    // Decodes in, handing each stretch of output to fn until it returns false.
+    Result feed(std::string_view in, const std::function<bool(std::string_view)> &fn);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
@@ -0,0 +1,251 @@
+#include "jam3z_core.h"
+
+#include "asn_index.hpp"
+#include "common.hpp"
+#include "parsers.hpp"
+#include "plugins.hpp"
+
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static thread_local std::string last_error;
+
+static void set_error(std::string message) {
+    last_error = std::move(message);
+}
+
+struct jam3z_zgrab_scanner {
+    uint16_t port = 0;
+    std::ifstream file;
+    std::string_view buffer;
+    size_t buffer_pos = 0;
+    bool from_buffer = false;
+    std::string line;
+    std::vector<HttpRecord> records;
+    std::vector<size_t> live;
+    std::vector<jam3z_record> views;
+    std::vector<jam3z_header> headers;
+
+    bool next_line(std::string_view &out) {
+        if (!from_buffer) {
+            if (!std::getline(file, line)) {
+                return false;
+            }
+            out = line;
+            return true;
+        }
+        if (buffer_pos >= buffer.size()) {
+            return false;
+        }
+        size_t nl = buffer.find('\n', buffer_pos);
+        size_t end = nl == std::string_view::npos ? buffer.size() : nl;
+        out = buffer.substr(buffer_pos, end - buffer_pos);
+        buffer_pos = end + 1;
+        return true;
+    }
+};
+
+struct jam3z_asn_index {
+    AsnIndex index;
+};
+
+extern "C" {
+
+uint32_t jam3z_core_abi_version(void) {
+    return JAM3Z_CORE_ABI_VERSION;
+}
+
+const char *jam3z_last_error(void) {
+    return last_error.c_str();
+}
+
+int jam3z_parse_ipv4(const char *s, size_t len, uint32_t *out) {
+    uint32_t ip = 0;
+    if (!s || !parse_ipv4(std::string_view(s, len), ip)) {
+        return 0;
+    }
+    if (out) {
+        *out = ip;
+    }
+    return 1;
+}
+
+size_t jam3z_format_ipv4(uint32_t ip, char *out) {
+    std::string text = format_ipv4(ip);
+    std::memcpy(out, text.c_str(), text.size() + 1);
+    return text.size();
+}
+
+size_t jam3z_masscan_parse(const char *buf, size_t len, int final, uint32_t *ips, uint16_t *ports, uint8_t *protos,
+                           uint32_t *timestamps, size_t capacity, size_t *consumed) {
+    std::string_view data(buf ? buf : "", buf ? len : 0);
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos < data.size() && count < capacity) {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string_view::npos && !final) {
+            break;
+        }
+        size_t end = nl == std::string_view::npos ? data.size() : nl;
+        MasscanEntry entry;
+        if (parse_masscan_line(data.substr(pos, end - pos), entry)) {
+            if (ips) {
+                ips[count] = entry.ip;
+            }
+            if (ports) {
+                ports[count] = entry.port;
+            }
+            if (protos) {
+                protos[count] = entry.proto;
+            }
+            if (timestamps) {
+                timestamps[count] = entry.timestamp;
+            }
+            ++count;
+        }
+        pos = nl == std::string_view::npos ? data.size() : nl + 1;
+    }
+    if (consumed) {
+        *consumed = pos;
+    }
+    return count;
+}
+
+jam3z_zgrab_scanner *jam3z_zgrab_open(const char *path, uint16_t port) {
+    try {
+        auto scanner = std::make_unique<jam3z_zgrab_scanner>();
+        scanner->port = port;
+        scanner->file.open(path ? path : "", std::ios::binary);
+        if (!scanner->file) {
+            set_error(std::string("failed to open ") + (path ? path : "(null)"));
+            return nullptr;
+        }
+        return scanner.release();
+    } catch (const std::exception &e) {
+        set_error(e.what());
+        return nullptr;
+    }
+}
+
+jam3z_zgrab_scanner *jam3z_zgrab_open_buffer(const char *data, size_t len, uint16_t port) {
+    try {
+        auto scanner = std::make_unique<jam3z_zgrab_scanner>();
+        scanner->port = port;
+        scanner->from_buffer = true;
+        scanner->buffer = std::string_view(data ? data : "", data ? len : 0);
+        return scanner.release();
+    } catch (const std::exception &e) {
+        set_error(e.what());
+        return nullptr;
+    }
+}
+
+size_t jam3z_zgrab_next(jam3z_zgrab_scanner *scanner, size_t max_records, const jam3z_record **records) {
+    if (!scanner || max_records == 0) {
+        return 0;
+    }
+    try {
+        scanner->records.clear();
+        std::string_view line;
+        while (scanner->records.size() < max_records && scanner->next_line(line)) {
+            parse_zgrab_line(line, scanner->port, scanner->records);
+        }
+        make_record_views(scanner->records, scanner->live, scanner->views, scanner->headers);
+        if (records) {
+            *records = scanner->views.empty() ? nullptr : scanner->views.data();
+        }
+        return scanner->views.size();
+    } catch (const std::exception &e) {
+        set_error(e.what());
+        return 0;
+    }
+}
+
+void jam3z_zgrab_close(jam3z_zgrab_scanner *scanner) {
+    delete scanner;
+}
+
+int jam3z_find_title(const char *html, size_t len, jam3z_str *title) {
+    if (!html) {
+        return 0;
+    }
+    auto found = find_title(std::string_view(html, len));
+    if (!found) {
+        return 0;
+    }
+    if (title) {
+        *title = {found->data(), found->size()};
+    }
+    return 1;
+}
+
+static jam3z_asn_index *load_index(bool from_file, const char *data, size_t len) {
+    try {
+        auto index = std::make_unique<jam3z_asn_index>();
+        bool ok = from_file ? index->index.load(data ? data : "")
+                            : index->index.load_buffer(std::string_view(data ? data : "", data ? len : 0));
+        if (!ok) {
+            set_error("no IPv4 or IPv6 ranges found");
+            return nullptr;
+        }
+        return index.release();
+    } catch (const std::exception &e) {
+        set_error(e.what());
+        return nullptr;
+    }
+}
+
+jam3z_asn_index *jam3z_asn_index_load(const char *path) {
+    return load_index(true, path, 0);
+}
+
+jam3z_asn_index *jam3z_asn_index_load_buffer(const char *data, size_t len) {
+    return load_index(false, data, len);
+}
+
+size_t jam3z_asn_index_size(const jam3z_asn_index *index) {
+    return index ? index->index.size() : 0;
+}
+
+static jam3z_str view(std::string_view s) {
+    return {s.data(), s.size()};
+}
+
+int jam3z_asn_lookup(const jam3z_asn_index *index, uint32_t ip, jam3z_asn_info *info) {
+    const AsnRange *range = index ? index->index.lookup(ip) : nullptr;
+    if (!range) {
+        return 0;
+    }
+    if (info) {
+        info->start = range->start;
+        info->end = range->end;
+        info->asn = range->asn;
+        info->country = view(index->index.str(range->country));
+        info->country_name = view(index->index.str(range->country_name));
+        info->as_name = view(index->index.str(range->as_name));
+    }
+    return 1;
+}
+
+size_t jam3z_asn_lookup_batch(const jam3z_asn_index *index, const uint32_t *ips, size_t count, uint32_t *asns) {
+    if (!index || !ips || !asns) {
+        return 0;
+    }
+    size_t hits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const AsnRange *range = index->index.lookup(ips[i]);
+        asns[i] = range ? range->asn : 0;
+        hits += range ? 1 : 0;
+    }
+    return hits;
+}
+
+void jam3z_asn_index_free(jam3z_asn_index *index) {
+    delete index;
+}
+
+}
@@ -0,0 +1,166 @@
+#include "coro.hpp"
+
+#include <new>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Frames are rounded up to 64-byte classes; larger ones go to the heap as is.
+static constexpr size_t kFrameClass = 64;
+static constexpr size_t kFrameClasses = 64;
+// Most memory a thread keeps cached for reuse.
+static constexpr size_t kFrameCacheBytes = 16u << 20;
+
+struct FrameCache {
+    std::vector<void *> free[kFrameClasses];
+    size_t bytes = 0;
+
+    ~FrameCache() {
+        for (size_t c = 0; c < kFrameClasses; ++c) {
+            for (void *frame : free[c]) {
+                ::operator delete(frame, (c + 1) * kFrameClass);
+            }
+        }
+    }
+};
+
+static thread_local FrameCache frame_cache;
+
+void *coro_frame_alloc(size_t size) {
+    size_t c = (size + kFrameClass - 1) / kFrameClass;
+    if (c == 0 || c > kFrameClasses) {
+        return ::operator new(size);
+    }
+    auto &list = frame_cache.free[c - 1];
+    if (list.empty()) {
+        return ::operator new(c * kFrameClass);
+    }
+    void *frame = list.back();
+    list.pop_back();
+    frame_cache.bytes -= c * kFrameClass;
+    return frame;
+}
+
+void coro_frame_free(void *frame, size_t size) {
+    size_t c = (size + kFrameClass - 1) / kFrameClass;
+    if (c == 0 || c > kFrameClasses) {
+        ::operator delete(frame, size);
+        return;
+    }
+    if (frame_cache.bytes + c * kFrameClass > kFrameCacheBytes) {
+        ::operator delete(frame, c * kFrameClass);
+        return;
+    }
+    frame_cache.free[c - 1].push_back(frame);
+    frame_cache.bytes += c * kFrameClass;
+}
+
+// Owns a spawned task: starts at once and frees itself at the end.
+struct Detached {
+    struct promise_type {
+        static void *operator new(size_t size) { return coro_frame_alloc(size); }
+        static void operator delete(void *frame, size_t size) { coro_frame_free(frame, size); }
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static Detached run_detached(Task<> task) {
+    co_await std::move(task);
+}
+
+void spawn(Task<> task) {
+    run_detached(std::move(task));
+}
+
+#ifndef _WIN32
+
+void AsyncFd::reset(int fd) {
+    close();
+    fd_ = fd;
+}
+
+void AsyncFd::close() {
+    cancel_timer();
+    expired_ = false;
+    if (fd_ < 0) {
+        return;
+    }
+    if (armed_) {
+        loop_.unwatch(fd_);
+        armed_ = 0;
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void AsyncFd::cancel_timer() {
+    if (timer_) {
+        loop_.cancel_timer(timer_);
+        timer_ = 0;
+    }
+}
+
+void AsyncFd::set_timeout(double seconds) {
+    cancel_timer();
+    expired_ = false;
+    if (seconds <= 0) {
+        return;
+    }
+    timer_ = loop_.add_timer(seconds, [this] {
+        timer_ = 0;
+        expired_ = true;
+        if (waiter_) {
+            std::exchange(waiter_, {}).resume();
+        }
+    });
+}
+
+bool AsyncFd::arm(unsigned events, std::coroutine_handle<> waiter) {
+    if (armed_ != events) {
+        if (!loop_.watch(fd_, events, [this](unsigned ready) { on_ready(ready); })) {
+            ready_ = EventLoop::kError;
+            return false;
+        }
+        armed_ = events;
+    }
+    waiter_ = waiter;
+    return true;
+}
+
+void AsyncFd::on_ready(unsigned events) {
+    if (!waiter_) {
+        // Readiness nobody waits for: stop watching rather than hear it again
+        // on every turn of the loop.
+        loop_.unwatch(fd_);
+        armed_ = 0;
+        return;
+    }
+    ready_ = events;
+    std::exchange(waiter_, {}).resume();
+}
+
+Task<int> async_connect(AsyncFd &fd, const sockaddr *addr, unsigned addr_len) {
+    if (::connect(fd.fd(), addr, static_cast<socklen_t>(addr_len)) == 0) {
+        co_return 0;
+    }
+    if (errno != EINPROGRESS) {
+        co_return errno;
+    }
+    if (!co_await fd.wait(EventLoop::kWrite)) {
+        co_return ETIMEDOUT;
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd.fd(), SOL_SOCKET, SO_ERROR, &err, &len);
+    co_return err;
+}
+
+#endif
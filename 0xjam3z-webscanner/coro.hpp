@@ -0,0 +1,160 @@
+#pragma once
+
+#include "event_loop.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+struct sockaddr;
+
+// Coroutine frames come from per-thread size-class free lists, so the
+// short-lived steps of a probe (connect, write, read) recycle the memory of
+// earlier ones rather than going back to malloc.
+void *coro_frame_alloc(size_t size);
+void coro_frame_free(void *frame, size_t size);
+
+struct TaskPromiseBase {
+    // Resumed when the task finishes: the coroutine co_awaiting it.
+    std::coroutine_handle<> continuation;
+
+    static void *operator new(size_t size) { return coro_frame_alloc(size); }
+    static void operator delete(void *frame, size_t size) { coro_frame_free(frame, size); }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> done) noexcept {
+            std::coroutine_handle<> next = done.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    // Probe code reports failures through its results, never by throwing.
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+    void return_value(T v) { value = std::move(v); }
+    T result() { return std::move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    void return_void() {}
+    void result() {}
+};
+
+// A coroutine that starts when it is co_awaited and hands its result back to
+// the awaiting coroutine, which resumes without going through the event loop.
+// Top-level tasks are started with spawn().
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : TaskPromise<T> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Runs `task` up to its first suspension; its frame is freed when it finishes.
+void spawn(Task<> task);
+
+// A non-blocking descriptor watched by the loop. One coroutine at a time waits
+// on it; the watch stays armed between waits for the same events, so a
+// read-heavy exchange costs no epoll_ctl per read.
+class AsyncFd {
+public:
+    explicit AsyncFd(EventLoop &loop) : loop_(loop) {}
+    ~AsyncFd() { close(); }
+    AsyncFd(const AsyncFd &) = delete;
+    AsyncFd &operator=(const AsyncFd &) = delete;
+
+    // Takes ownership of fd, closing the previous one.
+    void reset(int fd);
+    void close();
+    int fd() const { return fd_; }
+    bool is_open() const { return fd_ >= 0; }
+
+    // Every wait from now on fails once `seconds` have passed; 0 for no limit.
+    void set_timeout(double seconds);
+    bool expired() const { return expired_; }
+
+    struct WaitAwaiter {
+        AsyncFd &fd;
+        unsigned events;
+        bool await_ready() const noexcept { return fd.expired_; }
+        bool await_suspend(std::coroutine_handle<> waiter) { return fd.arm(events, waiter); }
+        // The ready events, or 0 when the timeout passed first.
+        unsigned await_resume() noexcept { return fd.expired_ ? 0 : std::exchange(fd.ready_, 0u); }
+    };
+    WaitAwaiter wait(unsigned events) { return WaitAwaiter{*this, events}; }
+
+private:
+    // False, with kError as the result, when the loop cannot watch fd_.
+    bool arm(unsigned events, std::coroutine_handle<> waiter);
+    void on_ready(unsigned events);
+    void cancel_timer();
+
+    EventLoop &loop_;
+    int fd_ = -1;
+    // Events the loop watches fd_ for, 0 when unwatched.
+    unsigned armed_ = 0;
+    unsigned ready_ = 0;
+    std::coroutine_handle<> waiter_;
+    uint64_t timer_ = 0;
+    bool expired_ = false;
+};
+
+// co_await sleep_for(loop, seconds) resumes the coroutine from the loop's timers.
+struct SleepAwaiter {
+    EventLoop &loop;
+    double seconds;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter) {
+        loop.add_timer(seconds, [waiter] { waiter.resume(); });
+    }
+    void await_resume() noexcept {}
+};
+inline SleepAwaiter sleep_for(EventLoop &loop, double seconds) {
+    return SleepAwaiter{loop, seconds};
+}
+
+// Non-blocking connect on fd's socket: 0 once connected, ETIMEDOUT when fd's
+// timeout passes first, else the errno the connect failed with.
+Task<int> async_connect(AsyncFd &fd, const sockaddr *addr, unsigned addr_len);
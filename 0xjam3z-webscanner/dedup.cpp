@@ -0,0 +1,126 @@
+#include "dedup.hpp"
+
+#include "common.hpp"
+
+DedupPlanner::DedupPlanner(size_t samples, const AsnIndex *asn) : samples_(samples), asn_(asn) {}
+
+uint64_t DedupPlanner::group_key(uint32_t ip, uint16_t port) const {
+    uint64_t group = ip & 0xffffff00u;
+    if (asn_) {
+        if (const AsnRange *range = asn_->lookup(ip); range && range->asn) {
+            group = 1ull << 32 | range->asn;
+        }
+    }
+    return static_cast<uint64_t>(port) << 40 | group;
+}
+
+std::string DedupPlanner::split(uint16_t port, std::string_view ips) {
+    std::string wave;
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t pos = 0;
+    while (pos < ips.size()) {
+        size_t end = ips.find('\n', pos);
+        if (end == std::string::npos) {
+            end = ips.size();
+        }
+        std::string_view line(ips.data() + pos, end - pos);
+        pos = end + 1;
+        uint32_t ip = 0;
+        if (!parse_ipv4(line, ip)) {
+            // IPv6 is not grouped and always goes out in the first wave.
+            if (!line.empty()) {
+                wave.append(line.data(), line.size());
+                wave += '\n';
+            }
+            continue;
+        }
+        uint64_t key = group_key(ip, port);
+        if (sent_[key]++ < samples_) {
+            wave.append(line.data(), line.size());
+            wave += '\n';
+        } else {
+            groups_[key].deferred.push_back(ip);
+            ++deferred_;
+        }
+    }
+    return wave;
+}
+
+void DedupPlanner::observe(const std::vector<HttpRecord> &batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &rec : batch) {
+        uint32_t ip = 0;
+        if (rec.status != "success" || !parse_ipv4(rec.ip, ip)) {
+            continue;
+        }
+        auto it = groups_.find(group_key(ip, rec.port));
+        if (it == groups_.end() || it->second.deferred.empty()) {
+            continue;
+        }
+        Group &group = it->second;
+        uint64_t fingerprint = response_fingerprint(rec);
+        if (group.seen++ == 0) {
+            group.fingerprint = fingerprint;
+            group.sample = rec;
+        } else if (fingerprint != group.fingerprint) {
+            group.uniform = false;
+        }
+    }
+}
+
+std::string DedupPlanner::pending(uint16_t port) const {
+    std::string out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : groups_) {
+        const Group &group = entry.second;
+        if (group.deferred.empty() || converged(group) || entry.first >> 40 != port) {
+            continue;
+        }
+        for (uint32_t ip : group.deferred) {
+            out += format_ipv4(ip);
+            out += '\n';
+        }
+    }
+    return out;
+}
+
+size_t DedupPlanner::skipped() const {
+    size_t total = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : groups_) {
+        if (converged(entry.second)) {
+            total += entry.second.deferred.size();
+        }
+    }
+    return total;
+}
+
+void DedupPlanner::for_each_skipped(size_t batch_size,
+                                    const std::function<void(std::vector<HttpRecord> &)> &fn) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HttpRecord> batch;
+    for (const auto &entry : groups_) {
+        const Group &group = entry.second;
+        if (group.deferred.empty() || !converged(group)) {
+            continue;
+        }
+        uint64_t id = entry.first & 0xffffffffffull;
+        std::string label = id >> 32 ? "AS" + std::to_string(id & 0xffffffffu)
+                                     : format_ipv4(static_cast<uint32_t>(id)) + "/24";
+        std::string note = "same as " + group.sample.ip + " (" + label + ")";
+        for (uint32_t ip : group.deferred) {
+            HttpRecord rec = group.sample;
+            rec.ip = format_ipv4(ip);
+            rec.domain.clear();
+            rec.fields.emplace_back("dedup", note);
+            batch.push_back(std::move(rec));
+            if (batch.size() >= batch_size) {
+                fn(batch);
+                batch.clear();
+            }
+        }
+    }
+    if (!batch.empty()) {
+        fn(batch);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "asn_index.hpp"
+#include "parsers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Adaptive sampling for CDN and shared-hosting ranges. Open hosts are grouped
+// per port by ASN (when an index is loaded) or /24. The first wave grabs up to
+// K hosts per group. When all K answer with the same status, title and body
+// hash, the rest of the group is not grabbed. Its hosts get annotated copies
+// of a sample instead. All other deferred hosts go to a second wave.
+class DedupPlanner {
+public:
+    DedupPlanner(size_t samples, const AsnIndex *asn);
+
+    // Newline-separated IPs in, first-wave IPs out; the remainder is deferred.
+    // May be called once per chunk of a longer list.
+    std::string split(uint16_t port, std::string_view ips);
+    // First-wave records, called from the parse workers.
+    void observe(const std::vector<HttpRecord> &batch);
+
+    // Deferred hosts whose group did not converge on one response.
+    std::string pending(uint16_t port) const;
+    // Annotated stand-ins for the deferred hosts of converged groups.
+    void for_each_skipped(size_t batch_size, const std::function<void(std::vector<HttpRecord> &)> &fn) const;
+
+    size_t deferred() const { return deferred_; }
+    size_t skipped() const;
+
+private:
+    struct Group {
+        size_t seen = 0;
+        bool uniform = true;
+        uint64_t fingerprint = 0;
+        HttpRecord sample;
+        std::vector<uint32_t> deferred;
+    };
+
+    uint64_t group_key(uint32_t ip, uint16_t port) const;
+    bool converged(const Group &group) const { return group.uniform && group.seen >= samples_; }
+
+    size_t samples_;
+    const AsnIndex *asn_;
+    size_t deferred_ = 0;
+    mutable std::mutex mutex_;
+    // Ordered by key (port, then /24 or ASN) so the second wave and the
+    // stand-in records come out the same on every run.
+    std::map<uint64_t, Group> groups_;
+    // First-wave hosts handed out per group so far.
+    std::unordered_map<uint64_t, size_t> sent_;
+};
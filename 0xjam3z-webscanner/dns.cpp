@@ -0,0 +1,409 @@
+#include "dns.hpp"
+
+#include "common.hpp"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Per-attempt timeout; attempt n waits (n + 1) times this long.
+static constexpr double kAttemptTimeout = 1.0;
+static constexpr unsigned kMinAttempts = 3;
+
+bool parse_dns_server(const std::string &spec, DnsServer &out) {
+    size_t colon = spec.find(':');
+    std::string host = spec.substr(0, colon);
+    out.port = 53;
+    if (colon != std::string::npos) {
+        unsigned long port = std::strtoul(spec.c_str() + colon + 1, nullptr, 10);
+        if (port == 0 || port > 65535) {
+            return false;
+        }
+        out.port = static_cast<uint16_t>(port);
+    }
+    return parse_ipv4(host, out.ip);
+}
+
+std::vector<DnsServer> system_dns_servers() {
+    std::vector<DnsServer> servers;
+    std::ifstream in("/etc/resolv.conf");
+    std::string line;
+    while (std::getline(in, line)) {
+        auto words = split_ws(line);
+        DnsServer server;
+        if (words.size() >= 2 && words[0] == "nameserver" && parse_dns_server(words[1], server)) {
+            servers.push_back(server);
+        }
+    }
+    return servers;
+}
+
+bool looks_like_hostname(std::string_view s) {
+    bool letter = false;
+    if (s.empty() || s.size() > 253 || s.find('.') == std::string_view::npos) {
+        return false;
+    }
+    for (char c : s) {
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            letter = true;
+        } else if (!std::isdigit(static_cast<unsigned char>(c)) && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return letter;
+}
+
+static bool encode_name(const std::string &name, std::string &out) {
+    size_t pos = 0;
+    while (pos < name.size()) {
+        size_t dot = name.find('.', pos);
+        if (dot == std::string::npos) {
+            dot = name.size();
+        }
+        size_t len = dot - pos;
+        if (len == 0 || len > 63) {
+            return false;
+        }
+        out += static_cast<char>(len);
+        out.append(name, pos, len);
+        pos = dot + 1;
+    }
+    out += '\0';
+    return true;
+}
+
+static std::string build_query(uint16_t id, const std::string &name, uint16_t type) {
+    std::string msg;
+    msg += static_cast<char>(id >> 8);
+    msg += static_cast<char>(id & 0xff);
+    msg += '\x01'; // RD
+    msg += '\x00';
+    msg.append("\x00\x01\x00\x00\x00\x00\x00\x00", 8); // QDCOUNT=1
+    if (!encode_name(name, msg)) {
+        return std::string();
+    }
+    msg += static_cast<char>(type >> 8);
+    msg += static_cast<char>(type & 0xff);
+    msg.append("\x00\x01", 2); // IN
+    return msg;
+}
+
+static uint16_t read16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+// Decodes a possibly compressed name at pos and advances pos past it.
+static bool read_name(const uint8_t *msg, size_t len, size_t &pos, std::string &out) {
+    size_t cursor = pos;
+    bool jumped = false;
+    for (int hops = 0; hops < 64; ++hops) {
+        if (cursor >= len) {
+            return false;
+        }
+        uint8_t label = msg[cursor];
+        if ((label & 0xc0) == 0xc0) {
+            if (cursor + 1 >= len) {
+                return false;
+            }
+            if (!jumped) {
+                pos = cursor + 2;
+            }
+            jumped = true;
+            cursor = static_cast<size_t>(label & 0x3f) << 8 | msg[cursor + 1];
+            continue;
+        }
+        if (label == 0) {
+            if (!jumped) {
+                pos = cursor + 1;
+            }
+            return true;
+        }
+        if (cursor + 1 + label > len) {
+            return false;
+        }
+        if (!out.empty()) {
+            out += '.';
+        }
+        out.append(reinterpret_cast<const char *>(msg) + cursor + 1, label);
+        cursor += 1 + label;
+    }
+    return false;
+}
+
+// rcode, or -1 when the message is malformed or not for (name, type).
+static int parse_response(const uint8_t *msg, size_t len, const std::string &name, uint16_t type,
+                          DnsAnswer &answer) {
+    if (len < 12 || !(msg[2] & 0x80)) {
+        return -1;
+    }
+    int rcode = msg[3] & 0x0f;
+    uint16_t qdcount = read16(msg + 4);
+    uint16_t ancount = read16(msg + 6);
+    size_t pos = 12;
+    for (uint16_t i = 0; i < qdcount; ++i) {
+        std::string qname;
+        if (!read_name(msg, len, pos, qname) || pos + 4 > len) {
+            return -1;
+        }
+        if (i == 0 && (to_lower(qname) != to_lower(name) || read16(msg + pos) != type)) {
+            return -1;
+        }
+        pos += 4;
+    }
+    for (uint16_t i = 0; i < ancount; ++i) {
+        std::string owner;
+        if (!read_name(msg, len, pos, owner) || pos + 10 > len) {
+            return -1;
+        }
+        uint16_t rtype = read16(msg + pos);
+        uint16_t rdlength = read16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlength > len) {
+            return -1;
+        }
+        if (rtype == DnsResolver::kTypeA && type == DnsResolver::kTypeA && rdlength == 4) {
+            answer.addrs.push_back(static_cast<uint32_t>(msg[pos]) << 24 | static_cast<uint32_t>(msg[pos + 1]) << 16 |
+                                   static_cast<uint32_t>(msg[pos + 2]) << 8 | msg[pos + 3]);
+        } else if (rtype == DnsResolver::kTypePtr && type == DnsResolver::kTypePtr && answer.name.empty()) {
+            size_t rdata = pos;
+            read_name(msg, len, rdata, answer.name);
+        }
+        pos += rdlength;
+    }
+    return rcode;
+}
+
+#ifdef _WIN32
+
+std::unordered_map<std::string, std::vector<uint32_t>> resolve_hostnames(const std::vector<std::string> &,
+                                                                         const std::vector<DnsServer> &) {
+    std::cerr << "The built-in DNS resolver is not available on Windows." << std::endl;
+    return {};
+}
+
+std::unordered_map<uint32_t, std::string> resolve_ptrs(const std::vector<uint32_t> &, const std::vector<DnsServer> &) {
+    std::cerr << "The built-in DNS resolver is not available on Windows." << std::endl;
+    return {};
+}
+
+#else
+
+DnsResolver::DnsResolver(EventLoop &loop, std::vector<DnsServer> servers, size_t max_outstanding)
+    : loop_(loop), servers_(std::move(servers)), max_outstanding_(max_outstanding) {
+    next_id_ = static_cast<uint16_t>(std::random_device{}());
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            continue;
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(servers_[i].port);
+        addr.sin_addr.s_addr = htonl(servers_[i].ip);
+        // Bursts of answers to thousands of queries overflow the default buffer.
+        int rcvbuf = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            continue;
+        }
+        size_t index = sockets_.size();
+        sockets_.push_back(fd);
+        loop_.watch(fd, EventLoop::kRead, [this, index](unsigned) { on_readable(index); });
+    }
+}
+
+DnsResolver::~DnsResolver() {
+    for (int fd : sockets_) {
+        loop_.unwatch(fd);
+        close(fd);
+    }
+    for (const auto &entry : pending_) {
+        loop_.cancel_timer(entry.second.timer);
+    }
+}
+
+void DnsResolver::query(const std::string &name, uint16_t type, Callback cb) {
+    std::string key = std::to_string(type) + ":" + to_lower(name);
+    if (auto it = cache_.find(key); it != cache_.end()) {
+        cb(it->second);
+        return;
+    }
+    if (auto it = pending_.find(key); it != pending_.end()) {
+        it->second.waiters.push_back(std::move(cb));
+        return;
+    }
+    std::string wire;
+    if (!encode_name(name, wire)) {
+        // Not a name DNS can carry; as final as NXDOMAIN.
+        DnsAnswer invalid;
+        invalid.ok = true;
+        cb(invalid);
+        return;
+    }
+    if (sockets_.empty()) {
+        cb(DnsAnswer());
+        return;
+    }
+    Pending &pending = pending_[key];
+    pending.name = to_lower(name);
+    pending.type = type;
+    pending.waiters.push_back(std::move(cb));
+    backlog_.push_back(key);
+    pump();
+}
+
+void DnsResolver::pump() {
+    while (outstanding_ < max_outstanding_ && !backlog_.empty()) {
+        std::string key = std::move(backlog_.front());
+        backlog_.pop_front();
+        ++outstanding_;
+        send(key);
+    }
+}
+
+void DnsResolver::send(const std::string &key) {
+    Pending &pending = pending_[key];
+    if (pending.attempt > 0) {
+        by_id_.erase(pending.id);
+    }
+    do {
+        pending.id = next_id_++;
+    } while (by_id_.count(pending.id));
+    by_id_[pending.id] = key;
+    std::string msg = build_query(pending.id, pending.name, pending.type);
+    size_t server = pending.attempt % sockets_.size();
+    // Lost datagrams are covered by the timeout just like lost answers.
+    ::send(sockets_[server], msg.data(), msg.size(), 0);
+    pending.timer = loop_.add_timer(kAttemptTimeout * (pending.attempt + 1), [this, key] { on_timeout(key); });
+}
+
+void DnsResolver::on_timeout(const std::string &key) {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        return;
+    }
+    it->second.timer = 0;
+    if (++it->second.attempt >= std::max<size_t>(kMinAttempts, 2 * sockets_.size())) {
+        finish(key, DnsAnswer());
+        return;
+    }
+    send(key);
+}
+
+void DnsResolver::on_readable(size_t server) {
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = recv(sockets_[server], buf, sizeof(buf), 0);
+        if (n < 0) {
+            return;
+        }
+        if (n < 12) {
+            continue;
+        }
+        auto id_it = by_id_.find(read16(buf));
+        if (id_it == by_id_.end()) {
+            continue;
+        }
+        std::string key = id_it->second;
+        Pending &pending = pending_[key];
+        DnsAnswer answer;
+        int rcode = parse_response(buf, static_cast<size_t>(n), pending.name, pending.type, answer);
+        if (rcode < 0) {
+            continue;
+        }
+        // SERVFAIL/REFUSED and friends: let the next server have a go. So does a
+        // truncated (TC) answer, which may be missing records; there is no TCP fallback.
+        if ((rcode != 0 && rcode != 3) || (buf[2] & 0x02)) {
+            loop_.cancel_timer(pending.timer);
+            on_timeout(key);
+            continue;
+        }
+        answer.ok = true;
+        finish(key, answer);
+    }
+}
+
+void DnsResolver::finish(const std::string &key, const DnsAnswer &answer) {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        return;
+    }
+    Pending pending = std::move(it->second);
+    pending_.erase(it);
+    by_id_.erase(pending.id);
+    if (pending.timer) {
+        loop_.cancel_timer(pending.timer);
+    }
+    --outstanding_;
+    if (answer.ok) {
+        cache_[key] = answer;
+    }
+    for (const auto &cb : pending.waiters) {
+        cb(answer);
+    }
+    pump();
+}
+
+void DnsResolver::resolve_ptr(uint32_t ip, Callback cb) {
+    std::string name = std::to_string(ip & 0xff) + "." + std::to_string(ip >> 8 & 0xff) + "." +
+                       std::to_string(ip >> 16 & 0xff) + "." + std::to_string(ip >> 24) + ".in-addr.arpa";
+    query(name, kTypePtr, std::move(cb));
+}
+
+std::unordered_map<std::string, std::vector<uint32_t>> resolve_hostnames(const std::vector<std::string> &names,
+                                                                         const std::vector<DnsServer> &servers) {
+    std::unordered_map<std::string, std::vector<uint32_t>> out;
+    EventLoop loop;
+    DnsResolver resolver(loop, servers);
+    // The resolver's sockets keep the loop alive; stop once every name is answered.
+    size_t remaining = names.size();
+    for (const auto &name : names) {
+        resolver.query(name, DnsResolver::kTypeA, [&, name](const DnsAnswer &answer) {
+            if (!answer.addrs.empty()) {
+                out[name] = answer.addrs;
+            }
+            if (--remaining == 0) {
+                loop.stop();
+            }
+        });
+    }
+    if (remaining > 0) {
+        loop.run();
+    }
+    return out;
+}
+
+std::unordered_map<uint32_t, std::string> resolve_ptrs(const std::vector<uint32_t> &ips,
+                                                       const std::vector<DnsServer> &servers) {
+    std::unordered_map<uint32_t, std::string> out;
+    EventLoop loop;
+    DnsResolver resolver(loop, servers);
+    size_t remaining = ips.size();
+    for (uint32_t ip : ips) {
+        resolver.resolve_ptr(ip, [&, ip](const DnsAnswer &answer) {
+            if (!answer.name.empty()) {
+                out[ip] = answer.name;
+            }
+            if (--remaining == 0) {
+                loop.stop();
+            }
+        });
+    }
+    if (remaining > 0) {
+        loop.run();
+    }
+    return out;
+}
+
+#endif
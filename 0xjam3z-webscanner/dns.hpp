@@ -0,0 +1,84 @@
+#pragma once
+
+#include "event_loop.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct DnsServer {
+    uint32_t ip = 0;
+    uint16_t port = 53;
+};
+
+// "1.2.3.4" or "1.2.3.4:5353".
+bool parse_dns_server(const std::string &spec, DnsServer &out);
+// IPv4 nameservers from /etc/resolv.conf.
+std::vector<DnsServer> system_dns_servers();
+
+// Letters, digits, '-' and '.', with at least one letter and one dot.
+bool looks_like_hostname(std::string_view s);
+
+struct DnsAnswer {
+    // False when every resolver failed or timed out; NXDOMAIN is a valid, empty answer.
+    bool ok = false;
+    std::vector<uint32_t> addrs; // A records
+    std::string name;            // first PTR record
+};
+
+// Stub resolver that speaks DNS over UDP directly on an EventLoop (POSIX only):
+// thousands of queries in flight over one socket per server, retries that rotate
+// across the servers with a growing timeout, and a cache that also merges
+// duplicate in-flight queries.
+class DnsResolver {
+public:
+    using Callback = std::function<void(const DnsAnswer &)>;
+    static constexpr uint16_t kTypeA = 1;
+    static constexpr uint16_t kTypePtr = 12;
+
+    DnsResolver(EventLoop &loop, std::vector<DnsServer> servers, size_t max_outstanding = 2048);
+    ~DnsResolver();
+    DnsResolver(const DnsResolver &) = delete;
+    DnsResolver &operator=(const DnsResolver &) = delete;
+
+    void query(const std::string &name, uint16_t type, Callback cb);
+    void resolve_ptr(uint32_t ip, Callback cb);
+
+private:
+    struct Pending {
+        std::string name;
+        uint16_t type = 0;
+        uint16_t id = 0;
+        unsigned attempt = 0;
+        uint64_t timer = 0;
+        std::vector<Callback> waiters;
+    };
+
+    void send(const std::string &key);
+    void on_readable(size_t server);
+    void on_timeout(const std::string &key);
+    void finish(const std::string &key, const DnsAnswer &answer);
+    void pump();
+
+    EventLoop &loop_;
+    std::vector<DnsServer> servers_;
+    std::vector<int> sockets_;
+    size_t max_outstanding_;
+    size_t outstanding_ = 0;
+    uint16_t next_id_ = 0;
+    std::unordered_map<std::string, DnsAnswer> cache_;
+    std::unordered_map<std::string, Pending> pending_;
+    std::unordered_map<uint16_t, std::string> by_id_;
+    std::deque<std::string> backlog_;
+};
+
+// Blocking bulk helpers that run their own loop.
+std::unordered_map<std::string, std::vector<uint32_t>> resolve_hostnames(const std::vector<std::string> &names,
+                                                                         const std::vector<DnsServer> &servers);
+std::unordered_map<uint32_t, std::string> resolve_ptrs(const std::vector<uint32_t> &ips,
+                                                       const std::vector<DnsServer> &servers);
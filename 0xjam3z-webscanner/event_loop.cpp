@@ -0,0 +1,158 @@
+#include "event_loop.hpp"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+EventLoop::EventLoop() {
+#ifdef __linux__
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+
+EventLoop::~EventLoop() {
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+#ifdef __linux__
+static uint32_t to_epoll(unsigned events) {
+    return (events & EventLoop::kRead ? EPOLLIN : 0u) | (events & EventLoop::kWrite ? EPOLLOUT : 0u);
+}
+#endif
+
+bool EventLoop::watch(int fd, unsigned events, IoCallback cb) {
+    auto it = watches_.find(fd);
+    uint32_t serial = it == watches_.end() ? next_serial_++ : it->second.serial;
+#ifdef __linux__
+    epoll_event ev{};
+    ev.events = to_epoll(events);
+    ev.data.u64 = static_cast<uint64_t>(serial) << 32 | static_cast<uint32_t>(fd);
+    if (epoll_ctl(epoll_fd_, it == watches_.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) != 0) {
+        return false;
+    }
+#endif
+    watches_[fd] = Watch{events, std::move(cb), serial};
+    return true;
+}
+
+void EventLoop::unwatch(int fd) {
+    if (watches_.erase(fd) == 0) {
+        return;
+    }
+#ifdef __linux__
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+uint64_t EventLoop::add_timer(double seconds, TimerCallback cb) {
+    uint64_t id = next_timer_++;
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    timers_.emplace(std::make_pair(deadline, id), std::move(cb));
+    timer_deadlines_.emplace(id, deadline);
+    return id;
+}
+
+void EventLoop::cancel_timer(uint64_t id) {
+    auto it = timer_deadlines_.find(id);
+    if (it == timer_deadlines_.end()) {
+        return;
+    }
+    timers_.erase(std::make_pair(it->second, id));
+    timer_deadlines_.erase(it);
+}
+
+int EventLoop::wait_timeout_ms() const {
+    if (timers_.empty()) {
+        return -1;
+    }
+    auto left = timers_.begin()->first.first - Clock::now();
+    if (left <= Clock::duration::zero()) {
+        return 0;
+    }
+    // Round up so a timer is never polled a millisecond early and spun on.
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(left).count()) + 1;
+}
+
+void EventLoop::fire_timers() {
+    auto now = Clock::now();
+    while (!timers_.empty() && timers_.begin()->first.first <= now) {
+        auto it = timers_.begin();
+        TimerCallback cb = std::move(it->second);
+        timer_deadlines_.erase(it->first.second);
+        timers_.erase(it);
+        cb();
+    }
+}
+
+void EventLoop::run() {
+    stopped_ = false;
+    struct Ready {
+        int fd;
+        uint32_t serial;
+        unsigned events;
+    };
+    std::vector<Ready> ready;
+#ifdef __linux__
+    std::vector<epoll_event> events(256);
+#else
+    std::vector<pollfd> fds;
+    std::vector<uint32_t> serials;
+#endif
+    while (!stopped_ && (!watches_.empty() || !timers_.empty())) {
+        ready.clear();
+        int timeout = wait_timeout_ms();
+#ifdef __linux__
+        int n = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), timeout);
+        for (int i = 0; i < n; ++i) {
+            uint32_t e = events[i].events;
+            uint64_t data = events[i].data.u64;
+            ready.push_back(Ready{static_cast<int>(data & 0xffffffffu), static_cast<uint32_t>(data >> 32),
+                                  (e & EPOLLIN ? kRead : 0u) | (e & EPOLLOUT ? kWrite : 0u) |
+                                      (e & (EPOLLERR | EPOLLHUP) ? kError : 0u)});
+        }
+#else
+        fds.clear();
+        serials.clear();
+        for (const auto &entry : watches_) {
+            short want = (entry.second.events & kRead ? POLLIN : 0) | (entry.second.events & kWrite ? POLLOUT : 0);
+            fds.push_back(pollfd{entry.first, want, 0});
+            serials.push_back(entry.second.serial);
+        }
+        int n = poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout);
+        for (int i = 0; n > 0 && i < static_cast<int>(fds.size()); ++i) {
+            short e = fds[i].revents;
+            if (e) {
+                ready.push_back(Ready{fds[i].fd, serials[i],
+                                      (e & POLLIN ? kRead : 0u) | (e & POLLOUT ? kWrite : 0u) |
+                                          (e & (POLLERR | POLLHUP) ? kError : 0u)});
+            }
+        }
+#endif
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        for (const auto &item : ready) {
+            // An earlier callback in this round may have closed the fd, or closed
+            // it and opened another one under the same number.
+            auto it = watches_.find(item.fd);
+            if (it != watches_.end() && it->second.serial == item.serial) {
+                IoCallback cb = it->second.cb;
+                cb(item.events);
+            }
+        }
+        fire_timers();
+    }
+}
+
+#endif
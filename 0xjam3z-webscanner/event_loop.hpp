@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+// Single-threaded readiness loop for the in-process network code: epoll on
+// Linux, poll() on other POSIX systems. Not available on Windows.
+class EventLoop {
+public:
+    enum : unsigned { kRead = 1, kWrite = 2, kError = 4 };
+    using IoCallback = std::function<void(unsigned events)>;
+    using TimerCallback = std::function<void()>;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Registers or re-arms fd. Callbacks may watch/unwatch any fd, including
+    // their own.
+    bool watch(int fd, unsigned events, IoCallback cb);
+    void unwatch(int fd);
+    uint64_t add_timer(double seconds, TimerCallback cb);
+    void cancel_timer(uint64_t id);
+
+    // Dispatches until nothing is watched and no timer is pending, or stop().
+    void run();
+    void stop() { stopped_ = true; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Watch {
+        unsigned events = 0;
+        IoCallback cb;
+        // Distinguishes a reused fd number from the registration an event was for.
+        uint32_t serial = 0;
+    };
+
+    int wait_timeout_ms() const;
+    void fire_timers();
+
+    int epoll_fd_ = -1;
+    bool stopped_ = false;
+    uint64_t next_timer_ = 1;
+    uint32_t next_serial_ = 1;
+    std::unordered_map<int, Watch> watches_;
+    std::map<std::pair<Clock::time_point, uint64_t>, TimerCallback> timers_;
+    std::unordered_map<uint64_t, Clock::time_point> timer_deadlines_;
+};
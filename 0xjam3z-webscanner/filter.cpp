@@ -0,0 +1,630 @@
+#include "filter.hpp"
+
+#include "asn_index.hpp"
+#include "common.hpp"
+#include "ipv6.hpp"
+#include "targets.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+// Three-valued, since a bare target can leave a predicate undecided.
+enum class FilterTruth { False, True, Unknown };
+
+// What a node is evaluated against: a whole record, or only a target.
+struct FilterInput {
+    const HttpRecord *rec = nullptr;
+    std::string_view ip;
+    uint16_t port = 0;
+    const AsnIndex *asn = nullptr;
+    // ASN data, looked up on first use.
+    mutable bool looked_up = false;
+    mutable uint32_t asn_number = 0;
+    mutable std::string_view country;
+    mutable std::string_view org;
+
+    void lookup() const {
+        if (looked_up) {
+            return;
+        }
+        looked_up = true;
+        uint32_t v4 = 0;
+        Ipv6Addr v6;
+        if (parse_ipv4(ip, v4)) {
+            if (const AsnRange *range = asn->lookup(v4)) {
+                asn_number = range->asn;
+                country = asn->str(range->country);
+                org = asn->str(range->as_name);
+            }
+        } else if (parse_ipv6(ip, v6)) {
+            if (const AsnRange6 *range = asn->lookup6(v6)) {
+                asn_number = range->asn;
+                country = asn->str(range->country);
+                org = asn->str(range->as_name);
+            }
+        }
+    }
+};
+
+// The part of the input a leaf reads.
+enum class FilterNeeds { Ip, Port, Asn, Record };
+
+enum class FilterFieldType { Number, Text, Address };
+
+using FilterNumber = std::function<long long(const FilterInput &)>;
+using FilterText = std::function<std::string_view(const FilterInput &)>;
+
+struct FilterField {
+    FilterFieldType type = FilterFieldType::Text;
+    FilterNeeds needs = FilterNeeds::Record;
+    // Relative price of reading the field; siblings are tested cheapest first.
+    int cost = 0;
+    FilterNumber number;
+    FilterText text;
+};
+
+struct FilterToken {
+    enum Kind { Word, String, Op, LParen, RParen, Comma, End } kind = End;
+    std::string text;
+    size_t pos = 0;
+};
+
+struct RecordFilter::Node {
+    enum Kind { And, Or, Not, Leaf } kind = Leaf;
+    std::vector<std::unique_ptr<Node>> kids;
+    int cost = 0;
+    FilterNeeds needs = FilterNeeds::Record;
+    std::function<bool(const FilterInput &)> test;
+};
+
+using Node = RecordFilter::Node;
+
+static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+// Case-insensitive substring search; `needle` is lower case.
+static bool icontains(std::string_view hay, const std::string &needle) {
+    auto it = std::search(hay.begin(), hay.end(), needle.begin(), needle.end(), [](char h, char n) {
+        return std::tolower(static_cast<unsigned char>(h)) == n;
+    });
+    return it != hay.end();
+}
+
+static std::string_view header_value(const HttpRecord &rec, std::string_view name) {
+    for (const auto &header : rec.headers) {
+        if (iequals(header.first, name)) {
+            return header.second;
+        }
+    }
+    return {};
+}
+
+static std::string_view field_value(const HttpRecord &rec, std::string_view name) {
+    for (const auto &field : rec.fields) {
+        if (iequals(field.first, name)) {
+            return field.second;
+        }
+    }
+    return {};
+}
+
+static std::optional<FilterField> lookup_field(const std::string &name) {
+    FilterField f;
+    if (name == "ip") {
+        f.type = FilterFieldType::Address;
+        f.needs = FilterNeeds::Ip;
+        f.cost = 1;
+        f.text = [](const FilterInput &in) { return in.ip; };
+    } else if (name == "port") {
+        f.type = FilterFieldType::Number;
+        f.needs = FilterNeeds::Port;
+        f.cost = 1;
+        f.number = [](const FilterInput &in) { return static_cast<long long>(in.port); };
+    } else if (name == "asn") {
+        f.type = FilterFieldType::Number;
+        f.needs = FilterNeeds::Asn;
+        f.cost = 2;
+        f.number = [](const FilterInput &in) {
+            in.lookup();
+            return static_cast<long long>(in.asn_number);
+        };
+    } else if (name == "country" || name == "org") {
+        bool country = name == "country";
+        f.needs = FilterNeeds::Asn;
+        f.cost = 2;
+        f.text = [country](const FilterInput &in) {
+            in.lookup();
+            return country ? in.country : in.org;
+        };
+    } else if (name == "status") {
+        f.type = FilterFieldType::Number;
+        f.cost = 3;
+        f.number = [](const FilterInput &in) { return static_cast<long long>(in.rec->status_code); };
+    } else if (name == "result") {
+        f.cost = 3;
+        f.text = [](const FilterInput &in) { return std::string_view(in.rec->status); };
+    } else if (name == "module") {
+        f.cost = 3;
+        f.text = [](const FilterInput &in) { return std::string_view(in.rec->module); };
+    } else if (name == "host") {
+        f.cost = 3;
+        f.text = [](const FilterInput &in) { return std::string_view(in.rec->domain); };
+    } else if (name == "server" || name.rfind("header.", 0) == 0) {
+        std::string header = name == "server" ? name : name.substr(7);
+        f.cost = 4;
+        f.text = [header](const FilterInput &in) { return header_value(*in.rec, header); };
+    } else if (name == "ptr" || name.rfind("field.", 0) == 0) {
+        std::string field = name == "ptr" ? name : name.substr(6);
+        f.cost = 4;
+        f.text = [field](const FilterInput &in) { return field_value(*in.rec, field); };
+    } else if (name == "title") {
+        f.cost = 5;
+        f.text = [](const FilterInput &in) { return std::string_view(in.rec->title); };
+    } else if (name == "body") {
+        f.cost = 8;
+        f.text = [](const FilterInput &in) { return std::string_view(in.rec->body); };
+    } else {
+        return std::nullopt;
+    }
+    return f;
+}
+
+// An address, CIDR or range literal; IPv4 or IPv6.
+struct FilterAddress {
+    bool v6 = false;
+    Ipv4Range range4;
+    Ipv6Range range6;
+
+    bool contains(std::string_view ip) const {
+        if (v6) {
+            Ipv6Addr addr;
+            return parse_ipv6(ip, addr) && range6.start <= addr && addr <= range6.end;
+        }
+        uint32_t addr = 0;
+        return parse_ipv4(ip, addr) && range4.start <= addr && addr <= range4.end;
+    }
+};
+
+class FilterParser {
+public:
+    explicit FilterParser(std::string_view src) : src_(src) {}
+
+    std::unique_ptr<Node> parse() {
+        advance();
+        auto node = parse_or();
+        if (node && tok_.kind != FilterToken::End) {
+            return fail("unexpected '" + tok_.text + "'");
+        }
+        return node;
+    }
+
+    const std::string &error() const { return error_; }
+    size_t error_pos() const { return error_pos_; }
+    bool needs_asn() const { return needs_asn_; }
+
+private:
+    std::unique_ptr<Node> fail(const std::string &message) {
+        if (error_.empty()) {
+            error_ = message;
+            error_pos_ = tok_.pos;
+        }
+        return nullptr;
+    }
+
+    void advance() {
+        while (pos_ < src_.size() && std::isspace(static_cast<unsigned char>(src_[pos_]))) {
+            ++pos_;
+        }
+        tok_ = FilterToken();
+        tok_.pos = pos_;
+        if (pos_ >= src_.size()) {
+            return;
+        }
+        char c = src_[pos_];
+        if (c == '(' || c == ')' || c == ',') {
+            tok_.kind = c == '(' ? FilterToken::LParen : c == ')' ? FilterToken::RParen : FilterToken::Comma;
+            tok_.text = std::string(1, c);
+            ++pos_;
+            return;
+        }
+        if (c == '"' || c == '\'') {
+            tok_.kind = FilterToken::String;
+            ++pos_;
+            while (pos_ < src_.size() && src_[pos_] != c) {
+                if (src_[pos_] == '\\' && pos_ + 1 < src_.size()) {
+                    ++pos_;
+                }
+                tok_.text += src_[pos_++];
+            }
+            if (pos_ >= src_.size()) {
+                tok_.kind = FilterToken::End;
+                fail("unterminated string");
+                return;
+            }
+            ++pos_;
+            return;
+        }
+        static const char *const kOps[] = {"==", "!=", "<=", ">=", "!~", "&&", "||", "=", "<", ">", "~", "!"};
+        for (const char *op : kOps) {
+            std::string_view o(op);
+            if (src_.substr(pos_, o.size()) == o) {
+                tok_.kind = FilterToken::Op;
+                tok_.text = std::string(o);
+                pos_ += o.size();
+                return;
+            }
+        }
+        tok_.kind = FilterToken::Word;
+        while (pos_ < src_.size()) {
+            char w = src_[pos_];
+            if (std::isspace(static_cast<unsigned char>(w)) || std::string_view("(),\"'=!<>~&|").find(w) !=
+                                                                     std::string_view::npos) {
+                break;
+            }
+            tok_.text += w;
+            ++pos_;
+        }
+        if (tok_.text.empty()) {
+            tok_.text = std::string(1, c);
+            fail("unexpected '" + tok_.text + "'");
+            tok_.kind = FilterToken::End;
+        }
+    }
+
+    bool keyword(const char *word) const { return tok_.kind == FilterToken::Word && iequals(tok_.text, word); }
+    bool op(const char *text) const { return tok_.kind == FilterToken::Op && tok_.text == text; }
+
+    std::unique_ptr<Node> combine(Node::Kind kind, std::unique_ptr<Node> left, std::unique_ptr<Node> right) {
+        if (left->kind == kind) {
+            left->kids.push_back(std::move(right));
+            return left;
+        }
+        auto node = std::make_unique<Node>();
+        node->kind = kind;
+        node->kids.push_back(std::move(left));
+        node->kids.push_back(std::move(right));
+        return node;
+    }
+
+    std::unique_ptr<Node> parse_or() {
+        auto left = parse_and();
+        while (left && (keyword("or") || op("||"))) {
+            advance();
+            auto right = parse_and();
+            if (!right) {
+                return nullptr;
+            }
+            left = combine(Node::Or, std::move(left), std::move(right));
+        }
+        return left;
+    }
+
+    std::unique_ptr<Node> parse_and() {
+        auto left = parse_not();
+        while (left && (keyword("and") || op("&&"))) {
+            advance();
+            auto right = parse_not();
+            if (!right) {
+                return nullptr;
+            }
+            left = combine(Node::And, std::move(left), std::move(right));
+        }
+        return left;
+    }
+
+    std::unique_ptr<Node> parse_not() {
+        if (keyword("not") || op("!")) {
+            advance();
+            auto inner = parse_not();
+            if (!inner) {
+                return nullptr;
+            }
+            auto node = std::make_unique<Node>();
+            node->kind = Node::Not;
+            node->kids.push_back(std::move(inner));
+            return node;
+        }
+        if (tok_.kind == FilterToken::LParen) {
+            advance();
+            auto inner = parse_or();
+            if (!inner) {
+                return nullptr;
+            }
+            if (tok_.kind != FilterToken::RParen) {
+                return fail("expected ')'");
+            }
+            advance();
+            return inner;
+        }
+        return parse_comparison();
+    }
+
+    bool parse_value(std::string &out) {
+        if (tok_.kind != FilterToken::Word && tok_.kind != FilterToken::String) {
+            fail(tok_.kind == FilterToken::End ? "expected a value" : "unexpected '" + tok_.text + "'");
+            return false;
+        }
+        out = tok_.text;
+        advance();
+        return true;
+    }
+
+    std::unique_ptr<Node> parse_comparison() {
+        if (tok_.kind != FilterToken::Word) {
+            return fail(tok_.kind == FilterToken::End ? "expected a field" : "unexpected '" + tok_.text + "'");
+        }
+        size_t start = tok_.pos;
+        std::string name = to_lower(tok_.text);
+        auto field = lookup_field(name);
+        if (!field) {
+            return fail("unknown field '" + tok_.text + "'");
+        }
+        advance();
+        std::string oper;
+        std::vector<std::string> values;
+        bool not_in = keyword("not");
+        if (not_in) {
+            advance();
+            if (!keyword("in")) {
+                return fail("expected 'in' after not");
+            }
+        }
+        if (keyword("in")) {
+            oper = not_in ? "not in" : "in";
+            advance();
+            if (tok_.kind != FilterToken::LParen) {
+                return fail("expected '(' after in");
+            }
+            advance();
+            for (;;) {
+                std::string value;
+                if (!parse_value(value)) {
+                    return nullptr;
+                }
+                values.push_back(std::move(value));
+                if (tok_.kind == FilterToken::Comma) {
+                    advance();
+                    continue;
+                }
+                if (tok_.kind != FilterToken::RParen) {
+                    return fail("expected ',' or ')'");
+                }
+                advance();
+                break;
+            }
+        } else if (tok_.kind == FilterToken::Op && tok_.text != "!" && tok_.text != "&&" && tok_.text != "||") {
+            oper = tok_.text == "=" ? "==" : tok_.text;
+            advance();
+            std::string value;
+            if (!parse_value(value)) {
+                return nullptr;
+            }
+            values.push_back(std::move(value));
+        } else {
+            return fail("expected an operator after '" + name + "'");
+        }
+        if (field->needs == FilterNeeds::Asn) {
+            needs_asn_ = true;
+        }
+        auto leaf = make_leaf(name, *field, oper, values);
+        if (!leaf) {
+            // Value errors point at the comparison, not past it.
+            error_pos_ = start;
+        }
+        return leaf;
+    }
+
+    std::unique_ptr<Node> make_leaf(const std::string &name, const FilterField &field, const std::string &oper,
+                                    const std::vector<std::string> &values) {
+        auto node = std::make_unique<Node>();
+        node->cost = field.cost;
+        node->needs = field.needs;
+        bool negate = oper == "!=" || oper == "!~" || oper == "not in";
+        bool list = oper == "in" || oper == "not in";
+        switch (field.type) {
+        case FilterFieldType::Number: {
+            std::vector<long long> numbers;
+            for (const auto &value : values) {
+                char *end = nullptr;
+                long long n = std::strtoll(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0') {
+                    return fail("'" + name + "' takes numbers, not '" + value + "'");
+                }
+                numbers.push_back(n);
+            }
+            FilterNumber get = field.number;
+            long long n = numbers.front();
+            if (list) {
+                node->test = [get, numbers, negate](const FilterInput &in) {
+                    return (std::find(numbers.begin(), numbers.end(), get(in)) != numbers.end()) != negate;
+                };
+            } else if (oper == "==" || oper == "!=") {
+                node->test = [get, n, negate](const FilterInput &in) { return (get(in) == n) != negate; };
+            } else if (oper == "<") {
+                node->test = [get, n](const FilterInput &in) { return get(in) < n; };
+            } else if (oper == "<=") {
+                node->test = [get, n](const FilterInput &in) { return get(in) <= n; };
+            } else if (oper == ">") {
+                node->test = [get, n](const FilterInput &in) { return get(in) > n; };
+            } else if (oper == ">=") {
+                node->test = [get, n](const FilterInput &in) { return get(in) >= n; };
+            } else {
+                return fail("'" + oper + "' does not apply to '" + name + "'");
+            }
+            break;
+        }
+        case FilterFieldType::Address: {
+            FilterText get = field.text;
+            if (oper == "~" || oper == "!~") {
+                std::string needle = to_lower(values.front());
+                node->test = [get, needle, negate](const FilterInput &in) {
+                    return icontains(get(in), needle) != negate;
+                };
+                break;
+            }
+            if (!list && oper != "==" && oper != "!=") {
+                return fail("'" + oper + "' does not apply to '" + name + "'");
+            }
+            std::vector<FilterAddress> specs;
+            for (const auto &value : values) {
+                FilterAddress spec;
+                if (!parse_target_spec(value, spec.range4)) {
+                    spec.v6 = true;
+                    if (!parse_ipv6_spec(value, spec.range6)) {
+                        return fail("'" + value + "' is not an address, CIDR or range");
+                    }
+                }
+                specs.push_back(spec);
+            }
+            node->test = [get, specs, negate](const FilterInput &in) {
+                std::string_view ip = get(in);
+                bool hit = std::any_of(specs.begin(), specs.end(),
+                                       [&](const FilterAddress &spec) { return spec.contains(ip); });
+                return hit != negate;
+            };
+            break;
+        }
+        case FilterFieldType::Text: {
+            FilterText get = field.text;
+            if (oper == "~" || oper == "!~") {
+                std::string needle = to_lower(values.front());
+                node->test = [get, needle, negate](const FilterInput &in) {
+                    return icontains(get(in), needle) != negate;
+                };
+            } else if (oper == "==" || oper == "!=" || list) {
+                node->test = [get, values, negate](const FilterInput &in) {
+                    std::string_view text = get(in);
+                    bool hit = std::any_of(values.begin(), values.end(),
+                                           [&](const std::string &v) { return iequals(text, v); });
+                    return hit != negate;
+                };
+            } else {
+                return fail("'" + oper + "' does not apply to '" + name + "'");
+            }
+            break;
+        }
+        }
+        return node;
+    }
+
+    std::string_view src_;
+    size_t pos_ = 0;
+    FilterToken tok_;
+    std::string error_;
+    size_t error_pos_ = 0;
+    bool needs_asn_ = false;
+};
+
+// Orders every and/or cheapest operand first and returns the subtree's cost.
+static int order_by_cost(Node &node) {
+    if (node.kind == Node::Leaf) {
+        return node.cost;
+    }
+    for (auto &kid : node.kids) {
+        order_by_cost(*kid);
+    }
+    std::stable_sort(node.kids.begin(), node.kids.end(),
+                     [](const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b) { return a->cost < b->cost; });
+    node.cost = 0;
+    for (const auto &kid : node.kids) {
+        node.cost = std::max(node.cost, kid->cost);
+    }
+    return node.cost;
+}
+
+static bool available(FilterNeeds needs, const FilterInput &in) {
+    switch (needs) {
+    case FilterNeeds::Ip:
+        return !in.ip.empty();
+    case FilterNeeds::Port:
+        return in.port != 0;
+    case FilterNeeds::Asn:
+        return !in.ip.empty() && in.asn != nullptr;
+    case FilterNeeds::Record:
+        return in.rec != nullptr;
+    }
+    return false;
+}
+
+static FilterTruth eval(const Node &node, const FilterInput &in) {
+    switch (node.kind) {
+    case Node::Leaf:
+        if (!available(node.needs, in)) {
+            return FilterTruth::Unknown;
+        }
+        return node.test(in) ? FilterTruth::True : FilterTruth::False;
+    case Node::Not: {
+        FilterTruth inner = eval(*node.kids.front(), in);
+        if (inner == FilterTruth::Unknown) {
+            return inner;
+        }
+        return inner == FilterTruth::True ? FilterTruth::False : FilterTruth::True;
+    }
+    case Node::And:
+    case Node::Or: {
+        // The value that decides the whole node on its own.
+        FilterTruth decisive = node.kind == Node::And ? FilterTruth::False : FilterTruth::True;
+        FilterTruth result = node.kind == Node::And ? FilterTruth::True : FilterTruth::False;
+        for (const auto &kid : node.kids) {
+            FilterTruth value = eval(*kid, in);
+            if (value == decisive) {
+                return value;
+            }
+            if (value == FilterTruth::Unknown) {
+                result = FilterTruth::Unknown;
+            }
+        }
+        return result;
+    }
+    }
+    return FilterTruth::Unknown;
+}
+
+RecordFilter::RecordFilter() = default;
+RecordFilter::~RecordFilter() = default;
+RecordFilter::RecordFilter(RecordFilter &&) noexcept = default;
+RecordFilter &RecordFilter::operator=(RecordFilter &&) noexcept = default;
+
+bool RecordFilter::compile(const std::string &expr) {
+    FilterParser parser(expr);
+    auto root = parser.parse();
+    if (!root) {
+        std::cerr << "Invalid --where at column " << parser.error_pos() + 1 << ": " << parser.error() << std::endl;
+        return false;
+    }
+    order_by_cost(*root);
+    root_ = std::move(root);
+    needs_asn_ = parser.needs_asn();
+    return true;
+}
+
+bool RecordFilter::may_match(std::string_view ip, uint16_t port) const {
+    if (!root_) {
+        return true;
+    }
+    FilterInput in;
+    in.ip = ip;
+    in.port = port;
+    in.asn = asn_;
+    return eval(*root_, in) != FilterTruth::False;
+}
+
+bool RecordFilter::matches(const HttpRecord &rec) const {
+    if (!root_) {
+        return true;
+    }
+    FilterInput in;
+    in.rec = &rec;
+    in.ip = rec.ip;
+    in.port = rec.port;
+    in.asn = asn_;
+    return eval(*root_, in) == FilterTruth::True;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "parsers.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class AsnIndex;
+
+// --where: a boolean expression over result records, compiled once into a tree
+// of closures.
+//
+//   status == 200 and title ~ "login" and port in (80, 8080)
+//   not (org ~ cloudflare or asn in (13335, 16509)) and ip in (10.0.0.0/8)
+//
+// `and` and `or` test their cheapest operands first, and the tree can be
+// evaluated against a bare target: ip, port, asn, country and org are known
+// before anything is grabbed, so targets they rule out are never grabbed and
+// zgrab2 lines they rule out are never decoded.
+class RecordFilter {
+public:
+    RecordFilter();
+    ~RecordFilter();
+    RecordFilter(RecordFilter &&) noexcept;
+    RecordFilter &operator=(RecordFilter &&) noexcept;
+
+    // False, with the reason on stderr, for a malformed expression.
+    bool compile(const std::string &expr);
+    bool empty() const { return !root_; }
+    // asn, country and org look addresses up here; set before evaluating.
+    bool needs_asn() const { return needs_asn_; }
+    void bind_asn(const AsnIndex *asn) { asn_ = asn; }
+
+    // False only when the known parts of a target already rule out every record
+    // it could produce. An empty ip or a port of 0 is unknown.
+    bool may_match(std::string_view ip, uint16_t port) const;
+    bool matches(const HttpRecord &rec) const;
+
+    struct Node;
+
+private:
+    std::unique_ptr<Node> root_;
+    bool needs_asn_ = false;
+    const AsnIndex *asn_ = nullptr;
+};
@@ -0,0 +1,447 @@
+#include "http.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Longest status line plus headers accepted, and longest chunk-size line.
+static constexpr size_t kMaxHead = 64 * 1024;
+static constexpr size_t kMaxLine = 1024;
+
+static char lower_ascii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool http_name_equals(std::string_view name, std::string_view lower) {
+    if (name.size() != lower.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (lower_ascii(name[i]) != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Case-insensitive search for a lower-case word in a header value.
+static bool contains_lower(std::string_view value, std::string_view lower) {
+    for (size_t i = 0; i + lower.size() <= value.size(); ++i) {
+        if (http_name_equals(value.substr(i, lower.size()), lower)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Offset of the first a or b in p[0, n), or n. Compares 32 or 16 bytes per
+// step; for one or two needles that beats SSE4.2 PCMPESTRI.
+static size_t find_either(const char *p, size_t n, char a, char b) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i wa = _mm256_set1_epi8(a);
+    const __m256i wb = _mm256_set1_epi8(b);
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, wa), _mm256_cmpeq_epi8(block, wb))));
+        if (mask) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        uint32_t mask =
+            static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, va), _mm_cmpeq_epi8(block, vb))));
+        if (mask) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (p[i] == a || p[i] == b) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Offset just past the blank line ending a response head in p[0, n), looking
+// at line ends from `from` on; npos if there is none yet, with `from` moved to
+// where the next look should resume. Lines end in CRLF or a bare LF.
+static size_t find_head_end(const char *p, size_t n, size_t &from) {
+    size_t pos = from;
+    while (pos < n) {
+        // glibc's memchr is already vectorized for a single needle.
+        const char *hit = static_cast<const char *>(std::memchr(p + pos, '\n', n - pos));
+        if (!hit) {
+            break;
+        }
+        size_t nl = static_cast<size_t>(hit - p);
+        if (nl + 1 < n && p[nl + 1] == '\n') {
+            return nl + 2;
+        }
+        if (nl + 1 < n && p[nl + 1] == '\r') {
+            if (nl + 2 < n && p[nl + 2] == '\n') {
+                return nl + 3;
+            }
+            if (nl + 2 >= n) {
+                from = nl;
+                return std::string_view::npos;
+            }
+        } else if (nl + 1 >= n) {
+            from = nl;
+            return std::string_view::npos;
+        }
+        pos = nl + 1;
+    }
+    from = n;
+    return std::string_view::npos;
+}
+
+static std::string_view trim_view(std::string_view s) {
+    size_t begin = 0;
+    size_t end = s.size();
+    while (begin < end && (s[begin] == ' ' || s[begin] == '\t')) {
+        ++begin;
+    }
+    while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t' || s[end - 1] == '\r')) {
+        --end;
+    }
+    return s.substr(begin, end - begin);
+}
+
+void HttpStreamParser::reset() {
+    state_ = State::Head;
+    carry_.clear();
+    scan_ = 0;
+    remaining_ = 0;
+    keep_alive_ = false;
+    stopped_ = false;
+    headers_.clear();
+}
+
+bool HttpStreamParser::parse_head(std::string_view head, HttpHandler &handler) {
+    size_t eol = std::min(head.find('\n'), head.size());
+    std::string_view status = trim_view(head.substr(0, eol));
+    // "HTTP/1.1 200 OK"
+    if (status.size() < 12 || status.compare(0, 5, "HTTP/") != 0 || status[8] != ' ') {
+        return false;
+    }
+    bool http10 = status.compare(5, 3, "1.0") == 0;
+    int code = 0;
+    for (size_t i = 9; i < 12; ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(status[i]))) {
+            return false;
+        }
+        code = code * 10 + (status[i] - '0');
+    }
+    if (code < 200) {
+        // Interim response; the real one follows.
+        return true;
+    }
+
+    headers_.clear();
+    bool chunked = false;
+    bool have_length = false;
+    uint64_t length = 0;
+    bool close = false;
+    bool keep_alive = false;
+    // One pass over the head stops at every ':' and '\n': a colon first ends a
+    // header name, a newline first is a line without one.
+    size_t pos = eol + 1;
+    while (pos < head.size()) {
+        size_t hit = pos + find_either(head.data() + pos, head.size() - pos, ':', '\n');
+        if (hit == head.size() || head[hit] == '\n') {
+            pos = hit + 1;
+            continue;
+        }
+        const char *nl = static_cast<const char *>(std::memchr(head.data() + hit, '\n', head.size() - hit));
+        size_t end = nl ? static_cast<size_t>(nl - head.data()) : head.size();
+        HttpHeaderView header{head.substr(pos, hit - pos), trim_view(head.substr(hit + 1, end - hit - 1))};
+        pos = end + 1;
+        if (http_name_equals(header.name, "content-length")) {
+            length = 0;
+            have_length = !header.value.empty() && header.value.size() <= 19;
+            for (char c : header.value) {
+                if (!std::isdigit(static_cast<unsigned char>(c))) {
+                    have_length = false;
+                    break;
+                }
+                length = length * 10 + static_cast<uint64_t>(c - '0');
+            }
+        } else if (http_name_equals(header.name, "transfer-encoding")) {
+            chunked = contains_lower(header.value, "chunked");
+        } else if (http_name_equals(header.name, "connection")) {
+            close = contains_lower(header.value, "close");
+            keep_alive = contains_lower(header.value, "keep-alive");
+        }
+        headers_.push_back(header);
+    }
+
+    keep_alive_ = http10 ? keep_alive : !close;
+    if (code == 204 || code == 304) {
+        state_ = State::Done;
+    } else if (chunked) {
+        state_ = State::ChunkSize;
+    } else if (have_length) {
+        remaining_ = length;
+        state_ = length == 0 ? State::Done : State::Body;
+    } else {
+        keep_alive_ = false;
+        state_ = State::UntilClose;
+    }
+    if (!handler.on_head(code, headers_)) {
+        stopped_ = true;
+        keep_alive_ = false;
+        state_ = State::Done;
+    }
+    return true;
+}
+
+void HttpStreamParser::deliver(std::string_view data, HttpHandler &handler) {
+    if (!data.empty() && !handler.on_body(data)) {
+        // The rest is never read, so the connection cannot be reused.
+        stopped_ = true;
+        keep_alive_ = false;
+        state_ = State::Done;
+    }
+}
+
+// Next line at data[pos], joined to the partial line carried from earlier
+// feeds, without its line end. When the line is not complete yet, carries
+// what there is and returns false; `ok` turns false past `max` bytes.
+static bool take_line(std::string_view data, size_t &pos, std::string &carry, size_t max, std::string_view &line,
+                      bool &ok) {
+    const char *start = data.data() + pos;
+    size_t n = data.size() - pos;
+    const char *nl = static_cast<const char *>(std::memchr(start, '\n', n));
+    if (!nl) {
+        ok = carry.size() + n <= max;
+        carry.append(start, n);
+        pos = data.size();
+        return false;
+    }
+    size_t len = static_cast<size_t>(nl - start);
+    pos += len + 1;
+    if (carry.empty()) {
+        line = std::string_view(start, len);
+    } else {
+        carry.append(start, len);
+        line = carry;
+    }
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return true;
+}
+
+bool HttpStreamParser::feed(std::string_view data, HttpHandler &handler) {
+    size_t pos = 0;
+    bool ok = true;
+    std::string_view line;
+    while (ok && state_ != State::Done && pos < data.size()) {
+        std::string_view rest = data.substr(pos);
+        if (state_ == State::Head) {
+            if (carry_.empty()) {
+                size_t from = 0;
+                size_t end = find_head_end(rest.data(), rest.size(), from);
+                if (end == std::string_view::npos) {
+                    ok = rest.size() <= kMaxHead;
+                    carry_.assign(rest.data(), rest.size());
+                    scan_ = from;
+                    break;
+                }
+                ok = parse_head(rest.substr(0, end), handler);
+                pos += end;
+                continue;
+            }
+            // The head spans feeds: continue it in carry_, scanning only what is new.
+            size_t before = carry_.size();
+            carry_.append(rest.data(), std::min(rest.size(), kMaxHead + 4 - std::min(before, kMaxHead)));
+            size_t end = find_head_end(carry_.data(), carry_.size(), scan_);
+            if (end == std::string_view::npos) {
+                ok = carry_.size() <= kMaxHead;
+                pos += carry_.size() - before;
+                continue;
+            }
+            ok = parse_head(std::string_view(carry_).substr(0, end), handler);
+            pos += end - before;
+            carry_.clear();
+            scan_ = 0;
+        } else if (state_ == State::Body || state_ == State::ChunkData) {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, rest.size()));
+            remaining_ -= take;
+            pos += take;
+            if (remaining_ == 0) {
+                state_ = state_ == State::Body ? State::Done : State::ChunkEnd;
+            }
+            deliver(rest.substr(0, take), handler);
+        } else if (state_ == State::UntilClose) {
+            deliver(rest, handler);
+            pos = data.size();
+        } else {
+            // Chunk-size, chunk-end and trailer lines.
+            if (!take_line(data, pos, carry_, state_ == State::Trailers ? kMaxHead : kMaxLine, line, ok)) {
+                break;
+            }
+            if (state_ == State::ChunkEnd) {
+                ok = line.empty();
+                state_ = State::ChunkSize;
+            } else if (state_ == State::Trailers) {
+                if (line.empty()) {
+                    state_ = State::Done;
+                }
+            } else {
+                // Chunk extensions after ';' are ignored.
+                uint64_t size = 0;
+                size_t digits = 0;
+                for (; digits < line.size() && std::isxdigit(static_cast<unsigned char>(line[digits])); ++digits) {
+                    int c = lower_ascii(line[digits]);
+                    size = size * 16 + static_cast<uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+                }
+                ok = digits > 0 && digits <= 15;
+                remaining_ = size;
+                state_ = size == 0 ? State::Trailers : State::ChunkData;
+            }
+            carry_.clear();
+        }
+    }
+    if (state_ == State::Done) {
+        if (pos < data.size()) {
+            // Bytes past the response: the server is not speaking plain request/response.
+            keep_alive_ = false;
+        }
+        carry_.clear();
+    }
+    return ok;
+}
+
+bool HttpStreamParser::finish() {
+    if (state_ == State::UntilClose) {
+        state_ = State::Done;
+    }
+    keep_alive_ = false;
+    return state_ == State::Done;
+}
+
+void HttpResponseParser::reset() {
+    stream_.reset();
+    decoding_ = false;
+    skipping_ = false;
+    skipped_ = 0;
+    at_title_ = false;
+    status_code_ = 0;
+    headers_.clear();
+    body_.clear();
+}
+
+bool HttpResponseParser::on_head(int status_code, const std::vector<HttpHeaderView> &headers) {
+    status_code_ = status_code;
+    headers_.clear();
+    for (const auto &header : headers) {
+        if (http_name_equals(header.name, "content-encoding")) {
+            ContentCoding coding = parse_content_coding(header.value);
+            // Anything this build cannot decode is kept as sent.
+            decoding_ = coding != ContentCoding::Identity && decoder_.start(coding);
+        }
+        std::string name(header.name);
+        std::transform(name.begin(), name.end(), name.begin(), lower_ascii);
+        auto it = std::find_if(headers_.begin(), headers_.end(),
+                               [&](const std::pair<std::string, std::string> &h) { return h.first == name; });
+        if (it != headers_.end()) {
+            it->second += ", ";
+            it->second.append(header.value.data(), header.value.size());
+        } else {
+            headers_.emplace_back(std::move(name), std::string(header.value));
+        }
+    }
+    return true;
+}
+
+// Whether s has a "</title>" starting at or after `from`.
+static bool has_title_close(std::string_view s, size_t from) {
+    while (from < s.size()) {
+        const char *lt = static_cast<const char *>(std::memchr(s.data() + from, '<', s.size() - from));
+        if (!lt) {
+            return false;
+        }
+        from = static_cast<size_t>(lt - s.data());
+        if (http_name_equals(s.substr(from, 8), "</title>")) {
+            return true;
+        }
+        ++from;
+    }
+    return false;
+}
+
+bool HttpResponseParser::on_decoded(std::string_view data) {
+    // A closing tag may straddle the previous window.
+    size_t from = body_.size() > 7 ? body_.size() - 7 : 0;
+    body_.append(data.data(), std::min(data.size(), max_body_ - body_.size()));
+    if (has_title_close(body_, from) && title_end(body_) != std::string::npos) {
+        at_title_ = true;
+        return false;
+    }
+    return body_.size() < max_body_;
+}
+
+bool HttpResponseParser::on_body(std::string_view data) {
+    if (skipping_) {
+        skipped_ += data.size();
+        return skipped_ <= max_body_;
+    }
+    if (decoding_) {
+        auto result = decoder_.feed(data, [this](std::string_view out) { return on_decoded(out); });
+        // Stopped, finished or corrupt: whatever follows adds nothing to the body.
+        skipping_ = result != ContentDecoder::Result::More;
+        return true;
+    }
+    size_t room = max_body_ - body_.size();
+    if (data.size() > room) {
+        body_.append(data.data(), room);
+        return false;
+    }
+    body_.append(data.data(), data.size());
+    return true;
+}
+
+std::string build_http_request(std::string_view host, bool keep_alive) {
+    std::string request = "GET / HTTP/1.1\r\nHost: ";
+    request.append(host.data(), host.size());
+    request += "\r\nUser-Agent: Mozilla/5.0 zgrab/0.x\r\nAccept: */*\r\n";
+    std::string_view codings = accepted_content_codings();
+    if (!codings.empty()) {
+        request += "Accept-Encoding: ";
+        request.append(codings.data(), codings.size());
+        request += "\r\n";
+    }
+    request += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    return request;
+}
+
+void fill_http_record(HttpResponseParser &response, HttpRecord &rec) {
+    rec.module = "http";
+    rec.status = "success";
+    rec.status_code = response.status_code();
+    rec.headers = response.headers();
+    rec.body = response.take_body();
+    rec.has_body = !rec.body.empty();
+    if (auto title = find_title(rec.body)) {
+        rec.title = std::string(*title);
+    } else {
+        rec.title.clear();
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "content_decoder.hpp"
+#include "parsers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Body bytes kept per response; zgrab2's --max-size default.
+static constexpr size_t kHttpMaxBody = 256 * 1024;
+
+struct HttpHeaderView {
+    std::string_view name; // as sent; compare with http_name_equals
+    std::string_view value; // surrounding whitespace trimmed
+};
+
+// ASCII case-insensitive match against a lower-case name.
+bool http_name_equals(std::string_view name, std::string_view lower);
+
+// Receives what HttpStreamParser decodes. Views are only valid during the call.
+class HttpHandler {
+public:
+    virtual ~HttpHandler() = default;
+    // Final (non-1xx) status line and headers. Return false to stop as if done.
+    virtual bool on_head(int status_code, const std::vector<HttpHeaderView> &headers) = 0;
+    // Next stretch of the decoded body. Return false to stop reading it.
+    virtual bool on_body(std::string_view data) = 0;
+};
+
+// Incremental, zero-copy HTTP/1.x response parser. feed() accepts the bytes
+// as they arrive, in pieces of any size. Header views point into the fed
+// buffer, or into a copy of the head when it spanned several feeds. Bodies
+// reach the handler as spans of the fed buffers, with chunked framing removed
+// but nothing reassembled. Only an incomplete head or chunk-size line is
+// carried over between feeds. Line and header delimiters are found 16 or 32
+// bytes at a time with SSE2/AVX2 where the build targets them.
+class HttpStreamParser {
+public:
+    void reset();
+    // False on a malformed response. Stops at the end of one response.
+    bool feed(std::string_view data, HttpHandler &handler);
+    // End of stream; completes close-delimited bodies. False if the response is cut short.
+    bool finish();
+
+    bool done() const { return state_ == State::Done; }
+    // The connection may carry another request after this response.
+    bool keep_alive() const { return keep_alive_; }
+    // The handler stopped before the end of the body.
+    bool stopped() const { return stopped_; }
+
+private:
+    enum class State { Head, Body, ChunkSize, ChunkData, ChunkEnd, Trailers, UntilClose, Done };
+
+    // Consumes a complete head; false when malformed.
+    bool parse_head(std::string_view head, HttpHandler &handler);
+    // Feeds body bytes to the handler, stopping when it asks to.
+    void deliver(std::string_view data, HttpHandler &handler);
+
+    State state_ = State::Head;
+    // Partial head or chunk-size line from earlier feeds.
+    std::string carry_;
+    // Where the line scan of carry_ resumes.
+    size_t scan_ = 0;
+    uint64_t remaining_ = 0;
+    bool keep_alive_ = false;
+    bool stopped_ = false;
+    std::vector<HttpHeaderView> headers_;
+};
+
+// Response reader for the native clients, on top of HttpStreamParser: keeps
+// the status, lower-cased headers and the first max_body body bytes. done()
+// turns true once a whole response, or those body bytes, has been read.
+//
+// gzip, deflate and br bodies are decoded as they stream in, and decoding
+// stops once the title has closed or max_body decoded bytes are kept. The rest
+// of the compressed body is read and dropped, up to max_body bytes, so the
+// connection stays usable.
+class HttpResponseParser : private HttpHandler {
+public:
+    explicit HttpResponseParser(size_t max_body = kHttpMaxBody) : max_body_(max_body) {}
+
+    void reset();
+    bool feed(std::string_view data) { return stream_.feed(data, *this); }
+    bool finish() { return stream_.finish(); }
+
+    bool done() const { return stream_.done(); }
+    bool keep_alive() const { return stream_.keep_alive(); }
+    bool truncated() const { return stream_.stopped(); }
+    // The body was decoded only up to the end of its title.
+    bool partial_body() const { return at_title_; }
+    int status_code() const { return status_code_; }
+    // Lower-case names, repeated headers joined with ", ".
+    const std::vector<std::pair<std::string, std::string>> &headers() const { return headers_; }
+    const std::string &body() const { return body_; }
+    std::string take_body() { return std::move(body_); }
+
+private:
+    bool on_head(int status_code, const std::vector<HttpHeaderView> &headers) override;
+    bool on_body(std::string_view data) override;
+    // Keeps decoded output; false once no more is wanted.
+    bool on_decoded(std::string_view data);
+
+    size_t max_body_;
+    HttpStreamParser stream_;
+    ContentDecoder decoder_;
+    bool decoding_ = false;
+    // Decoding is over; the rest of the body is only read.
+    bool skipping_ = false;
+    uint64_t skipped_ = 0;
+    bool at_title_ = false;
+    int status_code_ = 0;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string body_;
+};
+
+// GET / for `host` with the headers zgrab2's http module sends, and the
+// Accept-Encoding this build can decode.
+std::string build_http_request(std::string_view host, bool keep_alive);
+
+// Moves a finished response into rec as a successful "http" grab.
+void fill_http_record(HttpResponseParser &response, HttpRecord &rec);
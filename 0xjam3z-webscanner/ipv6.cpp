@@ -0,0 +1,306 @@
+#include "ipv6.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+static int clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & (1ull << 63))) {
+        x <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Length of the common leading bit string of a and b.
+static int common_bits(const Ipv6Addr &a, const Ipv6Addr &b) {
+    if (uint64_t x = a.hi ^ b.hi) {
+        return clz64(x);
+    }
+    uint64_t x = a.lo ^ b.lo;
+    return x ? 64 + clz64(x) : 128;
+}
+
+static uint64_t prefix_mask64(int bits) {
+    return bits <= 0 ? 0 : (bits >= 64 ? ~0ull : ~0ull << (64 - bits));
+}
+
+Ipv6Addr ipv6_network(const Ipv6Addr &a, int bits) {
+    return {a.hi & prefix_mask64(bits), a.lo & prefix_mask64(bits - 64)};
+}
+
+Ipv6Addr ipv6_broadcast(const Ipv6Addr &a, int bits) {
+    return {a.hi | ~prefix_mask64(bits), a.lo | ~prefix_mask64(bits - 64)};
+}
+
+static bool parse_hex_group(std::string_view s, uint16_t &out) {
+    if (s.empty() || s.size() > 4) {
+        return false;
+    }
+    unsigned value = 0;
+    for (char c : s) {
+        unsigned digit = 0;
+        if (c >= '0' && c <= '9') {
+            digit = static_cast<unsigned>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = static_cast<unsigned>(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            digit = static_cast<unsigned>(c - 'A' + 10);
+        } else {
+            return false;
+        }
+        value = value << 4 | digit;
+    }
+    out = static_cast<uint16_t>(value);
+    return true;
+}
+
+bool parse_ipv6(std::string_view s, Ipv6Addr &out) {
+    uint16_t groups[8] = {};
+    int count = 0;
+    int gap = -1;
+    size_t i = 0;
+    if (s.size() >= 2 && s[0] == ':' && s[1] == ':') {
+        gap = 0;
+        i = 2;
+    } else if (s.empty() || s[0] == ':') {
+        return false;
+    }
+    while (i < s.size()) {
+        if (count >= 8) {
+            return false;
+        }
+        size_t end = s.find(':', i);
+        std::string_view token = s.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i);
+        if (token.find('.') != std::string_view::npos) {
+            // Trailing dotted quad, e.g. ::ffff:192.0.2.1.
+            uint32_t v4 = 0;
+            if (end != std::string_view::npos || count > 6 || !parse_ipv4(token, v4)) {
+                return false;
+            }
+            groups[count++] = static_cast<uint16_t>(v4 >> 16);
+            groups[count++] = static_cast<uint16_t>(v4);
+            break;
+        }
+        if (!parse_hex_group(token, groups[count])) {
+            return false;
+        }
+        ++count;
+        if (end == std::string_view::npos) {
+            break;
+        }
+        i = end + 1;
+        if (i < s.size() && s[i] == ':') {
+            if (gap >= 0) {
+                return false;
+            }
+            gap = count;
+            ++i;
+        } else if (i == s.size()) {
+            return false;
+        }
+    }
+    if (gap < 0 ? count != 8 : count > 7) {
+        return false;
+    }
+    uint16_t full[8] = {};
+    int tail = gap < 0 ? 0 : count - gap;
+    int head = count - tail;
+    std::copy(groups, groups + head, full);
+    std::copy(groups + head, groups + count, full + 8 - tail);
+    out = {};
+    for (int k = 0; k < 4; ++k) {
+        out.hi = out.hi << 16 | full[k];
+        out.lo = out.lo << 16 | full[k + 4];
+    }
+    return true;
+}
+
+std::string format_ipv6(const Ipv6Addr &addr) {
+    if (addr.hi == 0 && addr.lo >> 32 == 0xffff) {
+        return "::ffff:" + format_ipv4(static_cast<uint32_t>(addr.lo));
+    }
+    uint16_t groups[8];
+    for (int k = 0; k < 4; ++k) {
+        groups[k] = static_cast<uint16_t>(addr.hi >> (48 - 16 * k));
+        groups[k + 4] = static_cast<uint16_t>(addr.lo >> (48 - 16 * k));
+    }
+    // The longest run of two or more zero groups (the first on a tie) becomes "::".
+    int best = -1;
+    int best_len = 1;
+    for (int k = 0; k < 8;) {
+        int run = 0;
+        while (k + run < 8 && groups[k + run] == 0) {
+            ++run;
+        }
+        if (run > best_len) {
+            best = k;
+            best_len = run;
+        }
+        k += run ? run : 1;
+    }
+    static const char hex[] = "0123456789abcdef";
+    std::string text;
+    for (int k = 0; k < 8; ++k) {
+        if (k == best) {
+            text += "::";
+            k += best_len - 1;
+            continue;
+        }
+        if (!text.empty() && text.back() != ':') {
+            text += ':';
+        }
+        bool digits = false;
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            unsigned nibble = groups[k] >> shift & 15;
+            if (nibble || digits || shift == 0) {
+                text += hex[nibble];
+                digits = true;
+            }
+        }
+    }
+    return text;
+}
+
+bool parse_ipv6_spec(std::string_view spec, Ipv6Range &out) {
+    size_t dash = spec.find('-');
+    if (dash != std::string_view::npos) {
+        return parse_ipv6(spec.substr(0, dash), out.start) && parse_ipv6(spec.substr(dash + 1), out.end) &&
+               out.start <= out.end;
+    }
+    size_t slash = spec.find('/');
+    if (slash == std::string_view::npos) {
+        if (!parse_ipv6(spec, out.start)) {
+            return false;
+        }
+        out.end = out.start;
+        return true;
+    }
+    std::string_view bits_text = spec.substr(slash + 1);
+    if (bits_text.empty() || bits_text.size() > 3 ||
+        bits_text.find_first_not_of("0123456789") != std::string_view::npos) {
+        return false;
+    }
+    int bits = std::atoi(std::string(bits_text).c_str());
+    Ipv6Addr addr;
+    if (bits > 128 || !parse_ipv6(spec.substr(0, slash), addr)) {
+        return false;
+    }
+    out.start = ipv6_network(addr, bits);
+    out.end = ipv6_broadcast(addr, bits);
+    return true;
+}
+
+double ipv6_range_size(const Ipv6Range &range) {
+    uint64_t lo = range.end.lo - range.start.lo;
+    uint64_t hi = range.end.hi - range.start.hi - (range.end.lo < range.start.lo ? 1 : 0);
+    return static_cast<double>(hi) * 18446744073709551616.0 + static_cast<double>(lo) + 1;
+}
+
+std::vector<std::pair<Ipv6Addr, int>> ipv6_range_prefixes(const Ipv6Range &range) {
+    std::vector<std::pair<Ipv6Addr, int>> prefixes;
+    Ipv6Addr cur = range.start;
+    for (;;) {
+        // Largest aligned block at cur that stays inside the range.
+        int bits = 0;
+        while (ipv6_network(cur, bits) != cur || ipv6_broadcast(cur, bits) > range.end) {
+            ++bits;
+        }
+        prefixes.emplace_back(cur, bits);
+        Ipv6Addr last = ipv6_broadcast(cur, bits);
+        if (last >= range.end) {
+            break;
+        }
+        cur = last.next();
+    }
+    return prefixes;
+}
+
+uint32_t Ipv6Trie::add_node(const Ipv6Addr &key, int bits) {
+    Node node;
+    node.key = key;
+    node.bits = static_cast<uint8_t>(bits);
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void Ipv6Trie::insert(const Ipv6Addr &prefix, int bits, uint32_t value) {
+    Ipv6Addr key = ipv6_network(prefix, bits);
+    uint32_t parent = kNone;
+    unsigned side = 0;
+    uint32_t idx = root_;
+    auto link = [&](uint32_t node) {
+        if (parent == kNone) {
+            root_ = node;
+        } else {
+            nodes_[parent].child[side] = node;
+        }
+    };
+    auto set_value = [&](uint32_t node) {
+        nodes_[node].has_value = true;
+        nodes_[node].value = value;
+    };
+    while (idx != kNone) {
+        const Node node = nodes_[idx];
+        int common = std::min({common_bits(node.key, key), static_cast<int>(node.bits), bits});
+        if (common == node.bits) {
+            if (node.bits == bits) {
+                set_value(idx);
+                return;
+            }
+            parent = idx;
+            side = ipv6_bit(key, node.bits);
+            idx = node.child[side];
+            continue;
+        }
+        if (common == bits) {
+            // The new prefix sits above this node.
+            uint32_t above = add_node(key, bits);
+            set_value(above);
+            nodes_[above].child[ipv6_bit(node.key, bits)] = idx;
+            link(above);
+            return;
+        }
+        uint32_t branch = add_node(ipv6_network(key, common), common);
+        uint32_t leaf = add_node(key, bits);
+        set_value(leaf);
+        nodes_[branch].child[ipv6_bit(node.key, common)] = idx;
+        nodes_[branch].child[ipv6_bit(key, common)] = leaf;
+        link(branch);
+        return;
+    }
+    uint32_t leaf = add_node(key, bits);
+    set_value(leaf);
+    link(leaf);
+}
+
+void Ipv6Trie::insert_range(const Ipv6Range &range, uint32_t value) {
+    for (const auto &prefix : ipv6_range_prefixes(range)) {
+        insert(prefix.first, prefix.second, value);
+    }
+}
+
+const uint32_t *Ipv6Trie::lookup(const Ipv6Addr &addr) const {
+    const uint32_t *best = nullptr;
+    uint32_t idx = root_;
+    while (idx != kNone) {
+        const Node &node = nodes_[idx];
+        if (common_bits(node.key, addr) < node.bits) {
+            break;
+        }
+        if (node.has_value) {
+            best = &node.value;
+        }
+        if (node.bits == 128) {
+            break;
+        }
+        idx = node.child[ipv6_bit(addr, node.bits)];
+    }
+    return best;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// IPv6 address as a 128-bit number in two host-order halves, so ranges of
+// them sort and merge like IPv4 ranges do.
+struct Ipv6Addr {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const Ipv6Addr &o) const { return hi == o.hi && lo == o.lo; }
+    bool operator!=(const Ipv6Addr &o) const { return !(*this == o); }
+    bool operator<(const Ipv6Addr &o) const { return hi < o.hi || (hi == o.hi && lo < o.lo); }
+    bool operator<=(const Ipv6Addr &o) const { return !(o < *this); }
+    bool operator>(const Ipv6Addr &o) const { return o < *this; }
+    bool operator>=(const Ipv6Addr &o) const { return !(*this < o); }
+
+    bool is_max() const { return hi == ~0ull && lo == ~0ull; }
+    // Wrap around at the ends of the address space.
+    Ipv6Addr next() const { return {lo == ~0ull ? hi + 1 : hi, lo + 1}; }
+    Ipv6Addr prev() const { return {lo == 0 ? hi - 1 : hi, lo - 1}; }
+};
+
+// RFC 4291 text forms, including "::" and a trailing dotted quad; no zone ids.
+bool parse_ipv6(std::string_view s, Ipv6Addr &out);
+// RFC 5952 canonical form.
+std::string format_ipv6(const Ipv6Addr &addr);
+
+// Bit i counted from the most significant end.
+inline unsigned ipv6_bit(const Ipv6Addr &a, int i) {
+    return static_cast<unsigned>(i < 64 ? a.hi >> (63 - i) & 1 : a.lo >> (127 - i) & 1);
+}
+// The first `bits` bits of a, rest zero.
+Ipv6Addr ipv6_network(const Ipv6Addr &a, int bits);
+// Set host bits of a `bits`-long prefix.
+Ipv6Addr ipv6_broadcast(const Ipv6Addr &a, int bits);
+
+// Inclusive range.
+struct Ipv6Range {
+    Ipv6Addr start;
+    Ipv6Addr end;
+};
+
+// "addr", "addr/n" or "addr-addr"; a CIDR with host bits set covers its whole network.
+bool parse_ipv6_spec(std::string_view spec, Ipv6Range &out);
+// Address count, as a double because a single /64 already holds 2^64.
+double ipv6_range_size(const Ipv6Range &range);
+// Shortest list of CIDR prefixes (network, length) covering the range exactly.
+std::vector<std::pair<Ipv6Addr, int>> ipv6_range_prefixes(const Ipv6Range &range);
+
+// Path-compressed binary (PATRICIA) trie over IPv6 prefixes, answering
+// longest-prefix matches in at most 128 bit tests. Nodes live in one vector
+// and link by index; a node exists only where prefixes branch or end, so n
+// prefixes take at most 2n nodes.
+class Ipv6Trie {
+public:
+    void insert(const Ipv6Addr &prefix, int bits, uint32_t value);
+    void insert_range(const Ipv6Range &range, uint32_t value);
+    // Value of the longest prefix containing addr, or nullptr.
+    const uint32_t *lookup(const Ipv6Addr &addr) const;
+    bool empty() const { return root_ == kNone; }
+
+private:
+    static constexpr uint32_t kNone = ~0u;
+
+    struct Node {
+        Ipv6Addr key;
+        uint8_t bits = 0;
+        bool has_value = false;
+        uint32_t value = 0;
+        uint32_t child[2] = {kNone, kNone};
+    };
+
+    uint32_t add_node(const Ipv6Addr &key, int bits);
+
+    std::vector<Node> nodes_;
+    uint32_t root_ = kNone;
+};
@@ -0,0 +1,92 @@
+/*
+ * C ABI over the 0xjam3z-scanner parsing core (libjam3z).
+ *
+ * Everything is batch oriented: callers hand over large buffers and get
+ * struct-of-arrays output back, so bindings such as python/jam3z.py can wrap
+ * the arrays with the buffer protocol instead of building objects per record.
+ * Functions never throw; failures return NULL/0 and set jam3z_last_error().
+ */
+#ifndef JAM3Z_CORE_H
+#define JAM3Z_CORE_H
+
+#include "jam3z_plugin.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JAM3Z_CORE_ABI_VERSION 2u
+
+#if defined(_WIN32)
+#if defined(JAM3Z_CORE_BUILD)
+#define JAM3Z_API __declspec(dllexport)
+#else
+#define JAM3Z_API __declspec(dllimport)
+#endif
+#else
+#define JAM3Z_API __attribute__((visibility("default")))
+#endif
+
+JAM3Z_API uint32_t jam3z_core_abi_version(void);
+/* Message for the last failure on the calling thread, "" when none. */
+JAM3Z_API const char *jam3z_last_error(void);
+
+/* Host-order IPv4 helpers. jam3z_format_ipv4 writes at most 16 bytes including the NUL. */
+JAM3Z_API int jam3z_parse_ipv4(const char *s, size_t len, uint32_t *out);
+JAM3Z_API size_t jam3z_format_ipv4(uint32_t ip, char *out);
+
+/*
+ * Parses masscan -oL lines from buf into up to `capacity` entries. Only `open`
+ * lines produce entries. Any output array may be NULL. Parsing stops at the
+ * last complete line unless `final` is non-zero. *consumed receives the bytes
+ * used, so the caller can carry the remainder into the next call.
+ * Returns the number of entries written.
+ */
+JAM3Z_API size_t jam3z_masscan_parse(const char *buf, size_t len, int final, uint32_t *ips, uint16_t *ports,
+                                     uint8_t *protos, uint32_t *timestamps, size_t capacity, size_t *consumed);
+
+/* zgrab2 JSON lines scanner. Records returned by jam3z_zgrab_next stay valid until the next call. */
+typedef struct jam3z_zgrab_scanner jam3z_zgrab_scanner;
+
+/* port 0 derives the port from each record's request URL. */
+JAM3Z_API jam3z_zgrab_scanner *jam3z_zgrab_open(const char *path, uint16_t port);
+/* The buffer is borrowed and must outlive the scanner. */
+JAM3Z_API jam3z_zgrab_scanner *jam3z_zgrab_open_buffer(const char *data, size_t len, uint16_t port);
+/* Fills *records with up to max_records records; returns 0 at end of input. */
+JAM3Z_API size_t jam3z_zgrab_next(jam3z_zgrab_scanner *scanner, size_t max_records, const jam3z_record **records);
+JAM3Z_API void jam3z_zgrab_close(jam3z_zgrab_scanner *scanner);
+
+/* Sets *title to the trimmed <title> text inside html (a view into html). Returns 1 when found. */
+JAM3Z_API int jam3z_find_title(const char *html, size_t len, jam3z_str *title);
+
+/* IP -> ASN index over the IPv4 and IPv6 ranges of country_asn.json. The lookups below take
+ * IPv4 addresses; jam3z_asn_index_size counts ranges of both families. */
+typedef struct jam3z_asn_index jam3z_asn_index;
+
+typedef struct jam3z_asn_info {
+    uint32_t start;
+    uint32_t end;
+    uint32_t asn;
+    jam3z_str country;
+    jam3z_str country_name;
+    jam3z_str as_name;
+} jam3z_asn_info;
+
+JAM3Z_API jam3z_asn_index *jam3z_asn_index_load(const char *path);
+JAM3Z_API jam3z_asn_index *jam3z_asn_index_load_buffer(const char *data, size_t len);
+JAM3Z_API size_t jam3z_asn_index_size(const jam3z_asn_index *index);
+/* Returns 1 and fills *info when ip falls in a known range. */
+JAM3Z_API int jam3z_asn_lookup(const jam3z_asn_index *index, uint32_t ip, jam3z_asn_info *info);
+/* Writes one ASN per ip (0 when unknown); returns the number of hits. */
+JAM3Z_API size_t jam3z_asn_lookup_batch(const jam3z_asn_index *index, const uint32_t *ips, size_t count,
+                                        uint32_t *asns);
+JAM3Z_API void jam3z_asn_index_free(jam3z_asn_index *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
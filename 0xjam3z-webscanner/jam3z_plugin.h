@@ -0,0 +1,95 @@
+/*
+ * Processor plugin ABI for 0xjam3z-scanner.
+ *
+ * A plugin is a shared library loaded with --plugin <path>[=<args>]. It exports
+ * jam3z_plugin_entry(), which returns a static descriptor. The scanner calls
+ * process_batch() from its parse workers with batches of parsed records. The
+ * record views point straight into the pipeline's buffers and are only valid
+ * for the duration of the call.
+ *
+ * Compatibility rules: structs only ever grow at the end, and abi_version is
+ * bumped when they do. A plugin built against version N runs on any scanner
+ * that reports a host abi_version >= N; its records array is laid out with the
+ * jam3z_record size of version N, so records[i] stays valid.
+ *
+ * Version 2 added jam3z_record.domain.
+ */
+#ifndef JAM3Z_PLUGIN_H
+#define JAM3Z_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JAM3Z_PLUGIN_ABI_VERSION 2u
+
+#if defined(_WIN32)
+#define JAM3Z_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define JAM3Z_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Not NUL-terminated. data is NULL when the value is absent. */
+typedef struct jam3z_str {
+    const char *data;
+    size_t len;
+} jam3z_str;
+
+typedef struct jam3z_header {
+    jam3z_str name;
+    jam3z_str value;
+} jam3z_header;
+
+typedef struct jam3z_record {
+    jam3z_str ip;
+    uint16_t port;
+    int32_t status_code; /* 0 when there was no HTTP response */
+    jam3z_str status;    /* zgrab2 module status, e.g. "success", "io-timeout" */
+    jam3z_str module;    /* zgrab2 module name */
+    const jam3z_header *headers;
+    size_t header_count;
+    jam3z_str body; /* decoded response body */
+    jam3z_str title;
+    jam3z_str domain; /* Host/SNI name the target was grabbed with; absent for a bare IP (ABI 2) */
+} jam3z_record;
+
+/* Opaque handle for the output side of one process_batch() call. */
+typedef struct jam3z_batch_output jam3z_batch_output;
+
+enum jam3z_log_level { JAM3Z_LOG_INFO = 0, JAM3Z_LOG_WARN = 1, JAM3Z_LOG_ERROR = 2 };
+
+typedef struct jam3z_host_api {
+    uint32_t abi_version;
+    /* Appends " - key: value" to the record's output line. Key and value are copied. */
+    void (*add_field)(jam3z_batch_output *out, size_t index, jam3z_str key, jam3z_str value);
+    /* Removes the record from the scanner's output. */
+    void (*drop_record)(jam3z_batch_output *out, size_t index);
+    void (*log)(int level, const char *message);
+} jam3z_host_api;
+
+/* process_batch() is called concurrently from several workers unless this flag is set. */
+#define JAM3Z_PLUGIN_SERIAL 0x1u
+
+typedef struct jam3z_plugin {
+    uint32_t abi_version;
+    uint32_t flags;
+    const char *name;
+    /* Returns the plugin state passed to the other callbacks, NULL on failure. */
+    void *(*create)(const jam3z_host_api *host, const char *args);
+    /* Returns 0 on success; non-zero is reported and the batch passes through unchanged. */
+    int (*process_batch)(void *state, const jam3z_record *records, size_t count, jam3z_batch_output *out);
+    void (*destroy)(void *state);
+} jam3z_plugin;
+
+typedef const jam3z_plugin *(*jam3z_plugin_entry_fn)(void);
+
+#define JAM3Z_PLUGIN_ENTRY_SYMBOL "jam3z_plugin_entry"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
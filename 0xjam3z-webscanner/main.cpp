@@ -1,13 +1,44 @@
+#include "asn_index.hpp"
+#include "common.hpp"
+#include "dedup.hpp"
+#include "dns.hpp"
+#include "filter.hpp"
+#include "parsers.hpp"
+#include "plan.hpp"
+#include "plugins.hpp"
+#include "retry.hpp"
+#include "spill.hpp"
+#include "sqlite_sink.hpp"
+#include "supervisor.hpp"
+#include "targets.hpp"
+#include "title_index.hpp"
+#include "tools.hpp"
+#include "udp_probe.hpp"
+#include "vhost.hpp"
+#include "work_pool.hpp"
+
 #include <algorithm>
-#include <cctype>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <optional>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -19,410 +50,1369 @@ struct Config {
     std::string list_file = "list";
     std::string output_file = "opendomains";
     bool no_download = false;
+    bool refresh_tools = false;
     bool list_mode = false;
     std::string country_filter;
+    bool parse_mode = false;
+    std::vector<std::string> parse_inputs;
+    std::string parse_out_dir = ".";
+    unsigned jobs = 0;
+    std::vector<std::string> plugins;
+    std::string sqlite_path;
+    // --where: records that do not match are dropped as early as their fields allow.
+    std::string where;
+    bool plan = false;
+    bool retry = true;
+    size_t dedup = 0;
+    std::vector<std::string> excludes;
+    std::vector<std::string> exclude_files;
+    std::vector<std::string> resolvers;
+    bool ptr = false;
+    bool vhosts = false;
+    bool fast_path = true;
+    // --tool-timeout: seconds a supervised zgrab2 run may take before it is
+    // killed and resumed; 0 for no limit.
+    double tool_timeout = 0;
+    // --grab masscan: take port 80 titles from masscan's own banners.
+    bool masscan_banners = false;
+    std::string hitlist;
+    // `index add|search <dir> ...`
+    std::string index_action;
+    std::string index_dir;
+    std::string scan_label;
+    size_t limit = 100;
+    uint64_t memory_limit = 0;
 };
 
-static std::string to_lower(std::string s) {
-    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
-    return s;
+// Records handed to processor plugins per call.
+static constexpr size_t kRecordBatch = 512;
+// zgrab2 output is split into chunks of about this many bytes for the pool, so a
+// task holds a few hundred small records or a handful of large bodies.
+static constexpr size_t kParseChunkBytes = 256 * 1024;
+// Hosts probed at once by --vhosts, one connection each.
+static constexpr size_t kVhostConnections = 256;
+static constexpr double kVhostTimeout = 10.0;
+// masscan's TCP stack for --banners answers from this port; the host's own
+// stack must be kept from resetting those connections (see README).
+static constexpr const char *kBannerSourcePort = "61000";
+// Scans of at most this many addresses are grabbed in-process (see run_fast_path).
+static constexpr uint64_t kFastPathHosts = 16;
+// Seconds the UDP prober listens on after its last probe.
+static constexpr double kUdpWait = 3.0;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-static std::string trim(const std::string &s) {
-    size_t start = 0;
-    while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) {
-        ++start;
-    }
-    size_t end = s.size();
-    while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
-        --end;
+// Hostname targets resolved to the names each address was reached by. An empty
+// name means the address was also listed literally and is grabbed bare as well.
+using HostNames = std::unordered_map<uint32_t, std::vector<std::string>>;
+
+// --hitlist: only the listed addresses that fall inside `targets` are kept.
+static bool apply_hitlist(const Config &cfg, TargetSet &targets) {
+    TargetSet hits;
+    uint64_t outside = 0;
+    if (!load_hitlist(cfg.hitlist, targets, hits, outside)) {
+        return false;
     }
-    return s.substr(start, end - start);
+    std::cout << "Hitlist: " << hits.size() << " IPv4 and " << hits.singles6().size()
+              << " IPv6 addresses in scope, " << outside << " outside" << std::endl;
+    targets = std::move(hits);
+    return true;
 }
 
-static std::vector<std::string> split_ws(const std::string &line) {
-    std::istringstream iss(line);
-    std::vector<std::string> tokens;
-    std::string token;
-    while (iss >> token) {
-        tokens.push_back(token);
+// Why AsnIndex::load() failed on `path`, for error messages.
+static std::string asn_load_failure(const fs::path &path) {
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        return "file not found";
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return std::string("cannot read it (") + std::strerror(errno) + ")";
     }
-    return tokens;
+    return "no start/end IP ranges in it (empty, or not country_asn.json)";
 }
 
-static bool is_ipv4(const std::string &ip) {
-    if (ip.find(':') != std::string::npos) {
-        return false;
-    }
-    std::istringstream iss(ip);
-    std::string part;
-    int parts = 0;
-    while (std::getline(iss, part, '.')) {
-        if (part.empty() || part.size() > 3) {
+// Targets as masscan will see them, after ASN filtering, --hitlist and
+// coalescing. Hostnames are left for the caller to resolve.
+static bool collect_targets(const Config &cfg, TargetSet &targets, std::vector<std::string> *hostnames = nullptr) {
+    fs::path input_path(cfg.input);
+    if (fs::exists(input_path) && input_path.extension() == ".json") {
+        AsnIndex index;
+        if (!index.load(input_path)) {
+            std::cerr << "Could not parse start/end IPs from " << input_path << std::endl;
             return false;
         }
-        for (char c : part) {
-            if (!std::isdigit(static_cast<unsigned char>(c))) {
-                return false;
+        std::string country = to_lower(cfg.country_filter);
+        auto wanted = [&](uint32_t country_name) {
+            return country.empty() || to_lower(std::string(index.str(country_name))) == country;
+        };
+        for (const auto &range : index.ranges()) {
+            if (wanted(range.country_name)) {
+                targets.add(range.start, range.end);
             }
         }
-        int value = std::stoi(part);
-        if (value < 0 || value > 255) {
-            return false;
+        // Announced IPv6 space is far too large to sweep; it only narrows a hitlist.
+        size_t ranges6 = 0;
+        for (const auto &range : index.ranges6()) {
+            if (wanted(range.country_name)) {
+                if (!cfg.hitlist.empty()) {
+                    targets.add6(range.range);
+                }
+                ++ranges6;
+            }
+        }
+        if (ranges6 && cfg.hitlist.empty()) {
+            std::cout << "Skipping " << ranges6 << " IPv6 ranges; pass --hitlist to scan known addresses in them."
+                      << std::endl;
         }
-        ++parts;
+        targets.coalesce();
+        return cfg.hitlist.empty() || apply_hitlist(cfg, targets);
     }
-    return parts == 4;
+    bool ok = cfg.list_mode ? load_target_file(input_path, targets, hostnames)
+                            : targets.add_line(cfg.input, hostnames);
+    targets.coalesce();
+    return ok && (cfg.hitlist.empty() || apply_hitlist(cfg, targets));
 }
 
-static std::string quote_path(const std::string &path) {
-#ifdef _WIN32
-    return "\"" + path + "\"";
-#else
-    return "'" + path + "'";
-#endif
+// --exclude/--exclude-file plus the broadcast address masscan is always told to skip.
+static bool collect_exclusions(const Config &cfg, TargetSet &excluded) {
+    excluded.add(0xffffffffu, 0xffffffffu);
+    for (const auto &spec : cfg.excludes) {
+        if (!excluded.add_line(spec)) {
+            return false;
+        }
+    }
+    for (const auto &file : cfg.exclude_files) {
+        if (!load_target_file(file, excluded)) {
+            return false;
+        }
+    }
+    excluded.coalesce();
+    return true;
 }
 
-static std::optional<std::string> find_in_path(const std::string &name) {
-    const char *path_env = std::getenv("PATH");
-    if (!path_env) {
-        return std::nullopt;
+// --resolver servers, or the system's when none are given.
+static bool dns_servers(const Config &cfg, std::vector<DnsServer> &servers) {
+    servers.clear();
+    for (const auto &spec : cfg.resolvers) {
+        DnsServer server;
+        if (!parse_dns_server(spec, server)) {
+            std::cerr << "Invalid --resolver: " << spec << std::endl;
+            return false;
+        }
+        servers.push_back(server);
     }
-#ifdef _WIN32
-    const char sep = ';';
-#else
-    const char sep = ':';
-#endif
-    std::string paths = path_env;
-    std::istringstream iss(paths);
-    std::string dir;
-    while (std::getline(iss, dir, sep)) {
-        if (dir.empty()) {
+    if (servers.empty()) {
+        servers = system_dns_servers();
+    }
+    if (servers.empty()) {
+        std::cerr << "No DNS resolvers configured; pass --resolver <ip[:port]>." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Resolves hostname targets and adds their addresses to `targets`, remembering
+// which names each address stands for so zgrab2 can send them as Host and SNI.
+static bool resolve_target_names(std::vector<std::string> names, const std::vector<DnsServer> &servers,
+                                 TargetSet &targets, HostNames &hosts) {
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    auto resolved = resolve_hostnames(names, servers);
+    size_t found = 0;
+    size_t addresses = 0;
+    for (const auto &name : names) {
+        auto it = resolved.find(name);
+        if (it == resolved.end() || it->second.empty()) {
+            std::cerr << "Could not resolve " << name << std::endl;
             continue;
         }
-        fs::path candidate = fs::path(dir) / name;
-        if (fs::exists(candidate)) {
-            return candidate.string();
+        ++found;
+        for (uint32_t ip : it->second) {
+            auto &entry = hosts[ip];
+            if (entry.empty() && targets.contains(ip)) {
+                entry.emplace_back();
+            }
+            entry.push_back(name);
+            ++addresses;
         }
     }
-    return std::nullopt;
+    for (const auto &entry : hosts) {
+        targets.add(entry.first, entry.first);
+    }
+    targets.coalesce();
+    std::cout << "Resolved " << found << " of " << names.size() << " hostnames to " << addresses
+              << " addresses" << std::endl;
+    return !targets.empty();
 }
 
-static bool run_command(const std::string &cmd) {
-    std::cout << "[cmd] " << cmd << std::endl;
-    int result = std::system(cmd.c_str());
-    return result == 0;
+// Newline-separated IPs to zgrab2 input lines, one "ip,name" line per hostname
+// an address was resolved from.
+static std::string with_host_names(std::string_view ips, const HostNames &hosts) {
+    std::string out;
+    out.reserve(ips.size());
+    size_t pos = 0;
+    while (pos < ips.size()) {
+        size_t end = ips.find('\n', pos);
+        if (end == std::string::npos) {
+            end = ips.size();
+        }
+        std::string_view line(ips.data() + pos, end - pos);
+        pos = end + 1;
+        uint32_t ip = 0;
+        auto it = parse_ipv4(line, ip) ? hosts.find(ip) : hosts.end();
+        if (it == hosts.end()) {
+            out.append(line.data(), line.size());
+            out += '\n';
+            continue;
+        }
+        for (const auto &name : it->second) {
+            out.append(line.data(), line.size());
+            if (!name.empty()) {
+                out += ',';
+                out += name;
+            }
+            out += '\n';
+        }
+    }
+    return out;
 }
 
-static std::optional<std::string> ensure_masscan(const fs::path &base_dir, bool no_download) {
-#ifdef _WIN32
-    std::string exe_name = "masscan.exe";
-#else
-    std::string exe_name = "masscan";
-#endif
-    if (auto found = find_in_path(exe_name)) {
-        return found;
+// Distinct addresses in newline-separated IP lists.
+static std::vector<uint32_t> distinct_ips(std::initializer_list<const SpillQueue *> lists) {
+    std::vector<uint32_t> ips;
+    for (const SpillQueue *list : lists) {
+        list->for_each_line([&](std::string_view line) {
+            uint32_t ip = 0;
+            if (parse_ipv4(line, ip)) {
+                ips.push_back(ip);
+            }
+        });
     }
+    std::sort(ips.begin(), ips.end());
+    ips.erase(std::unique(ips.begin(), ips.end()), ips.end());
+    return ips;
+}
 
-    fs::path local_bin = base_dir / "bin" / exe_name;
-    if (fs::exists(local_bin)) {
-        return local_bin.string();
+static bool build_list_from_asn_json(const Config &cfg, const fs::path &list_path, TargetSet &targets) {
+    if (!collect_targets(cfg, targets) || !write_target_list(list_path, targets)) {
+        return false;
     }
+    std::cout << "Wrote " << targets.ranges().size() << " IPv4 ranges";
+    if (targets.has_ipv6()) {
+        std::cout << " and " << targets.singles6().size() << " IPv6 addresses";
+    }
+    std::cout << " to " << list_path << std::endl;
+    return !targets.empty();
+}
 
-    if (no_download) {
-        std::cerr << "masscan not found and downloads disabled." << std::endl;
-        return std::nullopt;
+static bool write_single_input_list(const fs::path &list_path, const std::string &input) {
+    std::ofstream out(list_path);
+    if (!out) {
+        std::cerr << "Failed to write " << list_path << std::endl;
+        return false;
     }
+    out << input << "\n";
+    return true;
+}
 
-    fs::path third_party = base_dir / "third_party";
-    fs::path repo_dir = third_party / "masscan";
-    fs::create_directories(third_party);
+static bool wildcard_match(const std::string &pattern, const std::string &name) {
+    size_t p = 0;
+    size_t n = 0;
+    size_t star = std::string::npos;
+    size_t mark = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = n;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            n = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
 
-    if (!fs::exists(repo_dir)) {
-        if (!run_command("git clone https://github.com/robertdavidgraham/masscan.git " + quote_path(repo_dir.string()))) {
-            std::cerr << "Failed to clone masscan." << std::endl;
-            return std::nullopt;
+// Expands '*' and '?' in the file name component so quoted globs work the same
+// on every platform and month-sized archive sets do not hit the shell's ARG_MAX.
+static std::vector<fs::path> expand_input_globs(const std::vector<std::string> &inputs) {
+    std::vector<fs::path> files;
+    for (const auto &input : inputs) {
+        fs::path pattern(input);
+        std::string name = pattern.filename().string();
+        if (name.find_first_of("*?") == std::string::npos) {
+            files.push_back(pattern);
+            continue;
         }
+        fs::path dir = pattern.has_parent_path() ? pattern.parent_path() : fs::path(".");
+        std::vector<fs::path> matches;
+        std::error_code ec;
+        for (const auto &entry : fs::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file(ec) && wildcard_match(name, entry.path().filename().string())) {
+                matches.push_back(pattern.has_parent_path() ? entry.path() : entry.path().filename());
+            }
+        }
+        if (matches.empty()) {
+            std::cerr << "No files match " << input << std::endl;
+        }
+        std::sort(matches.begin(), matches.end());
+        files.insert(files.end(), matches.begin(), matches.end());
     }
+    return files;
+}
 
-#ifdef _WIN32
-    std::cerr << "masscan requires a Windows build toolchain. Build it in " << repo_dir << " and place the binary in "
-              << (base_dir / "bin") << "." << std::endl;
-    return std::nullopt;
-#else
-    if (!run_command("make -C " + quote_path(repo_dir.string()))) {
-        std::cerr << "Failed to build masscan." << std::endl;
-        return std::nullopt;
-    }
-    fs::create_directories(base_dir / "bin");
-    fs::path built = repo_dir / "bin" / "masscan";
-    if (!fs::exists(built)) {
-        std::cerr << "masscan build did not produce expected binary." << std::endl;
-        return std::nullopt;
-    }
-    fs::copy_file(built, local_bin, fs::copy_options::overwrite_existing);
-    return local_bin.string();
-#endif
+static bool is_zgrab_file(const fs::path &file) {
+    return file.extension() == ".json";
 }
 
-static std::optional<std::string> ensure_zgrab2(const fs::path &base_dir, bool no_download) {
-#ifdef _WIN32
-    std::string exe_name = "zgrab2.exe";
-#else
-    std::string exe_name = "zgrab2";
-#endif
-    if (auto found = find_in_path(exe_name)) {
-        return found;
+struct ParseJob {
+    fs::path file;
+    bool ok = false;
+    bool done = false;
+    SpillQueue titles;
+    SpillQueue ips_80;
+    SpillQueue ips_443;
+    MasscanCounts counts;
+};
+
+static ParseJob make_parse_job(const fs::path &file, MemoryBudget &budget) {
+    ParseJob job;
+    job.file = file;
+    job.titles = SpillQueue(&budget, "titles");
+    job.ips_80 = SpillQueue(&budget, "open_ips80");
+    job.ips_443 = SpillQueue(&budget, "open_ips443");
+    return job;
+}
+
+static void write_queue(std::ostream &out, const SpillQueue &queue) {
+    queue.for_each_chunk([&](std::string_view chunk) {
+        out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        return static_cast<bool>(out);
+    });
+}
+
+// Per-record stages that run on the parse workers after a zgrab2 batch is read.
+struct RecordPipeline {
+    PluginHost plugins;
+    SqliteSink sqlite;
+    // Set during a scan's first pass; retryable records wait here for the second.
+    RetryQueue *retry = nullptr;
+    // Set during the first dedup wave to learn which groups serve one response.
+    DedupPlanner *dedup = nullptr;
+    // Set with --vhosts to learn open endpoints, default pages and certificate names.
+    VhostQueue *vhosts = nullptr;
+    // --ptr results, added as a "ptr" field once the lookups are in.
+    const std::unordered_map<uint32_t, std::string> *ptr_names = nullptr;
+    RecordFilter where;
+    // Runs the CPU-heavy work: decoding zgrab2 output and process() itself.
+    WorkPool pool;
+
+    bool setup(const Config &cfg, const std::string &source) {
+        if (!cfg.where.empty() && !where.compile(cfg.where)) {
+            return false;
+        }
+        pool.start(cfg.jobs);
+        for (const auto &spec : cfg.plugins) {
+            if (!plugins.load(spec)) {
+                return false;
+            }
+        }
+        return cfg.sqlite_path.empty() || sqlite.open(cfg.sqlite_path, source);
     }
 
-    fs::path local_bin = base_dir / "bin" / exe_name;
-    if (fs::exists(local_bin)) {
-        return local_bin.string();
+    void process(std::vector<HttpRecord> &batch, std::string &out) {
+        if (dedup) {
+            dedup->observe(batch);
+        }
+        if (retry) {
+            retry->hold(batch);
+        }
+        if (vhosts) {
+            vhosts->observe(batch);
+        }
+        if (ptr_names) {
+            for (auto &rec : batch) {
+                uint32_t ip = 0;
+                if (parse_ipv4(rec.ip, ip)) {
+                    auto it = ptr_names->find(ip);
+                    if (it != ptr_names->end()) {
+                        rec.fields.emplace_back("ptr", it->second);
+                    }
+                }
+            }
+        }
+        if (!where.empty()) {
+            batch.erase(std::remove_if(batch.begin(), batch.end(),
+                                       [&](const HttpRecord &rec) { return !where.matches(rec); }),
+                        batch.end());
+        }
+        plugins.process(batch);
+        for (const auto &rec : batch) {
+            if (!rec.dropped) {
+                format_record(rec, out);
+            }
+        }
+        sqlite.submit(batch);
     }
 
-    if (no_download) {
-        std::cerr << "zgrab2 not found and downloads disabled." << std::endl;
-        return std::nullopt;
+    bool finish() { return sqlite.close(); }
+};
+
+// Batches handed to push() go through the pipeline on its pool; their output
+// reaches `out` in the order they were pushed.
+class PipelineWriter {
+public:
+    PipelineWriter(RecordPipeline &pipeline, std::ostream &out)
+        : pipeline_(pipeline), tasks_(pipeline.pool, [&out](std::string &text) { out << text; }) {}
+
+    // Moves the records out of `batch`.
+    void push(std::vector<HttpRecord> &batch) {
+        tasks_.submit([this, batch = std::move(batch)](std::string &text) mutable {
+            pipeline_.process(batch, text);
+        });
+        batch.clear();
     }
+    void finish() { tasks_.wait(); }
 
-    fs::path third_party = base_dir / "third_party";
-    fs::path repo_dir = third_party / "zgrab2";
-    fs::create_directories(third_party);
+private:
+    RecordPipeline &pipeline_;
+    OrderedTasks<std::string> tasks_;
+};
 
-    if (!fs::exists(repo_dir)) {
-        if (!run_command("git clone https://github.com/zmap/zgrab2.git " + quote_path(repo_dir.string()))) {
-            std::cerr << "Failed to clone zgrab2." << std::endl;
-            return std::nullopt;
-        }
+// Records produced in-process, through the pipeline in batches; moved from.
+static void write_records(RecordPipeline &pipeline, std::vector<HttpRecord> &records, std::ostream &out) {
+    PipelineWriter writer(pipeline, out);
+    for (size_t i = 0; i < records.size(); i += kRecordBatch) {
+        auto first = records.begin() + static_cast<std::ptrdiff_t>(i);
+        auto last = records.begin() + static_cast<std::ptrdiff_t>(std::min(records.size(), i + kRecordBatch));
+        std::vector<HttpRecord> batch(std::make_move_iterator(first), std::make_move_iterator(last));
+        writer.push(batch);
     }
+    writer.finish();
+}
 
-    fs::create_directories(base_dir / "bin");
-#ifdef _WIN32
-    std::string build_cmd = "cd /d " + quote_path(repo_dir.string()) + " && go build -o " + quote_path(local_bin.string()) + " ./cmd/zgrab2";
-#else
-    std::string build_cmd = "cd " + quote_path(repo_dir.string()) + " && go build -o " + quote_path(local_bin.string()) + " ./cmd/zgrab2";
-#endif
-    if (!run_command(build_cmd)) {
-        std::cerr << "Failed to build zgrab2. Ensure Go is installed." << std::endl;
-        return std::nullopt;
+// --where pushdown into masscan: drops the TCP ports of `spec` that rule out
+// every result whatever the address. False when none is left. Specs with
+// non-TCP entries are left alone.
+static bool where_port_spec(const RecordFilter &where, std::string &spec) {
+    std::vector<uint32_t> ports;
+    if (!parse_port_spec(spec, ports) ||
+        std::any_of(ports.begin(), ports.end(), [](uint32_t p) { return (p >> 16) != 0; })) {
+        return true;
     }
+    std::sort(ports.begin(), ports.end());
+    ports.erase(std::unique(ports.begin(), ports.end()), ports.end());
+    std::vector<uint32_t> kept;
+    for (uint32_t port : ports) {
+        if (where.may_match({}, static_cast<uint16_t>(port))) {
+            kept.push_back(port);
+        }
+    }
+    if (kept.size() == ports.size()) {
+        return true;
+    }
+    spec.clear();
+    for (size_t i = 0; i < kept.size();) {
+        size_t j = i;
+        while (j + 1 < kept.size() && kept[j + 1] == kept[j] + 1) {
+            ++j;
+        }
+        spec += (spec.empty() ? "" : ",") + std::to_string(kept[i]);
+        if (j > i) {
+            spec += "-" + std::to_string(kept[j]);
+        }
+        i = j + 1;
+    }
+    return !kept.empty();
+}
 
-    return local_bin.string();
+// --where pushdown for target lists: hands `fn` the lines of `ips` whose address
+// and port do not already rule out every result, and returns how many did.
+static uint64_t filter_targets(const RecordFilter &where, uint16_t port, const SpillQueue &ips,
+                               const std::function<void(std::string_view)> &fn) {
+    uint64_t dropped = 0;
+    std::string kept;
+    ips.for_each_line([&](std::string_view line) {
+        if (!where.may_match(line, port)) {
+            ++dropped;
+            return;
+        }
+        kept.append(line.data(), line.size());
+        kept += '\n';
+        if (kept.size() >= 64 * 1024) {
+            fn(kept);
+            kept.clear();
+        }
+    });
+    if (!kept.empty()) {
+        fn(kept);
+    }
+    return dropped;
 }
 
-static bool build_list_from_asn_json(const fs::path &json_path, const fs::path &list_path,
-                                     const std::string &country_filter) {
-    std::ifstream in(json_path);
+static void run_parse_job(ParseJob &job, RecordPipeline &pipeline) {
+    if (is_zgrab_file(job.file)) {
+        // This thread only reads and splits; the chunks are decoded and processed
+        // on the pool and their titles appended in file order.
+        uint16_t port = zgrab_port_from_filename(job.file);
+        TargetFilter keep = [&](std::string_view ip, uint16_t p) { return pipeline.where.may_match(ip, p); };
+        const TargetFilter *filter = pipeline.where.empty() ? nullptr : &keep;
+        OrderedTasks<std::string> tasks(pipeline.pool, [&](std::string &text) { job.titles.append(text); });
+        job.ok = for_each_line_chunk(job.file, kParseChunkBytes, [&](std::string &chunk) {
+            tasks.submit([&pipeline, port, filter, chunk = std::move(chunk)](std::string &text) {
+                std::vector<HttpRecord> batch;
+                parse_zgrab_chunk(chunk, port, batch, filter);
+                pipeline.process(batch, text);
+            });
+        });
+        tasks.wait();
+        return;
+    }
+    std::ifstream in(job.file);
     if (!in) {
-        std::cerr << "Failed to open " << json_path << std::endl;
-        return false;
+        std::cerr << "Failed to read " << job.file << std::endl;
+        return;
     }
+    SpillStream out_80(job.ips_80);
+    SpillStream out_443(job.ips_443);
+    job.counts = parse_masscan_stream(in, out_80, out_443);
+    out_80.flush();
+    out_443.flush();
+    job.ok = true;
+}
 
-    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    std::regex start_re("\\\"start_ip\\\"\\s*:\\s*\\\"([^\\\"]+)\\\"");
-    std::regex end_re("\\\"end_ip\\\"\\s*:\\s*\\\"([^\\\"]+)\\\"");
-    std::regex country_re("\\\"country_name\\\"\\s*:\\s*\\\"([^\\\"]+)\\\"");
+// Reads the jobs on up to one thread per pool worker and hands each finished job
+// to `sink` in input order, releasing its buffers afterwards. A reader starts a
+// job only while fewer than two per reader are finished or in progress ahead of
+// the sink, so memory tracks that window rather than the whole input. Returns
+// the pool's worker count.
+static unsigned run_parse_jobs(std::vector<ParseJob> &jobs, RecordPipeline &pipeline,
+                               const std::function<void(ParseJob &)> &sink) {
+    if (jobs.empty()) {
+        return 0;
+    }
+    unsigned threads = std::max(1u, std::min<unsigned>(pipeline.pool.size(), static_cast<unsigned>(jobs.size())));
 
-    std::vector<std::string> starts;
-    std::vector<std::string> ends;
-    std::vector<std::string> countries;
+    std::mutex mutex;
+    std::atomic<size_t> next{0};
+    size_t sunk = 0;
+    size_t window = 2 * static_cast<size_t>(threads);
+    std::vector<std::thread> readers;
+    readers.reserve(threads);
+    for (unsigned r = 0; r < threads; ++r) {
+        readers.emplace_back([&] {
+            for (size_t i = next++; i < jobs.size(); i = next++) {
+                // The job the sink waits for is always inside the window.
+                pipeline.pool.wait_until([&] {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return i < sunk + window;
+                });
+                run_parse_job(jobs[i], pipeline);
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs[i].done = true;
+            }
+        });
+    }
 
-    for (auto it = std::sregex_iterator(content.begin(), content.end(), start_re); it != std::sregex_iterator(); ++it) {
-        starts.push_back((*it)[1].str());
+    for (auto &job : jobs) {
+        // Waiting here helps with the pool rather than blocking.
+        pipeline.pool.wait_until([&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return job.done;
+        });
+        sink(job);
+        job.titles.clear();
+        job.ips_80.clear();
+        job.ips_443.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        ++sunk;
     }
-    for (auto it = std::sregex_iterator(content.begin(), content.end(), end_re); it != std::sregex_iterator(); ++it) {
-        ends.push_back((*it)[1].str());
+    for (auto &t : readers) {
+        t.join();
     }
-    for (auto it = std::sregex_iterator(content.begin(), content.end(), country_re); it != std::sregex_iterator(); ++it) {
-        countries.push_back((*it)[1].str());
+    return std::max(1u, pipeline.pool.size());
+}
+
+// Offline reprocessing: parses existing masscan/zgrab2 output on every core and
+// writes the results in input order. No tool resolution, no directory setup.
+static int run_parse_mode(const Config &cfg) {
+    std::vector<fs::path> files = expand_input_globs(cfg.parse_inputs);
+    if (files.empty()) {
+        std::cerr << "No input files to parse." << std::endl;
+        return 1;
     }
 
-    if (starts.empty() || ends.empty() || starts.size() != ends.size()) {
-        std::cerr << "Could not parse start/end IPs from " << json_path << std::endl;
-        return false;
+    MemoryBudget budget(cfg.memory_limit, fs::path(cfg.parse_out_dir) / ".jam3z-spill");
+    std::vector<ParseJob> jobs;
+    jobs.reserve(files.size());
+    bool any_zgrab = false;
+    bool any_masscan = false;
+    for (size_t i = 0; i < files.size(); ++i) {
+        jobs.push_back(make_parse_job(files[i], budget));
+        if (is_zgrab_file(files[i])) {
+            any_zgrab = true;
+        } else {
+            any_masscan = true;
+        }
     }
 
-    std::ofstream out(list_path);
-    if (!out) {
-        std::cerr << "Failed to write " << list_path << std::endl;
-        return false;
+    RecordPipeline pipeline;
+    if (!pipeline.setup(cfg, "parse")) {
+        return 1;
+    }
+    if (pipeline.where.needs_asn()) {
+        std::cerr << "--where on asn, country or org needs a country_asn.json scan input." << std::endl;
+        return 1;
+    }
+
+    std::ofstream titles_out;
+    if (any_zgrab) {
+        titles_out.open(cfg.output_file);
+        if (!titles_out) {
+            std::cerr << "Failed to open output file: " << cfg.output_file << std::endl;
+            return 1;
+        }
+    }
+    std::ofstream out_80;
+    std::ofstream out_443;
+    if (any_masscan) {
+        fs::path out_dir(cfg.parse_out_dir);
+        out_80.open(out_dir / "open_ips80.txt");
+        out_443.open(out_dir / "open_ips443.txt");
+        if (!out_80 || !out_443) {
+            std::cerr << "Failed to open output IP files." << std::endl;
+            return 1;
+        }
+    }
+
+    MasscanCounts totals;
+    size_t failed = 0;
+    unsigned workers = run_parse_jobs(jobs, pipeline, [&](ParseJob &job) {
+        if (!job.ok) {
+            ++failed;
+            return;
+        }
+        write_queue(titles_out, job.titles);
+        if (pipeline.where.empty()) {
+            write_queue(out_80, job.ips_80);
+            write_queue(out_443, job.ips_443);
+        } else {
+            auto to = [](std::ofstream &out) {
+                return [&out](std::string_view chunk) {
+                    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                };
+            };
+            filter_targets(pipeline.where, 80, job.ips_80, to(out_80));
+            filter_targets(pipeline.where, 443, job.ips_443, to(out_443));
+        }
+        totals.port_80 += job.counts.port_80;
+        totals.port_443 += job.counts.port_443;
+    });
+
+    std::cout << "Parsed " << (jobs.size() - failed) << " of " << jobs.size() << " files with " << workers
+              << " workers" << std::endl;
+    if (any_masscan) {
+        std::cout << "Open port 80 IPs: " << totals.port_80 << std::endl;
+        std::cout << "Open port 443 IPs: " << totals.port_443 << std::endl;
     }
+    if (!pipeline.finish()) {
+        ++failed;
+    }
+    return failed == 0 ? 0 : 1;
+}
 
-    size_t count = 0;
-    for (size_t i = 0; i < starts.size(); ++i) {
-        if (!country_filter.empty()) {
-            if (i >= countries.size()) {
-                continue;
+// `index add`: one new segment holding every input file, each file a scan
+// unless --scan names them all. `index search`: substring query over every
+// segment.
+static int run_index_mode(const Config &cfg) {
+    fs::path dir(cfg.index_dir);
+    if (cfg.index_action == "add") {
+        std::vector<fs::path> files = expand_input_globs(cfg.parse_inputs);
+        if (files.empty()) {
+            std::cerr << "No input files to index." << std::endl;
+            return 1;
+        }
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        auto start = std::chrono::steady_clock::now();
+        TitleIndexWriter writer;
+        WorkPool pool;
+        pool.start(cfg.jobs);
+        uint16_t scan = 0;
+        if (!cfg.scan_label.empty()) {
+            scan = writer.add_scan(cfg.scan_label);
+        }
+        for (const auto &file : files) {
+            if (cfg.scan_label.empty()) {
+                scan = writer.add_scan(file.string());
             }
-            if (to_lower(countries[i]) != to_lower(country_filter)) {
-                continue;
+            if (!writer.add_file(file, scan, &pool)) {
+                return 1;
             }
         }
-        if (is_ipv4(starts[i]) && is_ipv4(ends[i])) {
-            out << starts[i] << "-" << ends[i] << "\n";
-            ++count;
+        fs::path segment = next_title_index_segment(dir);
+        if (!writer.write(segment)) {
+            return 1;
         }
+        std::cout << "Indexed " << writer.entries() << " entries (" << writer.texts() << " distinct texts) from "
+                  << files.size() << " files into " << segment << " in " << seconds_since(start) << "s"
+                  << std::endl;
+        return 0;
     }
 
-    std::cout << "Wrote " << count << " IPv4 ranges to " << list_path << std::endl;
-    return count > 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<fs::path> files = title_index_segments(dir);
+    if (files.empty()) {
+        std::cerr << "No index segments in " << dir << std::endl;
+        return 1;
+    }
+    std::vector<TitleMatch> matches;
+    size_t segments = 0;
+    for (const auto &file : files) {
+        TitleIndexSegment segment;
+        if (!segment.open(file)) {
+            return 1;
+        }
+        ++segments;
+        segment.search(cfg.input, cfg.limit, matches);
+        if (matches.size() >= cfg.limit) {
+            break;
+        }
+    }
+    double seconds = seconds_since(start);
+    std::string text;
+    for (const auto &match : matches) {
+        text = "IP: " + match.ip;
+        if (match.port) {
+            text += " - Port: " + std::to_string(match.port);
+        }
+        text += " - Scan: " + match.scan;
+        text += match.kind == IndexedKind::Title ? " - Title: " : " - ";
+        text += match.text;
+        std::cout << text << "\n";
+    }
+    std::cerr << matches.size() << (matches.size() >= cfg.limit ? "+" : "") << " matches from " << segments
+              << " segments in " << seconds * 1000 << " ms" << std::endl;
+    return 0;
 }
 
-static bool write_single_input_list(const fs::path &list_path, const std::string &input) {
-    std::ofstream out(list_path);
-    if (!out) {
-        std::cerr << "Failed to write " << list_path << std::endl;
+// Sends a supervised child's stdout lines to `file`, which stays open until the
+// job is destroyed.
+static bool output_to_file(ChildJob &job, const fs::path &file) {
+    auto out = std::make_shared<std::ofstream>(file, std::ios::binary);
+    if (!*out) {
+        std::cerr << "Failed to open " << file << std::endl;
         return false;
     }
-    out << input << "\n";
+    job.output = [out](std::string_view line) {
+        out->write(line.data(), static_cast<std::streamsize>(line.size()));
+        out->put('\n');
+    };
     return true;
 }
 
-static bool parse_masscan_results(const fs::path &masscan_file, const fs::path &out80, const fs::path &out443) {
-    std::ifstream in(masscan_file);
-    if (!in) {
-        std::cerr << "Failed to read " << masscan_file << std::endl;
-        return false;
+// One zgrab2 http run. Targets go over stdin when the build reads them from
+// there, and a run that crashes is then resumed with the targets it had not
+// answered; otherwise they go through target_file. `size` is the target bytes,
+// for the log; `timeout` the seconds allowed per attempt, 0 for no limit.
+static bool zgrab_http_job(const ToolInfo &zgrab2, const std::string &port, uint64_t size, const InputSource &targets,
+                           const fs::path &target_file, const fs::path &output, const std::vector<std::string> &flags,
+                           double timeout, ChildJob &job) {
+    job.argv = {zgrab2.path, "http", "--port", port};
+    job.argv.insert(job.argv.end(), flags.begin(), flags.end());
+    job.argv.insert(job.argv.end(), {"--max-redirects", "0"});
+    job.timeout = timeout;
+    if (zgrab2.has("stdin")) {
+        job.input = targets;
+        job.input_size = size;
+        job.answers = [](std::string_view line) { return zgrab_answered_input(line, false); };
+        return output_to_file(job, output);
     }
+    {
+        std::ofstream list(target_file);
+        targets([&](std::string_view chunk) {
+            list.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            return static_cast<bool>(list);
+        });
+        if (!list) {
+            std::cerr << "Failed to write " << target_file << std::endl;
+            return false;
+        }
+    }
+    job.argv.insert(job.argv.end(), {"--input-file", target_file.string()});
+    return output_to_file(job, output);
+}
 
-    std::ofstream out_80(out80);
-    std::ofstream out_443(out443);
-    if (!out_80 || !out_443) {
-        std::cerr << "Failed to open output IP files." << std::endl;
-        return false;
+// Input for one port of a multiple-module zgrab2 run.
+struct ZgrabPortInput {
+    uint16_t port = 0;
+    uint64_t size = 0;
+    InputSource lines;
+};
+
+// zgrab2 input lines ("ip" or "ip,name") with the port as trigger tag, which
+// routes each line to the module section that grabs that port.
+static std::string with_trigger(std::string_view lines, const std::string &tag) {
+    std::string out;
+    out.reserve(lines.size() + lines.size() / 4);
+    size_t pos = 0;
+    while (pos < lines.size()) {
+        size_t end = lines.find('\n', pos);
+        if (end == std::string::npos) {
+            end = lines.size();
+        }
+        std::string_view line(lines.data() + pos, end - pos);
+        pos = end + 1;
+        if (line.empty()) {
+            continue;
+        }
+        out.append(line.data(), line.size());
+        out += line.find(',') == std::string_view::npos ? ",," : ",";
+        out += tag;
+        out += '\n';
     }
+    return out;
+}
 
-    std::string line;
-    size_t count_80 = 0;
-    size_t count_443 = 0;
-    while (std::getline(in, line)) {
-        auto tokens = split_ws(line);
-        if (tokens.size() >= 4 && tokens[0] == "open" && tokens[1] == "tcp") {
-            const std::string &port = tokens[2];
-            const std::string &ip = tokens[3];
-            if (port == "80") {
-                out_80 << ip << "\n";
-                ++count_80;
-            } else if (port == "443") {
-                out_443 << ip << "\n";
-                ++count_443;
+// One zgrab2 process for every port: a generated "multiple" config holds an
+// http section per port, named http<port> and triggered by the port tag, and
+// the tagged targets of all ports are streamed through the same stdin. The
+// output mixes ports; parse it with port 0 so records take it from the module
+// name. `flags_timeout` and `senders` are left to zgrab2 when empty or 0.
+static bool zgrab_multiple_job(const ToolInfo &zgrab2, std::vector<ZgrabPortInput> inputs, const fs::path &ini,
+                               const fs::path &output, const std::string &flags_timeout, unsigned senders,
+                               double timeout, ChildJob &job) {
+    {
+        std::ofstream config(ini);
+        config << "[Application Options]\n";
+        config << "input-file=\"-\"\n";
+        if (senders) {
+            config << "senders=" << senders << "\n";
+        }
+        for (const auto &input : inputs) {
+            std::string port = std::to_string(input.port);
+            config << "\n[http]\n";
+            config << "name=\"http" << port << "\"\n";
+            config << "port=" << port << "\n";
+            config << "trigger=\"" << port << "\"\n";
+            config << "max-redirects=0\n";
+            if (input.port == 443) {
+                config << "use-https=true\n";
+            }
+            if (!flags_timeout.empty()) {
+                config << "timeout=" << flags_timeout << "\n";
             }
         }
+        if (!config) {
+            std::cerr << "Failed to write " << ini << std::endl;
+            return false;
+        }
+    }
+    job.argv = {zgrab2.path, "multiple", "-c", ini.string()};
+    job.timeout = timeout;
+    job.input_size = 0;
+    for (const auto &input : inputs) {
+        job.input_size += input.size;
     }
+    job.input = [inputs = std::move(inputs)](const std::function<bool(std::string_view)> &write) {
+        for (const auto &input : inputs) {
+            std::string tag = std::to_string(input.port);
+            if (!input.lines([&](std::string_view chunk) { return write(with_trigger(chunk, tag)); })) {
+                return false;
+            }
+        }
+        return true;
+    };
+    job.answers = [](std::string_view line) { return zgrab_answered_input(line, true); };
+    return output_to_file(job, output);
+}
 
-    std::cout << "Open port 80 IPs: " << count_80 << std::endl;
-    std::cout << "Open port 443 IPs: " << count_443 << std::endl;
-    return true;
+// Whether one multiple-module process can stand in for the per-port runs.
+static bool zgrab_multiple_usable(const ToolInfo &zgrab2) {
+    return zgrab2.has("multiple") && zgrab2.has("stdin");
 }
 
-static std::string unescape_json_string(const std::string &s) {
-    std::string out;
-    out.reserve(s.size());
-    for (size_t i = 0; i < s.size(); ++i) {
-        char c = s[i];
-        if (c != '\\' || i + 1 >= s.size()) {
-            out.push_back(c);
-            continue;
+// Second pass over the records the first pass held back: a fresh zgrab2 run per
+// port with a timeout derived from connect RTTs to responsive hosts and far fewer
+// senders. Recovered results replace the first-pass ones; the rest are written
+// as they were.
+static void run_retry_pass(const ToolInfo &zgrab2, const fs::path &base_dir, double tool_timeout,
+                           RetryQueue &queue, RecordPipeline &pipeline, std::ostream &out) {
+    std::vector<HttpRecord> held = queue.take_held();
+    if (held.empty()) {
+        return;
+    }
+    auto key = [](const HttpRecord &rec) { return rec.ip + ":" + std::to_string(rec.port) + "/" + rec.domain; };
+    std::map<uint16_t, std::string> targets;
+    std::unordered_set<std::string> queued;
+    for (const auto &rec : held) {
+        if (queued.insert(key(rec)).second) {
+            targets[rec.port] += rec.domain.empty() ? rec.ip + "\n" : rec.ip + "," + rec.domain + "\n";
         }
-        char n = s[++i];
-        switch (n) {
-            case '\\': out.push_back('\\'); break;
-            case '"': out.push_back('"'); break;
-            case '/': out.push_back('/'); break;
-            case 'b': out.push_back('\b'); break;
-            case 'f': out.push_back('\f'); break;
-            case 'n': out.push_back('\n'); break;
-            case 'r': out.push_back('\r'); break;
-            case 't': out.push_back('\t'); break;
-            case 'u': {
-                if (i + 4 < s.size()) {
-                    std::string hex = s.substr(i + 1, 4);
-                    unsigned int code = 0;
-                    std::istringstream iss(hex);
-                    iss >> std::hex >> code;
-                    if (code <= 0x7F) {
-                        out.push_back(static_cast<char>(code));
-                    } else {
-                        out.push_back('?');
-                    }
-                    i += 4;
-                }
-                break;
+    }
+
+    RetryPolicy policy = plan_retry(sample_connect_rtts(queue.responsive(), 64, 3.0), queued.size());
+    std::cout << "Retrying " << queued.size() << " targets with --timeout " << policy.timeout_seconds
+              << "s --senders " << policy.senders;
+    if (policy.rtt_p99 > 0) {
+        char rtt[64];
+        std::snprintf(rtt, sizeof(rtt), " (connect RTT p50 %.1f ms, p99 %.1f ms)", policy.rtt_p50 * 1000,
+                      policy.rtt_p99 * 1000);
+        std::cout << rtt;
+    }
+    std::cout << std::endl;
+
+    std::unordered_map<std::string, HttpRecord> recovered;
+    auto keep = [&](std::vector<HttpRecord> &batch) {
+        for (auto &rec : batch) {
+            if (!is_retryable(rec)) {
+                std::string k = key(rec);
+                recovered.emplace(std::move(k), std::move(rec));
+            }
+        }
+    };
+    std::string flags_timeout = std::to_string(policy.timeout_seconds) + "s";
+    std::vector<std::string> flags = {"--timeout", flags_timeout, "--senders", std::to_string(policy.senders)};
+    auto lines_of = [](const std::string &lines) -> InputSource {
+        return [&lines](const std::function<bool(std::string_view)> &write) { return write(lines); };
+    };
+    std::vector<ChildJob> grabs;
+    std::vector<std::pair<fs::path, uint16_t>> outputs;
+    if (zgrab_multiple_usable(zgrab2) && targets.size() > 1) {
+        std::vector<ZgrabPortInput> inputs;
+        for (const auto &entry : targets) {
+            inputs.push_back({entry.first, entry.second.size(), lines_of(entry.second)});
+        }
+        ChildJob job;
+        fs::path output = base_dir / "zgrab_retry_all.json";
+        if (zgrab_multiple_job(zgrab2, std::move(inputs), base_dir / "zgrab_retry.ini", output, flags_timeout,
+                               policy.senders, tool_timeout, job)) {
+            grabs.push_back(std::move(job));
+            outputs.emplace_back(output, 0);
+        }
+    } else {
+        for (const auto &entry : targets) {
+            std::string port = std::to_string(entry.first);
+            ChildJob job;
+            fs::path output = base_dir / ("zgrab_retry_" + port + ".json");
+            if (zgrab_http_job(zgrab2, port, entry.second.size(), lines_of(entry.second),
+                               base_dir / ("retry_ips" + port + ".txt"), output, flags, tool_timeout, job)) {
+                grabs.push_back(std::move(job));
+                outputs.emplace_back(output, entry.first);
             }
-            default:
-                out.push_back(n);
-                break;
         }
     }
-    return out;
+    if (!run_children(grabs)) {
+        std::cerr << "zgrab2 retry failed; keeping what it returned." << std::endl;
+    }
+    grabs.clear();
+    for (const auto &output : outputs) {
+        for_each_zgrab_batch(output.first, output.second, kRecordBatch, keep);
+    }
+
+    size_t hits = 0;
+    for (auto &rec : held) {
+        auto it = recovered.find(key(rec));
+        if (it != recovered.end()) {
+            rec = std::move(it->second);
+            recovered.erase(it);
+            ++hits;
+        }
+    }
+    write_records(pipeline, held, out);
+    std::cout << "Recovered " << hits << " of " << queued.size() << " targets" << std::endl;
 }
 
-static std::optional<std::string> extract_json_string_value(const std::string &line, const std::string &key) {
-    std::regex re(key + "\\s*:\\s*\\\"((?:[^\\\\\\\"]|\\\\.)*)\\\"");
-    std::smatch match;
-    if (std::regex_search(line, match, re)) {
-        return unescape_json_string(match[1].str());
+// Requests every name known for an open endpoint (input hostnames, PTR, SANs of
+// the certificates it presented) that zgrab2 has not already grabbed there.
+static void run_vhost_pass(VhostQueue &queue, RecordPipeline &pipeline, std::ostream &out) {
+    std::vector<VhostGroup> groups = queue.take_groups();
+    if (groups.empty()) {
+        return;
     }
-    return std::nullopt;
+    size_t names = 0;
+    for (const auto &group : groups) {
+        names += group.names.size();
+    }
+    std::cout << "Probing " << names << " virtual hosts on " << groups.size() << " endpoints" << std::endl;
+    // Off the event loop thread, so decoding and plugins do not hold up the probes.
+    PipelineWriter writer(pipeline, out);
+    auto sink = [&](std::vector<HttpRecord> &batch) { writer.push(batch); };
+    VhostStats stats = probe_vhosts(std::move(groups), kVhostConnections, kVhostTimeout, kRecordBatch, sink);
+    writer.finish();
+    std::cout << "Vhosts: " << stats.requests << " requests over " << stats.connections << " connections, "
+              << stats.same_as_default << " same as the default page, " << stats.duplicates << " aliases, "
+              << stats.failed << " failed" << std::endl;
 }
 
-static std::string extract_title(const std::string &html) {
-    std::string lower = to_lower(html);
-    size_t start = lower.find("<title");
-    if (start == std::string::npos) {
-        return "No title found";
+// Moves the U: entries of a --ports value into `udp`, leaving the rest for
+// masscan. False, with the reason on stderr, for a UDP port without a probe.
+static bool split_udp_ports(std::string &spec, std::vector<uint16_t> &udp) {
+    std::string rest;
+    std::string udp_spec;
+    std::string spaced = spec;
+    std::replace(spaced.begin(), spaced.end(), ',', ' ');
+    for (const auto &item : split_ws(spaced)) {
+        bool is_udp = item.size() > 2 && (item[0] == 'U' || item[0] == 'u') && item[1] == ':';
+        std::string &into = is_udp ? udp_spec : rest;
+        into += (into.empty() ? "" : ",") + item;
     }
-    size_t gt = lower.find('>', start);
-    if (gt == std::string::npos) {
-        return "No title found";
+    spec = rest;
+    if (udp_spec.empty()) {
+        return true;
     }
-    size_t end = lower.find("</title>", gt);
-    if (end == std::string::npos || end <= gt) {
-        return "No title found";
+    std::vector<uint32_t> ports;
+    if (!parse_port_spec(udp_spec, ports)) {
+        std::cerr << "Invalid --ports: " << udp_spec << std::endl;
+        return false;
     }
-    std::string title = html.substr(gt + 1, end - gt - 1);
-    title = trim(title);
-    if (title.empty()) {
-        return "No title found";
+    for (uint32_t entry : ports) {
+        uint16_t port = static_cast<uint16_t>(entry);
+        if (!udp_service(port)) {
+            std::cerr << "No UDP probe for port " << port << "; UDP ports with one: " << udp_service_list()
+                      << std::endl;
+            return false;
+        }
+        udp.push_back(port);
     }
-    return title;
+    return true;
 }
 
-static bool parse_zgrab_titles(const fs::path &zgrab_file, std::ofstream &out) {
-    std::ifstream in(zgrab_file);
-    if (!in) {
-        std::cerr << "Failed to read " << zgrab_file << std::endl;
-        return false;
+// The U: ports of --ports, probed in-process once the TCP stages are done.
+static void run_udp_pass(const Config &cfg, TargetSet targets, const std::vector<uint16_t> &ports,
+                         RecordPipeline &pipeline, std::ostream &out) {
+    TargetSet excluded;
+    if (collect_exclusions(cfg, excluded)) {
+        targets.subtract(excluded);
+    }
+    if (targets.has_ipv6()) {
+        std::cout << "UDP probing covers IPv4 targets only; skipping the IPv6 ones." << std::endl;
+    }
+    if (targets.ranges().empty()) {
+        return;
+    }
+    std::cout << "Probing " << ports.size() << " UDP ports on " << targets.size() << " hosts" << std::endl;
+    std::function<bool(uint32_t, uint16_t)> want;
+    if (!pipeline.where.empty()) {
+        want = [&](uint32_t ip, uint16_t port) { return pipeline.where.may_match(format_ipv4(ip), port); };
     }
+    PipelineWriter writer(pipeline, out);
+    auto sink = [&](std::vector<HttpRecord> &batch) { writer.push(batch); };
+    UdpScanStats stats =
+        probe_udp(targets, ports, std::strtod(cfg.rate.c_str(), nullptr), kUdpWait, kRecordBatch, want, sink);
+    writer.finish();
+    std::cout << "UDP: " << stats.probes << " probes, " << stats.services << " services answered, "
+              << stats.unmatched << " unmatched replies, " << stats.failed << " failed sends" << std::endl;
+}
 
-    std::string line;
-    while (std::getline(in, line)) {
-        auto ip = extract_json_string_value(line, "\\\"ip\\\"");
-        auto body = extract_json_string_value(line, "\\\"body\\\"");
-        if (!ip) {
-            continue;
+// Endpoints for the in-process fast path, or false when the scan needs
+// masscan and zgrab2: too many addresses, IPv6, --dedup, or a port the
+// native client cannot grab. Only 80 and 443 are grabbed either way.
+static bool fast_path_groups(const Config &cfg, TargetSet targets, const HostNames &hosts,
+                             std::vector<VhostGroup> &groups) {
+#ifdef _WIN32
+    return false;
+#else
+    if (!cfg.fast_path || cfg.dedup > 0 || targets.has_ipv6()) {
+        return false;
+    }
+    TargetSet excluded;
+    std::vector<uint32_t> ports;
+    if (!collect_exclusions(cfg, excluded) || !parse_port_spec(cfg.ports, ports)) {
+        return false;
+    }
+    targets.subtract(excluded);
+    if (targets.empty() || targets.size() > kFastPathHosts) {
+        return false;
+    }
+    bool port_80 = std::find(ports.begin(), ports.end(), 80u) != ports.end();
+    bool port_443 = std::find(ports.begin(), ports.end(), 443u) != ports.end();
+    if (!port_80 && !port_443) {
+        return false;
+    }
+    if (port_443 && !native_tls_supported()) {
+        return false;
+    }
+    std::vector<uint32_t> ips;
+    for (const auto &range : targets.ranges()) {
+        for (uint64_t ip = range.start; ip <= range.end; ++ip) {
+            ips.push_back(static_cast<uint32_t>(ip));
         }
-        if (!body) {
-            out << "IP: " << *ip << " - No response body found" << "\n";
+    }
+    for (uint16_t port : {80, 443}) {
+        if ((port == 80 && !port_80) || (port == 443 && !port_443)) {
             continue;
         }
-        std::string title = extract_title(*body);
-        out << "IP: " << *ip << " - Title: " << title << "\n";
+        for (uint32_t ip : ips) {
+            VhostGroup group;
+            group.ip = ip;
+            group.port = port;
+            group.tls = port == 443;
+            auto it = hosts.find(ip);
+            group.names = it == hosts.end() ? std::vector<std::string>{""} : it->second;
+            std::sort(group.names.begin(), group.names.end());
+            groups.push_back(std::move(group));
+        }
     }
-
     return true;
+#endif
+}
+
+// Small scans skip masscan and zgrab2: each endpoint is connected to and, if
+// it answers, grabbed right away by the native HTTP client, with no temp
+// files or child processes. Results go through the same pipeline.
+static int run_fast_path(const Config &cfg, std::vector<VhostGroup> groups, const HostNames &hosts,
+                         const std::vector<DnsServer> &resolvers, RecordPipeline &pipeline, const TargetSet &targets,
+                         const std::vector<uint16_t> &udp_ports) {
+    std::ofstream out(cfg.output_file);
+    if (!out) {
+        std::cerr << "Failed to open output file: " << cfg.output_file << std::endl;
+        return 1;
+    }
+    std::vector<uint32_t> ips;
+    for (const auto &group : groups) {
+        ips.push_back(group.ip);
+    }
+    std::sort(ips.begin(), ips.end());
+    ips.erase(std::unique(ips.begin(), ips.end()), ips.end());
+    std::future<std::unordered_map<uint32_t, std::string>> ptr_future;
+    if (cfg.ptr) {
+        ptr_future = std::async(std::launch::async, resolve_ptrs, ips, resolvers);
+    }
+    std::cout << "Fast path: grabbing " << groups.size() << " endpoints on " << ips.size()
+              << " hosts directly (--no-fast-path to use masscan and zgrab2)" << std::endl;
+
+    std::vector<HttpRecord> records;
+    grab_endpoints(std::move(groups), kVhostConnections, kVhostTimeout, kRecordBatch,
+                   [&](std::vector<HttpRecord> &batch) {
+                       std::move(batch.begin(), batch.end(), std::back_inserter(records));
+                   });
+    // Port 80 results first, as the zgrab2 runs write them.
+    std::stable_sort(records.begin(), records.end(),
+                     [](const HttpRecord &a, const HttpRecord &b) { return a.port < b.port; });
+    std::unordered_set<std::string> open_80;
+    std::unordered_set<std::string> open_443;
+    for (const auto &rec : records) {
+        (rec.port == 80 ? open_80 : open_443).insert(rec.ip);
+    }
+    std::cout << "Open port 80 IPs: " << open_80.size() << std::endl;
+    std::cout << "Open port 443 IPs: " << open_443.size() << std::endl;
+
+    std::unordered_map<uint32_t, std::string> ptr_names;
+    if (ptr_future.valid()) {
+        ptr_names = ptr_future.get();
+        pipeline.ptr_names = &ptr_names;
+        std::cout << "PTR names: " << ptr_names.size() << std::endl;
+    }
+    VhostQueue vhost_queue;
+    if (cfg.vhosts) {
+        pipeline.vhosts = &vhost_queue;
+        for (const auto &entry : hosts) {
+            for (const auto &name : entry.second) {
+                if (!name.empty()) {
+                    vhost_queue.add_name(entry.first, name);
+                }
+            }
+        }
+    }
+    write_records(pipeline, records, out);
+    if (cfg.vhosts) {
+        pipeline.vhosts = nullptr;
+        for (const auto &entry : ptr_names) {
+            vhost_queue.add_name(entry.first, entry.second);
+        }
+        run_vhost_pass(vhost_queue, pipeline, out);
+    }
+    if (!udp_ports.empty()) {
+        run_udp_pass(cfg, targets, udp_ports, pipeline, out);
+    }
+    if (!pipeline.finish()) {
+        std::cerr << "Failed to write SQLite results." << std::endl;
+        return 1;
+    }
+    std::cout << "Success" << std::endl;
+    return 0;
+}
+
+static int run_plan_mode(const Config &cfg) {
+    fs::path input_path(cfg.input);
+    if (!cfg.country_filter.empty() && (input_path.extension() != ".json" || !fs::exists(input_path))) {
+        std::cerr << "--country requires a country_asn.json input." << std::endl;
+        return 1;
+    }
+    TargetSet targets;
+    TargetSet excluded;
+    std::vector<std::string> hostnames;
+    if (!collect_targets(cfg, targets, &hostnames) || !collect_exclusions(cfg, excluded)) {
+        return 1;
+    }
+    std::sort(hostnames.begin(), hostnames.end());
+    hostnames.erase(std::unique(hostnames.begin(), hostnames.end()), hostnames.end());
+    uint64_t before = targets.size();
+    double before6 = targets.size6();
+    targets.subtract(excluded);
+    std::vector<uint32_t> ports;
+    if (!parse_port_spec(cfg.ports, ports)) {
+        std::cerr << "Invalid --ports: " << cfg.ports << std::endl;
+        return 1;
+    }
+
+    PlanInput plan;
+    plan.addresses = targets.size();
+    plan.addresses6 = targets.size6();
+    plan.ranges = targets.ranges().size() + targets.ranges6().size() + targets.singles6().size();
+    plan.excluded = before - plan.addresses + static_cast<uint64_t>(before6 - plan.addresses6);
+    plan.hostnames = hostnames.size();
+    plan.ports = ports.size();
+    plan.web_ports = static_cast<size_t>(
+        std::count_if(ports.begin(), ports.end(), [](uint32_t port) { return port == 80 || port == 443; }));
+    plan.rate = std::strtod(cfg.rate.c_str(), nullptr);
+
+    ScanHistory history(ScanHistory::default_path());
+    history.load();
+    print_plan(plan, history, std::cout);
+    return 0;
 }
 
 static void print_usage() {
-    std::cout << "Usage: 0xjam3z-scanner <ip|cidr|range|list|country_asn.json> [options]\n"
+    std::cout << "Usage: 0xjam3z-scanner <ip|cidr|range|hostname|list|country_asn.json> [options]\n"
+              << "       0xjam3z-scanner parse <masscan_results.txt|zgrab_results_*.json>... [parse options]\n"
+              << "       0xjam3z-scanner index add <dir> <zgrab_results_*.json|opendomains>... [--scan <id>]\n"
+              << "       0xjam3z-scanner index search <dir> <text> [--limit <n>]\n"
               << "Options:\n"
-              << "  --ports <list>        Ports to scan (default: 80,443)\n"
+              << "  --ports <list>        Ports to scan (default: 80,443); U:<port> probes a UDP service\n"
+              << "                        natively: U:53,U:123,U:161,U:443,U:500,U:1900\n"
               << "  --rate <n>            Masscan rate (default: 10000)\n"
               << "  --no-download         Do not auto-download tools\n"
+              << "  --refresh-tools       Ignore the tool resolution cache and re-probe masscan/zgrab2\n"
               << "  --output <file>       Output file for titles (default: opendomains)\n"
               << "  --list                Treat input as a pre-built masscan list file\n"
               << "  --country <name>      Filter country_name when parsing country_asn.json\n"
-              << "  --help                Show this help\n";
+              << "  --plugin <so>[=args]  Load a result processor plugin (repeatable)\n"
+              << "  --sqlite <db>         Also write results to a SQLite database\n"
+              << "  --exclude <spec>      Skip an ip, cidr or range (repeatable)\n"
+              << "  --exclude-file <file> Skip every target listed in a file (repeatable)\n"
+              << "  --hitlist <file>      Scan only the listed addresses that fall inside the targets\n"
+              << "  --dedup <k>           Stop grabbing a /24 or ASN once k hosts return the same page\n"
+              << "  --no-retry            Do not re-grab timed out or empty targets in a second pass\n"
+              << "  --resolver <ip[:port]> DNS server for hostname targets and --ptr (repeatable;\n"
+              << "                        default: /etc/resolv.conf)\n"
+              << "  --ptr                 Add the PTR name of every open host to its results\n"
+              << "  --vhosts              Request every known name (input, PTR, certificate SANs) as\n"
+              << "                        Host/SNI on each open host\n"
+              << "  --memory-limit <size> Spill stage queues to disk beyond this (e.g. 512M, 2G)\n"
+              << "  --grab <tool>         zgrab2 (default) or masscan: take port 80 titles from masscan\n"
+              << "                        banners and grab only the rest with zgrab2\n"
+              << "  --no-fast-path        Use masscan and zgrab2 even for a handful of hosts\n"
+              << "  --tool-timeout <sec>  Kill a zgrab2 run after this long and resume it with the\n"
+              << "                        targets it had not answered (default: no limit)\n"
+              << "  --where <expr>        Keep only results matching expr (see README); ip, port and\n"
+              << "                        asn terms also prune targets before they are grabbed\n"
+              << "  --plan                Print target/probe counts and time/size estimates, then exit\n"
+              << "  --help                Show this help\n"
+              << "Parse options:\n"
+              << "  --output <file>       Output file for titles (default: opendomains)\n"
+              << "  --out-dir <dir>       Directory for open_ips80.txt/open_ips443.txt (default: .)\n"
+              << "  --jobs <n>            Worker threads (default: all cores)\n"
+              << "  --memory-limit <size> Spill buffered results to disk beyond this (e.g. 512M, 2G)\n"
+              << "  --plugin <so>[=args]  Load a result processor plugin (repeatable)\n"
+              << "  --sqlite <db>         Also write results to a SQLite database\n"
+              << "  --where <expr>        Keep only results matching expr\n"
+              << "Index options:\n"
+              << "  --scan <id>           Scan id for every input (default: each file's path)\n"
+              << "  --limit <n>           Stop after n matches (default: 100)\n"
+              << "  --jobs <n>            Threads decoding zgrab2 files for add (default: all cores)\n";
+}
+
+static bool parse_memory_limit(const char *text, Config &cfg) {
+    if (!parse_byte_size(text, cfg.memory_limit)) {
+        std::cerr << "Invalid --memory-limit: " << text << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool parse_parse_args(int argc, char **argv, Config &cfg) {
+    cfg.parse_mode = true;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return false;
+        } else if (arg == "--output" && i + 1 < argc) {
+            cfg.output_file = argv[++i];
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            cfg.parse_out_dir = argv[++i];
+        } else if (arg == "--memory-limit" && i + 1 < argc) {
+            if (!parse_memory_limit(argv[++i], cfg)) {
+                return false;
+            }
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            cfg.jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--plugin" && i + 1 < argc) {
+            cfg.plugins.push_back(argv[++i]);
+        } else if (arg == "--sqlite" && i + 1 < argc) {
+            cfg.sqlite_path = argv[++i];
+        } else if (arg == "--where" && i + 1 < argc) {
+            cfg.where = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        } else {
+            cfg.parse_inputs.push_back(arg);
+        }
+    }
+
+    if (cfg.parse_inputs.empty()) {
+        print_usage();
+        return false;
+    }
+
+    return true;
+}
+
+static bool parse_index_args(int argc, char **argv, Config &cfg) {
+    if (argc < 4 || (std::string(argv[2]) != "add" && std::string(argv[2]) != "search")) {
+        print_usage();
+        return false;
+    }
+    cfg.index_action = argv[2];
+    cfg.index_dir = argv[3];
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--scan" && i + 1 < argc) {
+            cfg.scan_label = argv[++i];
+        } else if (arg == "--limit" && i + 1 < argc) {
+            cfg.limit = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            cfg.jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        } else if (cfg.index_action == "add") {
+            cfg.parse_inputs.push_back(arg);
+        } else if (cfg.input.empty()) {
+            cfg.input = arg;
+        } else {
+            std::cerr << "Unexpected argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (cfg.index_action == "add" ? cfg.parse_inputs.empty() : cfg.input.empty()) {
+        print_usage();
+        return false;
+    }
+    return true;
 }
 
 static bool parse_args(int argc, char **argv, Config &cfg) {
@@ -431,6 +1421,13 @@ static bool parse_args(int argc, char **argv, Config &cfg) {
         return false;
     }
 
+    if (std::string(argv[1]) == "parse") {
+        return parse_parse_args(argc, argv, cfg);
+    }
+    if (std::string(argv[1]) == "index") {
+        return parse_index_args(argc, argv, cfg);
+    }
+
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--help" || arg == "-h") {
@@ -442,12 +1439,53 @@ static bool parse_args(int argc, char **argv, Config &cfg) {
             cfg.rate = argv[++i];
         } else if (arg == "--no-download") {
             cfg.no_download = true;
+        } else if (arg == "--refresh-tools") {
+            cfg.refresh_tools = true;
         } else if (arg == "--output" && i + 1 < argc) {
             cfg.output_file = argv[++i];
         } else if (arg == "--list") {
             cfg.list_mode = true;
         } else if (arg == "--country" && i + 1 < argc) {
             cfg.country_filter = argv[++i];
+        } else if (arg == "--plugin" && i + 1 < argc) {
+            cfg.plugins.push_back(argv[++i]);
+        } else if (arg == "--sqlite" && i + 1 < argc) {
+            cfg.sqlite_path = argv[++i];
+        } else if (arg == "--where" && i + 1 < argc) {
+            cfg.where = argv[++i];
+        } else if (arg == "--exclude" && i + 1 < argc) {
+            cfg.excludes.push_back(argv[++i]);
+        } else if (arg == "--exclude-file" && i + 1 < argc) {
+            cfg.exclude_files.push_back(argv[++i]);
+        } else if (arg == "--hitlist" && i + 1 < argc) {
+            cfg.hitlist = argv[++i];
+        } else if (arg == "--dedup" && i + 1 < argc) {
+            cfg.dedup = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--no-retry") {
+            cfg.retry = false;
+        } else if (arg == "--resolver" && i + 1 < argc) {
+            cfg.resolvers.push_back(argv[++i]);
+        } else if (arg == "--ptr") {
+            cfg.ptr = true;
+        } else if (arg == "--vhosts") {
+            cfg.vhosts = true;
+        } else if (arg == "--no-fast-path") {
+            cfg.fast_path = false;
+        } else if (arg == "--tool-timeout" && i + 1 < argc) {
+            cfg.tool_timeout = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--grab" && i + 1 < argc) {
+            std::string tool = argv[++i];
+            if (tool != "zgrab2" && tool != "masscan") {
+                std::cerr << "Invalid --grab: " << tool << " (zgrab2 or masscan)" << std::endl;
+                return false;
+            }
+            cfg.masscan_banners = tool == "masscan";
+        } else if (arg == "--memory-limit" && i + 1 < argc) {
+            if (!parse_memory_limit(argv[++i], cfg)) {
+                return false;
+            }
+        } else if (arg == "--plan") {
+            cfg.plan = true;
         } else if (arg.rfind("--", 0) == 0) {
             std::cerr << "Unknown option: " << arg << std::endl;
             return false;
@@ -468,50 +1506,57 @@ static bool parse_args(int argc, char **argv, Config &cfg) {
 }
 
 int main(int argc, char **argv) {
+#ifndef _WIN32
+    // A tool that exits early must not kill us while we feed it targets.
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
     Config cfg;
     if (!parse_args(argc, argv, cfg)) {
         return 1;
     }
 
-    fs::path base_dir = fs::current_path();
-    fs::create_directories(base_dir / "bin");
-    fs::create_directories(base_dir / "third_party");
+    if (cfg.parse_mode) {
+        return run_parse_mode(cfg);
+    }
+    if (!cfg.index_action.empty()) {
+        return run_index_mode(cfg);
+    }
+    if (cfg.plan) {
+        return run_plan_mode(cfg);
+    }
 
-    auto masscan = ensure_masscan(base_dir, cfg.no_download);
-    if (!masscan) {
-        std::cerr << "masscan is required." << std::endl;
+    // U: ports go to the native UDP prober, the rest to masscan.
+    std::vector<uint16_t> udp_ports;
+    if (!split_udp_ports(cfg.ports, udp_ports)) {
         return 1;
     }
-    auto zgrab2 = ensure_zgrab2(base_dir, cfg.no_download);
-    if (!zgrab2) {
-        std::cerr << "zgrab2 is required." << std::endl;
+    RecordPipeline pipeline;
+    if (!pipeline.setup(cfg, cfg.input)) {
+        return 1;
+    }
+
+    fs::path base_dir = fs::current_path();
+
+    std::vector<DnsServer> resolvers;
+    if (cfg.ptr && !dns_servers(cfg, resolvers)) {
         return 1;
     }
 
     fs::path input_path(cfg.input);
     fs::path list_path = base_dir / cfg.list_file;
-    bool list_ready = false;
-
-    if (fs::exists(input_path)) {
-        if (input_path.extension() == ".json") {
-            list_ready = build_list_from_asn_json(input_path, list_path, cfg.country_filter);
-        } else {
-            if (!cfg.country_filter.empty()) {
-                std::cerr << "--country requires a country_asn.json input." << std::endl;
-                return 1;
-            }
-            if (cfg.list_mode) {
-                list_ready = fs::equivalent(input_path, list_path);
-                if (!list_ready) {
-                    fs::copy_file(input_path, list_path, fs::copy_options::overwrite_existing);
-                    list_ready = true;
-                }
-            } else {
-                list_ready = write_single_input_list(list_path, cfg.input);
-            }
-        }
-    } else {
-        if (cfg.list_mode) {
+    bool asn_input = fs::exists(input_path) && input_path.extension() == ".json";
+    if (pipeline.where.needs_asn() && !asn_input) {
+        std::cerr << "--where on asn, country or org needs a country_asn.json input." << std::endl;
+        return 1;
+    }
+    TargetSet targets;
+    HostNames hosts;
+    bool names_resolved = false;
+    bool have_names = false;
+    // Plain targets are known before any tool is resolved, so a handful of
+    // hosts can be grabbed without them.
+    if (!asn_input) {
+        if (cfg.list_mode && !fs::exists(input_path)) {
             std::cerr << "List file not found: " << input_path << std::endl;
             return 1;
         }
@@ -519,45 +1564,237 @@ int main(int argc, char **argv) {
             std::cerr << "--country requires a country_asn.json input." << std::endl;
             return 1;
         }
-        list_ready = write_single_input_list(list_path, cfg.input);
+        std::vector<std::string> hostnames;
+        if (!collect_targets(cfg, targets, &hostnames)) {
+            return 1;
+        }
+        if (!hostnames.empty()) {
+            // masscan takes addresses only, so the list is rebuilt from the resolved set.
+            if (resolvers.empty() && !dns_servers(cfg, resolvers)) {
+                return 1;
+            }
+            have_names = true;
+            names_resolved = resolve_target_names(std::move(hostnames), resolvers, targets, hosts);
+        }
+        std::vector<VhostGroup> groups;
+        if ((!have_names || names_resolved) && fast_path_groups(cfg, targets, hosts, groups)) {
+            return run_fast_path(cfg, std::move(groups), hosts, resolvers, pipeline, targets, udp_ports);
+        }
+    }
+
+    if (cfg.ports.empty()) {
+        // Only U: ports: nothing for masscan or zgrab2 to do.
+        if (asn_input && !collect_targets(cfg, targets)) {
+            return 1;
+        }
+        std::ofstream out(cfg.output_file);
+        if (!out) {
+            std::cerr << "Failed to open output file: " << cfg.output_file << std::endl;
+            return 1;
+        }
+        run_udp_pass(cfg, targets, udp_ports, pipeline, out);
+        if (!pipeline.finish()) {
+            std::cerr << "Failed to write SQLite results." << std::endl;
+            return 1;
+        }
+        std::cout << "Success" << std::endl;
+        return 0;
+    }
+
+    // Both tools are fetched and built at the same time; on a fresh host that is
+    // the difference between two sequential builds and the slower of the two.
+    // With a warm resolution cache each is a single stat().
+    ToolResolutionCache tool_cache(base_dir, cfg.refresh_tools);
+    auto masscan_future = std::async(std::launch::async, [&] {
+        return resolve_masscan(base_dir, cfg.no_download, tool_cache);
+    });
+    auto zgrab2_future = std::async(std::launch::async, [&] {
+        return resolve_zgrab2(base_dir, cfg.no_download, tool_cache);
+    });
+    auto masscan = masscan_future.get();
+    auto zgrab2 = zgrab2_future.get();
+    tool_cache.save();
+    if (!masscan) {
+        std::cerr << "masscan is required." << std::endl;
+        return 1;
+    }
+    if (!zgrab2) {
+        std::cerr << "zgrab2 is required." << std::endl;
+        return 1;
+    }
+
+    bool list_ready = false;
+    if (asn_input) {
+        list_ready = build_list_from_asn_json(cfg, list_path, targets);
+    } else {
+        if (have_names) {
+            list_ready = names_resolved && write_target_list(list_path, targets);
+        } else if (!cfg.hitlist.empty()) {
+            list_ready = !targets.empty() && write_target_list(list_path, targets);
+        } else if (cfg.list_mode) {
+            list_ready = fs::equivalent(input_path, list_path);
+            if (!list_ready) {
+                fs::copy_file(input_path, list_path, fs::copy_options::overwrite_existing);
+                list_ready = true;
+            }
+        } else {
+            list_ready = write_single_input_list(list_path, cfg.input);
+        }
     }
 
     if (!list_ready) {
         std::cerr << "Failed to prepare list file for masscan." << std::endl;
         return 1;
     }
+    if (targets.has_ipv6() && !masscan->has("ipv6")) {
+        std::cerr << "masscan " << masscan->version << " cannot scan IPv6 targets; 1.3.0 or newer is required."
+                  << std::endl;
+        return 1;
+    }
 
     fs::path masscan_output = base_dir / "masscan_results.txt";
-    fs::path open80 = base_dir / "open_ips80.txt";
-    fs::path open443 = base_dir / "open_ips443.txt";
-    fs::path zgrab80 = base_dir / "zgrab_results_80.json";
-    fs::path zgrab443 = base_dir / "zgrab_results_443.json";
 
-    std::string masscan_cmd = quote_path(*masscan) + " -p" + cfg.ports + " -iL " + quote_path(list_path.string()) +
-                              " --rate=" + cfg.rate + " --exclude 255.255.255.255 --wait 0 -oL " + quote_path(masscan_output.string());
+    std::string scan_ports = cfg.ports;
+    if (!pipeline.where.empty() && !where_port_spec(pipeline.where, scan_ports)) {
+        std::cout << "--where rules out every port in " << cfg.ports << "; nothing to scan." << std::endl;
+        return 0;
+    }
+
+    // Exact probe count for the throughput history that --plan estimates from;
+    // left at 0 when IPv6 prefixes make it too large to record.
+    uint64_t probes = 0;
+    {
+        TargetSet excluded;
+        std::vector<uint32_t> ports;
+        if (collect_exclusions(cfg, excluded) && parse_port_spec(scan_ports, ports)) {
+            targets.subtract(excluded);
+            double total = (static_cast<double>(targets.size()) + targets.size6()) * static_cast<double>(ports.size());
+            probes = total < 9007199254740992.0 ? static_cast<uint64_t>(total) : 0;
+        }
+    }
+    ScanHistory history(ScanHistory::default_path());
+
+    std::string masscan_cmd = quote_path(masscan->path) + " -p" + scan_ports + " -iL " + quote_path(list_path.string()) +
+                              " --rate=" + cfg.rate + " --exclude 255.255.255.255";
+    for (const auto &spec : cfg.excludes) {
+        masscan_cmd += " --exclude " + quote_path(spec);
+    }
+    for (const auto &file : cfg.exclude_files) {
+        masscan_cmd += " --excludefile " + quote_path(file);
+    }
+    if (cfg.masscan_banners) {
+        if (!masscan->has("banners")) {
+            std::cerr << "masscan " << masscan->version << " cannot grab banners; use --grab zgrab2." << std::endl;
+            return 1;
+        }
+        // Banner exchanges need masscan's default wait after the last probe.
+        masscan_cmd += " --banners --source-port " + std::string(kBannerSourcePort);
+    } else {
+        masscan_cmd += " --wait 0";
+    }
+    masscan_cmd += " -oL " + quote_path(masscan_output.string());
+    auto stage_start = std::chrono::steady_clock::now();
     if (!run_command(masscan_cmd)) {
         std::cerr << "masscan failed. You may need elevated privileges." << std::endl;
         return 1;
     }
+    double masscan_seconds = seconds_since(stage_start);
 
-    if (!parse_masscan_results(masscan_output, open80, open443)) {
+    std::ifstream masscan_in(masscan_output);
+    if (!masscan_in) {
+        std::cerr << "Failed to read " << masscan_output << std::endl;
         return 1;
     }
+    // Stage queues between masscan, zgrab2 and the parse workers spill to disk
+    // once --memory-limit is exceeded.
+    MemoryBudget budget(cfg.memory_limit, base_dir / "spill");
+    SpillQueue ips_80(&budget, "open_ips80");
+    SpillQueue ips_443(&budget, "open_ips443");
+    MasscanCounts counts;
+    MasscanBanners banners;
+    {
+        SpillStream found_80(ips_80);
+        SpillStream found_443(ips_443);
+        counts = parse_masscan_stream(masscan_in, found_80, found_443, cfg.masscan_banners ? &banners : nullptr);
+    }
+    std::cout << "Open port 80 IPs: " << counts.port_80 << std::endl;
+    std::cout << "Open port 443 IPs: " << counts.port_443 << std::endl;
 
-    if (fs::file_size(open80) > 0) {
-        std::string zgrab_cmd_80 = quote_path(*zgrab2) + " http --port 80 --input-file " + quote_path(open80.string()) +
-                                   " --max-redirects 0 --output-file " + quote_path(zgrab80.string());
-        if (!run_command(zgrab_cmd_80)) {
-            std::cerr << "zgrab2 failed for port 80." << std::endl;
+    // --grab masscan: a port 80 banner with a title is the result; only the
+    // rest, and 443, go to zgrab2. Addresses reached by hostname still need
+    // zgrab2 to send their names.
+    std::vector<HttpRecord> banner_records;
+    if (cfg.masscan_banners) {
+        SpillQueue rest(&budget, "open_ips80");
+        std::string kept;
+        ips_80.for_each_line([&](std::string_view line) {
+            uint32_t ip = 0;
+            auto it = parse_ipv4(line, ip) && !hosts.count(ip) ? banners.find(static_cast<uint64_t>(ip) << 16 | 80)
+                                                               : banners.end();
+            if (it == banners.end() || it->second.title.empty()) {
+                kept.append(line.data(), line.size());
+                kept += '\n';
+                if (kept.size() >= 64 * 1024) {
+                    rest.append(kept);
+                    kept.clear();
+                }
+                return;
+            }
+            HttpRecord rec;
+            rec.ip = std::string(line);
+            rec.port = 80;
+            rec.module = "http";
+            rec.status = "success";
+            rec.status_code = it->second.status_code;
+            rec.headers = std::move(it->second.headers);
+            // masscan read the body to find the title but does not report it.
+            rec.has_body = true;
+            rec.title = std::move(it->second.title);
+            banner_records.push_back(std::move(rec));
+        });
+        rest.append(kept);
+        ips_80 = std::move(rest);
+        MasscanBanners().swap(banners);
+        std::cout << "masscan banners: " << banner_records.size() << " port 80 titles, "
+                  << (counts.port_80 - banner_records.size()) << " port 80 IPs left for zgrab2" << std::endl;
+    }
+    AsnIndex asn_index;
+    bool have_asn = asn_input && (cfg.dedup > 0 || pipeline.where.needs_asn()) && asn_index.load(input_path);
+    if (pipeline.where.needs_asn()) {
+        if (!have_asn) {
+            std::cerr << "--where on asn, country or org: cannot load the ASN index " << input_path << ": "
+                      << asn_load_failure(input_path) << std::endl;
+            return 1;
         }
+        pipeline.where.bind_asn(&asn_index);
     }
-
-    if (fs::file_size(open443) > 0) {
-        std::string zgrab_cmd_443 = quote_path(*zgrab2) + " http --port 443 --input-file " + quote_path(open443.string()) +
-                                    " --max-redirects 0 --output-file " + quote_path(zgrab443.string());
-        if (!run_command(zgrab_cmd_443)) {
-            std::cerr << "zgrab2 failed for port 443." << std::endl;
+    if (!pipeline.where.empty()) {
+        uint64_t dropped = 0;
+        for (auto *ips : {&ips_80, &ips_443}) {
+            uint16_t port = ips == &ips_80 ? 80 : 443;
+            SpillQueue kept(&budget, "open_ips" + std::to_string(port));
+            auto keep = [&](std::string_view chunk) { kept.append(chunk); };
+            dropped += filter_targets(pipeline.where, port, *ips, keep);
+            *ips = std::move(kept);
         }
+        std::cout << "--where: " << dropped << " open ports ruled out before grabbing" << std::endl;
+    }
+    if (probes > 0) {
+        StageSample sample;
+        sample.stage = "masscan";
+        sample.in = probes;
+        sample.out = counts.port_80 + counts.port_443 + counts.other;
+        sample.bytes = fs::file_size(masscan_output);
+        sample.seconds = masscan_seconds;
+        sample.ideal_seconds = static_cast<double>(probes) / std::max(1.0, std::strtod(cfg.rate.c_str(), nullptr));
+        history.append(sample);
+    }
+
+    // PTR lookups overlap with the first zgrab2 run and are joined before parsing.
+    std::future<std::unordered_map<uint32_t, std::string>> ptr_future;
+    std::unordered_map<uint32_t, std::string> ptr_names;
+    if (cfg.ptr) {
+        ptr_future = std::async(std::launch::async, resolve_ptrs, distinct_ips({&ips_80, &ips_443}), resolvers);
     }
 
     std::ofstream out(cfg.output_file);
@@ -566,11 +1803,172 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    if (fs::exists(zgrab80)) {
-        parse_zgrab_titles(zgrab80, out);
+    std::optional<DedupPlanner> dedup;
+    if (cfg.dedup > 0) {
+        dedup.emplace(cfg.dedup, have_asn ? &asn_index : nullptr);
+        for (auto *ips : {&ips_80, &ips_443}) {
+            uint16_t port = ips == &ips_80 ? 80 : 443;
+            SpillQueue wave(&budget, "wave1_" + std::to_string(port));
+            ips->for_each_chunk([&](std::string_view chunk) {
+                wave.append(dedup->split(port, chunk));
+                return true;
+            });
+            *ips = std::move(wave);
+        }
+        pipeline.dedup = &*dedup;
+    }
+    RetryQueue retry_queue;
+    if (cfg.retry) {
+        pipeline.retry = &retry_queue;
+    }
+    VhostQueue vhost_queue;
+    if (cfg.vhosts) {
+        pipeline.vhosts = &vhost_queue;
+        for (const auto &entry : hosts) {
+            for (const auto &name : entry.second) {
+                if (!name.empty()) {
+                    vhost_queue.add_name(entry.first, name);
+                }
+            }
+        }
+    }
+
+    // One grab + parse round over both ports; dedup adds a second round.
+    double zgrab_seconds = 0;
+    double parse_seconds = 0;
+    uint64_t zgrab_bytes = 0;
+    uint64_t titles = 0;
+    uint64_t title_bytes = 0;
+    auto run_wave = [&](const std::string &prefix, const SpillQueue &targets_80, const SpillQueue &targets_443) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ParseJob> jobs;
+        auto queue_lines = [&](const SpillQueue &queue) -> InputSource {
+            return [&](const std::function<bool(std::string_view)> &write) {
+                return queue.for_each_chunk([&](std::string_view chunk) {
+                    return hosts.empty() ? write(chunk) : write(with_host_names(chunk, hosts));
+                });
+            };
+        };
+        std::vector<ChildJob> grabs;
+        std::vector<fs::path> outputs;
+        if (zgrab_multiple_usable(*zgrab2) && !targets_80.empty() && !targets_443.empty()) {
+            // Both ports in one zgrab2 process rather than a start-up and a drain per port.
+            std::vector<ZgrabPortInput> inputs{{80, targets_80.bytes(), queue_lines(targets_80)},
+                                               {443, targets_443.bytes(), queue_lines(targets_443)}};
+            ChildJob job;
+            fs::path output = base_dir / (prefix + "all.json");
+            if (zgrab_multiple_job(*zgrab2, std::move(inputs), base_dir / (prefix + "all.ini"), output, "", 0,
+                                   cfg.tool_timeout, job)) {
+                grabs.push_back(std::move(job));
+                outputs.push_back(output);
+            }
+        } else {
+            for (const auto &grab : {std::make_pair("80", &targets_80), std::make_pair("443", &targets_443)}) {
+                std::string port = grab.first;
+                if (grab.second->empty()) {
+                    continue;
+                }
+                ChildJob job;
+                fs::path output = base_dir / (prefix + port + ".json");
+                if (zgrab_http_job(*zgrab2, port, grab.second->bytes(), queue_lines(*grab.second),
+                                   base_dir / ("open_ips" + port + ".txt"), output, {}, cfg.tool_timeout, job)) {
+                    grabs.push_back(std::move(job));
+                    outputs.push_back(output);
+                }
+            }
+        }
+        if (!run_children(grabs)) {
+            std::cerr << "zgrab2 failed; parsing what it returned." << std::endl;
+        }
+        // Closes the output files.
+        grabs.clear();
+        for (const auto &output : outputs) {
+            if (fs::exists(output)) {
+                jobs.push_back(make_parse_job(output, budget));
+                zgrab_bytes += fs::file_size(output);
+            }
+        }
+        zgrab_seconds += seconds_since(start);
+        if (ptr_future.valid()) {
+            ptr_names = ptr_future.get();
+            pipeline.ptr_names = &ptr_names;
+            std::cout << "PTR names: " << ptr_names.size() << std::endl;
+        }
+        start = std::chrono::steady_clock::now();
+        run_parse_jobs(jobs, pipeline, [&](ParseJob &job) {
+            job.titles.for_each_chunk([&](std::string_view chunk) {
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                titles += static_cast<uint64_t>(std::count(chunk.begin(), chunk.end(), '\n'));
+                return true;
+            });
+            title_bytes += job.titles.bytes();
+        });
+        parse_seconds += seconds_since(start);
+    };
+    run_wave("zgrab_results_", ips_80, ips_443);
+    if (!banner_records.empty()) {
+        // Banner results are final: nothing to retry, and no dedup wave covers them.
+        RetryQueue *retry = pipeline.retry;
+        DedupPlanner *planner = pipeline.dedup;
+        pipeline.retry = nullptr;
+        pipeline.dedup = nullptr;
+        write_records(pipeline, banner_records, out);
+        std::vector<HttpRecord>().swap(banner_records);
+        pipeline.retry = retry;
+        pipeline.dedup = planner;
+    }
+
+    if (dedup) {
+        pipeline.dedup = nullptr;
+        SpillQueue rest_80(&budget, "wave2_80");
+        SpillQueue rest_443(&budget, "wave2_443");
+        rest_80.append(dedup->pending(80));
+        rest_443.append(dedup->pending(443));
+        size_t skipped = dedup->skipped();
+        std::cout << "Dedup: " << dedup->deferred() << " hosts deferred, " << skipped
+                  << " skipped as duplicates, " << (dedup->deferred() - skipped) << " grabbed in a second wave"
+                  << std::endl;
+        run_wave("zgrab_wave2_", rest_80, rest_443);
+        PipelineWriter writer(pipeline, out);
+        dedup->for_each_skipped(kRecordBatch, [&](std::vector<HttpRecord> &batch) { writer.push(batch); });
+        writer.finish();
+    }
+
+    if (counts.port_80 + counts.port_443 > 0 && zgrab_bytes > 0) {
+        StageSample sample;
+        sample.stage = "zgrab2";
+        sample.in = counts.port_80 + counts.port_443;
+        sample.out = titles;
+        sample.bytes = zgrab_bytes;
+        sample.seconds = zgrab_seconds;
+        history.append(sample);
+        sample.stage = "parse";
+        sample.in = zgrab_bytes;
+        sample.bytes = title_bytes;
+        sample.seconds = parse_seconds;
+        history.append(sample);
+    }
+    if (cfg.retry) {
+        pipeline.retry = nullptr;
+        run_retry_pass(*zgrab2, base_dir, cfg.tool_timeout, retry_queue, pipeline, out);
+    }
+    if (cfg.vhosts) {
+        pipeline.vhosts = nullptr;
+        for (const auto &entry : ptr_names) {
+            vhost_queue.add_name(entry.first, entry.second);
+        }
+        run_vhost_pass(vhost_queue, pipeline, out);
+    }
+    if (!udp_ports.empty()) {
+        run_udp_pass(cfg, targets, udp_ports, pipeline, out);
+    }
+    if (!pipeline.finish()) {
+        std::cerr << "Failed to write SQLite results." << std::endl;
+        return 1;
     }
-    if (fs::exists(zgrab443)) {
-        parse_zgrab_titles(zgrab443, out);
+    if (budget.spilled_segments()) {
+        std::cout << "Spilled " << budget.spilled_bytes() / (1024 * 1024) << " MB to " << budget.spilled_segments()
+                  << " segment files to stay under --memory-limit" << std::endl;
     }
 
     std::cout << "Success" << std::endl;
@@ -0,0 +1,789 @@
+#include "parsers.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static std::string_view next_token(std::string_view line, size_t &pos) {
+    while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+        ++pos;
+    }
+    size_t start = pos;
+    while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos]))) {
+        ++pos;
+    }
+    return line.substr(start, pos - start);
+}
+
+static bool parse_u32(std::string_view s, uint32_t &out) {
+    if (s.empty() || s.size() > 10) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (value > 0xFFFFFFFFull) {
+        return false;
+    }
+    out = static_cast<uint32_t>(value);
+    return true;
+}
+
+bool parse_masscan_line(std::string_view line, MasscanEntry &entry) {
+    size_t pos = 0;
+    if (next_token(line, pos) != "open") {
+        return false;
+    }
+    std::string_view proto = next_token(line, pos);
+    if (proto == "tcp") {
+        entry.proto = 6;
+    } else if (proto == "udp") {
+        entry.proto = 17;
+    } else {
+        return false;
+    }
+    uint32_t port = 0;
+    if (!parse_u32(next_token(line, pos), port) || port > 65535 || !parse_ipv4(next_token(line, pos), entry.ip)) {
+        return false;
+    }
+    entry.port = static_cast<uint16_t>(port);
+    uint32_t ts = 0;
+    entry.timestamp = parse_u32(next_token(line, pos), ts) ? ts : 0;
+    return true;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool parse_masscan_banner_line(std::string_view line, MasscanEntry &entry, std::string_view &service,
+                               std::string &text) {
+    size_t pos = 0;
+    if (next_token(line, pos) != "banner") {
+        return false;
+    }
+    std::string_view proto = next_token(line, pos);
+    if (proto == "tcp") {
+        entry.proto = 6;
+    } else if (proto == "udp") {
+        entry.proto = 17;
+    } else {
+        return false;
+    }
+    uint32_t port = 0;
+    if (!parse_u32(next_token(line, pos), port) || port > 65535 || !parse_ipv4(next_token(line, pos), entry.ip) ||
+        !parse_u32(next_token(line, pos), entry.timestamp)) {
+        return false;
+    }
+    entry.port = static_cast<uint16_t>(port);
+    service = next_token(line, pos);
+    if (service.empty()) {
+        return false;
+    }
+    // One space separates the service from the text, which may itself contain spaces.
+    std::string_view raw = line.substr(std::min(line.size(), pos + 1));
+    text.clear();
+    text.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        int hi = 0;
+        int lo = 0;
+        if (raw[i] == '\\' && i + 3 < raw.size() && raw[i + 1] == 'x' && (hi = hex_value(raw[i + 2])) >= 0 &&
+            (lo = hex_value(raw[i + 3])) >= 0) {
+            text += static_cast<char>(hi << 4 | lo);
+            i += 3;
+        } else {
+            text += raw[i];
+        }
+    }
+    return true;
+}
+
+// Status line and headers of masscan's "http" banner, which stops wherever its
+// capture did.
+static void parse_banner_head(std::string_view head, MasscanBanner &banner) {
+    size_t eol = std::min(head.find('\n'), head.size());
+    std::string_view status = head.substr(0, eol);
+    if (status.size() >= 12 && status.compare(0, 5, "HTTP/") == 0) {
+        uint32_t code = 0;
+        if (parse_u32(status.substr(9, 3), code)) {
+            banner.status_code = static_cast<int>(code);
+        }
+    }
+    size_t pos = eol + 1;
+    while (pos < head.size()) {
+        size_t end = std::min(head.find('\n', pos), head.size());
+        std::string_view line = head.substr(pos, end - pos);
+        pos = end + 1;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string name = to_lower(std::string(line.substr(0, colon)));
+        std::string value = trim(std::string(line.substr(colon + 1)));
+        auto it = std::find_if(banner.headers.begin(), banner.headers.end(),
+                               [&](const std::pair<std::string, std::string> &h) { return h.first == name; });
+        if (it != banner.headers.end()) {
+            it->second += ", ";
+            it->second += value;
+        } else {
+            banner.headers.emplace_back(std::move(name), std::move(value));
+        }
+    }
+}
+
+static void add_banner(const MasscanEntry &entry, std::string_view service, const std::string &text,
+                       MasscanBanners &banners) {
+    if (service != "http" && service != "http.server" && service != "title") {
+        return;
+    }
+    MasscanBanner &banner = banners[static_cast<uint64_t>(entry.ip) << 16 | entry.port];
+    if (service == "title") {
+        banner.has_title = true;
+        banner.title = trim(text);
+    } else if (service == "http") {
+        parse_banner_head(text, banner);
+    } else if (std::none_of(banner.headers.begin(), banner.headers.end(),
+                            [](const std::pair<std::string, std::string> &h) { return h.first == "server"; })) {
+        banner.headers.emplace_back("server", trim(text));
+    }
+}
+
+MasscanCounts parse_masscan_stream(std::istream &in, std::ostream &out_80, std::ostream &out_443,
+                                   MasscanBanners *banners) {
+    MasscanCounts counts;
+    std::string line;
+    MasscanEntry entry;
+    std::string_view service;
+    std::string text;
+    while (std::getline(in, line)) {
+        std::string_view view(line);
+        if (banners && parse_masscan_banner_line(view, entry, service, text)) {
+            if (entry.proto == 6) {
+                add_banner(entry, service, text, *banners);
+            }
+            continue;
+        }
+        size_t pos = 0;
+        if (next_token(view, pos) != "open" || next_token(view, pos) != "tcp") {
+            continue;
+        }
+        std::string_view port = next_token(view, pos);
+        std::string_view ip = next_token(view, pos);
+        if (ip.empty()) {
+            continue;
+        }
+        if (port == "80") {
+            out_80 << ip << "\n";
+            ++counts.port_80;
+        } else if (port == "443") {
+            out_443 << ip << "\n";
+            ++counts.port_443;
+        } else {
+            ++counts.other;
+        }
+    }
+    return counts;
+}
+
+bool parse_masscan_results(const fs::path &masscan_file, const fs::path &out80, const fs::path &out443) {
+    std::ifstream in(masscan_file);
+    if (!in) {
+        std::cerr << "Failed to read " << masscan_file << std::endl;
+        return false;
+    }
+
+    std::ofstream out_80(out80);
+    std::ofstream out_443(out443);
+    if (!out_80 || !out_443) {
+        std::cerr << "Failed to open output IP files." << std::endl;
+        return false;
+    }
+
+    MasscanCounts counts = parse_masscan_stream(in, out_80, out_443);
+    std::cout << "Open port 80 IPs: " << counts.port_80 << std::endl;
+    std::cout << "Open port 443 IPs: " << counts.port_443 << std::endl;
+    return true;
+}
+
+static size_t skip_ws(std::string_view s, size_t pos) {
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+        ++pos;
+    }
+    return pos;
+}
+
+// pos is on the opening quote; returns the index just past the closing quote.
+static size_t skip_string(std::string_view s, size_t pos) {
+    ++pos;
+    while (pos < s.size()) {
+        size_t hit = s.find_first_of("\"\\", pos);
+        if (hit == std::string_view::npos) {
+            return std::string_view::npos;
+        }
+        if (s[hit] == '"') {
+            return hit + 1;
+        }
+        pos = hit + 2;
+    }
+    return std::string_view::npos;
+}
+
+size_t json_skip_value(std::string_view s, size_t pos) {
+    pos = skip_ws(s, pos);
+    if (pos >= s.size()) {
+        return std::string_view::npos;
+    }
+    char c = s[pos];
+    if (c == '"') {
+        return skip_string(s, pos);
+    }
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (pos < s.size()) {
+            char d = s[pos];
+            if (d == '"') {
+                pos = skip_string(s, pos);
+                if (pos == std::string_view::npos) {
+                    return pos;
+                }
+                continue;
+            }
+            if (d == '{' || d == '[') {
+                ++depth;
+            } else if ((d == '}' || d == ']') && --depth == 0) {
+                return pos + 1;
+            }
+            ++pos;
+        }
+        return std::string_view::npos;
+    }
+    while (pos < s.size() && s[pos] != ',' && s[pos] != '}' && s[pos] != ']' &&
+           !std::isspace(static_cast<unsigned char>(s[pos]))) {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool next_in_container(std::string_view s, size_t &pos, char open, char close) {
+    if (pos == 0) {
+        pos = skip_ws(s, 0);
+        if (pos >= s.size() || s[pos] != open) {
+            return false;
+        }
+        ++pos;
+    }
+    pos = skip_ws(s, pos);
+    if (pos < s.size() && s[pos] == ',') {
+        pos = skip_ws(s, pos + 1);
+    }
+    return pos < s.size() && s[pos] != close;
+}
+
+bool json_next_member(std::string_view object, size_t &pos, std::string_view &key, std::string_view &value) {
+    if (!next_in_container(object, pos, '{', '}') || object[pos] != '"') {
+        return false;
+    }
+    size_t key_end = skip_string(object, pos);
+    if (key_end == std::string_view::npos) {
+        return false;
+    }
+    key = object.substr(pos + 1, key_end - pos - 2);
+    pos = skip_ws(object, key_end);
+    if (pos >= object.size() || object[pos] != ':') {
+        return false;
+    }
+    size_t start = skip_ws(object, pos + 1);
+    size_t end = json_skip_value(object, start);
+    if (end == std::string_view::npos) {
+        return false;
+    }
+    value = object.substr(start, end - start);
+    pos = end;
+    return true;
+}
+
+bool json_next_element(std::string_view array, size_t &pos, std::string_view &value) {
+    if (!next_in_container(array, pos, '[', ']')) {
+        return false;
+    }
+    size_t end = json_skip_value(array, pos);
+    if (end == std::string_view::npos) {
+        return false;
+    }
+    value = array.substr(pos, end - pos);
+    pos = end;
+    return true;
+}
+
+std::optional<std::string_view> json_member(std::string_view object, std::string_view key) {
+    size_t pos = 0;
+    std::string_view k;
+    std::string_view v;
+    while (json_next_member(object, pos, k, v)) {
+        if (k == key) {
+            return v;
+        }
+    }
+    return std::nullopt;
+}
+
+std::string unescape_json_string(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        char c = s[i];
+        if (c != '\\' || i + 1 >= s.size()) {
+            out.push_back(c);
+            continue;
+        }
+        char n = s[++i];
+        switch (n) {
+            case '\\': out.push_back('\\'); break;
+            case '"': out.push_back('"'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                if (i + 4 < s.size()) {
+                    std::string hex(s.substr(i + 1, 4));
+                    unsigned int code = static_cast<unsigned int>(std::strtoul(hex.c_str(), nullptr, 16));
+                    if (code <= 0x7F) {
+                        out.push_back(static_cast<char>(code));
+                    } else {
+                        out.push_back('?');
+                    }
+                    i += 4;
+                }
+                break;
+            }
+            default:
+                out.push_back(n);
+                break;
+        }
+    }
+    return out;
+}
+
+std::optional<std::string> json_string(std::string_view raw) {
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') {
+        return std::nullopt;
+    }
+    return unescape_json_string(raw.substr(1, raw.size() - 2));
+}
+
+std::optional<long long> json_int(std::string_view raw) {
+    if (raw.empty() || !(raw[0] == '-' || std::isdigit(static_cast<unsigned char>(raw[0])))) {
+        return std::nullopt;
+    }
+    return std::strtoll(std::string(raw).c_str(), nullptr, 10);
+}
+
+static size_t find_nocase(std::string_view hay, std::string_view lower_needle, size_t from) {
+    const char first = lower_needle[0];
+    const char first_upper = static_cast<char>(std::toupper(static_cast<unsigned char>(first)));
+    for (size_t i = from; i + lower_needle.size() <= hay.size(); ++i) {
+        if (hay[i] != first && hay[i] != first_upper) {
+            continue;
+        }
+        size_t j = 1;
+        while (j < lower_needle.size() &&
+               std::tolower(static_cast<unsigned char>(hay[i + j])) == static_cast<unsigned char>(lower_needle[j])) {
+            ++j;
+        }
+        if (j == lower_needle.size()) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+std::optional<std::string_view> find_title(std::string_view html) {
+    size_t start = find_nocase(html, "<title", 0);
+    if (start == std::string_view::npos) {
+        return std::nullopt;
+    }
+    size_t gt = html.find('>', start);
+    if (gt == std::string_view::npos) {
+        return std::nullopt;
+    }
+    size_t end = find_nocase(html, "</title>", gt);
+    if (end == std::string_view::npos || end <= gt) {
+        return std::nullopt;
+    }
+    size_t first = gt + 1;
+    while (first < end && std::isspace(static_cast<unsigned char>(html[first]))) {
+        ++first;
+    }
+    while (end > first && std::isspace(static_cast<unsigned char>(html[end - 1]))) {
+        --end;
+    }
+    if (first == end) {
+        return std::nullopt;
+    }
+    return html.substr(first, end - first);
+}
+
+size_t title_end(std::string_view html) {
+    size_t start = find_nocase(html, "<title", 0);
+    if (start == std::string_view::npos) {
+        return std::string_view::npos;
+    }
+    size_t gt = html.find('>', start);
+    if (gt == std::string_view::npos) {
+        return std::string_view::npos;
+    }
+    size_t end = find_nocase(html, "</title>", gt);
+    return end == std::string_view::npos ? end : end + 8;
+}
+
+std::string extract_title(const std::string &html) {
+    auto title = find_title(html);
+    return title ? std::string(*title) : std::string("No title found");
+}
+
+static uint16_t port_from_url(std::string_view url) {
+    auto scheme = json_member(url, "scheme");
+    auto host = json_member(url, "host");
+    if (host) {
+        std::string h = json_string(*host).value_or("");
+        size_t colon = h.rfind(':');
+        if (colon != std::string::npos && h.find(']', colon) == std::string::npos) {
+            return static_cast<uint16_t>(std::strtoul(h.c_str() + colon + 1, nullptr, 10));
+        }
+    }
+    if (scheme && json_string(*scheme).value_or("") == "https") {
+        return 443;
+    }
+    return 80;
+}
+
+// zgrab2 lower-cases header names and maps '-' to '_'; undo the latter.
+static std::string header_name(std::string_view key) {
+    std::string name(key);
+    std::replace(name.begin(), name.end(), '_', '-');
+    return name;
+}
+
+static std::string join_header_values(std::string_view values) {
+    std::string joined;
+    size_t pos = 0;
+    std::string_view v;
+    while (json_next_element(values, pos, v)) {
+        if (!joined.empty()) {
+            joined += ", ";
+        }
+        joined += json_string(v).value_or("");
+    }
+    return joined;
+}
+
+static void parse_headers(std::string_view headers, HttpRecord &rec) {
+    size_t pos = 0;
+    std::string_view key;
+    std::string_view value;
+    while (json_next_member(headers, pos, key, value)) {
+        if (key == "unknown") {
+            size_t upos = 0;
+            std::string_view entry;
+            while (json_next_element(value, upos, entry)) {
+                auto k = json_member(entry, "key");
+                auto v = json_member(entry, "value");
+                if (k && v) {
+                    rec.headers.emplace_back(json_string(*k).value_or(""), join_header_values(*v));
+                }
+            }
+            continue;
+        }
+        rec.headers.emplace_back(header_name(key), join_header_values(value));
+    }
+}
+
+static std::optional<std::string_view> json_path(std::string_view value, std::initializer_list<std::string_view> keys) {
+    std::optional<std::string_view> current = value;
+    for (auto key : keys) {
+        current = json_member(*current, key);
+        if (!current) {
+            break;
+        }
+    }
+    return current;
+}
+
+static std::string path_string(std::string_view value, std::initializer_list<std::string_view> keys) {
+    auto raw = json_path(value, keys);
+    return raw ? json_string(*raw).value_or(std::string()) : std::string();
+}
+
+static void parse_certificate(std::string_view request, HttpRecord &rec) {
+    auto parsed = json_path(request, {"tls_log", "handshake_log", "server_certificates", "certificate", "parsed"});
+    if (!parsed) {
+        return;
+    }
+    CertInfo cert;
+    cert.subject = path_string(*parsed, {"subject_dn"});
+    cert.issuer = path_string(*parsed, {"issuer_dn"});
+    cert.fingerprint_sha256 = path_string(*parsed, {"fingerprint_sha256"});
+    cert.not_after = path_string(*parsed, {"validity", "end"});
+    if (auto names = json_path(*parsed, {"extensions", "subject_alt_name", "dns_names"})) {
+        size_t pos = 0;
+        std::string_view name;
+        while (json_next_element(*names, pos, name)) {
+            if (auto text = json_string(name)) {
+                cert.names.push_back(std::move(*text));
+            }
+        }
+    }
+    rec.cert = std::move(cert);
+}
+
+static void parse_module_result(std::string_view module, uint16_t port, HttpRecord &rec) {
+    if (auto status = json_member(module, "status")) {
+        rec.status = json_string(*status).value_or("");
+    }
+    rec.port = port;
+    auto result = json_member(module, "result");
+    auto response = result ? json_member(*result, "response") : std::nullopt;
+    if (!response) {
+        return;
+    }
+    if (auto code = json_member(*response, "status_code")) {
+        rec.status_code = static_cast<int>(json_int(*code).value_or(0));
+    }
+    if (auto headers = json_member(*response, "headers")) {
+        parse_headers(*headers, rec);
+    }
+    auto request = json_member(*response, "request");
+    if (request) {
+        parse_certificate(*request, rec);
+    }
+    if (rec.port == 0) {
+        auto url = request ? json_member(*request, "url") : std::nullopt;
+        rec.port = url ? port_from_url(*url) : 80;
+    }
+    if (auto body = json_member(*response, "body")) {
+        if (auto decoded = json_string(*body)) {
+            rec.has_body = true;
+            rec.body = std::move(*decoded);
+            if (auto title = find_title(rec.body)) {
+                rec.title = std::string(*title);
+            }
+        }
+    }
+}
+
+// Sections of a zgrab2 "multiple" run are named <module><port> ("http443");
+// strips the port off name and returns it, 0 for a plain module name.
+static uint16_t module_port(std::string_view &name) {
+    size_t digits = name.size();
+    while (digits > 0 && std::isdigit(static_cast<unsigned char>(name[digits - 1]))) {
+        --digits;
+    }
+    if (digits == 0 || digits == name.size() || name.size() - digits > 5) {
+        return 0;
+    }
+    unsigned long port = std::strtoul(std::string(name.substr(digits)).c_str(), nullptr, 10);
+    if (port == 0 || port > 65535) {
+        return 0;
+    }
+    name = name.substr(0, digits);
+    return static_cast<uint16_t>(port);
+}
+
+bool parse_zgrab_line(std::string_view line, uint16_t port, std::vector<HttpRecord> &out, const TargetFilter *keep) {
+    auto ip = json_member(line, "ip");
+    std::optional<std::string> ip_str = ip ? json_string(*ip) : std::nullopt;
+    if (!ip_str) {
+        return false;
+    }
+    std::string domain;
+    if (auto member = json_member(line, "domain")) {
+        domain = json_string(*member).value_or("");
+    }
+    auto data = json_member(line, "data");
+    size_t pos = 0;
+    std::string_view name;
+    std::string_view module;
+    bool any = false;
+    while (data && json_next_member(*data, pos, name, module)) {
+        uint16_t section_port = port ? 0 : module_port(name);
+        any = true;
+        if (keep && !(*keep)(*ip_str, port ? port : section_port)) {
+            continue;
+        }
+        HttpRecord rec;
+        rec.ip = *ip_str;
+        rec.domain = domain;
+        rec.module = std::string(name);
+        parse_module_result(module, port ? port : section_port, rec);
+        out.push_back(std::move(rec));
+    }
+    if (!any && (!keep || (*keep)(*ip_str, port))) {
+        HttpRecord rec;
+        rec.ip = std::move(*ip_str);
+        rec.domain = std::move(domain);
+        rec.port = port;
+        out.push_back(std::move(rec));
+    }
+    return true;
+}
+
+std::string zgrab_answered_input(std::string_view line, bool tagged) {
+    auto ip = json_member(line, "ip");
+    std::string input = ip ? json_string(*ip).value_or("") : "";
+    if (input.empty()) {
+        return input;
+    }
+    std::string domain;
+    if (auto member = json_member(line, "domain")) {
+        domain = json_string(*member).value_or("");
+    }
+    if (!tagged) {
+        return domain.empty() ? input : input + "," + domain;
+    }
+    uint16_t port = 0;
+    if (auto data = json_member(line, "data")) {
+        size_t pos = 0;
+        std::string_view name;
+        std::string_view module;
+        if (json_next_member(*data, pos, name, module)) {
+            port = module_port(name);
+        }
+    }
+    return input + "," + domain + "," + std::to_string(port);
+}
+
+bool for_each_zgrab_batch(const fs::path &zgrab_file, uint16_t port, size_t batch_size,
+                          const std::function<void(std::vector<HttpRecord> &)> &fn, const TargetFilter *keep) {
+    std::ifstream in(zgrab_file);
+    if (!in) {
+        std::cerr << "Failed to read " << zgrab_file << std::endl;
+        return false;
+    }
+
+    std::vector<HttpRecord> batch;
+    batch.reserve(batch_size);
+    std::string line;
+    while (std::getline(in, line)) {
+        parse_zgrab_line(line, port, batch, keep);
+        if (batch.size() >= batch_size) {
+            fn(batch);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        fn(batch);
+    }
+    return true;
+}
+
+bool for_each_line_chunk(const fs::path &file, size_t chunk_bytes, const std::function<void(std::string &)> &fn) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to read " << file << std::endl;
+        return false;
+    }
+    std::string chunk;
+    std::string rest;
+    while (in) {
+        size_t have = chunk.size();
+        chunk.resize(have + chunk_bytes);
+        in.read(&chunk[have], static_cast<std::streamsize>(chunk_bytes));
+        chunk.resize(have + static_cast<size_t>(in.gcount()));
+        size_t end = chunk.rfind('\n');
+        if (end == std::string::npos) {
+            // No line ends in what was just read: keep reading into this chunk.
+            continue;
+        }
+        rest.assign(chunk, end + 1, std::string::npos);
+        chunk.resize(end + 1);
+        fn(chunk);
+        chunk.swap(rest);
+        rest.clear();
+    }
+    if (!chunk.empty()) {
+        fn(chunk);
+    }
+    return true;
+}
+
+void parse_zgrab_chunk(std::string_view chunk, uint16_t port, std::vector<HttpRecord> &out, const TargetFilter *keep) {
+    while (!chunk.empty()) {
+        size_t end = chunk.find('\n');
+        std::string_view line = chunk.substr(0, end);
+        if (!line.empty()) {
+            parse_zgrab_line(line, port, out, keep);
+        }
+        chunk.remove_prefix(end == std::string_view::npos ? chunk.size() : end + 1);
+    }
+}
+
+uint16_t zgrab_port_from_filename(const fs::path &file) {
+    std::string stem = file.stem().string();
+    size_t us = stem.rfind('_');
+    if (us == std::string::npos || us + 1 >= stem.size()) {
+        return 0;
+    }
+    for (size_t i = us + 1; i < stem.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(stem[i]))) {
+            return 0;
+        }
+    }
+    unsigned long port = std::strtoul(stem.c_str() + us + 1, nullptr, 10);
+    return port > 0 && port < 65536 ? static_cast<uint16_t>(port) : 0;
+}
+
+void format_record(const HttpRecord &rec, std::string &out) {
+    out += "IP: ";
+    out += rec.ip;
+    if (!rec.domain.empty()) {
+        out += " - Host: ";
+        out += rec.domain;
+    }
+    if (rec.has_body) {
+        out += " - Title: ";
+        out += rec.title.empty() ? "No title found" : rec.title;
+    } else {
+        out += " - No response body found";
+    }
+    for (const auto &field : rec.fields) {
+        out += " - ";
+        out += field.first;
+        out += ": ";
+        out += field.second;
+    }
+    out += "\n";
+}
+
+uint64_t response_fingerprint(const HttpRecord &rec) {
+    return fnv1a64(rec.body, fnv1a64(rec.title) ^ static_cast<uint64_t>(rec.status_code));
+}
+
+uint64_t response_prefix_fingerprint(const HttpRecord &rec) {
+    std::string_view body = rec.body;
+    body = body.substr(0, std::min(body.size(), title_end(body)));
+    return fnv1a64(body, fnv1a64(rec.title) ^ static_cast<uint64_t>(rec.status_code));
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct MasscanCounts {
+    size_t port_80 = 0;
+    size_t port_443 = 0;
+    // Open tcp ports other than 80/443.
+    size_t other = 0;
+};
+
+struct MasscanEntry {
+    uint32_t ip = 0;
+    uint16_t port = 0;
+    uint8_t proto = 0; // IPPROTO_TCP / IPPROTO_UDP
+    uint32_t timestamp = 0;
+};
+
+// Parses one `open <proto> <port> <ip> <timestamp>` line of masscan -oL output.
+bool parse_masscan_line(std::string_view line, MasscanEntry &entry);
+
+// What masscan --banners reported for one open port: its HTTP status line and
+// headers ("http"), server ("http.server") and page title ("title").
+struct MasscanBanner {
+    int status_code = 0;
+    // Lower-case names, repeated headers joined with ", ".
+    std::vector<std::pair<std::string, std::string>> headers;
+    bool has_title = false;
+    std::string title;
+};
+// Keyed by ip << 16 | port.
+using MasscanBanners = std::unordered_map<uint64_t, MasscanBanner>;
+
+// Parses one `banner <proto> <port> <ip> <timestamp> <service> <text>` line,
+// undoing masscan's \xNN escapes in text.
+bool parse_masscan_banner_line(std::string_view line, MasscanEntry &entry, std::string_view &service,
+                               std::string &text);
+
+// Open 80/443 addresses go to out_80/out_443. With `banners`, the HTTP
+// banners of tcp ports are collected there as well.
+MasscanCounts parse_masscan_stream(std::istream &in, std::ostream &out_80, std::ostream &out_443,
+                                   MasscanBanners *banners = nullptr);
+bool parse_masscan_results(const std::filesystem::path &masscan_file, const std::filesystem::path &out80,
+                           const std::filesystem::path &out443);
+
+// Minimal zero-copy JSON scanning. Values are returned as raw views into the
+// input (strings keep their quotes and escapes) and only decoded on demand.
+size_t json_skip_value(std::string_view s, size_t pos);
+bool json_next_member(std::string_view object, size_t &pos, std::string_view &key, std::string_view &value);
+bool json_next_element(std::string_view array, size_t &pos, std::string_view &value);
+std::optional<std::string_view> json_member(std::string_view object, std::string_view key);
+std::optional<std::string> json_string(std::string_view raw);
+std::optional<long long> json_int(std::string_view raw);
+std::string unescape_json_string(std::string_view s);
+
+// Leaf certificate presented during the TLS handshake, if any.
+struct CertInfo {
+    std::string subject;
+    std::string issuer;
+    std::string fingerprint_sha256;
+    std::string not_after;
+    std::vector<std::string> names; // subjectAltName DNS names
+};
+
+// One zgrab2 module result for one target.
+struct HttpRecord {
+    std::string ip;
+    std::string domain; // Host/SNI name when the target was given as a hostname
+    uint16_t port = 0;
+    std::string module;
+    std::string status;
+    int status_code = 0;
+    bool has_body = false;
+    std::string body;
+    std::string title; // empty when the body has no <title>
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::optional<CertInfo> cert;
+    // Extra output fields appended by processors, printed as " - key: value".
+    std::vector<std::pair<std::string, std::string>> fields;
+    bool dropped = false;
+};
+
+// View of the trimmed <title> text inside html, nullopt when absent or empty.
+std::optional<std::string_view> find_title(std::string_view html);
+std::string extract_title(const std::string &html);
+// Offset just past the closing tag of the first <title>, npos while it is not closed.
+size_t title_end(std::string_view html);
+
+// Decides from a target's address and port (0 when not yet known) whether its
+// result is wanted at all.
+using TargetFilter = std::function<bool(std::string_view ip, uint16_t port)>;
+
+// Appends one record per module in the zgrab2 line. Returns false when the line
+// carries no target IP. A port of 0 is taken from the module name of a
+// multiple-module run ("http443"), else derived from the request URL. Modules
+// `keep` rejects are skipped before their response is decoded.
+bool parse_zgrab_line(std::string_view line, uint16_t port, std::vector<HttpRecord> &out,
+                      const TargetFilter *keep = nullptr);
+
+// The zgrab2 input line a result line answers: "ip" or "ip,domain", or for a
+// multiple-module run "ip,domain,port" like the tagged lines it was fed.
+std::string zgrab_answered_input(std::string_view line, bool tagged);
+
+// Streams a zgrab2 output file in batches of up to batch_size records.
+bool for_each_zgrab_batch(const std::filesystem::path &zgrab_file, uint16_t port, size_t batch_size,
+                          const std::function<void(std::vector<HttpRecord> &)> &fn,
+                          const TargetFilter *keep = nullptr);
+
+// Reads a file as chunks of whole lines of about chunk_bytes, a single longer
+// line being a chunk of its own, for decoding the chunks in parallel. False when it cannot be read.
+bool for_each_line_chunk(const std::filesystem::path &file, size_t chunk_bytes,
+                         const std::function<void(std::string &)> &fn);
+// parse_zgrab_line over every line of a chunk.
+void parse_zgrab_chunk(std::string_view chunk, uint16_t port, std::vector<HttpRecord> &out,
+                       const TargetFilter *keep = nullptr);
+
+// zgrab_results_8080.json -> 8080, 0 when the name carries no port.
+uint16_t zgrab_port_from_filename(const std::filesystem::path &file);
+
+void format_record(const HttpRecord &rec, std::string &out);
+// Hash of status code, title and body; equal for responses that read the same.
+uint64_t response_fingerprint(const HttpRecord &rec);
+// The same over the body only up to title_end, for bodies that were not read
+// past their title.
+uint64_t response_prefix_fingerprint(const HttpRecord &rec);
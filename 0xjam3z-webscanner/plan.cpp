@@ -0,0 +1,191 @@
+#include "plan.hpp"
+
+#include "tools.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+// Samples per stage that feed an estimate.
+static constexpr size_t kHistoryWindow = 20;
+
+fs::path ScanHistory::default_path() {
+    if (const char *env = std::getenv("JAM3Z_HISTORY"); env && *env) {
+        return env;
+    }
+    return tool_cache_dir() / "history.tsv";
+}
+
+ScanHistory::ScanHistory(fs::path file) : file_(std::move(file)) {}
+
+void ScanHistory::load() {
+    std::ifstream in(file_);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        StageSample sample;
+        long long epoch = 0;
+        if (fields >> sample.stage >> epoch >> sample.in >> sample.out >> sample.bytes >> sample.seconds >>
+            sample.ideal_seconds) {
+            sample.runs = 1;
+            samples_.push_back(std::move(sample));
+        }
+    }
+}
+
+bool ScanHistory::append(const StageSample &sample) const {
+    std::error_code ec;
+    fs::create_directories(file_.parent_path(), ec);
+    bool fresh = !fs::exists(file_, ec);
+    std::ofstream out(file_, std::ios::app);
+    if (!out) {
+        return false;
+    }
+    if (fresh) {
+        out << "# stage\tepoch\tin\tout\tbytes\tseconds\tideal_seconds\n";
+    }
+    out << sample.stage << '\t' << static_cast<long long>(std::time(nullptr)) << '\t' << sample.in << '\t'
+        << sample.out << '\t' << sample.bytes << '\t' << sample.seconds << '\t' << sample.ideal_seconds << '\n';
+    return static_cast<bool>(out);
+}
+
+StageSample ScanHistory::totals(const std::string &stage) const {
+    StageSample sum;
+    sum.stage = stage;
+    for (auto it = samples_.rbegin(); it != samples_.rend() && sum.runs < kHistoryWindow; ++it) {
+        if (it->stage != stage) {
+            continue;
+        }
+        sum.in += it->in;
+        sum.out += it->out;
+        sum.bytes += it->bytes;
+        sum.seconds += it->seconds;
+        sum.ideal_seconds += it->ideal_seconds;
+        ++sum.runs;
+    }
+    return sum;
+}
+
+static std::string human_bytes(double bytes) {
+    static const char *const kUnits[] = {"B", "KB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit + 1 < sizeof(kUnits) / sizeof(kUnits[0])) {
+        bytes /= 1024;
+        ++unit;
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, kUnits[unit]);
+    return buf;
+}
+
+static std::string human_duration(double seconds) {
+    char buf[48];
+    if (seconds < 60) {
+        std::snprintf(buf, sizeof(buf), "%.1fs", seconds);
+    } else if (seconds < 3600) {
+        std::snprintf(buf, sizeof(buf), "%dm %02ds", static_cast<int>(seconds / 60), static_cast<int>(seconds) % 60);
+    } else if (seconds < 1e8) {
+        std::snprintf(buf, sizeof(buf), "%dh %02dm", static_cast<int>(seconds / 3600),
+                      static_cast<int>(seconds / 60) % 60);
+    } else {
+        // Sweeping an IPv6 prefix.
+        std::snprintf(buf, sizeof(buf), "%.3g years", seconds / (365.25 * 86400));
+    }
+    return buf;
+}
+
+// Exact below 2^53, a power of two beyond that; an IPv6 prefix is the usual cause.
+static std::string human_count(double count) {
+    char buf[32];
+    if (count < 9007199254740992.0) {
+        std::snprintf(buf, sizeof(buf), "%.0f", count);
+    } else {
+        std::snprintf(buf, sizeof(buf), "~2^%.1f", std::log2(count));
+    }
+    return buf;
+}
+
+void print_plan(const PlanInput &plan, const ScanHistory &history, std::ostream &out) {
+    const double addresses = static_cast<double>(plan.addresses) + plan.addresses6;
+    const double probes = addresses * static_cast<double>(plan.ports);
+    const double web_probes = addresses * static_cast<double>(plan.web_ports);
+    bool complete = true;
+
+    out << "Plan (dry run, no packets sent)\n";
+    out << "  targets: " << plan.ranges << " ranges, " << plan.addresses << " addresses";
+    if (plan.excluded) {
+        out << " (" << plan.excluded << " excluded)";
+    }
+    if (plan.addresses6 > 0) {
+        out << " + " << human_count(plan.addresses6) << " IPv6";
+    }
+    if (plan.hostnames) {
+        out << " (" << plan.hostnames << " hostnames not resolved)";
+    }
+    out << "\n";
+    out << "  ports:   " << plan.ports << " (" << plan.web_ports << " followed up by zgrab2)\n";
+    out << "  probes:  " << human_count(probes) << " packets at --rate " << plan.rate << "\n";
+
+    // masscan paces itself to --rate; history says how close it actually gets.
+    StageSample masscan = history.totals("masscan");
+    double efficiency = masscan.runs && masscan.seconds > 0 ? std::min(1.0, masscan.ideal_seconds / masscan.seconds) : 1.0;
+    double masscan_seconds = plan.rate > 0 ? probes / plan.rate / efficiency : 0;
+    out << "  masscan: ~" << human_duration(masscan_seconds);
+    double open_ports = 0;
+    double web_open = 0;
+    if (masscan.runs && masscan.in) {
+        double hit_ratio = static_cast<double>(masscan.out) / static_cast<double>(masscan.in);
+        open_ports = probes * hit_ratio;
+        web_open = web_probes * hit_ratio;
+        double bytes_per_open = masscan.out ? static_cast<double>(masscan.bytes) / static_cast<double>(masscan.out) : 0;
+        out << ", ~" << static_cast<uint64_t>(std::llround(open_ports)) << " open ports, ~"
+            << human_bytes(open_ports * bytes_per_open) << " output"
+            << " [" << masscan.runs << " runs, " << static_cast<int>(efficiency * 100) << "% of --rate]\n";
+    } else {
+        complete = false;
+        out << " at full --rate [no history]\n";
+    }
+
+    StageSample zgrab = history.totals("zgrab2");
+    double zgrab_seconds = 0;
+    double zgrab_bytes = 0;
+    if (plan.web_ports == 0) {
+        out << "  zgrab2:  skipped (no tcp/80 or tcp/443)\n";
+    } else if (masscan.runs && zgrab.runs && zgrab.in) {
+        zgrab_seconds = web_open * zgrab.seconds / static_cast<double>(zgrab.in);
+        zgrab_bytes = web_open * static_cast<double>(zgrab.bytes) / static_cast<double>(zgrab.in);
+        out << "  zgrab2:  ~" << static_cast<uint64_t>(std::llround(web_open)) << " targets, ~"
+            << human_duration(zgrab_seconds) << ", ~" << human_bytes(zgrab_bytes) << " output [" << zgrab.runs
+            << " runs]\n";
+    } else {
+        complete = false;
+        out << "  zgrab2:  [no history]\n";
+    }
+
+    StageSample parse = history.totals("parse");
+    double parse_seconds = 0;
+    if (plan.web_ports == 0) {
+        out << "  parse:   skipped\n";
+    } else if (zgrab_bytes > 0 && parse.runs && parse.in) {
+        parse_seconds = zgrab_bytes * parse.seconds / static_cast<double>(parse.in);
+        double titles = zgrab_bytes * static_cast<double>(parse.bytes) / static_cast<double>(parse.in);
+        out << "  parse:   ~" << human_duration(parse_seconds) << ", ~" << human_bytes(titles) << " of titles ["
+            << parse.runs << " runs]\n";
+    } else {
+        complete = false;
+        out << "  parse:   [no history]\n";
+    }
+
+    out << "  total:   " << (complete ? "~" : ">= ") << human_duration(masscan_seconds + zgrab_seconds + parse_seconds)
+        << "\n";
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// One stage of a finished run. The meaning of the counters depends on the stage:
+//   masscan: in = probes sent, out = open ports found, bytes = -oL output size
+//   zgrab2:  in = targets fed, out = records parsed, bytes = JSON output size
+//   parse:   in = JSON bytes read, out = titles written, bytes = titles size
+struct StageSample {
+    std::string stage;
+    uint64_t in = 0;
+    uint64_t out = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    // masscan only: probes / --rate, i.e. how long the run should have taken.
+    double ideal_seconds = 0;
+    size_t runs = 0;
+};
+
+// Append-only log of per-stage throughput, one tab-separated line per stage per
+// run. Estimates use the most recent samples so a changed host or uplink shows
+// up after a few runs.
+class ScanHistory {
+public:
+    // $JAM3Z_HISTORY, else history.tsv next to the tool cache.
+    static std::filesystem::path default_path();
+
+    explicit ScanHistory(std::filesystem::path file);
+
+    void load();
+    bool append(const StageSample &sample) const;
+    // Sum of the recent samples for `stage`; runs == 0 when there are none.
+    StageSample totals(const std::string &stage) const;
+
+private:
+    std::filesystem::path file_;
+    std::vector<StageSample> samples_;
+};
+
+struct PlanInput {
+    uint64_t addresses = 0;
+    size_t ranges = 0;
+    uint64_t excluded = 0;
+    // IPv6 addresses; a double since a single /64 overflows uint64_t.
+    double addresses6 = 0;
+    // Hostname entries; they are only resolved when the scan runs.
+    size_t hostnames = 0;
+    size_t ports = 0;
+    // How many of the ports are followed up by zgrab2 (tcp/80, tcp/443).
+    size_t web_ports = 0;
+    double rate = 0;
+};
+
+void print_plan(const PlanInput &plan, const ScanHistory &history, std::ostream &out);
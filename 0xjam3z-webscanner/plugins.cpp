@@ -0,0 +1,226 @@
+#include "plugins.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+struct jam3z_batch_output {
+    struct Field {
+        size_t index;
+        std::string key;
+        std::string value;
+    };
+    size_t count = 0;
+    std::vector<Field> fields;
+    std::vector<size_t> drops;
+};
+
+static jam3z_str view(const std::string &s) {
+    return {s.data(), s.size()};
+}
+
+static void host_add_field(jam3z_batch_output *out, size_t index, jam3z_str key, jam3z_str value) {
+    if (!out || index >= out->count || !key.data) {
+        return;
+    }
+    out->fields.push_back({index, std::string(key.data, key.len),
+                           value.data ? std::string(value.data, value.len) : std::string()});
+}
+
+static void host_drop_record(jam3z_batch_output *out, size_t index) {
+    if (out && index < out->count) {
+        out->drops.push_back(index);
+    }
+}
+
+static void host_log(int level, const char *message) {
+    static std::mutex log_mutex;
+    std::lock_guard<std::mutex> lock(log_mutex);
+    const char *prefix = level >= JAM3Z_LOG_ERROR ? "[plugin error] " : level == JAM3Z_LOG_WARN ? "[plugin warn] " : "[plugin] ";
+    std::cerr << prefix << (message ? message : "") << std::endl;
+}
+
+static const jam3z_host_api host_api = {JAM3Z_PLUGIN_ABI_VERSION, host_add_field, host_drop_record, host_log};
+
+static void *open_library(const std::string &path) {
+#ifdef _WIN32
+    return reinterpret_cast<void *>(LoadLibraryA(path.c_str()));
+#else
+    return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void *find_symbol(void *handle, const char *name) {
+#ifdef _WIN32
+    return reinterpret_cast<void *>(GetProcAddress(reinterpret_cast<HMODULE>(handle), name));
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+static void close_library(void *handle) {
+#ifdef _WIN32
+    FreeLibrary(reinterpret_cast<HMODULE>(handle));
+#else
+    dlclose(handle);
+#endif
+}
+
+static std::string library_error() {
+#ifdef _WIN32
+    return "error " + std::to_string(GetLastError());
+#else
+    const char *err = dlerror();
+    return err ? err : "unknown error";
+#endif
+}
+
+void make_record_views(const std::vector<HttpRecord> &records, std::vector<size_t> &live,
+                       std::vector<jam3z_record> &views, std::vector<jam3z_header> &headers) {
+    views.clear();
+    headers.clear();
+    live.clear();
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i].dropped) {
+            continue;
+        }
+        live.push_back(i);
+        for (const auto &h : records[i].headers) {
+            headers.push_back({view(h.first), view(h.second)});
+        }
+    }
+    size_t header_pos = 0;
+    for (size_t i : live) {
+        const HttpRecord &rec = records[i];
+        jam3z_record v{};
+        v.ip = view(rec.ip);
+        v.port = rec.port;
+        v.status_code = rec.status_code;
+        v.status = view(rec.status);
+        v.module = view(rec.module);
+        v.headers = rec.headers.empty() ? nullptr : headers.data() + header_pos;
+        v.header_count = rec.headers.size();
+        header_pos += rec.headers.size();
+        v.body = rec.has_body ? view(rec.body) : jam3z_str{nullptr, 0};
+        v.title = rec.title.empty() ? jam3z_str{nullptr, 0} : view(rec.title);
+        v.domain = rec.domain.empty() ? jam3z_str{nullptr, 0} : view(rec.domain);
+        views.push_back(v);
+    }
+}
+
+// jam3z_record as a plugin built against `abi` declared it: fields only ever
+// grow at the end, so an older plugin gets the prefix it knows at its stride.
+static size_t record_size(uint32_t abi) {
+    return abi >= 2 ? sizeof(jam3z_record) : offsetof(jam3z_record, domain);
+}
+
+PluginHost::~PluginHost() {
+    for (auto it = plugins_.rbegin(); it != plugins_.rend(); ++it) {
+        if (it->desc->destroy) {
+            it->desc->destroy(it->state);
+        }
+        close_library(it->handle);
+    }
+}
+
+bool PluginHost::load(const std::string &spec) {
+    size_t eq = spec.find('=');
+    std::string path = spec.substr(0, eq);
+    std::string args = eq == std::string::npos ? std::string() : spec.substr(eq + 1);
+
+    void *handle = open_library(path);
+    if (!handle) {
+        std::cerr << "Failed to load plugin " << path << ": " << library_error() << std::endl;
+        return false;
+    }
+    auto entry = reinterpret_cast<jam3z_plugin_entry_fn>(find_symbol(handle, JAM3Z_PLUGIN_ENTRY_SYMBOL));
+    const jam3z_plugin *desc = entry ? entry() : nullptr;
+    if (!desc || !desc->process_batch) {
+        std::cerr << "Plugin " << path << " does not export " << JAM3Z_PLUGIN_ENTRY_SYMBOL << std::endl;
+        close_library(handle);
+        return false;
+    }
+    if (desc->abi_version == 0 || desc->abi_version > JAM3Z_PLUGIN_ABI_VERSION) {
+        std::cerr << "Plugin " << path << " needs ABI version " << desc->abi_version << ", host provides "
+                  << JAM3Z_PLUGIN_ABI_VERSION << std::endl;
+        close_library(handle);
+        return false;
+    }
+
+    void *state = nullptr;
+    if (desc->create) {
+        state = desc->create(&host_api, args.c_str());
+        if (!state) {
+            std::cerr << "Plugin " << path << " failed to initialise." << std::endl;
+            close_library(handle);
+            return false;
+        }
+    }
+
+    Loaded loaded;
+    loaded.handle = handle;
+    loaded.desc = desc;
+    loaded.state = state;
+    loaded.path = path;
+    if (desc->flags & JAM3Z_PLUGIN_SERIAL) {
+        loaded.serial = std::make_unique<std::mutex>();
+    }
+    std::cout << "Loaded plugin " << (desc->name ? desc->name : path.c_str()) << std::endl;
+    plugins_.push_back(std::move(loaded));
+    return true;
+}
+
+void PluginHost::process(std::vector<HttpRecord> &records) const {
+    if (plugins_.empty() || records.empty()) {
+        return;
+    }
+
+    // Views are rebuilt per plugin so fields and drops from earlier plugins are visible to later ones.
+    std::vector<jam3z_record> views;
+    std::vector<jam3z_header> headers;
+    std::vector<size_t> live;
+    std::vector<unsigned char> packed;
+    for (const auto &plugin : plugins_) {
+        make_record_views(records, live, views, headers);
+        if (views.empty()) {
+            return;
+        }
+        const jam3z_record *array = views.data();
+        size_t size = record_size(plugin.desc->abi_version);
+        if (size != sizeof(jam3z_record)) {
+            packed.resize(size * views.size());
+            for (size_t i = 0; i < views.size(); ++i) {
+                std::memcpy(packed.data() + i * size, &views[i], size);
+            }
+            array = reinterpret_cast<const jam3z_record *>(packed.data());
+        }
+
+        jam3z_batch_output out;
+        out.count = views.size();
+        int rc;
+        if (plugin.serial) {
+            std::lock_guard<std::mutex> lock(*plugin.serial);
+            rc = plugin.desc->process_batch(plugin.state, array, views.size(), &out);
+        } else {
+            rc = plugin.desc->process_batch(plugin.state, array, views.size(), &out);
+        }
+        if (rc != 0) {
+            host_log(JAM3Z_LOG_WARN, (plugin.path + " rejected a batch of " + std::to_string(views.size()) +
+                                      " records (rc=" + std::to_string(rc) + ")")
+                                         .c_str());
+            continue;
+        }
+        for (auto &field : out.fields) {
+            records[live[field.index]].fields.emplace_back(std::move(field.key), std::move(field.value));
+        }
+        for (size_t index : out.drops) {
+            records[live[index]].dropped = true;
+        }
+    }
+}
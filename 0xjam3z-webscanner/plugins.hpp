@@ -0,0 +1,39 @@
+#pragma once
+
+#include "jam3z_plugin.h"
+#include "parsers.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Builds ABI views over the records that are not dropped; live[i] is the record
+// behind views[i]. The views borrow from records and headers.
+void make_record_views(const std::vector<HttpRecord> &records, std::vector<size_t> &live,
+                       std::vector<jam3z_record> &views, std::vector<jam3z_header> &headers);
+
+// Loads processor plugins (see jam3z_plugin.h) and runs them over record batches.
+// process() is safe to call from several parse workers at once.
+class PluginHost {
+public:
+    PluginHost() = default;
+    ~PluginHost();
+    PluginHost(const PluginHost &) = delete;
+    PluginHost &operator=(const PluginHost &) = delete;
+
+    // spec is <path>[=<args>].
+    bool load(const std::string &spec);
+    bool empty() const { return plugins_.empty(); }
+    void process(std::vector<HttpRecord> &records) const;
+
+private:
+    struct Loaded {
+        void *handle = nullptr;
+        const jam3z_plugin *desc = nullptr;
+        void *state = nullptr;
+        std::string path;
+        std::unique_ptr<std::mutex> serial;
+    };
+    std::vector<Loaded> plugins_;
+};
@@ -0,0 +1,85 @@
+/*
+ * Example processor plugin: copies the Server header into the output and tags
+ * records whose title contains a keyword (default "login").
+ *
+ *   ./0xjam3z-scanner 1.2.3.0/24 --plugin ./build/libexample_tagger.so=admin
+ */
+#include "jam3z_plugin.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct tagger {
+    const jam3z_host_api *host;
+    char keyword[64];
+    size_t keyword_len;
+};
+
+static int contains_nocase(jam3z_str haystack, const char *needle, size_t needle_len) {
+    if (!haystack.data || needle_len == 0 || haystack.len < needle_len) {
+        return 0;
+    }
+    for (size_t i = 0; i + needle_len <= haystack.len; ++i) {
+        size_t j = 0;
+        while (j < needle_len && tolower((unsigned char)haystack.data[i + j]) == needle[j]) {
+            ++j;
+        }
+        if (j == needle_len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *tagger_create(const jam3z_host_api *host, const char *args) {
+    struct tagger *t = calloc(1, sizeof(*t));
+    if (!t) {
+        return NULL;
+    }
+    t->host = host;
+    const char *keyword = (args && *args) ? args : "login";
+    size_t len = strlen(keyword);
+    if (len >= sizeof(t->keyword)) {
+        len = sizeof(t->keyword) - 1;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        t->keyword[i] = (char)tolower((unsigned char)keyword[i]);
+    }
+    t->keyword_len = len;
+    return t;
+}
+
+static int tagger_process(void *state, const jam3z_record *records, size_t count, jam3z_batch_output *out) {
+    struct tagger *t = state;
+    static const char server_key[] = "Server";
+    static const char tag_key[] = "Tag";
+    for (size_t i = 0; i < count; ++i) {
+        const jam3z_record *r = &records[i];
+        for (size_t h = 0; h < r->header_count; ++h) {
+            if (r->headers[h].name.len == 6 && memcmp(r->headers[h].name.data, "server", 6) == 0) {
+                jam3z_str key = {server_key, sizeof(server_key) - 1};
+                t->host->add_field(out, i, key, r->headers[h].value);
+                break;
+            }
+        }
+        if (contains_nocase(r->title, t->keyword, t->keyword_len)) {
+            jam3z_str key = {tag_key, sizeof(tag_key) - 1};
+            jam3z_str value = {t->keyword, t->keyword_len};
+            t->host->add_field(out, i, key, value);
+        }
+    }
+    return 0;
+}
+
+static void tagger_destroy(void *state) {
+    free(state);
+}
+
+static const jam3z_plugin tagger_plugin = {
+    JAM3Z_PLUGIN_ABI_VERSION, 0, "example_tagger", tagger_create, tagger_process, tagger_destroy,
+};
+
+JAM3Z_PLUGIN_EXPORT const jam3z_plugin *jam3z_plugin_entry(void) {
+    return &tagger_plugin;
+}
@@ -0,0 +1,335 @@
+"""ctypes bindings for libjam3z, the 0xjam3z-scanner parsing core.
+
+Gives Python tooling the scanner's native masscan/zgrab2 parsers, title
+extractor and ASN index without spawning the CLI. Results come back in
+batches; numeric columns are memoryviews (buffer protocol), so they can be
+handed to array/numpy without a per-record copy:
+
+    import jam3z
+    for batch in jam3z.iter_masscan("masscan_results.txt"):
+        ips = numpy.frombuffer(batch.ips, dtype=numpy.uint32)
+
+The library is looked up in $JAM3Z_LIB, next to this file, in ../build, and
+finally on the system library path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+from typing import Iterator, List, NamedTuple, Optional, Tuple, Union
+
+__all__ = [
+    "AsnIndex",
+    "AsnInfo",
+    "MasscanBatch",
+    "Record",
+    "find_title",
+    "format_ipv4",
+    "iter_masscan",
+    "iter_zgrab",
+    "parse_ipv4",
+]
+
+
+class _Str(ctypes.Structure):
+    _fields_ = [("data", ctypes.c_void_p), ("len", ctypes.c_size_t)]
+
+    def to_bytes(self) -> Optional[bytes]:
+        if not self.data:
+            return None
+        return ctypes.string_at(self.data, self.len)
+
+    def to_str(self) -> Optional[str]:
+        raw = self.to_bytes()
+        return None if raw is None else raw.decode("utf-8", "replace")
+
+
+class _Header(ctypes.Structure):
+    _fields_ = [("name", _Str), ("value", _Str)]
+
+
+class _Record(ctypes.Structure):
+    _fields_ = [
+        ("ip", _Str),
+        ("port", ctypes.c_uint16),
+        ("status_code", ctypes.c_int32),
+        ("status", _Str),
+        ("module", _Str),
+        ("headers", ctypes.POINTER(_Header)),
+        ("header_count", ctypes.c_size_t),
+        ("body", _Str),
+        ("title", _Str),
+        ("domain", _Str),
+    ]
+
+
+class _AsnInfo(ctypes.Structure):
+    _fields_ = [
+        ("start", ctypes.c_uint32),
+        ("end", ctypes.c_uint32),
+        ("asn", ctypes.c_uint32),
+        ("country", _Str),
+        ("country_name", _Str),
+        ("as_name", _Str),
+    ]
+
+
+def _candidates():
+    env = os.environ.get("JAM3Z_LIB")
+    if env:
+        yield env
+    here = os.path.dirname(os.path.abspath(__file__))
+    names = ["libjam3z.so", "libjam3z.dylib", "jam3z.dll"]
+    for directory in (here, os.path.join(here, "..", "build")):
+        for name in names:
+            yield os.path.join(directory, name)
+    found = ctypes.util.find_library("jam3z")
+    if found:
+        yield found
+
+
+def _load():
+    for path in _candidates():
+        if os.path.sep in path and not os.path.exists(path):
+            continue
+        try:
+            return ctypes.CDLL(path)
+        except OSError:
+            continue
+    raise OSError("libjam3z not found; build it with cmake or set JAM3Z_LIB")
+
+
+_lib = _load()
+
+_lib.jam3z_core_abi_version.restype = ctypes.c_uint32
+_lib.jam3z_last_error.restype = ctypes.c_char_p
+_lib.jam3z_parse_ipv4.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint32)]
+_lib.jam3z_parse_ipv4.restype = ctypes.c_int
+_lib.jam3z_format_ipv4.argtypes = [ctypes.c_uint32, ctypes.c_char_p]
+_lib.jam3z_format_ipv4.restype = ctypes.c_size_t
+_lib.jam3z_masscan_parse.argtypes = [
+    ctypes.c_char_p,
+    ctypes.c_size_t,
+    ctypes.c_int,
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.POINTER(ctypes.c_uint16),
+    ctypes.POINTER(ctypes.c_uint8),
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_size_t),
+]
+_lib.jam3z_masscan_parse.restype = ctypes.c_size_t
+_lib.jam3z_zgrab_open.argtypes = [ctypes.c_char_p, ctypes.c_uint16]
+_lib.jam3z_zgrab_open.restype = ctypes.c_void_p
+_lib.jam3z_zgrab_open_buffer.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint16]
+_lib.jam3z_zgrab_open_buffer.restype = ctypes.c_void_p
+_lib.jam3z_zgrab_next.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.POINTER(_Record))]
+_lib.jam3z_zgrab_next.restype = ctypes.c_size_t
+_lib.jam3z_zgrab_close.argtypes = [ctypes.c_void_p]
+_lib.jam3z_zgrab_close.restype = None
+_lib.jam3z_find_title.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(_Str)]
+_lib.jam3z_find_title.restype = ctypes.c_int
+_lib.jam3z_asn_index_load.argtypes = [ctypes.c_char_p]
+_lib.jam3z_asn_index_load.restype = ctypes.c_void_p
+_lib.jam3z_asn_index_load_buffer.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+_lib.jam3z_asn_index_load_buffer.restype = ctypes.c_void_p
+_lib.jam3z_asn_index_size.argtypes = [ctypes.c_void_p]
+_lib.jam3z_asn_index_size.restype = ctypes.c_size_t
+_lib.jam3z_asn_lookup.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(_AsnInfo)]
+_lib.jam3z_asn_lookup.restype = ctypes.c_int
+_lib.jam3z_asn_lookup_batch.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_uint32),
+    ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_uint32),
+]
+_lib.jam3z_asn_lookup_batch.restype = ctypes.c_size_t
+_lib.jam3z_asn_index_free.argtypes = [ctypes.c_void_p]
+_lib.jam3z_asn_index_free.restype = None
+
+ABI_VERSION = _lib.jam3z_core_abi_version()
+if ABI_VERSION < 2:
+    # _Record ends with the domain field added in version 2.
+    raise ImportError("libjam3z ABI version %d is older than the 2 these bindings need" % ABI_VERSION)
+
+
+def _error(what: str) -> OSError:
+    return OSError("%s: %s" % (what, _lib.jam3z_last_error().decode("utf-8", "replace")))
+
+
+def _u32_view(array) -> memoryview:
+    return memoryview(array).cast("B").cast("I")
+
+
+def parse_ipv4(text: Union[str, bytes]) -> int:
+    raw = text.encode() if isinstance(text, str) else text
+    out = ctypes.c_uint32()
+    if not _lib.jam3z_parse_ipv4(raw, len(raw), ctypes.byref(out)):
+        raise ValueError("not an IPv4 address: %r" % (text,))
+    return out.value
+
+
+def format_ipv4(ip: int) -> str:
+    buf = ctypes.create_string_buffer(16)
+    n = _lib.jam3z_format_ipv4(ip, buf)
+    return buf.raw[:n].decode()
+
+
+class MasscanBatch(NamedTuple):
+    """Columns of `open` entries; memoryviews of formats I, H, B and I."""
+
+    ips: memoryview
+    ports: memoryview
+    protos: memoryview
+    timestamps: memoryview
+
+    def __len__(self) -> int:
+        return len(self.ips)
+
+
+def iter_masscan(source: Union[str, bytes, os.PathLike], batch_size: int = 65536,
+                 chunk_size: int = 1 << 22) -> Iterator[MasscanBatch]:
+    """Yields batches of parsed masscan -oL `open` lines from a path or a bytes object."""
+    if isinstance(source, (bytes, bytearray)):
+        chunks = iter([bytes(source)])
+    else:
+        def read_chunks():
+            with open(source, "rb") as f:
+                while True:
+                    chunk = f.read(chunk_size)
+                    if not chunk:
+                        return
+                    yield chunk
+        chunks = read_chunks()
+
+    pending = b""
+    exhausted = False
+    while not exhausted or pending:
+        if not exhausted:
+            chunk = next(chunks, None)
+            if chunk is None:
+                exhausted = True
+            else:
+                pending += chunk
+        final = 1 if exhausted else 0
+        while pending:
+            ips = (ctypes.c_uint32 * batch_size)()
+            ports = (ctypes.c_uint16 * batch_size)()
+            protos = (ctypes.c_uint8 * batch_size)()
+            stamps = (ctypes.c_uint32 * batch_size)()
+            consumed = ctypes.c_size_t()
+            n = _lib.jam3z_masscan_parse(pending, len(pending), final, ips, ports, protos, stamps,
+                                         batch_size, ctypes.byref(consumed))
+            pending = pending[consumed.value:]
+            if n:
+                yield MasscanBatch(_u32_view(ips)[:n], memoryview(ports).cast("B").cast("H")[:n],
+                                   memoryview(protos).cast("B")[:n], _u32_view(stamps)[:n])
+            if consumed.value == 0 or (n < batch_size and not final):
+                break
+        if exhausted:
+            break
+
+
+class Record(NamedTuple):
+    ip: str
+    port: int
+    module: Optional[str]
+    status: Optional[str]
+    status_code: int
+    headers: List[Tuple[str, str]]
+    body: Optional[bytes]
+    title: Optional[str]
+    domain: Optional[str]
+
+
+def _record(r: _Record) -> Record:
+    headers = [(r.headers[i].name.to_str(), r.headers[i].value.to_str()) for i in range(r.header_count)]
+    return Record(r.ip.to_str(), r.port, r.module.to_str(), r.status.to_str(), r.status_code, headers,
+                  r.body.to_bytes(), r.title.to_str(), r.domain.to_str())
+
+
+def iter_zgrab(source: Union[str, bytes, os.PathLike], port: int = 0,
+               batch_size: int = 1024) -> Iterator[List[Record]]:
+    """Yields lists of Records from a zgrab2 output file or bytes; port 0 derives it per record."""
+    if isinstance(source, (bytes, bytearray)):
+        data = bytes(source)
+        handle = _lib.jam3z_zgrab_open_buffer(data, len(data), port)
+    else:
+        handle = _lib.jam3z_zgrab_open(os.fsencode(source), port)
+    if not handle:
+        raise _error("jam3z_zgrab_open")
+    try:
+        records = ctypes.POINTER(_Record)()
+        while True:
+            n = _lib.jam3z_zgrab_next(handle, batch_size, ctypes.byref(records))
+            if n == 0:
+                return
+            yield [_record(records[i]) for i in range(n)]
+    finally:
+        _lib.jam3z_zgrab_close(handle)
+
+
+def find_title(html: bytes) -> Optional[bytes]:
+    title = _Str()
+    if not _lib.jam3z_find_title(html, len(html), ctypes.byref(title)):
+        return None
+    return title.to_bytes()
+
+
+class AsnInfo(NamedTuple):
+    start: int
+    end: int
+    asn: int
+    country: str
+    country_name: str
+    as_name: str
+
+
+class AsnIndex:
+    """IP -> ASN index over the IPv4 and IPv6 ranges of country_asn.json (array or JSON lines).
+
+    Lookups take IPv4 addresses; len() counts ranges of both families.
+    """
+
+    def __init__(self, path: Optional[Union[str, os.PathLike]] = None, data: Optional[bytes] = None):
+        if data is not None:
+            self._handle = _lib.jam3z_asn_index_load_buffer(data, len(data))
+        else:
+            self._handle = _lib.jam3z_asn_index_load(os.fsencode(path))
+        if not self._handle:
+            raise _error("jam3z_asn_index_load")
+
+    def close(self) -> None:
+        if self._handle:
+            _lib.jam3z_asn_index_free(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __len__(self) -> int:
+        return _lib.jam3z_asn_index_size(self._handle)
+
+    def lookup(self, ip: Union[int, str]) -> Optional[AsnInfo]:
+        value = parse_ipv4(ip) if isinstance(ip, str) else ip
+        info = _AsnInfo()
+        if not _lib.jam3z_asn_lookup(self._handle, value, ctypes.byref(info)):
+            return None
+        return AsnInfo(info.start, info.end, info.asn, info.country.to_str(), info.country_name.to_str(),
+                       info.as_name.to_str())
+
+    def lookup_many(self, ips) -> memoryview:
+        """ASN per address for any buffer of uint32 (array('I'), numpy.uint32, MasscanBatch.ips)."""
+        view = memoryview(ips).cast("B")
+        count = len(view) // 4
+        src = (ctypes.c_uint32 * count).from_buffer_copy(view) if view.readonly else \
+            (ctypes.c_uint32 * count).from_buffer(view)
+        out = (ctypes.c_uint32 * count)()
+        _lib.jam3z_asn_lookup_batch(self._handle, src, count, out)
+        return _u32_view(out)
@@ -0,0 +1,140 @@
+#include "retry.hpp"
+
+#include "common.hpp"
+#include "event_loop.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iterator>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Responsive hosts kept for the latency sample.
+static constexpr size_t kRttSample = 256;
+// zgrab2's own defaults, used by the first pass.
+static constexpr unsigned kDefaultTimeout = 10;
+static constexpr unsigned kDefaultSenders = 1000;
+
+bool is_retryable(const HttpRecord &rec) {
+    if (rec.status == "success") {
+        return !rec.has_body || rec.body.empty();
+    }
+    return rec.status.empty() || rec.status == "connection-timeout" || rec.status == "io-timeout" ||
+           rec.status == "connection-closed" || rec.status == "unknown-error";
+}
+
+void RetryQueue::hold(std::vector<HttpRecord> &batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto keep = std::stable_partition(batch.begin(), batch.end(), [&](const HttpRecord &rec) {
+        if (is_retryable(rec)) {
+            return false;
+        }
+        uint32_t ip = 0;
+        if (rec.status == "success" && parse_ipv4(rec.ip, ip)) {
+            // Reservoir sampling keeps the sample uniform over the whole pass.
+            uint64_t slot = responsive_seen_++;
+            if (responsive_.size() < kRttSample) {
+                responsive_.emplace_back(ip, rec.port);
+            } else if ((slot = rng_() % (slot + 1)) < kRttSample) {
+                responsive_[slot] = Endpoint(ip, rec.port);
+            }
+        }
+        return true;
+    });
+    std::move(keep, batch.end(), std::back_inserter(held_));
+    batch.erase(keep, batch.end());
+}
+
+std::vector<HttpRecord> RetryQueue::take_held() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::move(held_);
+}
+
+std::vector<Endpoint> RetryQueue::responsive() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return responsive_;
+}
+
+#ifdef _WIN32
+std::vector<double> sample_connect_rtts(const std::vector<Endpoint> &, size_t, double) {
+    return {};
+}
+#else
+std::vector<double> sample_connect_rtts(const std::vector<Endpoint> &targets, size_t concurrency, double timeout) {
+    using Clock = std::chrono::steady_clock;
+    EventLoop loop;
+    std::vector<double> rtts;
+    size_t next = 0;
+    size_t in_flight = 0;
+
+    std::function<void()> launch;
+    auto done = [&](int fd, uint64_t timer) {
+        if (timer) {
+            loop.cancel_timer(timer);
+        }
+        loop.unwatch(fd);
+        close(fd);
+        --in_flight;
+        launch();
+    };
+    launch = [&] {
+        while (in_flight < concurrency && next < targets.size()) {
+            const Endpoint &target = targets[next++];
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                return;
+            }
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(target.second);
+            addr.sin_addr.s_addr = htonl(target.first);
+            auto start = Clock::now();
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+            ++in_flight;
+            uint64_t timer = loop.add_timer(timeout, [&done, fd] { done(fd, 0); });
+            loop.watch(fd, EventLoop::kWrite, [&, fd, start, timer](unsigned) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                // A reset comes back as fast as an accept; either way it is one round trip.
+                if (err == 0 || err == ECONNREFUSED) {
+                    rtts.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+                }
+                done(fd, timer);
+            });
+        }
+    };
+    launch();
+    loop.run();
+    return rtts;
+}
+#endif
+
+RetryPolicy plan_retry(std::vector<double> rtts, size_t targets) {
+    RetryPolicy policy;
+    // A grab is a handful of round trips (TCP, TLS, request, a few body windows);
+    // 16 p99 RTTs plus room for one retransmit timeout covers the slow tail. Never
+    // less than twice what the first pass allowed, since these already timed out.
+    policy.timeout_seconds = 3 * kDefaultTimeout;
+    if (!rtts.empty()) {
+        std::sort(rtts.begin(), rtts.end());
+        policy.rtt_p50 = rtts[rtts.size() / 2];
+        policy.rtt_p99 = rtts[std::min(rtts.size() - 1, rtts.size() * 99 / 100)];
+        double timeout = 16 * policy.rtt_p99 + 3;
+        policy.timeout_seconds = static_cast<unsigned>(std::ceil(std::clamp(timeout, 2.0 * kDefaultTimeout, 60.0)));
+    }
+    // Losses in the first pass are mostly self-inflicted congestion; go easy.
+    policy.senders = static_cast<unsigned>(std::clamp<size_t>(targets / 4, 1, kDefaultSenders / 10));
+    return policy;
+}
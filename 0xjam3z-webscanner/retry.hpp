@@ -0,0 +1,51 @@
+#pragma once
+
+#include "parsers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+using Endpoint = std::pair<uint32_t, uint16_t>;
+
+// Timeouts, resets and empty successful responses: worth a second, slower pass.
+// Refused connections and protocol errors are answers and are not retried.
+bool is_retryable(const HttpRecord &rec);
+
+// Shared by the parse workers during the first pass. Retryable records are held
+// back from the output until the second pass has had a go at them, and a random
+// sample of responsive hosts is kept to measure latency against.
+class RetryQueue {
+public:
+    // Moves the retryable records out of batch.
+    void hold(std::vector<HttpRecord> &batch);
+
+    std::vector<HttpRecord> take_held();
+    std::vector<Endpoint> responsive() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<HttpRecord> held_;
+    std::vector<Endpoint> responsive_;
+    uint64_t responsive_seen_ = 0;
+    std::minstd_rand rng_;
+};
+
+// Connect round-trip times in seconds for the endpoints that answered (SYN-ACK or
+// RST) within `timeout`, with at most `concurrency` connects in flight.
+std::vector<double> sample_connect_rtts(const std::vector<Endpoint> &targets, size_t concurrency, double timeout);
+
+struct RetryPolicy {
+    unsigned timeout_seconds = 0;
+    unsigned senders = 0;
+    // Connect RTT percentiles the timeout was derived from, 0 without samples.
+    double rtt_p50 = 0;
+    double rtt_p99 = 0;
+};
+
+// Second-pass zgrab2 --timeout and --senders for `targets` retries, given the
+// connect RTTs sampled after the first pass.
+RetryPolicy plan_retry(std::vector<double> rtts, size_t targets);
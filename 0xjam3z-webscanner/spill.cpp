@@ -0,0 +1,304 @@
+#include "spill.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+#ifdef JAM3Z_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Spilled data is written and read back in blocks of about this size, each
+// ending on a line boundary.
+static constexpr size_t kBlockSize = 1024 * 1024;
+// Smallest tail worth a segment file.
+static constexpr uint64_t kMinSpill = 64 * 1024;
+
+bool parse_byte_size(std::string_view text, uint64_t &out) {
+    size_t digits = 0;
+    uint64_t value = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        value = value * 10 + static_cast<uint64_t>(text[digits] - '0');
+        ++digits;
+    }
+    if (digits == 0 || digits > 15) {
+        return false;
+    }
+    std::string_view unit = text.substr(digits);
+    if (!unit.empty() && (unit.back() == 'b' || unit.back() == 'B')) {
+        unit.remove_suffix(1);
+    }
+    if (unit.size() > 1) {
+        return false;
+    }
+    int shift = 0;
+    if (!unit.empty()) {
+        switch (std::tolower(static_cast<unsigned char>(unit[0]))) {
+        case 'k': shift = 10; break;
+        case 'm': shift = 20; break;
+        case 'g': shift = 30; break;
+        case 't': shift = 40; break;
+        default: return false;
+        }
+    }
+    out = value << shift;
+    return true;
+}
+
+MemoryBudget::MemoryBudget(uint64_t limit, fs::path dir) : limit_(limit), dir_(std::move(dir)) {}
+
+MemoryBudget::~MemoryBudget() {
+    if (created_dir_) {
+        std::error_code ec;
+        fs::remove(dir_, ec);
+    }
+}
+
+uint64_t MemoryBudget::share() const {
+    return limit_ / std::max<size_t>(1, holding_);
+}
+
+fs::path MemoryBudget::next_segment(const std::string &name) {
+    std::error_code ec;
+    if (fs::create_directories(dir_, ec)) {
+        created_dir_ = true;
+    }
+    return dir_ / (name + "-" + std::to_string(next_id_++) + ".spill");
+}
+
+SpillQueue::SpillQueue(MemoryBudget *budget, std::string name) : budget_(budget), name_(std::move(name)) {}
+
+SpillQueue::SpillQueue(SpillQueue &&other) noexcept
+    : budget_(other.budget_), name_(std::move(other.name_)), segments_(std::move(other.segments_)),
+      tail_(std::move(other.tail_)), bytes_(other.bytes_), retry_at_(other.retry_at_) {
+    other.segments_.clear();
+    other.tail_.clear();
+    other.bytes_ = 0;
+}
+
+SpillQueue &SpillQueue::operator=(SpillQueue &&other) noexcept {
+    if (this != &other) {
+        clear();
+        budget_ = other.budget_;
+        name_ = std::move(other.name_);
+        segments_ = std::move(other.segments_);
+        tail_ = std::move(other.tail_);
+        bytes_ = other.bytes_;
+        retry_at_ = other.retry_at_;
+        other.segments_.clear();
+        other.tail_.clear();
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+SpillQueue::~SpillQueue() {
+    clear();
+}
+
+void SpillQueue::release_tail() {
+    if (budget_ && !tail_.empty()) {
+        budget_->sub(tail_.size());
+        --budget_->holding_;
+    }
+    std::string().swap(tail_);
+}
+
+void SpillQueue::clear() {
+    release_tail();
+    for (const auto &segment : segments_) {
+        std::error_code ec;
+        fs::remove(segment, ec);
+    }
+    segments_.clear();
+    bytes_ = 0;
+    retry_at_ = 0;
+}
+
+void SpillQueue::append(std::string_view data) {
+    if (data.empty()) {
+        return;
+    }
+    if (budget_) {
+        if (tail_.empty()) {
+            ++budget_->holding_;
+        }
+        budget_->add(data.size());
+    }
+    tail_.append(data.data(), data.size());
+    bytes_ += data.size();
+    if (budget_ && budget_->over() && tail_.size() >= std::max({kMinSpill, budget_->share(), retry_at_})) {
+        spill();
+    }
+}
+
+static void put_u32(std::string &out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>(v >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const char *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+// Block framing: raw size, stored size, stored bytes. Stored == raw means the
+// block is not compressed.
+static void write_block(std::ofstream &out, std::string_view raw, std::string &scratch) {
+    scratch.clear();
+    put_u32(scratch, static_cast<uint32_t>(raw.size()));
+#ifdef JAM3Z_HAVE_ZLIB
+    uLongf stored = compressBound(static_cast<uLong>(raw.size()));
+    std::string packed(stored, '\0');
+    if (compress2(reinterpret_cast<Bytef *>(&packed[0]), &stored, reinterpret_cast<const Bytef *>(raw.data()),
+                  static_cast<uLong>(raw.size()), 1) == Z_OK &&
+        stored < raw.size()) {
+        put_u32(scratch, static_cast<uint32_t>(stored));
+        scratch.append(packed.data(), stored);
+        out.write(scratch.data(), static_cast<std::streamsize>(scratch.size()));
+        return;
+    }
+#endif
+    put_u32(scratch, static_cast<uint32_t>(raw.size()));
+    scratch.append(raw.data(), raw.size());
+    out.write(scratch.data(), static_cast<std::streamsize>(scratch.size()));
+}
+
+void SpillQueue::spill() {
+    fs::path path = budget_->next_segment(name_);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string scratch;
+    std::string_view rest = tail_;
+    while (out && !rest.empty()) {
+        size_t cut = rest.size();
+        if (cut > kBlockSize) {
+            size_t nl = rest.rfind('\n', kBlockSize - 1);
+            cut = nl == std::string_view::npos ? rest.find('\n') : nl + 1;
+            cut = cut == std::string_view::npos ? rest.size() : cut;
+        }
+        write_block(out, rest.substr(0, cut), scratch);
+        rest.remove_prefix(cut);
+    }
+    out.close();
+    if (!out) {
+        // Keep the data in memory rather than lose it, and rewrite it only
+        // once the tail has doubled.
+        std::cerr << "Failed to write spill file " << path << "; keeping it in memory" << std::endl;
+        std::error_code ec;
+        fs::remove(path, ec);
+        retry_at_ = 2 * tail_.size();
+        return;
+    }
+    retry_at_ = 0;
+    budget_->spilled_bytes_ += tail_.size();
+    ++budget_->spilled_segments_;
+    segments_.push_back(std::move(path));
+    release_tail();
+}
+
+bool SpillQueue::for_each_chunk(const std::function<bool(std::string_view)> &fn) const {
+    std::string stored;
+    std::string raw;
+    for (const auto &segment : segments_) {
+        std::ifstream in(segment, std::ios::binary);
+        char header[8];
+        while (in.read(header, sizeof(header))) {
+            uint32_t raw_size = get_u32(header);
+            uint32_t stored_size = get_u32(header + 4);
+            stored.resize(stored_size);
+            if (!in.read(&stored[0], stored_size)) {
+                std::cerr << "Truncated spill file " << segment << std::endl;
+                return false;
+            }
+            if (stored_size == raw_size) {
+                if (!fn(stored)) {
+                    return true;
+                }
+                continue;
+            }
+#ifdef JAM3Z_HAVE_ZLIB
+            raw.resize(raw_size);
+            uLongf size = raw_size;
+            if (uncompress(reinterpret_cast<Bytef *>(&raw[0]), &size, reinterpret_cast<const Bytef *>(stored.data()),
+                           stored_size) != Z_OK ||
+                size != raw_size) {
+                std::cerr << "Corrupt spill file " << segment << std::endl;
+                return false;
+            }
+            if (!fn(raw)) {
+                return true;
+            }
+#else
+            std::cerr << "Compressed spill file " << segment << " needs zlib" << std::endl;
+            return false;
+#endif
+        }
+        if (!in.eof()) {
+            std::cerr << "Failed to read spill file " << segment << std::endl;
+            return false;
+        }
+    }
+    if (!tail_.empty()) {
+        fn(tail_);
+    }
+    return true;
+}
+
+void SpillQueue::for_each_line(const std::function<void(std::string_view)> &fn) const {
+    for_each_chunk([&](std::string_view chunk) {
+        size_t pos = 0;
+        while (pos < chunk.size()) {
+            size_t end = chunk.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = chunk.size();
+            }
+            fn(chunk.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        return true;
+    });
+}
+
+void SpillStreamBuf::push_lines() {
+    size_t nl = pending_.rfind('\n');
+    if (nl == std::string::npos) {
+        return;
+    }
+    queue_.append(std::string_view(pending_.data(), nl + 1));
+    pending_.erase(0, nl + 1);
+}
+
+SpillStreamBuf::int_type SpillStreamBuf::overflow(int_type c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        pending_ += traits_type::to_char_type(c);
+        if (pending_.size() >= kMinSpill) {
+            push_lines();
+        }
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize SpillStreamBuf::xsputn(const char *s, std::streamsize n) {
+    pending_.append(s, static_cast<size_t>(n));
+    if (pending_.size() >= kMinSpill) {
+        push_lines();
+    }
+    return n;
+}
+
+// Only whole lines go in on a flush, so a flush mid-line never splits one.
+int SpillStreamBuf::sync() {
+    push_lines();
+    return 0;
+}
+
+SpillStreamBuf::~SpillStreamBuf() {
+    queue_.append(pending_);
+}
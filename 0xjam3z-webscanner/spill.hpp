@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// "512M", "2G", "64k" or plain bytes.
+bool parse_byte_size(std::string_view text, uint64_t &out);
+
+// Global --memory-limit shared by the stage queues. Every queue accounts its
+// in-memory bytes here; while the total is over the limit, a queue holding at
+// least its share (the limit split over the queues currently holding data)
+// spills on its next append.
+class MemoryBudget {
+public:
+    // A limit of 0 never spills.
+    MemoryBudget(uint64_t limit, std::filesystem::path dir);
+    ~MemoryBudget();
+
+    uint64_t limit() const { return limit_; }
+    bool over() const { return limit_ && used_ > limit_; }
+    uint64_t share() const;
+
+    uint64_t spilled_bytes() const { return spilled_bytes_; }
+    uint64_t spilled_segments() const { return spilled_segments_; }
+
+private:
+    friend class SpillQueue;
+
+    void add(uint64_t bytes) { used_ += bytes; }
+    void sub(uint64_t bytes) { used_ -= bytes; }
+    std::filesystem::path next_segment(const std::string &name);
+
+    uint64_t limit_;
+    std::filesystem::path dir_;
+    std::atomic<uint64_t> used_{0};
+    std::atomic<size_t> holding_{0};
+    std::atomic<uint64_t> next_id_{0};
+    std::atomic<uint64_t> spilled_bytes_{0};
+    std::atomic<uint64_t> spilled_segments_{0};
+    std::atomic<bool> created_dir_{false};
+};
+
+// Append-only FIFO of text between two stages. Data stays in memory until the
+// budget says otherwise, then the in-memory tail goes to a segment file as
+// compressed blocks; reading returns spilled segments and then the tail, in
+// append order. Appends must be whole lines so every chunk handed to a reader
+// ends on a line boundary. One writer; reads may run concurrently once writing
+// is done.
+class SpillQueue {
+public:
+    // Without a budget, everything stays in memory.
+    SpillQueue() = default;
+    SpillQueue(MemoryBudget *budget, std::string name);
+    SpillQueue(SpillQueue &&other) noexcept;
+    SpillQueue &operator=(SpillQueue &&other) noexcept;
+    SpillQueue(const SpillQueue &) = delete;
+    SpillQueue &operator=(const SpillQueue &) = delete;
+    ~SpillQueue();
+
+    void append(std::string_view data);
+    bool empty() const { return bytes_ == 0; }
+    // Total bytes appended, in memory or not.
+    uint64_t bytes() const { return bytes_; }
+    // Calls fn with consecutive chunks until it returns false; false when a
+    // segment cannot be read back.
+    bool for_each_chunk(const std::function<bool(std::string_view)> &fn) const;
+    void for_each_line(const std::function<void(std::string_view)> &fn) const;
+    // Drops all data and segment files.
+    void clear();
+
+private:
+    void spill();
+    void release_tail();
+
+    MemoryBudget *budget_ = nullptr;
+    std::string name_;
+    std::vector<std::filesystem::path> segments_;
+    std::string tail_;
+    uint64_t bytes_ = 0;
+    // After a failed spill, the tail size at which to try again.
+    uint64_t retry_at_ = 0;
+};
+
+// std::ostream front end for a SpillQueue, for code that writes to streams.
+// Complete lines are appended as they arrive or on flush; a last line with no
+// newline when the buffer is destroyed.
+class SpillStreamBuf : public std::streambuf {
+public:
+    explicit SpillStreamBuf(SpillQueue &queue) : queue_(queue) {}
+    ~SpillStreamBuf() override;
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    void push_lines();
+
+    SpillQueue &queue_;
+    std::string pending_;
+};
+
+class SpillStream : public std::ostream {
+public:
+    explicit SpillStream(SpillQueue &queue) : std::ostream(nullptr), buf_(queue) { rdbuf(&buf_); }
+    ~SpillStream() override { flush(); }
+
+private:
+    SpillStreamBuf buf_;
+};
@@ -0,0 +1,346 @@
+#include "sqlite_sink.hpp"
+
+#include <chrono>
+#include <ctime>
+#include <iostream>
+
+#ifdef JAM3Z_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+// Batches queued ahead of the writer before producers block.
+static constexpr size_t kMaxQueuedBatches = 64;
+// Services written per transaction.
+static constexpr size_t kRowsPerTransaction = 50000;
+// An open transaction is committed once no batch has arrived for this long.
+static constexpr double kIdleCommitSeconds = 1.0;
+
+SqliteSink::~SqliteSink() {
+    close();
+}
+
+#ifndef JAM3Z_HAVE_SQLITE
+
+bool SqliteSink::open(const std::string &, const std::string &) {
+    std::cerr << "--sqlite is unavailable: this build has no SQLite support." << std::endl;
+    return false;
+}
+
+void SqliteSink::submit(std::vector<HttpRecord> &) {}
+
+bool SqliteSink::close() {
+    return true;
+}
+
+#else
+
+static const char *const kSchema = R"sql(
+CREATE TABLE IF NOT EXISTS scans (
+    id INTEGER PRIMARY KEY,
+    started_at INTEGER NOT NULL,
+    source TEXT
+);
+CREATE TABLE IF NOT EXISTS hosts (
+    id INTEGER PRIMARY KEY,
+    ip TEXT NOT NULL
+);
+CREATE TABLE IF NOT EXISTS services (
+    id INTEGER PRIMARY KEY,
+    scan_id INTEGER NOT NULL REFERENCES scans(id),
+    host_id INTEGER NOT NULL REFERENCES hosts(id),
+    port INTEGER NOT NULL,
+    module TEXT,
+    status TEXT,
+    status_code INTEGER,
+    has_body INTEGER NOT NULL
+);
+CREATE TABLE IF NOT EXISTS titles (
+    service_id INTEGER PRIMARY KEY REFERENCES services(id),
+    title TEXT NOT NULL
+);
+CREATE TABLE IF NOT EXISTS certs (
+    service_id INTEGER PRIMARY KEY REFERENCES services(id),
+    subject TEXT,
+    issuer TEXT,
+    fingerprint_sha256 TEXT,
+    not_after TEXT,
+    names TEXT
+);
+CREATE TABLE IF NOT EXISTS fields (
+    service_id INTEGER NOT NULL REFERENCES services(id),
+    key TEXT NOT NULL,
+    value TEXT
+);
+)sql";
+
+// Created after the bulk load so inserts never maintain secondary indexes.
+static const char *const kIndexes = R"sql(
+CREATE UNIQUE INDEX IF NOT EXISTS hosts_ip ON hosts(ip);
+CREATE INDEX IF NOT EXISTS services_host ON services(host_id, port);
+CREATE INDEX IF NOT EXISTS services_scan ON services(scan_id);
+CREATE INDEX IF NOT EXISTS titles_title ON titles(title);
+CREATE INDEX IF NOT EXISTS certs_fingerprint ON certs(fingerprint_sha256);
+CREATE INDEX IF NOT EXISTS fields_service ON fields(service_id);
+PRAGMA optimize;
+)sql";
+
+bool SqliteSink::exec(const char *sql) {
+    char *err = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+        std::cerr << "sqlite: " << (err ? err : sqlite3_errmsg(db_)) << std::endl;
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+bool SqliteSink::prepare() {
+    struct {
+        sqlite3_stmt **stmt;
+        const char *sql;
+    } statements[] = {
+        {&insert_host_, "INSERT INTO hosts(ip) VALUES (?)"},
+        {&insert_service_, "INSERT INTO services(scan_id, host_id, port, module, status, status_code, has_body) "
+                           "VALUES (?, ?, ?, ?, ?, ?, ?)"},
+        {&insert_title_, "INSERT INTO titles(service_id, title) VALUES (?, ?)"},
+        {&insert_cert_, "INSERT INTO certs(service_id, subject, issuer, fingerprint_sha256, not_after, names) "
+                        "VALUES (?, ?, ?, ?, ?, ?)"},
+        {&insert_field_, "INSERT INTO fields(service_id, key, value) VALUES (?, ?, ?)"},
+    };
+    for (auto &s : statements) {
+        if (sqlite3_prepare_v3(db_, s.sql, -1, SQLITE_PREPARE_PERSISTENT, s.stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "sqlite: " << sqlite3_errmsg(db_) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SqliteSink::open(const std::string &path, const std::string &source) {
+    if (sqlite3_open_v2(path.c_str(), &db_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX,
+                        nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to open SQLite database " << path << ": " << sqlite3_errmsg(db_) << std::endl;
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+    if (!exec("PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; PRAGMA temp_store=MEMORY;"
+              "PRAGMA cache_size=-65536;") ||
+        !exec(kSchema) || !prepare()) {
+        close();
+        return false;
+    }
+
+    // Existing hosts keep their ids across scans.
+    sqlite3_stmt *select = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT id, ip FROM hosts", -1, &select, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(select) == SQLITE_ROW) {
+            const unsigned char *ip = sqlite3_column_text(select, 1);
+            hosts_.emplace(ip ? reinterpret_cast<const char *>(ip) : "", sqlite3_column_int64(select, 0));
+        }
+    }
+    sqlite3_finalize(select);
+
+    sqlite3_stmt *scan = nullptr;
+    if (sqlite3_prepare_v2(db_, "INSERT INTO scans(started_at, source) VALUES (?, ?)", -1, &scan, nullptr) != SQLITE_OK) {
+        std::cerr << "sqlite: " << sqlite3_errmsg(db_) << std::endl;
+        close();
+        return false;
+    }
+    sqlite3_bind_int64(scan, 1, static_cast<sqlite3_int64>(std::time(nullptr)));
+    sqlite3_bind_text(scan, 2, source.c_str(), static_cast<int>(source.size()), SQLITE_TRANSIENT);
+    bool ok = sqlite3_step(scan) == SQLITE_DONE;
+    sqlite3_finalize(scan);
+    if (!ok) {
+        std::cerr << "sqlite: " << sqlite3_errmsg(db_) << std::endl;
+        close();
+        return false;
+    }
+    scan_id_ = sqlite3_last_insert_rowid(db_);
+
+    writer_ = std::thread([this] { run(); });
+    return true;
+}
+
+void SqliteSink::submit(std::vector<HttpRecord> &batch) {
+    if (!is_open() || batch.empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [&] { return queue_.size() < kMaxQueuedBatches || failed_; });
+    if (failed_) {
+        return;
+    }
+    queue_.push_back(std::move(batch));
+    batch.clear();
+    not_empty_.notify_one();
+}
+
+static void bind_text(sqlite3_stmt *stmt, int index, const std::string &value) {
+    sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+}
+
+static bool step_reset(sqlite3_stmt *stmt) {
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc == SQLITE_DONE;
+}
+
+int64_t SqliteSink::host_id(const std::string &ip) {
+    auto it = hosts_.find(ip);
+    if (it != hosts_.end()) {
+        return it->second;
+    }
+    bind_text(insert_host_, 1, ip);
+    if (!step_reset(insert_host_)) {
+        return -1;
+    }
+    int64_t id = sqlite3_last_insert_rowid(db_);
+    hosts_.emplace(ip, id);
+    return id;
+}
+
+bool SqliteSink::write_batch(const std::vector<HttpRecord> &batch) {
+    for (const auto &rec : batch) {
+        if (rec.dropped) {
+            continue;
+        }
+        int64_t host = host_id(rec.ip);
+        if (host < 0) {
+            return false;
+        }
+        sqlite3_bind_int64(insert_service_, 1, scan_id_);
+        sqlite3_bind_int64(insert_service_, 2, host);
+        sqlite3_bind_int(insert_service_, 3, rec.port);
+        bind_text(insert_service_, 4, rec.module);
+        bind_text(insert_service_, 5, rec.status);
+        if (rec.status_code) {
+            sqlite3_bind_int(insert_service_, 6, rec.status_code);
+        }
+        sqlite3_bind_int(insert_service_, 7, rec.has_body ? 1 : 0);
+        if (!step_reset(insert_service_)) {
+            return false;
+        }
+        int64_t service = sqlite3_last_insert_rowid(db_);
+
+        if (!rec.title.empty()) {
+            sqlite3_bind_int64(insert_title_, 1, service);
+            bind_text(insert_title_, 2, rec.title);
+            if (!step_reset(insert_title_)) {
+                return false;
+            }
+        }
+        if (rec.cert) {
+            std::string names;
+            for (const auto &name : rec.cert->names) {
+                if (!names.empty()) {
+                    names += ',';
+                }
+                names += name;
+            }
+            sqlite3_bind_int64(insert_cert_, 1, service);
+            bind_text(insert_cert_, 2, rec.cert->subject);
+            bind_text(insert_cert_, 3, rec.cert->issuer);
+            bind_text(insert_cert_, 4, rec.cert->fingerprint_sha256);
+            bind_text(insert_cert_, 5, rec.cert->not_after);
+            bind_text(insert_cert_, 6, names);
+            if (!step_reset(insert_cert_)) {
+                return false;
+            }
+        }
+        if (!rec.domain.empty()) {
+            sqlite3_bind_int64(insert_field_, 1, service);
+            static const std::string host_key = "host";
+            bind_text(insert_field_, 2, host_key);
+            bind_text(insert_field_, 3, rec.domain);
+            if (!step_reset(insert_field_)) {
+                return false;
+            }
+        }
+        for (const auto &field : rec.fields) {
+            sqlite3_bind_int64(insert_field_, 1, service);
+            bind_text(insert_field_, 2, field.first);
+            bind_text(insert_field_, 3, field.second);
+            if (!step_reset(insert_field_)) {
+                return false;
+            }
+        }
+        ++rows_;
+    }
+    return true;
+}
+
+void SqliteSink::run() {
+    bool in_txn = false;
+    size_t txn_rows = 0;
+    for (;;) {
+        std::vector<HttpRecord> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [&] { return !queue_.empty() || closing_; };
+            // Commit only after a real pause in the input, not each time the
+            // writer catches up, or transactions shrink to a few batches.
+            if (in_txn && !not_empty_.wait_for(lock, std::chrono::duration<double>(kIdleCommitSeconds), ready)) {
+                lock.unlock();
+                in_txn = !exec("COMMIT");
+                txn_rows = 0;
+                lock.lock();
+            }
+            not_empty_.wait(lock, ready);
+            if (queue_.empty()) {
+                break;
+            }
+            batch = std::move(queue_.front());
+            queue_.pop_front();
+            not_full_.notify_one();
+        }
+        if (!in_txn) {
+            in_txn = exec("BEGIN");
+        }
+        size_t before = rows_;
+        bool ok = in_txn && write_batch(batch);
+        txn_rows += rows_ - before;
+        if (!ok) {
+            std::cerr << "sqlite: " << sqlite3_errmsg(db_) << std::endl;
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed_ = true;
+            queue_.clear();
+            not_full_.notify_all();
+            break;
+        }
+        if (txn_rows >= kRowsPerTransaction) {
+            in_txn = !exec("COMMIT");
+            txn_rows = 0;
+        }
+    }
+    if (in_txn) {
+        exec(failed_ ? "ROLLBACK" : "COMMIT");
+    }
+}
+
+bool SqliteSink::close() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+        }
+        not_empty_.notify_all();
+        writer_.join();
+        if (!failed_) {
+            exec(kIndexes);
+            std::cout << "Wrote " << rows_ << " services to SQLite" << std::endl;
+        }
+    }
+    for (sqlite3_stmt *stmt : {insert_host_, insert_service_, insert_title_, insert_cert_, insert_field_}) {
+        sqlite3_finalize(stmt);
+    }
+    insert_host_ = insert_service_ = insert_title_ = insert_cert_ = insert_field_ = nullptr;
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+    return !failed_;
+}
+
+#endif
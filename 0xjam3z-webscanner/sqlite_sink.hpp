@@ -0,0 +1,59 @@
+#pragma once
+
+#include "parsers.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Writes parsed records to a normalized SQLite database (hosts, services,
+// titles, certs, fields) from a dedicated writer thread. Parse workers hand over
+// whole batches; the writer groups them into large transactions over prepared
+// statements and builds the indexes once the bulk load is done.
+class SqliteSink {
+public:
+    SqliteSink() = default;
+    ~SqliteSink();
+    SqliteSink(const SqliteSink &) = delete;
+    SqliteSink &operator=(const SqliteSink &) = delete;
+
+    bool open(const std::string &path, const std::string &source);
+    bool is_open() const { return writer_.joinable(); }
+    // Takes ownership of the batch contents. Blocks while the queue is full.
+    void submit(std::vector<HttpRecord> &batch);
+    // Drains the queue, commits and creates indexes. Returns false if any write failed.
+    bool close();
+
+private:
+    bool prepare();
+    void run();
+    bool write_batch(const std::vector<HttpRecord> &batch);
+    int64_t host_id(const std::string &ip);
+    bool exec(const char *sql);
+
+    sqlite3 *db_ = nullptr;
+    sqlite3_stmt *insert_host_ = nullptr;
+    sqlite3_stmt *insert_service_ = nullptr;
+    sqlite3_stmt *insert_title_ = nullptr;
+    sqlite3_stmt *insert_cert_ = nullptr;
+    sqlite3_stmt *insert_field_ = nullptr;
+    int64_t scan_id_ = 0;
+    std::unordered_map<std::string, int64_t> hosts_;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<std::vector<HttpRecord>> queue_;
+    bool closing_ = false;
+    bool failed_ = false;
+    size_t rows_ = 0;
+    std::thread writer_;
+};
@@ -0,0 +1,459 @@
+#include "supervisor.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+bool run_child(ChildJob &job) {
+    std::string cmd;
+    for (const auto &arg : job.argv) {
+        cmd += (cmd.empty() ? "" : " ") + quote_path(arg);
+    }
+    log_command(cmd + " < (" + std::to_string(job.input_size) + " bytes)");
+    std::string stem = "jam3z_child_" + std::to_string(std::rand());
+    fs::path in_file = fs::temp_directory_path() / (stem + ".in");
+    fs::path out_file = fs::temp_directory_path() / (stem + ".out");
+    {
+        std::ofstream in(in_file, std::ios::binary);
+        if (job.input) {
+            job.input([&](std::string_view chunk) {
+                in.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                return static_cast<bool>(in);
+            });
+        }
+    }
+    int status = std::system(("\"" + cmd + " < " + quote_path(in_file.string()) + " > " +
+                              quote_path(out_file.string()) + "\"").c_str());
+    std::ifstream out(out_file, std::ios::binary);
+    std::string line;
+    while (std::getline(out, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (job.output) {
+            job.output(line);
+        }
+    }
+    out.close();
+    std::error_code ec;
+    fs::remove(in_file, ec);
+    fs::remove(out_file, ec);
+    job.ok = status == 0;
+    return job.ok;
+}
+
+bool run_children(std::vector<ChildJob> &jobs) {
+    bool ok = true;
+    for (auto &job : jobs) {
+        ok = run_child(job) && ok;
+    }
+    return ok;
+}
+
+#else
+
+#include "event_loop.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+extern char **environ;
+
+// Exit polling interval where there are no pidfds.
+static constexpr double kExitPoll = 0.02;
+
+struct Child {
+    ChildJob *job = nullptr;
+    pid_t pid = -1;
+    int out_fd = -1;
+    int pid_fd = -1;
+    uint64_t deadline_timer = 0;
+    bool timed_out = false;
+    std::thread writer;
+    std::string partial;
+    // Inputs answered in earlier attempts, read by the writer to skip them, and
+    // those answered in this one, merged in before the next.
+    std::unordered_set<uint64_t> done;
+    std::unordered_set<uint64_t> fresh;
+};
+
+static std::string describe(const std::vector<std::string> &argv) {
+    std::string text;
+    for (const auto &arg : argv) {
+        bool plain = !arg.empty() && arg.find_first_of(" \t'\"\\$&;|<>()*?") == std::string::npos;
+        text += (text.empty() ? "" : " ") + (plain ? arg : quote_path(arg));
+    }
+    return text;
+}
+
+// Both ends are close-on-exec from the start, so a child that another thread
+// spawns in the meantime cannot inherit them. macOS has no pipe2().
+static bool cloexec_pipe(int fds[2]) {
+#ifdef __APPLE__
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#else
+    return pipe2(fds, O_CLOEXEC) == 0;
+#endif
+}
+
+static bool set_nonblock(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+// Streams the job's input into fd, leaving out lines already answered; runs on
+// its own thread so a slow reader never stalls the loop.
+static void write_input(int fd, const ChildJob &job, const std::unordered_set<uint64_t> &skip) {
+    if (job.input) {
+        std::string carry;
+        std::string kept;
+        auto keep = [&](std::string_view line) {
+            if (!line.empty() && skip.count(fnv1a64(line)) == 0) {
+                kept.append(line.data(), line.size());
+                kept += '\n';
+            }
+        };
+        bool ok = job.input([&](std::string_view chunk) {
+            if (skip.empty()) {
+                return write_all(fd, chunk);
+            }
+            kept.clear();
+            size_t pos = 0;
+            for (size_t nl; (nl = chunk.find('\n', pos)) != std::string_view::npos; pos = nl + 1) {
+                if (carry.empty()) {
+                    keep(chunk.substr(pos, nl - pos));
+                } else {
+                    carry.append(chunk.data() + pos, nl - pos);
+                    keep(carry);
+                    carry.clear();
+                }
+            }
+            carry.append(chunk.data() + pos, chunk.size() - pos);
+            return write_all(fd, kept);
+        });
+        if (ok && !carry.empty()) {
+            kept.clear();
+            keep(carry);
+            write_all(fd, kept);
+        }
+    }
+    close(fd);
+}
+
+// Held while the limits are swapped for a spawn.
+static std::mutex spawn_limits_mutex;
+
+// Spawns with the soft RLIMIT_NOFILE raised to the hard limit, so a tool with
+// thousands of senders is not capped by a login shell's 1024, and with core
+// dumps off, so a crashing grabber over a large target list leaves no
+// multi-GB core. posix_spawn has no per-child limits: the child inherits ours,
+// set just for the spawn and restored after it.
+static int spawn_limited(pid_t &pid, const char *file, const posix_spawn_file_actions_t &actions,
+                         char *const argv[]) {
+    std::lock_guard<std::mutex> lock(spawn_limits_mutex);
+    rlimit nofile{};
+    rlimit core{};
+    bool have_nofile = getrlimit(RLIMIT_NOFILE, &nofile) == 0;
+    bool have_core = getrlimit(RLIMIT_CORE, &core) == 0;
+    if (have_nofile && nofile.rlim_cur < nofile.rlim_max) {
+        rlimit raised = nofile;
+        raised.rlim_cur = raised.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &raised);
+    }
+    if (have_core && core.rlim_cur != 0) {
+        rlimit off = core;
+        off.rlim_cur = 0;
+        setrlimit(RLIMIT_CORE, &off);
+    }
+    int rc = posix_spawnp(&pid, file, &actions, nullptr, argv, environ);
+    if (have_nofile) {
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+    if (have_core) {
+        setrlimit(RLIMIT_CORE, &core);
+    }
+    return rc;
+}
+
+static int open_pidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+static bool spawn(Child &c) {
+    const ChildJob &job = *c.job;
+    int in_pipe[2];
+    int out_pipe[2];
+    if (!cloexec_pipe(in_pipe)) {
+        std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (!cloexec_pipe(out_pipe)) {
+        std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return false;
+    }
+    std::vector<char *> argv;
+    for (const auto &arg : job.argv) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    int rc = spawn_limited(c.pid, argv[0], actions, argv.data());
+    posix_spawn_file_actions_destroy(&actions);
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    if (rc != 0) {
+        std::cerr << "Failed to start " << job.argv[0] << ": " << std::strerror(rc) << std::endl;
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        return false;
+    }
+    set_nonblock(out_pipe[0]);
+    c.out_fd = out_pipe[0];
+    c.pid_fd = open_pidfd(c.pid);
+    c.partial.clear();
+    c.timed_out = false;
+    c.writer = std::thread(write_input, in_pipe[1], std::cref(job), std::cref(c.done));
+    return true;
+}
+
+static void deliver(Child &c, std::string_view line) {
+    ChildJob &job = *c.job;
+    if (job.output) {
+        job.output(line);
+    }
+    if (job.answers) {
+        std::string input = job.answers(line);
+        uint64_t key = fnv1a64(input);
+        if (!input.empty() && c.done.count(key) == 0 && c.fresh.insert(key).second) {
+            ++job.answered;
+        }
+    }
+}
+
+// Reads what stdout has, handing over complete lines. False at end of file.
+static bool drain(Child &c) {
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t n = read(c.out_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        std::string_view data(buf, static_cast<size_t>(n));
+        size_t pos = 0;
+        for (size_t nl; (nl = data.find('\n', pos)) != std::string_view::npos; pos = nl + 1) {
+            if (c.partial.empty()) {
+                deliver(c, data.substr(pos, nl - pos));
+            } else {
+                c.partial.append(data.data() + pos, nl - pos);
+                deliver(c, c.partial);
+                c.partial.clear();
+            }
+        }
+        c.partial.append(data.data() + pos, data.size() - pos);
+    }
+}
+
+static std::string exit_reason(int status, bool timed_out) {
+    if (timed_out) {
+        return "timed out";
+    }
+    if (WIFSIGNALED(status)) {
+        return std::string("killed by signal ") + std::to_string(WTERMSIG(status)) + " (" +
+               strsignal(WTERMSIG(status)) + ")";
+    }
+    return "exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+class Supervisor {
+public:
+    explicit Supervisor(std::vector<ChildJob> &jobs) {
+        for (auto &job : jobs) {
+            auto child = std::make_unique<Child>();
+            child->job = &job;
+            children_.push_back(std::move(child));
+        }
+    }
+
+    bool run() {
+        bool ok = true;
+        for (auto &child : children_) {
+            log_command(describe(child->job->argv) + " < (" + std::to_string(child->job->input_size) + " bytes)");
+            if (!start(*child)) {
+                ok = false;
+            }
+        }
+        loop_.run();
+        for (auto &child : children_) {
+            ok = ok && child->job->ok;
+        }
+        return ok;
+    }
+
+private:
+    bool start(Child &c) {
+        if (!spawn(c)) {
+            return false;
+        }
+        loop_.watch(c.out_fd, EventLoop::kRead, [this, &c](unsigned) {
+            if (!drain(c)) {
+                loop_.unwatch(c.out_fd);
+                close(c.out_fd);
+                c.out_fd = -1;
+            }
+        });
+        if (c.pid_fd >= 0) {
+            loop_.watch(c.pid_fd, EventLoop::kRead, [this, &c](unsigned) { reap(c, 0); });
+        } else {
+            poll_exit(c);
+        }
+        if (c.job->timeout > 0) {
+            c.deadline_timer = loop_.add_timer(c.job->timeout, [&c] {
+                c.deadline_timer = 0;
+                c.timed_out = true;
+                kill(c.pid, SIGKILL);
+            });
+        }
+        return true;
+    }
+
+    void poll_exit(Child &c) {
+        loop_.add_timer(kExitPoll, [this, &c] {
+            int status = 0;
+            pid_t r = waitpid(c.pid, &status, WNOHANG);
+            if (r == 0) {
+                poll_exit(c);
+                return;
+            }
+            reap(c, r == c.pid ? status : -1);
+        });
+    }
+
+    // Collects an exited child, then restarts it or records how it ended.
+    // `status` is 0 when waitpid still has to be called (the pidfd path).
+    void reap(Child &c, int status) {
+        ChildJob &job = *c.job;
+        if (c.pid_fd >= 0) {
+            loop_.unwatch(c.pid_fd);
+            close(c.pid_fd);
+            c.pid_fd = -1;
+            while (waitpid(c.pid, &status, 0) < 0 && errno == EINTR) {
+            }
+        }
+        if (c.deadline_timer) {
+            loop_.cancel_timer(c.deadline_timer);
+            c.deadline_timer = 0;
+        }
+        if (c.out_fd >= 0) {
+            drain(c);
+            loop_.unwatch(c.out_fd);
+            close(c.out_fd);
+            c.out_fd = -1;
+        }
+        bool clean = !c.timed_out && status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (clean && !c.partial.empty()) {
+            deliver(c, c.partial);
+        }
+        // A crash can cut the last line short; it is left for the restart.
+        c.partial.clear();
+        if (c.writer.joinable()) {
+            c.writer.join();
+        }
+        if (clean) {
+            job.ok = true;
+            return;
+        }
+        std::string reason = status < 0 ? "was lost" : exit_reason(status, c.timed_out);
+        size_t progress = c.fresh.size();
+        c.done.insert(c.fresh.begin(), c.fresh.end());
+        c.fresh.clear();
+        if (job.answers && progress > 0 && job.restarts < job.max_restarts) {
+            ++job.restarts;
+            std::cerr << job.argv[0] << " " << reason << " after " << job.answered
+                      << " answers; restarting with the remaining targets (" << job.restarts << "/"
+                      << job.max_restarts << ")" << std::endl;
+            if (start(c)) {
+                return;
+            }
+        } else {
+            std::cerr << job.argv[0] << " " << reason << std::endl;
+        }
+        job.ok = false;
+    }
+
+    EventLoop loop_;
+    std::vector<std::unique_ptr<Child>> children_;
+};
+
+bool run_children(std::vector<ChildJob> &jobs) {
+    // A child that dies mid-input must fail the writer's write(), not kill us.
+    struct sigaction ignore {};
+    struct sigaction saved {};
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &saved);
+    bool ok = Supervisor(jobs).run();
+    sigaction(SIGPIPE, &saved, nullptr);
+    return ok;
+}
+
+bool run_child(ChildJob &job) {
+    std::vector<ChildJob> jobs(1);
+    jobs[0] = std::move(job);
+    bool ok = run_children(jobs);
+    job = std::move(jobs[0]);
+    return ok;
+}
+
+#endif
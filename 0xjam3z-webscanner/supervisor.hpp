@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One external tool run under the supervisor: spawned without a shell, targets
+// streamed to its stdin and its stdout handed back line by line.
+struct ChildJob {
+    std::vector<std::string> argv;
+    // Written to stdin; read again from the start when the child is restarted.
+    InputSource input;
+    uint64_t input_size = 0;
+    // Each complete stdout line, without its newline.
+    std::function<void(std::string_view)> output;
+    // The stdin line an output line answers. When set, a child that crashes or
+    // times out is restarted with only the lines nothing has answered yet.
+    std::function<std::string(std::string_view)> answers;
+    // Killed after this many seconds per attempt; 0 for no limit.
+    double timeout = 0;
+    unsigned max_restarts = 3;
+
+    // Filled in by run_children.
+    bool ok = false;
+    unsigned restarts = 0;
+    uint64_t answered = 0;
+};
+
+// Runs the jobs concurrently and returns true when every one of them exited
+// successfully. Children get the soft RLIMIT_NOFILE raised to the hard limit
+// and core dumps disabled; the scanner's own limits stay as they were. On Linux exits are watched through pidfds on the
+// event loop, elsewhere by polling; on Windows the jobs run one at a time
+// through temporary files and are not restarted.
+bool run_children(std::vector<ChildJob> &jobs);
+bool run_child(ChildJob &job);
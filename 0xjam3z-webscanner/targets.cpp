@@ -0,0 +1,351 @@
+#include "targets.hpp"
+
+#include "common.hpp"
+#include "dns.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+bool parse_target_spec(std::string_view spec, Ipv4Range &out) {
+    size_t dash = spec.find('-');
+    if (dash != std::string_view::npos) {
+        return parse_ipv4(spec.substr(0, dash), out.start) && parse_ipv4(spec.substr(dash + 1), out.end) &&
+               out.start <= out.end;
+    }
+    size_t slash = spec.find('/');
+    if (slash == std::string_view::npos) {
+        if (!parse_ipv4(spec, out.start)) {
+            return false;
+        }
+        out.end = out.start;
+        return true;
+    }
+    std::string_view bits_text = spec.substr(slash + 1);
+    if (bits_text.empty() || bits_text.size() > 2 ||
+        bits_text.find_first_not_of("0123456789") != std::string_view::npos) {
+        return false;
+    }
+    int bits = std::atoi(std::string(bits_text).c_str());
+    uint32_t ip = 0;
+    if (bits > 32 || !parse_ipv4(spec.substr(0, slash), ip)) {
+        return false;
+    }
+    uint32_t host_mask = bits == 0 ? 0xffffffffu : (bits == 32 ? 0u : 0xffffffffu >> bits);
+    out.start = ip & ~host_mask;
+    out.end = ip | host_mask;
+    return true;
+}
+
+void TargetSet::add(uint32_t start, uint32_t end) {
+    if (!ranges_.empty() && (start <= ranges_.back().end || start - 1 == ranges_.back().end)) {
+        sorted_ = false;
+    }
+    ranges_.push_back({start, end});
+}
+
+void TargetSet::add6(const Ipv6Range &range) {
+    // Appending in order is the common case; anything else is sorted out by coalesce().
+    if (range.start == range.end) {
+        if (!singles6_.empty() && range.start <= singles6_.back()) {
+            sorted_ = false;
+        }
+        singles6_.push_back(range.start);
+    } else {
+        if (!ranges6_.empty() && range.start <= ranges6_.back().end.next()) {
+            sorted_ = false;
+        }
+        ranges6_.push_back(range);
+    }
+    if (!singles6_.empty() && !ranges6_.empty()) {
+        // Singles may fall inside a range.
+        sorted_ = false;
+    }
+}
+
+bool TargetSet::add_line(std::string_view line, std::vector<std::string> *hostnames) {
+    line = line.substr(0, line.find('#'));
+    size_t pos = 0;
+    while (pos < line.size()) {
+        size_t start = line.find_first_not_of(" \t\r\n,", pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t end = line.find_first_of(" \t\r\n,", start);
+        if (end == std::string_view::npos) {
+            end = line.size();
+        }
+        std::string_view spec = line.substr(start, end - start);
+        Ipv4Range range;
+        Ipv6Range range6;
+        if (parse_target_spec(spec, range)) {
+            add(range.start, range.end);
+        } else if (spec.find(':') != std::string_view::npos && parse_ipv6_spec(spec, range6)) {
+            add6(range6);
+        } else if (hostnames && looks_like_hostname(spec)) {
+            hostnames->push_back(to_lower(std::string(spec)));
+        } else {
+            std::cerr << "Invalid target: " << spec << std::endl;
+            return false;
+        }
+        pos = end;
+    }
+    return true;
+}
+
+// Interval helpers shared by the IPv4 and IPv6 range lists.
+static bool is_max(uint32_t a) { return a == 0xffffffffu; }
+static bool is_max(const Ipv6Addr &a) { return a.is_max(); }
+static uint32_t next_addr(uint32_t a) { return a + 1; }
+static Ipv6Addr next_addr(const Ipv6Addr &a) { return a.next(); }
+static uint32_t prev_addr(uint32_t a) { return a - 1; }
+static Ipv6Addr prev_addr(const Ipv6Addr &a) { return a.prev(); }
+
+template <typename Range>
+static void merge_ranges(std::vector<Range> &ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) { return a.start < b.start; });
+    size_t out = 0;
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        Range &last = ranges[out];
+        // Adjacent ranges merge too; the end check avoids overflow at the top address.
+        if (ranges[i].start <= last.end || (!is_max(last.end) && ranges[i].start == next_addr(last.end))) {
+            last.end = std::max(last.end, ranges[i].end);
+        } else {
+            ranges[++out] = ranges[i];
+        }
+    }
+    ranges.resize(ranges.empty() ? 0 : out + 1);
+}
+
+// Both lists sorted and merged.
+template <typename Range>
+static std::vector<Range> subtract_ranges(const std::vector<Range> &ranges, const std::vector<Range> &cuts) {
+    std::vector<Range> result;
+    result.reserve(ranges.size());
+    size_t j = 0;
+    for (Range range : ranges) {
+        while (j < cuts.size() && cuts[j].end < range.start) {
+            ++j;
+        }
+        bool alive = true;
+        for (size_t k = j; k < cuts.size() && cuts[k].start <= range.end; ++k) {
+            const Range &cut = cuts[k];
+            if (cut.start > range.start) {
+                result.push_back({range.start, prev_addr(cut.start)});
+            }
+            if (cut.end >= range.end) {
+                alive = false;
+                break;
+            }
+            range.start = std::max(range.start, next_addr(cut.end));
+        }
+        if (alive) {
+            result.push_back(range);
+        }
+    }
+    return result;
+}
+
+// Drops the sorted addresses that fall inside the sorted, merged ranges.
+static void remove_covered(std::vector<Ipv6Addr> &addrs, const std::vector<Ipv6Range> &ranges) {
+    size_t j = 0;
+    auto covered = [&](const Ipv6Addr &addr) {
+        while (j < ranges.size() && ranges[j].end < addr) {
+            ++j;
+        }
+        return j < ranges.size() && ranges[j].start <= addr;
+    };
+    addrs.erase(std::remove_if(addrs.begin(), addrs.end(), covered), addrs.end());
+}
+
+void TargetSet::coalesce() {
+    if (sorted_) {
+        return;
+    }
+    merge_ranges(ranges_);
+    merge_ranges(ranges6_);
+    std::sort(singles6_.begin(), singles6_.end());
+    singles6_.erase(std::unique(singles6_.begin(), singles6_.end()), singles6_.end());
+    remove_covered(singles6_, ranges6_);
+    sorted_ = true;
+}
+
+void TargetSet::subtract(TargetSet other) {
+    coalesce();
+    other.coalesce();
+    ranges_ = subtract_ranges(ranges_, other.ranges_);
+    if (!has_ipv6() || !other.has_ipv6()) {
+        return;
+    }
+    std::vector<Ipv6Range> cuts = std::move(other.ranges6_);
+    cuts.reserve(cuts.size() + other.singles6_.size());
+    for (const auto &addr : other.singles6_) {
+        cuts.push_back({addr, addr});
+    }
+    merge_ranges(cuts);
+    ranges6_ = subtract_ranges(ranges6_, cuts);
+    remove_covered(singles6_, cuts);
+}
+
+bool TargetSet::contains(uint32_t ip) const {
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), ip,
+                               [](uint32_t value, const Ipv4Range &range) { return value < range.start; });
+    return it != ranges_.begin() && std::prev(it)->end >= ip;
+}
+
+uint64_t TargetSet::size() const {
+    uint64_t total = 0;
+    for (const auto &range : ranges_) {
+        total += static_cast<uint64_t>(range.end) - range.start + 1;
+    }
+    return total;
+}
+
+double TargetSet::size6() const {
+    double total = static_cast<double>(singles6_.size());
+    for (const auto &range : ranges6_) {
+        total += ipv6_range_size(range);
+    }
+    return total;
+}
+
+bool load_target_file(const fs::path &path, TargetSet &targets, std::vector<std::string> *hostnames) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (!targets.add_line(line, hostnames)) {
+            std::cerr << "  at " << path.string() << ":" << line_no << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool write_target_list(const fs::path &path, const TargetSet &targets) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    for (const auto &range : targets.ranges()) {
+        out << format_ipv4(range.start);
+        if (range.end != range.start) {
+            out << "-" << format_ipv4(range.end);
+        }
+        out << "\n";
+    }
+    for (const auto &range : targets.ranges6()) {
+        auto prefixes = ipv6_range_prefixes(range);
+        if (prefixes.size() == 1) {
+            out << format_ipv6(range.start) << "/" << prefixes[0].second << "\n";
+        } else {
+            out << format_ipv6(range.start) << "-" << format_ipv6(range.end) << "\n";
+        }
+    }
+    for (const auto &addr : targets.singles6()) {
+        out << format_ipv6(addr) << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+bool load_hitlist(const fs::path &path, const TargetSet &scope, TargetSet &out, uint64_t &outside) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    Ipv6Trie scope6;
+    for (const auto &range : scope.ranges6()) {
+        scope6.insert_range(range, 0);
+    }
+    for (const auto &addr : scope.singles6()) {
+        scope6.insert(addr, 128, 0);
+    }
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        std::string_view text = line;
+        text = text.substr(0, text.find('#'));
+        size_t first = text.find_first_not_of(" \t\r\n,");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        size_t last = text.find_first_of(" \t\r\n,", first);
+        std::string_view token = text.substr(first, last == std::string_view::npos ? last : last - first);
+        uint32_t ip = 0;
+        Ipv6Addr addr;
+        if (parse_ipv4(token, ip)) {
+            if (scope.contains(ip)) {
+                out.add(ip, ip);
+            } else {
+                ++outside;
+            }
+        } else if (parse_ipv6(token, addr)) {
+            if (scope6.lookup(addr)) {
+                out.add6({addr, addr});
+            } else {
+                ++outside;
+            }
+        } else {
+            std::cerr << "Invalid hitlist address: " << token << "\n  at " << path.string() << ":" << line_no
+                      << std::endl;
+            return false;
+        }
+    }
+    out.coalesce();
+    return true;
+}
+
+bool parse_port_spec(const std::string &spec, std::vector<uint32_t> &ports) {
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t comma = spec.find(',', pos);
+        std::string item = trim(spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+        pos = comma == std::string::npos ? spec.size() + 1 : comma + 1;
+        if (item.empty()) {
+            continue;
+        }
+        // masscan prefixes: T: (default) TCP, U: UDP, S: SCTP, O: IP protocol.
+        uint32_t proto = 0;
+        if (item.size() > 2 && item[1] == ':') {
+            static const std::string kProtos = "TUSO";
+            size_t index = kProtos.find(static_cast<char>(std::toupper(static_cast<unsigned char>(item[0]))));
+            if (index == std::string::npos) {
+                return false;
+            }
+            proto = static_cast<uint32_t>(index);
+            item = item.substr(2);
+        }
+        size_t dash = item.find('-');
+        std::string low_text = item.substr(0, dash);
+        std::string high_text = dash == std::string::npos ? low_text : item.substr(dash + 1);
+        if (low_text.empty() || high_text.empty() ||
+            low_text.find_first_not_of("0123456789") != std::string::npos ||
+            high_text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        unsigned long low = std::strtoul(low_text.c_str(), nullptr, 10);
+        unsigned long high = std::strtoul(high_text.c_str(), nullptr, 10);
+        if (low > high || high > 65535) {
+            return false;
+        }
+        for (unsigned long port = low; port <= high; ++port) {
+            ports.push_back(proto << 16 | static_cast<uint32_t>(port));
+        }
+    }
+    std::sort(ports.begin(), ports.end());
+    ports.erase(std::unique(ports.begin(), ports.end()), ports.end());
+    return !ports.empty();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ipv6.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Inclusive IPv4 range in host byte order.
+struct Ipv4Range {
+    uint32_t start = 0;
+    uint32_t end = 0;
+};
+
+// Parses "a.b.c.d", "a.b.c.d/n" or "a.b.c.d-e.f.g.h" the way masscan does; a
+// CIDR with host bits set covers its whole network.
+bool parse_target_spec(std::string_view spec, Ipv4Range &out);
+
+// Set of IPv4 and IPv6 addresses kept as sorted, non-overlapping ranges. add()
+// is cheap; coalesce() sorts and merges and must run before anything is read.
+// Single IPv6 addresses, the bulk of a hitlist, are kept apart from the ranges
+// at 16 bytes each.
+class TargetSet {
+public:
+    void add(uint32_t start, uint32_t end);
+    void add6(const Ipv6Range &range);
+    // One masscan list line: specs separated by commas or whitespace, '#' starts a
+    // comment. Hostnames are collected into `hostnames` when given; anything else
+    // unparsable fails.
+    bool add_line(std::string_view line, std::vector<std::string> *hostnames = nullptr);
+    void coalesce();
+    void subtract(TargetSet other);
+
+    const std::vector<Ipv4Range> &ranges() const { return ranges_; }
+    const std::vector<Ipv6Range> &ranges6() const { return ranges6_; }
+    const std::vector<Ipv6Addr> &singles6() const { return singles6_; }
+    uint64_t size() const;
+    // IPv6 address count; a double because one /64 already holds 2^64.
+    double size6() const;
+    // Requires a coalesced set.
+    bool contains(uint32_t ip) const;
+    bool has_ipv6() const { return !ranges6_.empty() || !singles6_.empty(); }
+    bool empty() const { return ranges_.empty() && !has_ipv6(); }
+
+private:
+    std::vector<Ipv4Range> ranges_;
+    std::vector<Ipv6Range> ranges6_;
+    std::vector<Ipv6Addr> singles6_;
+    bool sorted_ = true;
+};
+
+bool load_target_file(const std::filesystem::path &path, TargetSet &targets,
+                      std::vector<std::string> *hostnames = nullptr);
+// IPv6 ranges go out in CIDR form when they are one prefix, as start-end otherwise.
+bool write_target_list(const std::filesystem::path &path, const TargetSet &targets);
+
+// Hitlist-driven targeting: streams a file of addresses and keeps those inside
+// `scope`. IPv6 membership goes through an Ipv6Trie of the scope's ranges, so
+// only the matching addresses are ever held. `outside` counts the rest.
+bool load_hitlist(const std::filesystem::path &path, const TargetSet &scope, TargetSet &out, uint64_t &outside);
+
+// Distinct (protocol, port) pairs in a masscan --ports value such as
+// "80,443,8000-8100,U:53", encoded as proto << 16 | port with TCP as proto 0.
+// Returns false on a malformed entry.
+bool parse_port_spec(const std::string &spec, std::vector<uint32_t> &ports);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Minimal assertions for the ctest targets: a failed check prints where and
+// what, the test keeps going, and check_result() makes the exit code non-zero.
+inline int &check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int check_result() {
+    if (check_failures()) {
+        std::cerr << check_failures() << " check(s) failed" << std::endl;
+    }
+    return check_failures() ? 1 : 0;
+}
+
+#define CHECK(cond)                                                                                            \
+    do {                                                                                                       \
+        if (!(cond)) {                                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl;              \
+            ++check_failures();                                                                                \
+        }                                                                                                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                         \
+    do {                                                                                                       \
+        const auto &check_a = (a);                                                                             \
+        const auto &check_b = (b);                                                                             \
+        if (!(check_a == check_b)) {                                                                           \
+            std::ostringstream check_msg;                                                                      \
+            check_msg << check_a << " != " << check_b;                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: " << check_msg.str() \
+                      << std::endl;                                                                            \
+            ++check_failures();                                                                                \
+        }                                                                                                      \
+    } while (0)
+
+// A fresh directory for one test's files, under the test's working directory.
+inline std::filesystem::path test_dir(const std::string &name) {
+    std::filesystem::path dir = std::filesystem::current_path() / (name + ".d");
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    return dir;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// zgrab2 http result lines in the shape bench/gen_fixtures.py writes, small
+// enough to build in memory: a success with a title, or a timeout.
+inline std::string zgrab_ip(uint32_t i) {
+    return "10." + std::to_string(i >> 16 & 0xff) + "." + std::to_string(i >> 8 & 0xff) + "." +
+           std::to_string(i & 0xff);
+}
+
+inline std::string zgrab_success_line(uint32_t i, const std::string &title, size_t filler = 0) {
+    std::string body = "<html><head><title>" + title + "</title></head><body>" + std::string(filler, 'x') +
+                       "</body></html>";
+    return "{\"ip\":\"" + zgrab_ip(i) +
+           "\",\"data\":{\"http\":{\"status\":\"success\",\"protocol\":\"http\",\"result\":{\"response\":"
+           "{\"status_line\":\"200 OK\",\"status_code\":200,\"headers\":{\"server\":[\"nginx\"]},\"body\":\"" +
+           body + "\"}},\"timestamp\":\"2024-05-01T00:00:00Z\"}}}";
+}
+
+inline std::string zgrab_timeout_line(uint32_t i) {
+    return "{\"ip\":\"" + zgrab_ip(i) +
+           "\",\"data\":{\"http\":{\"status\":\"io-timeout\",\"protocol\":\"http\",\"error\":\"timeout\"}}}";
+}
+
+// n lines mixing short, long and timed out results, deterministic in n.
+inline std::string zgrab_fixture(uint32_t n, uint32_t first = 1) {
+    std::string out;
+    for (uint32_t i = first; i < first + n; ++i) {
+        if (i % 9 == 0) {
+            out += zgrab_timeout_line(i);
+        } else {
+            out += zgrab_success_line(i, "Site " + std::to_string(i % 37), i % 13 == 0 ? 20000 : i % 300);
+        }
+        out += '\n';
+    }
+    return out;
+}
@@ -0,0 +1,246 @@
+#include "check.hpp"
+
+#include "common.hpp"
+#include "dns.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// DnsResolver against loopback UDP stubs: A and PTR answers, SERVFAIL and
+// truncated answers rotating to the next server, a server that never answers,
+// and duplicate queries merged into one datagram.
+
+#ifndef _WIN32
+
+struct StubReply {
+    bool drop = false;
+    int rcode = 0;
+    bool truncated = false;
+    std::vector<uint32_t> addrs;
+    std::string ptr;
+};
+
+// Answers queries on 127.0.0.1 from a name -> reply table and counts them.
+class StubServer {
+public:
+    explicit StubServer(std::map<std::string, StubReply> replies) : replies_(std::move(replies)) {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(0x7f000001);
+        socklen_t len = sizeof(addr);
+        CHECK(bind(fd_, reinterpret_cast<sockaddr *>(&addr), len) == 0);
+        CHECK(getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &len) == 0);
+        server_.ip = 0x7f000001;
+        server_.port = ntohs(addr.sin_port);
+        thread_ = std::thread([this] { serve(); });
+    }
+
+    ~StubServer() {
+        stop_ = true;
+        thread_.join();
+        close(fd_);
+    }
+
+    DnsServer server() const { return server_; }
+
+    size_t hits(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_[name];
+    }
+
+private:
+    void serve() {
+        while (!stop_) {
+            pollfd pfd{fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+            uint8_t buf[512];
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(fd_, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+            if (n < 12) {
+                continue;
+            }
+            // Question: labels, then type and class.
+            std::string name;
+            size_t pos = 12;
+            while (pos < static_cast<size_t>(n) && buf[pos]) {
+                name += (name.empty() ? "" : ".") + std::string(reinterpret_cast<char *>(buf) + pos + 1, buf[pos]);
+                pos += 1 + buf[pos];
+            }
+            size_t question_end = pos + 5;
+            if (question_end > static_cast<size_t>(n)) {
+                continue;
+            }
+            uint16_t type = static_cast<uint16_t>(buf[pos + 1] << 8 | buf[pos + 2]);
+            StubReply reply;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++hits_[name];
+                if (auto it = replies_.find(name); it != replies_.end()) {
+                    reply = it->second;
+                } else {
+                    reply.rcode = 3;
+                }
+            }
+            if (reply.drop) {
+                continue;
+            }
+            std::string out(reinterpret_cast<char *>(buf), question_end);
+            out[2] = static_cast<char>(0x81 | (reply.truncated ? 0x02 : 0)); // QR, RD, TC
+            out[3] = static_cast<char>(0x80 | reply.rcode);                 // RA
+            size_t answers = type == DnsResolver::kTypePtr ? !reply.ptr.empty() : reply.addrs.size();
+            out[6] = 0;
+            out[7] = static_cast<char>(answers);
+            out.replace(8, 4, std::string(4, '\0'));
+            auto record = [&](uint16_t rtype, const std::string &rdata) {
+                out += "\xc0\x0c"; // owner: the question name
+                out += static_cast<char>(rtype >> 8);
+                out += static_cast<char>(rtype & 0xff);
+                out.append("\x00\x01\x00\x00\x00\x3c", 6); // IN, TTL 60
+                out += static_cast<char>(rdata.size() >> 8);
+                out += static_cast<char>(rdata.size() & 0xff);
+                out += rdata;
+            };
+            if (type == DnsResolver::kTypePtr && !reply.ptr.empty()) {
+                std::string rdata;
+                size_t start = 0;
+                while (start < reply.ptr.size()) {
+                    size_t dot = std::min(reply.ptr.find('.', start), reply.ptr.size());
+                    rdata += static_cast<char>(dot - start);
+                    rdata.append(reply.ptr, start, dot - start);
+                    start = dot + 1;
+                }
+                record(DnsResolver::kTypePtr, rdata + '\0');
+            } else if (type == DnsResolver::kTypeA) {
+                for (uint32_t ip : reply.addrs) {
+                    uint32_t be = htonl(ip);
+                    record(DnsResolver::kTypeA, std::string(reinterpret_cast<char *>(&be), 4));
+                }
+            }
+            sendto(fd_, out.data(), out.size(), 0, reinterpret_cast<sockaddr *>(&from), from_len);
+        }
+    }
+
+    int fd_ = -1;
+    DnsServer server_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    std::mutex mutex_;
+    std::map<std::string, StubReply> replies_;
+    std::map<std::string, size_t> hits_;
+};
+
+// Runs the queries on one loop and returns the answers in query order.
+static std::vector<DnsAnswer> run_queries(const std::vector<DnsServer> &servers,
+                                          const std::vector<std::pair<std::string, uint16_t>> &queries) {
+    std::vector<DnsAnswer> answers(queries.size());
+    EventLoop loop;
+    DnsResolver resolver(loop, servers);
+    size_t remaining = queries.size();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        resolver.query(queries[i].first, queries[i].second, [&, i](const DnsAnswer &answer) {
+            answers[i] = answer;
+            if (--remaining == 0) {
+                loop.stop();
+            }
+        });
+    }
+    if (remaining > 0) {
+        loop.run();
+    }
+    return answers;
+}
+
+static void test_answers_and_rotation() {
+    StubReply flaky_servfail;
+    flaky_servfail.rcode = 2;
+    StubReply flaky_truncated;
+    flaky_truncated.truncated = true;
+    flaky_truncated.addrs = {0xc0000263};
+    StubServer flaky({{"servfail.test", flaky_servfail},
+                      {"trunc.test", flaky_truncated},
+                      {"a.test", StubReply{false, 0, false, {0xc0000201, 0xc0000202}, ""}}});
+    StubServer good({{"servfail.test", StubReply{false, 0, false, {0xc0000209}, ""}},
+                     {"trunc.test", StubReply{false, 0, false, {0xc0000207, 0xc0000208}, ""}},
+                     {"4.3.2.1.in-addr.arpa", StubReply{false, 0, false, {}, "host.example.net"}}});
+
+    // The first attempt goes to the first server, so only rotation reaches `good`.
+    auto answers = run_queries({flaky.server(), good.server()},
+                               {{"a.test", DnsResolver::kTypeA},
+                                {"A.Test", DnsResolver::kTypeA},
+                                {"a.test", DnsResolver::kTypeA},
+                                {"servfail.test", DnsResolver::kTypeA},
+                                {"trunc.test", DnsResolver::kTypeA},
+                                {"missing.test", DnsResolver::kTypeA}});
+    CHECK(answers[0].ok);
+    CHECK(answers[0].addrs == std::vector<uint32_t>({0xc0000201, 0xc0000202}));
+    CHECK(answers[1].addrs == answers[0].addrs && answers[2].addrs == answers[0].addrs);
+    CHECK_EQ(flaky.hits("a.test"), 1u);
+
+    CHECK(answers[3].ok);
+    CHECK(answers[3].addrs == std::vector<uint32_t>({0xc0000209}));
+    CHECK_EQ(flaky.hits("servfail.test"), 1u);
+    CHECK_EQ(good.hits("servfail.test"), 1u);
+
+    // The truncated answer's partial record set is not used.
+    CHECK(answers[4].ok);
+    CHECK(answers[4].addrs == std::vector<uint32_t>({0xc0000207, 0xc0000208}));
+    CHECK_EQ(good.hits("trunc.test"), 1u);
+
+    // NXDOMAIN is a final, empty answer.
+    CHECK(answers[5].ok);
+    CHECK(answers[5].addrs.empty());
+    CHECK_EQ(good.hits("missing.test"), 0u);
+
+    auto ptrs = resolve_ptrs({0x01020304, 0x01020304}, {good.server()});
+    CHECK_EQ(ptrs.size(), 1u);
+    CHECK_EQ(ptrs[0x01020304], "host.example.net");
+    CHECK_EQ(good.hits("4.3.2.1.in-addr.arpa"), 1u);
+
+    auto hosts = resolve_hostnames({"a.test", "missing.test"}, {flaky.server()});
+    CHECK_EQ(hosts.size(), 1u);
+    CHECK(hosts["a.test"] == std::vector<uint32_t>({0xc0000201, 0xc0000202}));
+}
+
+static void test_timeout() {
+    StubServer silent({{"slow.test", StubReply{true, 0, false, {}, ""}}});
+    auto answers = run_queries({silent.server()}, {{"slow.test", DnsResolver::kTypeA}});
+    CHECK(!answers[0].ok);
+    CHECK(answers[0].addrs.empty());
+    // Every attempt went out and none was answered.
+    CHECK_EQ(silent.hits("slow.test"), 3u);
+}
+
+int main() {
+    CHECK(looks_like_hostname("a.test"));
+    CHECK(!looks_like_hostname("192.0.2.1"));
+    DnsServer server;
+    CHECK(parse_dns_server("127.0.0.1:5353", server) && server.ip == 0x7f000001 && server.port == 5353);
+    CHECK(!parse_dns_server("127.0.0.1:0", server));
+    test_answers_and_rotation();
+    test_timeout();
+    return check_result();
+}
+
+#else
+
+int main() {
+    std::cout << "skipped: the DNS resolver is POSIX-only" << std::endl;
+    return 0;
+}
+
+#endif
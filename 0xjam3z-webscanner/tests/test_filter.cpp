@@ -0,0 +1,202 @@
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include "asn_index.hpp"
+#include "common.hpp"
+#include "filter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+// RecordFilter compile errors, record matching, pushdown to bare targets with
+// and without ASN data, and `parse --where` against filtering the unfiltered
+// output by hand.
+
+static bool compiles(const std::string &expr) {
+    RecordFilter filter;
+    return filter.compile(expr);
+}
+
+static bool matches(const std::string &expr, const HttpRecord &rec) {
+    RecordFilter filter;
+    CHECK(filter.compile(expr));
+    return filter.matches(rec);
+}
+
+static void test_compile() {
+    CHECK(compiles("status == 200 and title ~ login and port in (80, 8080)"));
+    CHECK(compiles("not (org ~ cloudflare or asn in (13335, 16509)) and ip in (10.0.0.0/8)"));
+    CHECK(compiles("header.server ~ nginx && body !~ \"default page\" || !(port = 443)"));
+    for (const char *bad : {"", "status ==", "port in (80", "bogus == 1", "title ~", "status == 200 and",
+                            "ip in (10.0.0.0/33)", "port > abc", "(status == 200"}) {
+        CHECK(!compiles(bad));
+    }
+}
+
+static void test_matches() {
+    HttpRecord rec;
+    rec.ip = "10.0.0.5";
+    rec.port = 80;
+    rec.module = "http";
+    rec.status = "success";
+    rec.status_code = 200;
+    rec.title = "Admin Login";
+    rec.body = "<title>Admin Login</title> nginx default page";
+    rec.headers = {{"server", "nginx/1.25"}, {"content-type", "text/html"}};
+    rec.fields = {{"ptr", "host5.example.net"}, {"tag", "admin"}};
+
+    CHECK(matches("status == 200 and title ~ login and port in (80, 8080)", rec));
+    CHECK(!matches("not (title ~ ADMIN)", rec));
+    CHECK(matches("server ~ NGINX and header.content-type == text/html", rec));
+    CHECK(matches("ptr ~ example and field.tag == admin", rec));
+    CHECK(!matches("body !~ \"default page\"", rec));
+    CHECK(matches("ip in (10.0.0.0/8, 2001:db8::/32)", rec));
+    CHECK(matches("ip not in (10.0.0.0-10.0.0.4, 10.0.0.6)", rec));
+    CHECK(matches("status >= 300 or result == success", rec));
+    CHECK(matches("status < 300 && !(port = 443)", rec));
+    CHECK(!matches("host == example.com", rec));
+    rec.domain = "Example.com";
+    CHECK(matches("host == example.com", rec));
+    rec.ip = "2001:db8::7";
+    CHECK(matches("ip in (2001:db8::/64)", rec));
+    CHECK(!matches("ip in (10.0.0.0/8)", rec));
+}
+
+static void test_may_match() {
+    RecordFilter filter;
+    CHECK(filter.compile("port == 443 and title ~ x"));
+    CHECK(!filter.needs_asn());
+    CHECK(!filter.may_match("10.0.0.1", 80));
+    CHECK(filter.may_match("10.0.0.1", 443));
+    // Unknown parts never rule a target out.
+    CHECK(filter.may_match("", 0));
+    CHECK(filter.may_match("10.0.0.1", 0));
+
+    CHECK(filter.compile("ip in (10.0.0.0/24) or title ~ x"));
+    CHECK(filter.may_match("192.0.2.1", 80));
+    CHECK(filter.compile("ip in (10.0.0.0/24) and status == 200"));
+    CHECK(!filter.may_match("192.0.2.1", 80));
+    CHECK(filter.may_match("10.0.0.9", 80));
+    CHECK(filter.compile("not ip in (10.0.0.0/24)"));
+    CHECK(!filter.may_match("10.0.0.9", 80));
+}
+
+static void test_asn() {
+    AsnIndex index;
+    CHECK(index.load_buffer(
+        "[{\"start_ip\":\"10.0.0.0\",\"end_ip\":\"10.0.0.255\",\"asn\":\"AS64500\",\"country\":\"NL\","
+        "\"country_name\":\"Netherlands\",\"as_name\":\"Example Net\"},"
+        "{\"start_ip\":\"2001:db8::\",\"end_ip\":\"2001:db8::ffff\",\"asn\":64501,\"country\":\"DE\","
+        "\"country_name\":\"Germany\",\"as_name\":\"Other Net\"}]"));
+    RecordFilter filter;
+    CHECK(filter.compile("asn == 64500 and country == nl and org ~ example"));
+    CHECK(filter.needs_asn());
+    filter.bind_asn(&index);
+    CHECK(filter.may_match("10.0.0.7", 80));
+    CHECK(!filter.may_match("10.0.1.1", 80));
+    CHECK(filter.compile("asn in (64501) and port == 80"));
+    filter.bind_asn(&index);
+    CHECK(filter.may_match("2001:db8::1", 80));
+    CHECK(!filter.may_match("2001:db8::1", 443));
+    CHECK(!filter.may_match("2001:db9::1", 80));
+    HttpRecord rec;
+    rec.ip = "2001:db8::1";
+    rec.port = 80;
+    CHECK(filter.matches(rec));
+}
+
+static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Runs `parse` over the inputs into out_dir; returns the exit status.
+static int parse(const std::string &scanner, const std::vector<std::filesystem::path> &inputs,
+                 const std::filesystem::path &out_dir, const std::string &args) {
+    std::filesystem::create_directories(out_dir);
+    std::string cmd = quote_path(scanner) + " parse";
+    for (const auto &input : inputs) {
+        cmd += " " + quote_path(input.string());
+    }
+    cmd += " --output " + quote_path((out_dir / "titles.txt").string()) + " --out-dir " +
+           quote_path(out_dir.string()) + " " + args + " > " + quote_path((out_dir / "log").string()) + " 2>&1";
+    return std::system(cmd.c_str());
+}
+
+// Keeps the lines of `text` that pass `keep`.
+template <typename Keep>
+static std::string filter_lines(const std::string &text, Keep keep) {
+    std::string out;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = std::min(text.find('\n', pos), text.size());
+        std::string line = text.substr(pos, end - pos);
+        if (keep(line)) {
+            out += line + "\n";
+        }
+        pos = end + 1;
+    }
+    return out;
+}
+
+static void test_parse_where(const std::string &scanner) {
+    std::filesystem::path dir = test_dir("filter");
+    auto zgrab = dir / "zgrab_results_80.json";
+    std::ofstream(zgrab) << zgrab_fixture(900);
+    auto masscan = dir / "masscan_results.txt";
+    {
+        std::ofstream out(masscan);
+        for (uint32_t i = 1; i <= 900; ++i) {
+            out << "open tcp " << (i % 2 ? 80 : 443) << " " << zgrab_ip(i) << " 1700000000\n";
+        }
+    }
+    std::vector<std::filesystem::path> inputs = {zgrab, masscan};
+    CHECK_EQ(parse(scanner, inputs, dir / "all", ""), 0);
+    std::string all = read_file(dir / "all" / "titles.txt");
+    CHECK(!all.empty());
+
+    // Titles are "Site <i % 37>"; 10.0.1.x holds i = 256..511.
+    const std::string where = "--where 'ip in (10.0.1.0/24) and title ~ \"site 1\"'";
+    std::string expected = filter_lines(all, [](const std::string &line) {
+        size_t title = line.find(" - Title: ");
+        return line.rfind("IP: 10.0.1.", 0) == 0 && title != std::string::npos &&
+               to_lower(line.substr(title + 10)).find("site 1") != std::string::npos;
+    });
+    CHECK(!expected.empty());
+    for (const char *jobs : {"1", "4"}) {
+        auto out = dir / (std::string("where") + jobs);
+        CHECK_EQ(parse(scanner, inputs, out, where + " --jobs " + jobs), 0);
+        CHECK_EQ(read_file(out / "titles.txt"), expected);
+        // Masscan lists keep what ip and port allow, whatever the title.
+        std::string ips_80 = read_file(out / "open_ips80.txt");
+        CHECK_EQ(ips_80, filter_lines(read_file(dir / "all" / "open_ips80.txt"), [](const std::string &line) {
+                     return line.rfind("10.0.1.", 0) == 0;
+                 }));
+        CHECK(!ips_80.empty());
+    }
+
+    auto ports = dir / "port443";
+    CHECK_EQ(parse(scanner, inputs, ports, "--where 'port == 443'"), 0);
+    CHECK(read_file(ports / "titles.txt").empty());
+    CHECK(read_file(ports / "open_ips80.txt").empty());
+    CHECK_EQ(read_file(ports / "open_ips443.txt"), read_file(dir / "all" / "open_ips443.txt"));
+
+    CHECK(parse(scanner, inputs, dir / "bad", "--where 'status =='") != 0);
+    CHECK(parse(scanner, inputs, dir / "asn", "--where 'asn == 1'") != 0);
+    CHECK(read_file(dir / "asn" / "log").find("country_asn.json") != std::string::npos);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: test_filter <0xjam3z-scanner>" << std::endl;
+        return 2;
+    }
+    test_compile();
+    test_matches();
+    test_may_match();
+    test_asn();
+    test_parse_where(argv[1]);
+    return check_result();
+}
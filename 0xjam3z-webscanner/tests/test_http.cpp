@@ -0,0 +1,422 @@
+#include "check.hpp"
+
+#include "content_decoder.hpp"
+#include "http.hpp"
+
+#ifdef JAM3Z_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// HttpStreamParser fed whole and in pieces: every response must decode the
+// same whether it arrives in one feed, split at any single byte, or one byte
+// at a time. HttpResponseParser decodes gzip, zlib and raw deflate, and br
+// bodies fed in pieces, stops after </title> while the skip budget keeps the
+// connection reusable, and gets through corrupt or cut-off streams.
+
+struct Recorder : HttpHandler {
+    int status = 0;
+    int heads = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    size_t stop_after = std::string::npos;
+
+    bool on_head(int status_code, const std::vector<HttpHeaderView> &views) override {
+        ++heads;
+        status = status_code;
+        // Views die with the call.
+        headers.clear();
+        for (const auto &view : views) {
+            headers.emplace_back(std::string(view.name), std::string(view.value));
+        }
+        return true;
+    }
+
+    bool on_body(std::string_view data) override {
+        body.append(data.data(), data.size());
+        return body.size() < stop_after;
+    }
+};
+
+struct Outcome {
+    bool ok = false;
+    bool done = false;
+    bool keep_alive = false;
+    Recorder rec;
+};
+
+// Feeds `response` in pieces cut at `cuts` (ascending offsets), then finish()
+// when `eof` is set.
+static Outcome run(std::string_view response, const std::vector<size_t> &cuts, bool eof = false) {
+    Outcome out;
+    HttpStreamParser parser;
+    out.ok = true;
+    size_t from = 0;
+    for (size_t i = 0; i <= cuts.size() && out.ok; ++i) {
+        size_t to = i < cuts.size() ? cuts[i] : response.size();
+        // A copy per feed, so a view kept past its feed reads freed memory under ASan.
+        std::string piece(response.substr(from, to - from));
+        out.ok = parser.feed(piece, out.rec);
+        from = to;
+    }
+    if (out.ok && eof) {
+        out.ok = parser.finish();
+    }
+    out.done = parser.done();
+    out.keep_alive = parser.keep_alive();
+    return out;
+}
+
+static bool same(const Outcome &a, const Outcome &b) {
+    return a.ok == b.ok && a.done == b.done && a.keep_alive == b.keep_alive && a.rec.status == b.rec.status &&
+           a.rec.heads == b.rec.heads && a.rec.headers == b.rec.headers && a.rec.body == b.rec.body;
+}
+
+// The whole-feed outcome, after checking every split of the response against it.
+static Outcome check_splits(const std::string &response, bool eof = false) {
+    Outcome whole = run(response, {}, eof);
+    for (size_t cut = 1; cut < response.size(); ++cut) {
+        if (!same(run(response, {cut}, eof), whole)) {
+            std::cerr << "split at " << cut << " differs" << std::endl;
+            ++check_failures();
+            break;
+        }
+    }
+    std::vector<size_t> bytes;
+    for (size_t cut = 1; cut < response.size(); ++cut) {
+        bytes.push_back(cut);
+    }
+    CHECK(same(run(response, bytes, eof), whole));
+    return whole;
+}
+
+static std::string header(const Outcome &out, const std::string &name) {
+    for (const auto &h : out.rec.headers) {
+        if (h.first == name) {
+            return h.second;
+        }
+    }
+    return "<missing>";
+}
+
+static void test_content_length() {
+    auto out = check_splits("HTTP/1.1 200 OK\r\nServer: stub\r\nContent-Type:  text/html \r\n"
+                            "Content-Length: 26\r\n\r\n<title>Split head</title>\n");
+    CHECK(out.ok && out.done && out.keep_alive);
+    CHECK_EQ(out.rec.status, 200);
+    CHECK_EQ(header(out, "Server"), "stub");
+    CHECK_EQ(header(out, "Content-Type"), "text/html");
+    CHECK_EQ(out.rec.body, "<title>Split head</title>\n");
+
+    // Bytes past the response end the connection's reuse.
+    out = run("HTTP/1.1 204 No Content\r\n\r\nHTTP/1.1", {});
+    CHECK(out.ok && out.done && !out.keep_alive);
+    CHECK(out.rec.body.empty());
+}
+
+static void test_chunked() {
+    auto out = check_splits("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                            "5;name=\"x;y\"\r\nhello\r\n"
+                            "1;ext\r\n \r\n"
+                            "A\r\n0123456789\r\n"
+                            "0;last=1\r\nX-Checksum: abc\r\nX-Other: 1\r\n\r\n");
+    CHECK(out.ok && out.done && out.keep_alive);
+    CHECK_EQ(out.rec.body, "hello 0123456789");
+    // Trailers are consumed, not reported as headers.
+    CHECK_EQ(header(out, "X-Checksum"), "<missing>");
+
+    CHECK(!run("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", {}).ok);
+    CHECK(!run("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n", {}).ok);
+    // Chunk-size lines are bounded even when they arrive a byte at a time.
+    std::string long_line = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1;" + std::string(2000, 'x');
+    std::vector<size_t> bytes;
+    for (size_t cut = 1; cut < long_line.size(); ++cut) {
+        bytes.push_back(cut);
+    }
+    CHECK(!run(long_line, bytes).ok);
+}
+
+static void test_interim() {
+    auto out = check_splits("HTTP/1.1 100 Continue\r\n\r\n"
+                            "HTTP/1.1 103 Early Hints\r\nLink: </style.css>; rel=preload\r\n\r\n"
+                            "HTTP/1.1 302 Found\r\nLocation: /login\r\nContent-Length: 2\r\n\r\nok");
+    CHECK(out.ok && out.done);
+    CHECK_EQ(out.rec.heads, 1);
+    CHECK_EQ(out.rec.status, 302);
+    CHECK_EQ(header(out, "Location"), "/login");
+    CHECK_EQ(header(out, "Link"), "<missing>");
+    CHECK_EQ(out.rec.body, "ok");
+}
+
+static void test_bare_lf() {
+    auto out = check_splits("HTTP/1.0 200 OK\nServer: lf-only\nConnection: keep-alive\nContent-Length: 3\n\nabc");
+    CHECK(out.ok && out.done && out.keep_alive);
+    CHECK_EQ(header(out, "Server"), "lf-only");
+    CHECK_EQ(out.rec.body, "abc");
+
+    out = check_splits("HTTP/1.1 200 OK\nTransfer-Encoding: chunked\n\n3\nabc\n0\n\n");
+    CHECK(out.ok && out.done);
+    CHECK_EQ(out.rec.body, "abc");
+
+    // No length: the body runs to the end of the stream.
+    out = check_splits("HTTP/1.0 200 OK\nServer: old\n\nuntil close", true);
+    CHECK(out.ok && out.done && !out.keep_alive);
+    CHECK_EQ(out.rec.body, "until close");
+    CHECK(!run("HTTP/1.1 200 OK\nContent-Length: 10\n\nshort", {}, true).ok);
+}
+
+static void test_head_limit() {
+    std::string big_header = "X-Big: " + std::string(60 * 1024, 'a') + "\r\n";
+    std::string fits = "HTTP/1.1 200 OK\r\n" + big_header + "Content-Length: 1\r\n\r\n!";
+    std::vector<size_t> cuts;
+    for (size_t cut = 1000; cut < fits.size(); cut += 1000) {
+        cuts.push_back(cut);
+    }
+    Outcome whole = run(fits, {});
+    CHECK(whole.ok && whole.done);
+    CHECK_EQ(header(whole, "X-Big").size(), 60u * 1024);
+    CHECK(same(run(fits, cuts), whole));
+
+    // A head that never ends is refused once it passes 64 KB, whole or in pieces.
+    std::string endless = "HTTP/1.1 200 OK\r\n" + big_header + big_header;
+    CHECK(!run(endless, {}).ok);
+    cuts.clear();
+    for (size_t cut = 1000; cut < endless.size(); cut += 1000) {
+        cuts.push_back(cut);
+    }
+    Outcome split = run(endless, cuts);
+    CHECK(!split.ok);
+    CHECK_EQ(split.rec.heads, 0);
+}
+
+static void test_stops() {
+    CHECK(!run("HTTP/1.1 2x0 OK\r\n\r\n", {}).ok);
+    CHECK(!run("SSH-2.0-OpenSSH_9.6\r\n\r\n", {}).ok);
+
+    // The handler can stop mid-body; the connection is then not reusable.
+    Outcome out;
+    out.rec.stop_after = 4;
+    HttpStreamParser parser;
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n01", out.rec));
+    CHECK(!parser.done());
+    CHECK(parser.feed("23456789", out.rec));
+    CHECK(parser.done() && parser.stopped() && !parser.keep_alive());
+    CHECK_EQ(out.rec.body, "0123456789");
+
+    // reset() makes the parser ready for the next response on a kept-alive connection.
+    parser.reset();
+    Recorder next;
+    CHECK(parser.feed("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", next));
+    CHECK(parser.done() && !parser.stopped() && parser.keep_alive());
+    CHECK_EQ(next.status, 404);
+}
+
+// A page whose title is near the start, padded with lines to about `size` bytes.
+static std::string page(size_t size, bool title = true) {
+    std::string out = title ? "<html><head><title>Compressed page</title></head><body>\n" : "<html><body>\n";
+    for (size_t i = 0; out.size() < size; ++i) {
+        out += "<p>line " + std::to_string(i) + " of the body</p>\n";
+    }
+    return out + "</body></html>";
+}
+
+// Random bytes, which no coding shrinks.
+static std::string noise(size_t size) {
+    std::string out;
+    uint64_t x = 88172645463325252ull;
+    while (out.size() < size) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        out += static_cast<char>(x >> 56);
+    }
+    return out;
+}
+
+static std::string encoded_response(const std::string &coding, const std::string &payload) {
+    return "HTTP/1.1 200 OK\r\nContent-Encoding: " + coding + "\r\nContent-Length: " +
+           std::to_string(payload.size()) + "\r\n\r\n" + payload;
+}
+
+struct Decoded {
+    bool ok = false;
+    bool done = false;
+    bool keep_alive = false;
+    bool truncated = false;
+    bool partial = false;
+    std::string body;
+};
+
+// Feeds `response` to an HttpResponseParser in `piece`-byte pieces.
+static Decoded decode(const std::string &response, size_t piece, size_t max_body = kHttpMaxBody) {
+    HttpResponseParser parser(max_body);
+    Decoded out;
+    out.ok = true;
+    for (size_t pos = 0; pos < response.size() && out.ok; pos += piece) {
+        out.ok = parser.feed(std::string_view(response).substr(pos, piece));
+    }
+    out.done = parser.done();
+    out.keep_alive = parser.keep_alive();
+    out.truncated = parser.truncated();
+    out.partial = parser.partial_body();
+    out.body = parser.body();
+    return out;
+}
+
+static bool is_prefix(const std::string &prefix, const std::string &of) {
+    return prefix.size() <= of.size() && of.compare(0, prefix.size(), prefix) == 0;
+}
+
+// brotli_page_text() as libbrotlienc encodes it at quality 11.
+static const char kBrotliPage[] =
+    "\x1b\x88\x0d\x60\xc4\x6d\xec\x7b\x96\x6b\x35\x5a\x33\x68\x08\x52\x10\x39\xc6\x01\xfb\x3d\xd8\x44\x03\xdd"
+    "\xa4\xb2\xa7\xac\x34\x86\xa4\x08\xdf\xf5\x87\x46\xa5\xa0\x2b\xf3\xf6\x2d\xda\xeb\x74\xa0\x33\x1d\x25\x00"
+    "\xb8\x78\x02\x00\x5a\xd3\x60\xc6\x1c\x04";
+
+static std::string brotli_page_text() {
+    std::string out = "<html><head><title>Brotli page</title></head><body>";
+    for (int i = 0; i < 200; ++i) {
+        out += "brotli body line\n";
+    }
+    return out + "</body></html>";
+}
+
+#ifdef JAM3Z_HAVE_ZLIB
+// window_bits: 31 for gzip, 15 for zlib, -15 for raw deflate.
+static std::string compress(const std::string &plain, int window_bits) {
+    z_stream zs{};
+    CHECK(deflateInit2(&zs, 6, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string out(deflateBound(&zs, static_cast<uLong>(plain.size())), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(plain.data()));
+    zs.avail_in = static_cast<uInt>(plain.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static void test_decode_zlib() {
+    const std::pair<const char *, int> codings[] = {{"gzip", 31}, {"x-gzip", 31}, {"deflate", 15}, {"deflate", -15}};
+    std::string titled = page(200 * 1024);
+    std::string untitled = page(50 * 1024, false);
+    for (const auto &coding : codings) {
+        std::string response = encoded_response(coding.first, compress(titled, coding.second));
+        for (size_t piece : {size_t{1}, size_t{3}, size_t{100}, size_t{1460}, response.size()}) {
+            Decoded out = decode(response, piece);
+            CHECK(out.ok && out.done && out.keep_alive && !out.truncated);
+            // Decoding stops at the window holding </title>, well short of the page.
+            CHECK(out.partial);
+            CHECK(out.body.find("</title>") != std::string::npos);
+            CHECK(out.body.size() < titled.size() / 4);
+            CHECK(is_prefix(out.body, titled));
+        }
+        // Without a title the whole body is decoded.
+        Decoded out = decode(encoded_response(coding.first, compress(untitled, coding.second)), 1460);
+        CHECK(out.ok && out.done && !out.partial);
+        CHECK(out.body == untitled);
+    }
+}
+
+static void test_skip_budget() {
+    // After the title, the rest of the body is read without decoding, up to
+    // max_body more bytes; within that the connection stays usable.
+    std::string small = page(8 * 1024) + noise(40 * 1024);
+    std::string response = encoded_response("gzip", compress(small, 31));
+    HttpResponseParser parser(64 * 1024);
+    CHECK(parser.feed(std::string_view(response).substr(0, 500)));
+    CHECK(parser.feed(std::string_view(response).substr(500)));
+    CHECK(parser.done() && parser.keep_alive() && !parser.truncated() && parser.partial_body());
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nagain"));
+    CHECK(parser.done() && parser.keep_alive() && parser.body() == "again" && !parser.partial_body());
+
+    // Past the budget the connection is given up instead of read to the end.
+    std::string big = page(8 * 1024) + noise(400 * 1024);
+    Decoded out = decode(encoded_response("gzip", compress(big, 31)), 1460, 64 * 1024);
+    CHECK(out.ok && out.truncated && !out.keep_alive);
+    CHECK(out.partial && is_prefix(out.body, big));
+}
+
+static void test_corrupt_zlib() {
+    std::string plain = page(100 * 1024, false);
+    std::string gzip = compress(plain, 31);
+
+    // A flipped byte fails the stream: inflate errors or the CRC does not match.
+    std::string corrupt = gzip;
+    corrupt[corrupt.size() / 2] = static_cast<char>(corrupt[corrupt.size() / 2] ^ 0x55);
+    ContentDecoder decoder;
+    CHECK(decoder.start(ContentCoding::Gzip));
+    ContentDecoder::Result result = ContentDecoder::Result::More;
+    for (size_t pos = 0; pos < corrupt.size() && result == ContentDecoder::Result::More; pos += 512) {
+        result = decoder.feed(std::string_view(corrupt).substr(pos, 512), [](std::string_view) { return true; });
+    }
+    CHECK(result == ContentDecoder::Result::Error);
+    // The framing is intact, so the response still ends cleanly.
+    Decoded out = decode(encoded_response("gzip", corrupt), 1460);
+    CHECK(out.ok && out.done && out.keep_alive);
+    CHECK(out.body.size() < plain.size());
+
+    // Not compressed at all.
+    CHECK(decoder.start(ContentCoding::Deflate));
+    CHECK(decoder.feed("<html>plain</html>", [](std::string_view) { return true; }) ==
+          ContentDecoder::Result::Error);
+
+    // A stream cut short never ends; what there is still decodes.
+    std::string cut = gzip.substr(0, gzip.size() / 2);
+    CHECK(decoder.start(ContentCoding::Gzip));
+    CHECK(decoder.feed(cut, [](std::string_view) { return true; }) == ContentDecoder::Result::More);
+    out = decode(encoded_response("gzip", cut), 100);
+    CHECK(out.ok && out.done);
+    CHECK(!out.body.empty() && is_prefix(out.body, plain));
+    // A connection closed before Content-Length is reached fails.
+    HttpResponseParser parser;
+    std::string response = encoded_response("gzip", gzip);
+    CHECK(parser.feed(std::string_view(response).substr(0, response.size() / 2)));
+    CHECK(!parser.finish());
+}
+#endif
+
+static void test_decode_brotli() {
+    std::string payload(kBrotliPage, sizeof(kBrotliPage) - 1);
+    std::string plain = brotli_page_text();
+    ContentDecoder decoder;
+#ifdef JAM3Z_HAVE_BROTLI
+    for (size_t piece : {size_t{1}, size_t{7}, payload.size()}) {
+        Decoded out = decode(encoded_response("br", payload), piece);
+        CHECK(out.ok && out.done && out.keep_alive);
+        CHECK(out.partial && out.body.find("</title>") != std::string::npos && is_prefix(out.body, plain));
+    }
+    CHECK(decoder.start(ContentCoding::Brotli));
+    std::string decoded;
+    CHECK(decoder.feed(payload.substr(0, 20), [&](std::string_view data) {
+        decoded.append(data.data(), data.size());
+        return true;
+    }) == ContentDecoder::Result::More);
+    CHECK(is_prefix(decoded, plain));
+    CHECK(decoder.start(ContentCoding::Brotli));
+    CHECK(decoder.feed(std::string(32, '\xff'), [](std::string_view) { return true; }) ==
+          ContentDecoder::Result::Error);
+#else
+    // Without a decoder the body is kept as sent.
+    CHECK(!decoder.start(ContentCoding::Brotli));
+    Decoded out = decode(encoded_response("br", payload), payload.size());
+    CHECK(out.ok && out.done && out.body == payload);
+#endif
+}
+
+int main() {
+    test_content_length();
+    test_chunked();
+    test_interim();
+    test_bare_lf();
+    test_head_limit();
+    test_stops();
+#ifdef JAM3Z_HAVE_ZLIB
+    test_decode_zlib();
+    test_skip_budget();
+    test_corrupt_zlib();
+#endif
+    test_decode_brotli();
+    return check_result();
+}
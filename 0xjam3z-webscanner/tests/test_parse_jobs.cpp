@@ -0,0 +1,72 @@
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+// `parse` output is byte-identical whatever the worker count, and with the
+// buffers spilling to disk under a tiny --memory-limit.
+
+static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: test_parse_jobs <0xjam3z-scanner>" << std::endl;
+        return 2;
+    }
+    std::string scanner = argv[1];
+    std::filesystem::path dir = test_dir("parse_jobs");
+    std::vector<std::string> inputs;
+    for (uint32_t i = 0; i < 6; ++i) {
+        auto file = dir / ("zgrab_results_" + std::string(i % 2 ? "443" : "80") + "_" + std::to_string(i) + ".json");
+        std::ofstream(file) << zgrab_fixture(150 + 40 * i, 1000 * i + 1);
+        inputs.push_back(file.string());
+    }
+    auto masscan = dir / "masscan_results.txt";
+    {
+        std::ofstream out(masscan);
+        for (uint32_t i = 1; i <= 3000; ++i) {
+            out << "open tcp " << (i % 3 ? 80 : 443) << " " << zgrab_ip(i) << " 1700000000\n";
+        }
+    }
+    inputs.push_back(masscan.string());
+
+    std::string expected_titles;
+    std::string expected_80;
+    for (const char *variant : {"1", "2", "4", "16", "4 --memory-limit 1K"}) {
+        std::string name = std::string("jobs") + variant;
+        for (char &c : name) {
+            c = std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        }
+        std::filesystem::path out_dir = dir / name;
+        std::filesystem::create_directories(out_dir);
+        std::string cmd = quote_path(scanner) + " parse";
+        for (const auto &input : inputs) {
+            cmd += " " + quote_path(input);
+        }
+        cmd += " --output " + quote_path((out_dir / "titles.txt").string()) + " --out-dir " +
+               quote_path(out_dir.string()) + " --jobs " + variant + " > " + quote_path((out_dir / "log").string());
+        CHECK_EQ(std::system(cmd.c_str()), 0);
+        std::string titles = read_file(out_dir / "titles.txt");
+        std::string ips_80 = read_file(out_dir / "open_ips80.txt");
+        if (expected_titles.empty()) {
+            expected_titles = titles;
+            expected_80 = ips_80;
+            CHECK(!titles.empty());
+            CHECK_EQ(std::count(ips_80.begin(), ips_80.end(), '\n'), 2000);
+            continue;
+        }
+        if (titles != expected_titles || ips_80 != expected_80) {
+            std::cerr << "output differs with --jobs " << variant << std::endl;
+            ++check_failures();
+        }
+    }
+    return check_result();
+}
@@ -0,0 +1,281 @@
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include "parsers.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static void test_masscan_lines() {
+    MasscanEntry entry;
+    CHECK(parse_masscan_line("open tcp 443 192.0.2.7 1700000000", entry));
+    CHECK_EQ(entry.ip, 0xc0000207u);
+    CHECK_EQ(entry.port, 443);
+    CHECK_EQ(static_cast<int>(entry.proto), 6);
+    CHECK_EQ(entry.timestamp, 1700000000u);
+    CHECK(parse_masscan_line("open udp 53 192.0.2.8 0", entry));
+    CHECK_EQ(static_cast<int>(entry.proto), 17);
+    CHECK(!parse_masscan_line("#masscan", entry));
+    CHECK(!parse_masscan_line("open tcp 70000 192.0.2.7 0", entry));
+    CHECK(!parse_masscan_line("open tcp 80 192.0.2 0", entry));
+
+    std::istringstream in("#masscan\nopen tcp 80 192.0.2.1 1\nopen tcp 443 192.0.2.2 1\n"
+                          "open tcp 8080 192.0.2.3 1\nopen tcp 80 192.0.2.4 1\n# end\n");
+    std::ostringstream out_80;
+    std::ostringstream out_443;
+    MasscanCounts counts = parse_masscan_stream(in, out_80, out_443);
+    CHECK_EQ(counts.port_80, 2u);
+    CHECK_EQ(counts.port_443, 1u);
+    CHECK_EQ(counts.other, 1u);
+    CHECK_EQ(out_80.str(), "192.0.2.1\n192.0.2.4\n");
+    CHECK_EQ(out_443.str(), "192.0.2.2\n");
+}
+
+static std::string banner_text(const std::string &line) {
+    MasscanEntry entry;
+    std::string_view service;
+    std::string text = "<rejected>";
+    if (!parse_masscan_banner_line(line, entry, service, text)) {
+        return "<rejected>";
+    }
+    return text;
+}
+
+static void test_masscan_banners() {
+    MasscanEntry entry;
+    std::string_view service;
+    std::string text;
+    CHECK(parse_masscan_banner_line("banner tcp 8080 192.0.2.9 1700000000 title Admin\\x20Login \\x3cb\\x3E",
+                                    entry, service, text));
+    CHECK_EQ(entry.ip, 0xc0000209u);
+    CHECK_EQ(entry.port, 8080);
+    CHECK_EQ(static_cast<int>(entry.proto), 6);
+    CHECK_EQ(entry.timestamp, 1700000000u);
+    CHECK_EQ(service, "title");
+    CHECK_EQ(text, "Admin Login <b>");
+    CHECK_EQ(banner_text("banner udp 53 192.0.2.9 1 dns \\x00\\xff"), std::string("\0\xff", 2));
+    // Escapes cut short or not hex stay as they were.
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title a\\x4"), "a\\x4");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title a\\x"), "a\\x");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title a\\"), "a\\");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title \\xzz\\x4g\\x41"), "\\xzz\\x4gA");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title \\\\x41"), "\\A");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1 title"), "");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2.9 1"), "<rejected>");
+    CHECK_EQ(banner_text("banner icmp 80 192.0.2.9 1 title x"), "<rejected>");
+    CHECK_EQ(banner_text("banner tcp 80 192.0.2 1 title x"), "<rejected>");
+    CHECK_EQ(banner_text("open tcp 80 192.0.2.9 1"), "<rejected>");
+
+    std::istringstream in(
+        "open tcp 80 192.0.2.1 1\n"
+        "banner tcp 80 192.0.2.1 1 http HTTP/1.1 301 Moved\\x0d\\x0aServer: nginx\\x0d\\x0aSet-Cookie: a=1\\x0d\\x0a"
+        "set-cookie: b=2\\x0d\\x0a\\x0d\\x0a<html>\n"
+        "banner tcp 80 192.0.2.1 1 title  Moved \\x26 Gone \n"
+        "banner tcp 80 192.0.2.1 1 http.server Apache\n"
+        // Neither a title nor a server, and the capture cut off mid-header.
+        "open tcp 443 192.0.2.2 1\n"
+        "banner tcp 443 192.0.2.2 1 http HTTP/1.0 404 Not Found\\x0d\\x0aContent-Type: text/ht\n"
+        // Only the server, from the http.server banner.
+        "banner tcp 8080 192.0.2.3 1 http.server lighttpd\\x2f1.4\n"
+        // Not HTTP, or not tcp: left out.
+        "banner tcp 22 192.0.2.4 1 ssh SSH-2.0-OpenSSH_9.6\n"
+        "banner udp 80 192.0.2.5 1 title x\n"
+        "open tcp 80 192.0.2.6 1\n");
+    std::ostringstream out_80;
+    std::ostringstream out_443;
+    MasscanBanners banners;
+    MasscanCounts counts = parse_masscan_stream(in, out_80, out_443, &banners);
+    CHECK_EQ(counts.port_80, 2u);
+    CHECK_EQ(counts.port_443, 1u);
+    CHECK_EQ(out_80.str(), "192.0.2.1\n192.0.2.6\n");
+    CHECK_EQ(banners.size(), 3u);
+
+    auto it = banners.find(0xc0000201ull << 16 | 80);
+    CHECK(it != banners.end());
+    if (it != banners.end()) {
+        const MasscanBanner &b = it->second;
+        CHECK_EQ(b.status_code, 301);
+        CHECK(b.has_title);
+        CHECK_EQ(b.title, "Moved & Gone");
+        // The http banner's Server wins over http.server; repeated headers are joined.
+        CHECK_EQ(b.headers.size(), 2u);
+        CHECK(b.headers.size() == 2 && b.headers[0].first == "server" && b.headers[0].second == "nginx");
+        CHECK(b.headers.size() == 2 && b.headers[1].first == "set-cookie" && b.headers[1].second == "a=1, b=2");
+    }
+    it = banners.find(0xc0000202ull << 16 | 443);
+    CHECK(it != banners.end());
+    if (it != banners.end()) {
+        const MasscanBanner &b = it->second;
+        CHECK_EQ(b.status_code, 404);
+        CHECK(!b.has_title);
+        CHECK(b.title.empty());
+        CHECK_EQ(b.headers.size(), 1u);
+        CHECK(b.headers.size() == 1 && b.headers[0].first == "content-type" && b.headers[0].second == "text/ht");
+    }
+    it = banners.find(0xc0000203ull << 16 | 8080);
+    CHECK(it != banners.end());
+    if (it != banners.end()) {
+        const MasscanBanner &b = it->second;
+        CHECK_EQ(b.status_code, 0);
+        CHECK(!b.has_title);
+        CHECK_EQ(b.headers.size(), 1u);
+        CHECK(b.headers.size() == 1 && b.headers[0].first == "server" && b.headers[0].second == "lighttpd/1.4");
+    }
+    CHECK(banners.find(0xc0000206ull << 16 | 80) == banners.end());
+}
+
+static void test_titles() {
+    CHECK_EQ(extract_title("<html><TITLE> Hello  </TITLE>"), "Hello");
+    CHECK_EQ(extract_title("<title></title>"), "No title found");
+    CHECK_EQ(extract_title("<p>no title</p>"), "No title found");
+    CHECK(!find_title("<p>no title</p>"));
+    CHECK(title_end("<title>open") == std::string::npos);
+    CHECK_EQ(title_end("<title>x</title>rest"), 16u);
+}
+
+static void test_zgrab_lines() {
+    std::vector<HttpRecord> records;
+    CHECK(parse_zgrab_line(zgrab_success_line(5, "Site \\u0026 Co"), 80, records));
+    CHECK(parse_zgrab_line(zgrab_timeout_line(6), 80, records));
+    CHECK(!parse_zgrab_line("{\"data\":{}}", 80, records));
+    CHECK_EQ(records.size(), 2u);
+    if (records.size() == 2) {
+        CHECK_EQ(records[0].ip, "10.0.0.5");
+        CHECK_EQ(records[0].port, 80);
+        CHECK_EQ(records[0].status, "success");
+        CHECK_EQ(records[0].status_code, 200);
+        CHECK(records[0].has_body);
+        CHECK_EQ(records[0].title, "Site & Co");
+        CHECK_EQ(records[1].status, "io-timeout");
+        CHECK(!records[1].has_body);
+        std::string text;
+        format_record(records[0], text);
+        format_record(records[1], text);
+        CHECK_EQ(text, "IP: 10.0.0.5 - Title: Site & Co\nIP: 10.0.0.6 - No response body found\n");
+    }
+
+    // A filter that rejects the target keeps the module from being decoded.
+    TargetFilter none = [](std::string_view, uint16_t) { return false; };
+    records.clear();
+    parse_zgrab_line(zgrab_success_line(5, "x"), 80, records, &none);
+    CHECK(records.empty());
+
+    CHECK_EQ(zgrab_port_from_filename("zgrab_results_8080.json"), 8080);
+    CHECK_EQ(zgrab_port_from_filename("zgrab_results_all.json"), 0);
+}
+
+// One section of a zgrab2 "multiple" run, keyed by its module name.
+static std::string zgrab_section(const std::string &name, const std::string &title, const std::string &url = "") {
+    return "\"" + name + "\":{\"status\":\"success\",\"protocol\":\"http\",\"result\":{\"response\":"
+           "{\"status_code\":200,\"body\":\"<title>" + title + "</title>\"" +
+           (url.empty() ? "" : ",\"request\":{\"url\":" + url + "}") + "}}}";
+}
+
+static void test_zgrab_modules() {
+    std::string line = "{\"ip\":\"192.0.2.1\",\"domain\":\"example.com\",\"data\":{" +
+                       zgrab_section("http443", "Secure") + "," + zgrab_section("http8080", "Alt") + "," +
+                       zgrab_section("http80", "Plain") +
+                       ",\"http8443\":{\"status\":\"io-timeout\",\"protocol\":\"http\",\"error\":\"timeout\"}}}";
+    std::vector<HttpRecord> records;
+    CHECK(parse_zgrab_line(line, 0, records));
+    CHECK_EQ(records.size(), 4u);
+    if (records.size() == 4) {
+        const std::pair<uint16_t, const char *> expected[] = {
+            {443, "Secure"}, {8080, "Alt"}, {80, "Plain"}, {8443, ""}};
+        for (size_t i = 0; i < 4; ++i) {
+            CHECK_EQ(records[i].ip, "192.0.2.1");
+            CHECK_EQ(records[i].domain, "example.com");
+            CHECK_EQ(records[i].module, "http");
+            CHECK_EQ(records[i].port, expected[i].first);
+            CHECK_EQ(records[i].title, expected[i].second);
+        }
+        CHECK_EQ(records[3].status, "io-timeout");
+        CHECK(!records[3].has_body);
+    }
+    CHECK_EQ(zgrab_answered_input(line, true), "192.0.2.1,example.com,443");
+    CHECK_EQ(zgrab_answered_input(line, false), "192.0.2.1,example.com");
+
+    // The filter sees each section's own port.
+    TargetFilter only_8080 = [](std::string_view, uint16_t port) { return port == 8080; };
+    records.clear();
+    parse_zgrab_line(line, 0, records, &only_8080);
+    CHECK(records.size() == 1 && records[0].port == 8080 && records[0].title == "Alt");
+
+    // A port from the file name wins, and the module names are left alone.
+    records.clear();
+    parse_zgrab_line(line, 9000, records);
+    CHECK_EQ(records.size(), 4u);
+    CHECK(std::all_of(records.begin(), records.end(), [](const HttpRecord &rec) { return rec.port == 9000; }));
+    CHECK(records.size() == 4 && records[0].module == "http443");
+
+    // Without a port suffix the port comes from the request URL, else 80.
+    records.clear();
+    for (const char *name : {"http", "http123456"}) {
+        parse_zgrab_line("{\"ip\":\"192.0.2.2\",\"data\":{" + zgrab_section(name, name) + "}}", 0, records);
+    }
+    parse_zgrab_line("{\"ip\":\"192.0.2.3\",\"data\":{" +
+                         zgrab_section("http", "url", "{\"scheme\":\"https\",\"host\":\"192.0.2.3\"}") + "," +
+                         zgrab_section("https", "url port", "{\"scheme\":\"https\",\"host\":\"192.0.2.3:8443\"}") +
+                         "}}",
+                     0, records);
+    CHECK_EQ(records.size(), 4u);
+    if (records.size() == 4) {
+        CHECK(records[0].module == "http" && records[0].port == 80);
+        // Too many digits for a port: the whole name is the module.
+        CHECK(records[1].module == "http123456" && records[1].port == 80);
+        CHECK(records[2].module == "http" && records[2].port == 443);
+        CHECK(records[3].module == "https" && records[3].port == 8443);
+    }
+    CHECK_EQ(zgrab_answered_input("{\"ip\":\"192.0.2.2\",\"data\":{" + zgrab_section("http", "x") + "}}", true),
+             "192.0.2.2,,0");
+}
+
+// Chunked decoding, whatever the chunk size, gives the same records in the
+// same order as decoding line by line.
+static void test_chunks() {
+    std::filesystem::path dir = test_dir("parsers");
+    std::filesystem::path file = dir / "zgrab_results_80.json";
+    std::string fixture = zgrab_fixture(500);
+    std::ofstream(file) << fixture;
+
+    std::string expected;
+    std::istringstream lines(fixture);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::vector<HttpRecord> records;
+        parse_zgrab_line(line, 80, records);
+        for (const auto &rec : records) {
+            format_record(rec, expected);
+        }
+    }
+    CHECK(!expected.empty());
+    for (size_t chunk_bytes : {size_t{1}, size_t{700}, size_t{64 * 1024}, size_t{16 << 20}}) {
+        std::string got;
+        size_t chunks = 0;
+        CHECK(for_each_line_chunk(file, chunk_bytes, [&](std::string &chunk) {
+            CHECK(!chunk.empty() && chunk.back() == '\n');
+            std::vector<HttpRecord> records;
+            parse_zgrab_chunk(chunk, 80, records);
+            for (const auto &rec : records) {
+                format_record(rec, got);
+            }
+            ++chunks;
+        }));
+        CHECK_EQ(got, expected);
+        if (chunk_bytes == 1) {
+            CHECK_EQ(chunks, 500u);
+        }
+    }
+    CHECK(!for_each_line_chunk(dir / "missing.json", 1024, [](std::string &) {}));
+}
+
+int main() {
+    test_masscan_lines();
+    test_masscan_banners();
+    test_titles();
+    test_zgrab_lines();
+    test_zgrab_modules();
+    test_chunks();
+    return check_result();
+}
@@ -0,0 +1,188 @@
+#include "check.hpp"
+
+#include "spill.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+// SpillQueue under a tiny --memory-limit: spilled segments and the in-memory
+// tail read back in append order, compressed and raw blocks alike, a spill
+// that cannot be written backs off, and SpillStream queues whole lines only.
+
+static std::string contents(const SpillQueue &queue, bool *whole_lines = nullptr) {
+    std::string out;
+    CHECK(queue.for_each_chunk([&](std::string_view chunk) {
+        if (whole_lines && (chunk.empty() || chunk.back() != '\n')) {
+            *whole_lines = false;
+        }
+        out.append(chunk.data(), chunk.size());
+        return true;
+    }));
+    return out;
+}
+
+// Lines of bytes that do not compress.
+static std::string noise_lines(size_t bytes, uint64_t seed) {
+    std::string out;
+    while (out.size() < bytes) {
+        for (int i = 0; i < 99; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            char c = static_cast<char>(seed >> 56);
+            out += c == '\n' ? ' ' : c;
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+static std::string text_lines(size_t bytes, size_t first = 0) {
+    std::string out;
+    for (size_t i = first; out.size() < bytes; ++i) {
+        out += "IP: 10.0." + std::to_string(i / 256 % 256) + "." + std::to_string(i % 256) + " - Title: Site\n";
+    }
+    return out;
+}
+
+struct BlockSizes {
+    uint32_t raw = 0;
+    uint32_t stored = 0;
+};
+
+static uint32_t read_u32(const char *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+static std::vector<BlockSizes> blocks(const std::filesystem::path &segment) {
+    std::vector<BlockSizes> out;
+    std::ifstream in(segment, std::ios::binary);
+    char header[8];
+    while (in.read(header, sizeof(header))) {
+        out.push_back({read_u32(header), read_u32(header + 4)});
+        in.seekg(out.back().stored, std::ios::cur);
+    }
+    return out;
+}
+
+static void test_byte_size() {
+    uint64_t n = 0;
+    CHECK(parse_byte_size("512M", n) && n == 512ull << 20);
+    CHECK(parse_byte_size("2gb", n) && n == 2ull << 30);
+    CHECK(parse_byte_size("64k", n) && n == 64ull << 10);
+    CHECK(parse_byte_size("1000", n) && n == 1000);
+    for (const char *bad : {"", "M", "12X", "1MM", "-5"}) {
+        CHECK(!parse_byte_size(bad, n));
+    }
+}
+
+static void test_spill_order() {
+    std::filesystem::path dir = test_dir("spill") / "segments";
+    MemoryBudget budget(1, dir);
+    SpillQueue queue(&budget, "titles");
+    std::string expected;
+    auto append = [&](const std::string &data) {
+        queue.append(data);
+        expected += data;
+    };
+    // One segment each: text that compresses, noise that does not, and a tail
+    // long enough for several blocks.
+    append(text_lines(100 * 1024));
+    append(noise_lines(100 * 1024, 42));
+    append(text_lines(3 * 1024 * 1024, 5000));
+    // Under the spill minimum, so it stays in memory.
+    append("IP: 192.0.2.1 - Title: last\n");
+    CHECK_EQ(budget.spilled_segments(), 3u);
+    CHECK_EQ(queue.bytes(), expected.size());
+
+    bool whole_lines = true;
+    CHECK(contents(queue, &whole_lines) == expected);
+    CHECK(whole_lines);
+    size_t lines = 0;
+    queue.for_each_line([&](std::string_view) { ++lines; });
+    CHECK_EQ(lines, static_cast<size_t>(std::count(expected.begin(), expected.end(), '\n')));
+
+    auto text = blocks(dir / "titles-0.spill");
+    auto noise = blocks(dir / "titles-1.spill");
+    auto big = blocks(dir / "titles-2.spill");
+    CHECK(text.size() == 1 && noise.size() == 1);
+    CHECK(!noise.empty() && noise[0].stored == noise[0].raw);
+#ifdef JAM3Z_HAVE_ZLIB
+    CHECK(!text.empty() && text[0].stored < text[0].raw / 2);
+#else
+    CHECK(!text.empty() && text[0].stored == text[0].raw);
+#endif
+    CHECK(big.size() >= 3);
+    for (const auto &block : big) {
+        CHECK(block.raw <= 1024 * 1024);
+    }
+
+    queue.clear();
+    CHECK(queue.empty());
+    CHECK(std::filesystem::is_empty(dir));
+}
+
+static void test_failed_spill() {
+    std::filesystem::path dir = test_dir("spill_failed");
+    // A file where the segment directory should be: every spill fails.
+    std::ofstream(dir / "not_a_dir") << "x";
+    MemoryBudget budget(1, dir / "not_a_dir");
+    SpillQueue queue(&budget, "titles");
+    std::ostringstream errors;
+    std::streambuf *saved = std::cerr.rdbuf(errors.rdbuf());
+    std::string expected;
+    for (size_t i = 0; i < 64; ++i) {
+        std::string data = text_lines(16 * 1024, i * 1000);
+        queue.append(data);
+        expected += data;
+    }
+    std::cerr.rdbuf(saved);
+    CHECK_EQ(budget.spilled_segments(), 0u);
+    CHECK(contents(queue) == expected);
+    // Tried at 64 KB and then each time the tail doubled, not on every append.
+    std::string text = errors.str();
+    size_t failures = 0;
+    for (size_t pos = 0; (pos = text.find("Failed to write spill file", pos)) != std::string::npos; ++pos) {
+        ++failures;
+    }
+    CHECK(failures >= 1 && failures <= 6);
+}
+
+static void test_stream() {
+    SpillQueue queue;
+    {
+        SpillStream out(queue);
+        out << "a\nb";
+        out.flush();
+        // A flush mid-line leaves the partial line pending.
+        CHECK_EQ(contents(queue), "a\n");
+        out << "c\n" << "tail";
+        out.flush();
+        CHECK_EQ(contents(queue), "a\nbc\n");
+    }
+    // The stream's end takes the last line even without a newline.
+    CHECK_EQ(contents(queue), "a\nbc\ntail");
+
+    SpillQueue big;
+    {
+        SpillStream out(big);
+        std::string lines = text_lines(100 * 1024);
+        out << lines << "partial";
+        // Past 64 KB the complete lines go in without a flush.
+        bool whole_lines = true;
+        CHECK_EQ(contents(big, &whole_lines), lines);
+        CHECK(whole_lines);
+    }
+}
+
+int main() {
+    test_byte_size();
+    test_spill_order();
+    test_failed_spill();
+    test_stream();
+    return check_result();
+}
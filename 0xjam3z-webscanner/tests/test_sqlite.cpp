@@ -0,0 +1,124 @@
+#include "check.hpp"
+
+#include "sqlite_sink.hpp"
+
+#ifdef JAM3Z_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+// SqliteSink: the schema and indexes of a new database, rows from many
+// batches across transactions, dropped records left out, and a second scan
+// into the same database keeping its hosts.
+
+#ifdef JAM3Z_HAVE_SQLITE
+
+static std::vector<HttpRecord> batch(size_t first, size_t count) {
+    std::vector<HttpRecord> out;
+    for (size_t i = first; i < first + count; ++i) {
+        HttpRecord rec;
+        // Two services per host.
+        rec.ip = "10.0." + std::to_string(i / 2 / 256 % 256) + "." + std::to_string(i / 2 % 256);
+        rec.port = i % 2 ? 443 : 80;
+        rec.module = "http";
+        rec.status = "success";
+        rec.status_code = 200;
+        rec.has_body = true;
+        if (i % 3 == 0) {
+            rec.title = "Site " + std::to_string(i % 10);
+        }
+        if (i % 5 == 0) {
+            rec.fields.emplace_back("Server", "nginx");
+        }
+        if (i == 7) {
+            rec.domain = "example.com";
+            rec.cert = CertInfo{};
+            rec.cert->subject = "CN=example.com";
+            rec.cert->fingerprint_sha256 = "ab12";
+            rec.cert->names = {"example.com", "www.example.com"};
+        }
+        rec.dropped = i % 100 == 99;
+        out.push_back(std::move(rec));
+    }
+    return out;
+}
+
+// First column of the first row, as text.
+static std::string query(sqlite3 *db, const std::string &sql) {
+    sqlite3_stmt *stmt = nullptr;
+    std::string out = "<error>";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        out = "<none>";
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *text = sqlite3_column_text(stmt, 0);
+            out = text ? reinterpret_cast<const char *>(text) : "<null>";
+        }
+    }
+    sqlite3_finalize(stmt);
+    return out;
+}
+
+static void write_scan(const std::string &path, const std::string &source, size_t first, size_t count) {
+    SqliteSink sink;
+    CHECK(sink.open(path, source));
+    for (size_t i = first; i < first + count; i += 500) {
+        auto records = batch(i, 500);
+        sink.submit(records);
+        CHECK(records.empty());
+    }
+    CHECK(sink.close());
+}
+
+int main() {
+    std::string path = (test_dir("sqlite") / "results.db").string();
+    // 60000 records: more than one transaction's worth.
+    write_scan(path, "first", 0, 60000);
+
+    sqlite3 *db = nullptr;
+    CHECK(sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK);
+    for (const char *table : {"scans", "hosts", "services", "titles", "certs", "fields"}) {
+        CHECK_EQ(query(db, std::string("SELECT type FROM sqlite_master WHERE name = '") + table + "'"), "table");
+    }
+    for (const char *index :
+         {"hosts_ip", "services_host", "services_scan", "titles_title", "certs_fingerprint", "fields_service"}) {
+        CHECK_EQ(query(db, std::string("SELECT type FROM sqlite_master WHERE name = '") + index + "'"), "index");
+    }
+    CHECK_EQ(query(db, "SELECT count(*) FROM scans"), "1");
+    CHECK_EQ(query(db, "SELECT source FROM scans"), "first");
+    // Every hundredth record is dropped.
+    CHECK_EQ(query(db, "SELECT count(*) FROM services"), "59400");
+    CHECK_EQ(query(db, "SELECT count(*) FROM hosts"), "30000");
+    CHECK_EQ(query(db, "SELECT count(*) FROM titles"), std::to_string(20000 - 200));
+    CHECK_EQ(query(db, "SELECT count(*) FROM fields WHERE key = 'Server'"), "12000");
+    CHECK_EQ(query(db, "SELECT h.ip || ':' || s.port FROM services s JOIN hosts h ON h.id = s.host_id "
+                       "JOIN fields f ON f.service_id = s.id WHERE f.key = 'host' AND f.value = 'example.com'"),
+             "10.0.0.3:443");
+    CHECK_EQ(query(db, "SELECT names FROM certs WHERE fingerprint_sha256 = 'ab12'"), "example.com,www.example.com");
+    CHECK_EQ(query(db, "SELECT count(*) FROM titles WHERE title = 'Site 3'"), "2000");
+    sqlite3_close(db);
+
+    // Reopened: a second scan, half of it on known hosts.
+    write_scan(path, "second", 30000, 60000);
+    CHECK(sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK);
+    CHECK_EQ(query(db, "SELECT count(*) FROM scans"), "2");
+    CHECK_EQ(query(db, "SELECT count(*) FROM hosts"), "45000");
+    CHECK_EQ(query(db, "SELECT count(DISTINCT ip) FROM hosts"), "45000");
+    CHECK_EQ(query(db, "SELECT count(*) FROM services WHERE scan_id = 2"), "59400");
+    CHECK_EQ(query(db, "SELECT count(DISTINCT host_id) FROM services WHERE host_id IN "
+                       "(SELECT host_id FROM services WHERE scan_id = 1) AND scan_id = 2"),
+             "15000");
+    CHECK_EQ(query(db, "PRAGMA integrity_check"), "ok");
+    sqlite3_close(db);
+
+    SqliteSink missing;
+    CHECK(!missing.open((test_dir("sqlite_missing") / "no" / "such" / "dir.db").string(), "x"));
+    return check_result();
+}
+
+#else
+
+int main() {
+    std::cout << "skipped: built without SQLite" << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "check.hpp"
+
+#include "supervisor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// run_child with a shell script standing in for a grabber: a child killed
+// partway through is restarted with only the targets it left unanswered, the
+// line it was cut off in is dropped, max_restarts is kept to, and the child
+// gets its own file and core limits without the caller's changing.
+
+#ifndef _WIN32
+
+// Answers "answer <target>" per stdin line and logs what each attempt was sent.
+// The first <crashes> attempts die after five answers, halfway through the sixth.
+static const char kGrabber[] = R"(dir=$(dirname "$0")
+n=$(cat "$dir/attempts" 2>/dev/null || echo 0)
+n=$((n + 1))
+echo $n > "$dir/attempts"
+count=0
+while IFS= read -r line; do
+    echo "$line" >> "$dir/input$n"
+    count=$((count + 1))
+    if [ "$n" -le "$1" ] && [ $count -gt 5 ]; then
+        printf 'answer %.4s' "$line"
+        kill -KILL $$
+    fi
+    echo "answer $line"
+done
+)";
+
+static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static std::string targets(int first, int last) {
+    std::string out;
+    for (int i = first; i <= last; ++i) {
+        out += "target-" + std::to_string(i) + "\n";
+    }
+    return out;
+}
+
+static ChildJob grabber_job(const std::filesystem::path &dir, int crashes, const std::string &input,
+                            std::string &output) {
+    std::ofstream(dir / "grabber.sh") << kGrabber;
+    ChildJob job;
+    job.argv = {"/bin/sh", (dir / "grabber.sh").string(), std::to_string(crashes)};
+    job.input = [input](const std::function<bool(std::string_view)> &write) {
+        // Uneven chunks, so lines straddle them.
+        for (size_t pos = 0; pos < input.size(); pos += 7) {
+            if (!write(std::string_view(input).substr(pos, 7))) {
+                return false;
+            }
+        }
+        return true;
+    };
+    job.input_size = input.size();
+    job.output = [&output](std::string_view line) {
+        output.append(line.data(), line.size());
+        output += '\n';
+    };
+    job.answers = [](std::string_view line) {
+        return line.rfind("answer ", 0) == 0 ? std::string(line.substr(7)) : std::string();
+    };
+    return job;
+}
+
+static void test_restart() {
+    std::filesystem::path dir = test_dir("supervisor_restart");
+    std::string output;
+    ChildJob job = grabber_job(dir, 1, targets(1, 20), output);
+    CHECK(run_child(job));
+    CHECK(job.ok);
+    CHECK_EQ(job.restarts, 1u);
+    CHECK_EQ(job.answered, 20u);
+    CHECK_EQ(read_file(dir / "attempts"), "2\n");
+    // The second attempt gets the sixth target on, the one cut off included.
+    CHECK_EQ(read_file(dir / "input2"), targets(6, 20));
+    // Every target answered once; "answer targ" from the crash never arrives.
+    std::string expected;
+    for (int i = 1; i <= 20; ++i) {
+        expected += "answer target-" + std::to_string(i) + "\n";
+    }
+    CHECK_EQ(output, expected);
+}
+
+static void test_max_restarts() {
+    std::filesystem::path dir = test_dir("supervisor_max");
+    std::string output;
+    ChildJob job = grabber_job(dir, 100, targets(1, 40), output);
+    job.max_restarts = 2;
+    CHECK(!run_child(job));
+    CHECK(!job.ok);
+    CHECK_EQ(job.restarts, 2u);
+    CHECK_EQ(job.answered, 15u);
+    CHECK_EQ(read_file(dir / "attempts"), "3\n");
+    CHECK_EQ(read_file(dir / "input2").substr(0, 9), "target-6\n");
+    CHECK_EQ(read_file(dir / "input3").substr(0, 10), "target-11\n");
+    CHECK(output.find("answer targ\n") == std::string::npos);
+
+    // Without answers there is no telling what is left, so no restart.
+    std::filesystem::path none = test_dir("supervisor_none");
+    ChildJob plain = grabber_job(none, 100, targets(1, 10), output);
+    plain.answers = nullptr;
+    CHECK(!run_child(plain));
+    CHECK_EQ(plain.restarts, 0u);
+    CHECK_EQ(read_file(none / "attempts"), "1\n");
+}
+
+static void test_limits() {
+    // Soft limits the child's must differ from.
+    rlimit nofile{};
+    rlimit core{};
+    CHECK(getrlimit(RLIMIT_NOFILE, &nofile) == 0);
+    CHECK(getrlimit(RLIMIT_CORE, &core) == 0);
+    nofile.rlim_cur = std::min<rlim_t>(nofile.rlim_max, 256);
+    core.rlim_cur = core.rlim_max;
+    CHECK(setrlimit(RLIMIT_NOFILE, &nofile) == 0);
+    CHECK(setrlimit(RLIMIT_CORE, &core) == 0);
+    std::string output;
+    ChildJob job;
+    job.argv = {"/bin/sh", "-c", "ulimit -Sc; ulimit -Sn; ulimit -Hn"};
+    job.output = [&output](std::string_view line) {
+        output.append(line.data(), line.size());
+        output += '\n';
+    };
+    CHECK(run_child(job));
+    std::string hard = nofile.rlim_max == RLIM_INFINITY ? "unlimited" : std::to_string(nofile.rlim_max);
+    CHECK_EQ(output, "0\n" + hard + "\n" + hard + "\n");
+    rlimit after{};
+    CHECK(getrlimit(RLIMIT_NOFILE, &after) == 0 && after.rlim_cur == nofile.rlim_cur);
+    CHECK(getrlimit(RLIMIT_CORE, &after) == 0 && after.rlim_cur == core.rlim_cur);
+}
+
+int main() {
+    test_restart();
+    test_max_restarts();
+    test_limits();
+    return check_result();
+}
+
+#else
+
+int main() {
+    std::cout << "skipped: the supervisor restarts children on POSIX only" << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include "check.hpp"
+
+#include "common.hpp"
+#include "targets.hpp"
+
+#include <fstream>
+#include <iterator>
+
+// Target specs and TargetSet arithmetic for both families, IPv6 text forms,
+// the prefix trie, target list round trips and hitlist filtering.
+
+static Ipv6Addr v6(const char *text) {
+    Ipv6Addr addr;
+    CHECK(parse_ipv6(text, addr));
+    return addr;
+}
+
+static void test_ipv4_specs() {
+    Ipv4Range range;
+    CHECK(parse_target_spec("10.0.0.0/30", range));
+    CHECK_EQ(range.start, 0x0a000000u);
+    CHECK_EQ(range.end, 0x0a000003u);
+    // Host bits set: the whole network, as masscan reads it.
+    CHECK(parse_target_spec("10.0.0.5/24", range));
+    CHECK_EQ(range.start, 0x0a000000u);
+    CHECK_EQ(range.end, 0x0a0000ffu);
+    CHECK(parse_target_spec("1.2.3.4-1.2.3.9", range));
+    CHECK_EQ(range.end - range.start, 5u);
+    CHECK(parse_target_spec("0.0.0.0/0", range) && range.start == 0 && range.end == 0xffffffffu);
+    CHECK(!parse_target_spec("1.2.3.4/33", range));
+    CHECK(!parse_target_spec("1.2.3.9-1.2.3.4", range));
+    CHECK(!parse_target_spec("example.com", range));
+}
+
+static void test_ipv6_text() {
+    const char *canonical[][2] = {
+        {"2001:DB8:0:0:1:0:0:1", "2001:db8::1:0:0:1"},
+        {"2001:db8:0000:0000:0000:0000:0000:0001", "2001:db8::1"},
+        {"::", "::"},
+        {"::1", "::1"},
+        {"2001:db8::", "2001:db8::"},
+        {"2001:0:0:1:0:0:0:1", "2001:0:0:1::1"},
+        {"2001:db8:0:1:1:1:1:1", "2001:db8:0:1:1:1:1:1"},
+        {"::ffff:192.0.2.1", "::ffff:192.0.2.1"},
+        {"1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8"},
+    };
+    for (const auto &pair : canonical) {
+        CHECK_EQ(format_ipv6(v6(pair[0])), pair[1]);
+    }
+    Ipv6Addr addr;
+    for (const char *bad : {"1::2::3", "12345::", ":::", "1:2:3:4:5:6:7:8:9", "1.2.3.4", "", "fe80::1%eth0"}) {
+        CHECK(!parse_ipv6(bad, addr));
+    }
+    CHECK(v6("::1").next() == v6("::2"));
+    CHECK(v6("::1:0:0:0:0").prev() == v6("::ffff:ffff:ffff:ffff"));
+
+    Ipv6Range range;
+    CHECK(parse_ipv6_spec("2001:db8::1/120", range));
+    CHECK(range.start == v6("2001:db8::") && range.end == v6("2001:db8::ff"));
+    CHECK_EQ(ipv6_range_size(range), 256.0);
+    CHECK(parse_ipv6_spec("2001:db8::/64", range));
+    CHECK_EQ(ipv6_range_size(range), 18446744073709551616.0);
+    CHECK(!parse_ipv6_spec("2001:db8::/129", range));
+
+    // ::1-::6 splits into /128, /127, /127, /128.
+    auto prefixes = ipv6_range_prefixes({v6("::1"), v6("::6")});
+    CHECK_EQ(prefixes.size(), 4u);
+    CHECK(prefixes.size() == 4 && prefixes[1].first == v6("::2") && prefixes[1].second == 127);
+    CHECK_EQ(ipv6_range_prefixes({v6("::"), v6("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")}).size(), 1u);
+}
+
+static void test_trie() {
+    Ipv6Trie trie;
+    CHECK(trie.empty());
+    trie.insert(v6("2001:db8::"), 32, 1);
+    trie.insert(v6("2001:db8:1::"), 48, 2);
+    trie.insert(v6("2001:db8:1::7"), 128, 3);
+    trie.insert_range({v6("2001:db9::"), v6("2001:db9::3")}, 4);
+    auto value = [&](const char *text) {
+        const uint32_t *found = trie.lookup(v6(text));
+        return found ? *found : 0u;
+    };
+    CHECK_EQ(value("2001:db8:2::1"), 1u);
+    CHECK_EQ(value("2001:db8:1::1"), 2u);
+    CHECK_EQ(value("2001:db8:1::7"), 3u);
+    CHECK_EQ(value("2001:db9::3"), 4u);
+    CHECK_EQ(value("2001:db9::4"), 0u);
+    CHECK_EQ(value("::1"), 0u);
+}
+
+static void test_target_set() {
+    TargetSet set;
+    std::vector<std::string> hostnames;
+    CHECK(set.add_line("10.0.0.0/30, 10.0.0.4 2001:db8::/126 2001:db8::5 2001:db8::2 Example.COM # 10.9.9.9",
+                       &hostnames));
+    CHECK(set.add_line("10.0.0.2,2001:db8::5", &hostnames));
+    CHECK(!set.add_line("not_a_target!", &hostnames));
+    CHECK(!TargetSet().add_line("example.com"));
+    CHECK(hostnames == std::vector<std::string>({"example.com"}));
+    set.coalesce();
+    // Adjacent ranges merge; singles inside a range and duplicates go.
+    CHECK_EQ(set.ranges().size(), 1u);
+    CHECK_EQ(set.size(), 5u);
+    CHECK_EQ(set.ranges6().size(), 1u);
+    CHECK_EQ(set.singles6().size(), 1u);
+    CHECK_EQ(set.size6(), 5.0);
+    CHECK(set.contains(0x0a000004) && !set.contains(0x0a000005) && !set.contains(0x0a090909));
+
+    TargetSet cuts;
+    CHECK(cuts.add_line("10.0.0.2 2001:db8::1 2001:db8::5"));
+    set.subtract(cuts);
+    CHECK_EQ(set.ranges().size(), 2u);
+    CHECK_EQ(set.size(), 4u);
+    CHECK(!set.contains(0x0a000002));
+    CHECK_EQ(set.ranges6().size(), 2u);
+    CHECK(set.singles6().empty());
+    CHECK_EQ(set.size6(), 3.0);
+
+    // Merging and subtracting at the top of the address space must not wrap.
+    TargetSet top;
+    top.add(0xfffffffeu, 0xffffffffu);
+    top.add(0xffffffffu, 0xffffffffu);
+    top.add(0, 0);
+    top.coalesce();
+    CHECK_EQ(top.ranges().size(), 2u);
+    CHECK_EQ(top.size(), 3u);
+    TargetSet all;
+    all.add(0, 0xffffffffu);
+    top.subtract(all);
+    CHECK(top.empty());
+}
+
+static void test_files() {
+    std::filesystem::path dir = test_dir("targets");
+    TargetSet set;
+    CHECK(set.add_line("192.0.2.0/29 192.0.2.10 2001:db8::/120 2001:db8:1::1-2001:db8:1::3 2001:db8:2::9"));
+    set.coalesce();
+    CHECK(write_target_list(dir / "list.txt", set));
+    std::ifstream in(dir / "list.txt");
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK_EQ(text, "192.0.2.0-192.0.2.7\n192.0.2.10\n2001:db8::/120\n2001:db8:1::1-2001:db8:1::3\n2001:db8:2::9\n");
+    TargetSet reloaded;
+    CHECK(load_target_file(dir / "list.txt", reloaded));
+    reloaded.coalesce();
+    CHECK_EQ(reloaded.size(), set.size());
+    CHECK_EQ(reloaded.size6(), set.size6());
+    CHECK(!load_target_file(dir / "missing.txt", reloaded));
+
+    std::ofstream(dir / "hitlist.txt") << "# hitlist\n192.0.2.3\n198.51.100.1\n2001:db8::42\n2001:db8::42\n"
+                                          "2001:db9::1\n\n2001:db8:2::9, seen 2024\n";
+    TargetSet hits;
+    uint64_t outside = 0;
+    CHECK(load_hitlist(dir / "hitlist.txt", set, hits, outside));
+    CHECK_EQ(outside, 2u);
+    CHECK_EQ(hits.size(), 1u);
+    CHECK_EQ(hits.singles6().size(), 2u);
+    std::ofstream(dir / "bad_hitlist.txt") << "192.0.2.3\nnot-an-address\n";
+    CHECK(!load_hitlist(dir / "bad_hitlist.txt", set, hits, outside));
+}
+
+static void test_ports() {
+    std::vector<uint32_t> ports;
+    CHECK(parse_port_spec("443, 80,8000-8002,U:53,t:80", ports));
+    CHECK(ports == std::vector<uint32_t>({80, 443, 8000, 8001, 8002, 1u << 16 | 53}));
+    for (const char *bad : {"", "80-", "90-80", "70000", "X:80", "eighty"}) {
+        std::vector<uint32_t> none;
+        CHECK(!parse_port_spec(bad, none));
+    }
+}
+
+int main() {
+    test_ipv4_specs();
+    test_ipv6_text();
+    test_trie();
+    test_target_set();
+    test_files();
+    test_ports();
+    return check_result();
+}
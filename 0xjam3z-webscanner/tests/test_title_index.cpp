@@ -0,0 +1,101 @@
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include "title_index.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+// Title index segments written from opendomains output with trailing fields
+// and from zgrab2 JSON, then searched: titles stop where the fields begin,
+// placeholders are not indexed, and headers are searchable on their own.
+
+static HttpRecord record(const std::string &ip, const std::string &title) {
+    HttpRecord rec;
+    rec.ip = ip;
+    rec.has_body = true;
+    rec.title = title;
+    return rec;
+}
+
+static std::vector<TitleMatch> search(const TitleIndexSegment &segment, const std::string &needle) {
+    std::vector<TitleMatch> out;
+    segment.search(needle, 100, out);
+    return out;
+}
+
+static void test_opendomains(const std::filesystem::path &dir) {
+    std::vector<HttpRecord> recs;
+    recs.push_back(record("192.0.2.1", "Admin Login"));
+    recs.back().fields = {{"Server", "nginx"}, {"Tag", "login"}};
+    recs.push_back(record("192.0.2.2", "Home - Example Corp"));
+    recs.back().domain = "example.com";
+    recs.back().fields = {{"ptr", "host2.example.net"}, {"aliases", "www.example.com"}};
+    recs.push_back(record("192.0.2.3", ""));
+    recs.back().fields = {{"Server", "nginx"}};
+    recs.push_back(record("192.0.2.4", "Admin Login"));
+    recs.push_back(record("192.0.2.5", "Router"));
+    recs.back().has_body = false;
+    std::string text;
+    for (const auto &rec : recs) {
+        format_record(rec, text);
+    }
+    std::ofstream(dir / "opendomains.txt") << text;
+
+    TitleIndexWriter writer;
+    uint16_t scan = writer.add_scan("scan1");
+    CHECK(writer.add_file(dir / "opendomains.txt", scan));
+    // Two distinct titles; the placeholder and the bodiless line add nothing.
+    CHECK_EQ(writer.texts(), 2u);
+    CHECK_EQ(writer.entries(), 3u);
+    CHECK(writer.write(dir / "opendomains.j3zi"));
+
+    TitleIndexSegment segment;
+    CHECK(segment.open(dir / "opendomains.j3zi"));
+    auto matches = search(segment, "LOGIN");
+    CHECK_EQ(matches.size(), 2u);
+    for (const auto &match : matches) {
+        CHECK_EQ(match.text, "Admin Login");
+        CHECK_EQ(match.scan, "scan1");
+        CHECK(match.kind == IndexedKind::Title);
+    }
+    matches = search(segment, "example corp");
+    CHECK_EQ(matches.size(), 1u);
+    CHECK(matches.size() == 1 && matches[0].text == "Home - Example Corp" && matches[0].ip == "192.0.2.2");
+    // Field text is not title text.
+    CHECK(search(segment, "nginx").empty());
+    CHECK(search(segment, "host2").empty());
+    CHECK(search(segment, "No title").empty());
+}
+
+static void test_zgrab(const std::filesystem::path &dir) {
+    std::ofstream(dir / "zgrab_results_8080.json") << zgrab_fixture(100);
+    WorkPool pool;
+    pool.start(2);
+    for (WorkPool *p : {static_cast<WorkPool *>(nullptr), &pool}) {
+        TitleIndexWriter writer;
+        CHECK(writer.add_file(dir / "zgrab_results_8080.json", writer.add_scan("zgrab"), p));
+        // Every success has a title and a Server header; i % 9 == 0 timed out.
+        CHECK_EQ(writer.entries(), 2u * 89);
+        CHECK(writer.write(dir / "zgrab.j3zi"));
+        TitleIndexSegment segment;
+        CHECK(segment.open(dir / "zgrab.j3zi"));
+        auto matches = search(segment, "site 36");
+        // i = 36 timed out; 73 is the other i with i % 37 == 36.
+        CHECK_EQ(matches.size(), 1u);
+        CHECK(matches.size() == 1 && matches[0].ip == zgrab_ip(73) && matches[0].port == 8080);
+        matches = search(segment, "nginx");
+        CHECK_EQ(matches.size(), 89u);
+        CHECK(std::all_of(matches.begin(), matches.end(), [](const TitleMatch &m) {
+            return m.kind == IndexedKind::Header && m.text == "server: nginx";
+        }));
+    }
+}
+
+int main() {
+    std::filesystem::path dir = test_dir("title_index");
+    test_opendomains(dir);
+    test_zgrab(dir);
+    return check_result();
+}
@@ -0,0 +1,150 @@
+#include "check.hpp"
+
+#include "common.hpp"
+#include "tools.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iterator>
+
+// Tool bootstrap against local file:// bare repositories: masscan and zgrab2
+// are cloned and "built" concurrently, a second checkout takes both from the
+// shared cache without building, and the resolution cache survives a reload
+// until the binary changes. A fake `go` and a Makefile that copies a script
+// stand in for the real toolchains, so nothing touches the network.
+
+namespace fs = std::filesystem;
+
+static std::string read_file(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void write_script(const fs::path &path, const std::string &body) {
+    std::ofstream(path) << "#!/bin/sh\n" << body;
+    fs::permissions(path, fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec |
+                              fs::perms::others_read | fs::perms::others_exec);
+}
+
+static size_t count_lines(const fs::path &path) {
+    std::string text = read_file(path);
+    return static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+}
+
+// Commits `src` and clones it bare to `bare`; returns the file:// URL.
+static std::string make_bare_repo(const fs::path &src, const fs::path &bare) {
+    std::string git = "git -C " + quote_path(src.string()) + " ";
+    bool ok = run_command(git + "init -q") && run_command(git + "add -A") &&
+              run_command(git + "-c user.name=jam3z -c user.email=jam3z@localhost commit -q -m fixture") &&
+              run_command("git clone -q --bare " + quote_path(src.string()) + " " + quote_path(bare.string()));
+    CHECK(ok);
+    return "file://" + bare.string();
+}
+
+static void bootstrap(const fs::path &base, const fs::path &masscan, const fs::path &zgrab2) {
+    // Different tools may be resolved at the same time.
+    auto m = std::async(std::launch::async, [&] { return ensure_masscan(base, false); });
+    auto z = std::async(std::launch::async, [&] { return ensure_zgrab2(base, false); });
+    auto m_path = m.get();
+    auto z_path = z.get();
+    CHECK(m_path && fs::path(*m_path) == masscan);
+    CHECK(z_path && fs::path(*z_path) == zgrab2);
+    CHECK(fs::exists(masscan));
+    CHECK(fs::exists(zgrab2));
+}
+
+int main() {
+#ifdef _WIN32
+    std::cout << "skipped: the fake toolchains are shell scripts" << std::endl;
+    return 0;
+#else
+    if (find_in_path("masscan") || find_in_path("zgrab2") || !find_in_path("git")) {
+        std::cout << "skipped: needs git, and masscan/zgrab2 must not be on PATH" << std::endl;
+        return 0;
+    }
+    fs::path dir = test_dir("tools");
+    fs::path builds = dir / "builds.log";
+
+    fs::path masscan_src = dir / "masscan-src";
+    fs::create_directories(masscan_src / "src");
+    write_script(masscan_src / "src" / "masscan.sh",
+                 "case \"$1\" in --version) echo 'Masscan version 1.3.2 ( fake )';; *) echo 'usage: -oB';; esac\n");
+    // The sleep keeps the two builds overlapping.
+    std::ofstream(masscan_src / "Makefile")
+        << "all:\n\tmkdir -p bin && sleep 1 && cp src/masscan.sh bin/masscan && echo masscan >> "
+        << quote_path(builds.string()) << "\n";
+    std::string masscan_url = make_bare_repo(masscan_src, dir / "masscan.git");
+
+    fs::path zgrab2_src = dir / "zgrab2-src";
+    fs::create_directories(zgrab2_src / "cmd" / "zgrab2");
+    std::ofstream(zgrab2_src / "cmd" / "zgrab2" / "main.go") << "package main\n\nfunc main() {}\n";
+    std::string zgrab2_url = make_bare_repo(zgrab2_src, dir / "zgrab2.git");
+
+    // `go build -p N -o OUT ./cmd/zgrab2` writes a script that answers like zgrab2.
+    fs::path fakebin = dir / "fakebin";
+    fs::create_directories(fakebin);
+    write_script(fakebin / "go", "if [ \"$1\" = version ]; then echo 'go version go0.0 fake'; exit 0; fi\n"
+                                 "sleep 1\n"
+                                 "printf '#!/bin/sh\\necho zgrab2 fake; echo \"  --input-file multiple\"\\n' > \"$5\"\n"
+                                 "chmod +x \"$5\"\n"
+                                 "echo zgrab2 >> " + quote_path(builds.string()) + "\n");
+    const char *path_env = std::getenv("PATH");
+    setenv("PATH", (fakebin.string() + ":" + (path_env ? path_env : "/usr/bin:/bin")).c_str(), 1);
+    setenv("JAM3Z_TOOL_CACHE", (dir / "cache").c_str(), 1);
+    setenv("JAM3Z_MASSCAN_URL", masscan_url.c_str(), 1);
+    setenv("JAM3Z_ZGRAB2_URL", zgrab2_url.c_str(), 1);
+    CHECK_EQ(tool_cache_dir(), dir / "cache");
+
+    // First checkout: both tools cloned and built, once each.
+    fs::path first = dir / "checkout1";
+    bootstrap(first, first / "bin" / "masscan", first / "bin" / "zgrab2");
+    CHECK_EQ(count_lines(builds), 2u);
+    CHECK(fs::exists(first / "third_party" / "masscan" / ".git"));
+    size_t entries = 0;
+    for (const auto &entry : fs::directory_iterator(dir / "cache")) {
+        if (fs::exists(entry.path() / "meta")) {
+            ++entries;
+            CHECK(read_file(entry.path() / "meta").find("url=file://") != std::string::npos);
+        }
+    }
+    CHECK_EQ(entries, 2u);
+
+    // Second checkout of the same commits: served from the cache, nothing cloned or built.
+    fs::path second = dir / "checkout2";
+    bootstrap(second, second / "bin" / "masscan", second / "bin" / "zgrab2");
+    CHECK_EQ(count_lines(builds), 2u);
+    CHECK(!fs::exists(second / "third_party"));
+    CHECK_EQ(read_file(second / "bin" / "masscan"), read_file(first / "bin" / "masscan"));
+
+    // Unreachable remote: the newest cached build from the same toolchain is used.
+    setenv("JAM3Z_MASSCAN_URL", ("file://" + (dir / "missing.git").string()).c_str(), 1);
+    fs::path offline = dir / "checkout3";
+    auto cached = ensure_masscan(offline, false);
+    CHECK(cached && fs::path(*cached) == offline / "bin" / "masscan");
+    CHECK_EQ(count_lines(builds), 2u);
+    CHECK(!ensure_zgrab2(dir / "checkout4", true));
+
+    // Resolution cache: probed once, reloaded from disk, dropped when the binary changes.
+    {
+        ToolResolutionCache cache(second, false);
+        auto info = resolve_masscan(second, false, cache);
+        CHECK(info && info->version == "1.3.2");
+        CHECK(info && info->has("oB") && info->has("stdout") && info->has("ipv6"));
+        auto zgrab = resolve_zgrab2(second, false, cache);
+        CHECK(zgrab && zgrab->has("stdin") && zgrab->has("multiple"));
+        cache.save();
+    }
+    {
+        ToolResolutionCache cache(second, false);
+        auto hit = cache.lookup("masscan");
+        CHECK(hit && fs::path(hit->path) == second / "bin" / "masscan" && hit->version == "1.3.2");
+        std::ofstream(second / "bin" / "masscan", std::ios::app) << "# changed\n";
+        CHECK(!cache.lookup("masscan"));
+        CHECK(cache.lookup("zgrab2"));
+        ToolResolutionCache refreshed(second, true);
+        CHECK(!refreshed.lookup("zgrab2"));
+    }
+    return check_result();
+#endif
+}
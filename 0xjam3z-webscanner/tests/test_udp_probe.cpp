@@ -0,0 +1,322 @@
+#include "check.hpp"
+
+#include "common.hpp"
+#include "udp_probe.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// probe_udp against loopback responders on the service ports: each payload
+// draws a decodable answer that becomes a record, while replies with a wrong
+// or missing cookie, undecodable replies and replies from outside the targets
+// only count as unmatched.
+
+#ifndef _WIN32
+
+static const uint16_t kPorts[] = {53, 123, 161, 500, 443, 1900};
+
+// 127.0.0.2 answers properly, 127.0.0.3 echoes a wrong cookie and 127.0.0.4
+// leaves it out.
+enum class Mode { Echo, Wrong, Absent };
+
+static uint32_t loopback(uint8_t host) {
+    return 0x7f000000u | host;
+}
+
+static std::string tlv(uint8_t tag, const std::string &value) {
+    return std::string(1, static_cast<char>(tag)) + static_cast<char>(value.size()) + value;
+}
+
+// The cookie bytes of a request, altered as `mode` says.
+static std::string cookie(const std::string &request, size_t offset, size_t len, Mode mode) {
+    std::string out = request.substr(offset, len);
+    if (mode == Mode::Wrong) {
+        out.back() = static_cast<char>(out.back() ^ 1);
+    } else if (mode == Mode::Absent) {
+        out.assign(len, '\0');
+    }
+    return out;
+}
+
+static std::string dns_reply(const std::string &request, Mode mode) {
+    if (mode == Mode::Absent) {
+        return request.substr(0, 8); // too short to carry an id that counts
+    }
+    std::string out = cookie(request, 0, 2, mode) + std::string("\x84\x00\x00\x01\x00\x01\x00\x00\x00\x00", 10);
+    out += request.substr(12);
+    std::string txt = "\x09" "9.18-test";
+    out += std::string("\xc0\x0c\x00\x10\x00\x03\x00\x00\x00\x00\x00", 11) + static_cast<char>(txt.size()) + txt;
+    return out;
+}
+
+static std::string ntp_reply(const std::string &request, Mode mode) {
+    std::string out(48, '\0');
+    out[0] = 0x24; // version 4, mode 4
+    out[1] = 2;
+    out.replace(12, 4, std::string("\xc0\x00\x02\x01", 4)); // refid 192.0.2.1
+    out.replace(24, 8, cookie(request, 40, 8, mode));
+    return out;
+}
+
+static std::string snmp_reply(const std::string &request, Mode mode) {
+    std::string request_id = mode == Mode::Absent ? std::string(1, '\0') : cookie(request, 17, 4, mode);
+    std::string varbind = tlv(0x30, tlv(0x06, "\x2b\x06\x01\x02\x01\x01\x01" + std::string(1, '\0')) +
+                                         tlv(0x04, "Linux test 6.1"));
+    std::string pdu = tlv(0x02, request_id) + tlv(0x02, std::string(1, '\0')) + tlv(0x02, std::string(1, '\0')) +
+                      tlv(0x30, varbind);
+    return tlv(0x30, tlv(0x02, "\x01") + tlv(0x04, "public") + tlv(0xa2, pdu));
+}
+
+static std::string ike_reply(const std::string &request, Mode mode) {
+    std::string out = cookie(request, 0, 8, mode) + "RESPONDR";
+    // Main Mode header, then a NO-PROPOSAL-CHOSEN notification.
+    out += std::string("\x0b\x10\x02\x00\x00\x00\x00\x00\x00\x00\x00\x28", 12);
+    out += std::string("\x00\x00\x00\x0c\x00\x00\x00\x01\x01\x00\x00\x0e", 12);
+    return out;
+}
+
+static std::string quic_reply(const std::string &request, Mode mode) {
+    // Version Negotiation: our SCID (empty) as DCID, our DCID as SCID.
+    std::string out = std::string("\x80\x00\x00\x00\x00\x00", 6);
+    out += mode == Mode::Absent ? std::string(1, '\0') : "\x08" + cookie(request, 6, 8, mode);
+    out += std::string("\x00\x00\x00\x01\x1a\x2a\x3a\x4a\x6b\x33\x43\xcf", 12);
+    return out;
+}
+
+static std::string ssdp_reply(Mode mode) {
+    if (mode == Mode::Wrong) {
+        return "NOTIFY * HTTP/1.1\r\nNTS: ssdp:alive\r\n\r\n";
+    }
+    return "HTTP/1.1 200 OK\r\nSERVER: Test/1.0 UPnP/1.0\r\nLOCATION: http://127.0.0.2/desc.xml\r\n"
+           "USN: uuid:test\r\n\r\n";
+}
+
+static std::string reply_for(uint16_t port, const std::string &request, Mode mode) {
+    switch (port) {
+    case 53:
+        return dns_reply(request, mode);
+    case 123:
+        return ntp_reply(request, mode);
+    case 161:
+        return snmp_reply(request, mode);
+    case 500:
+        return ike_reply(request, mode);
+    case 443:
+        return quic_reply(request, mode);
+    default:
+        return ssdp_reply(mode);
+    }
+}
+
+static int bound_socket(uint32_t ip, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(ip);
+    if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// One socket per (address, service port). Extras: 127.0.0.2 answers DNS
+// twice and once more from 127.0.0.9, outside the targets; 127.0.0.4 answers
+// SSDP from another port, as real devices do.
+class Responders {
+public:
+    bool start() {
+        for (uint8_t host : {2, 3, 4}) {
+            for (uint16_t port : kPorts) {
+                int fd = bound_socket(loopback(host), port);
+                if (fd < 0) {
+                    std::cerr << "cannot bind 127.0.0." << int(host) << ":" << port << ": " << std::strerror(errno)
+                              << std::endl;
+                    return false;
+                }
+                sockets_.push_back({fd, port, static_cast<Mode>(host - 2)});
+            }
+        }
+        stray_ = bound_socket(loopback(9), 53);
+        other_port_ = bound_socket(loopback(4), 0);
+        if (stray_ < 0 || other_port_ < 0) {
+            return false;
+        }
+        thread_ = std::thread([this] { serve(); });
+        return true;
+    }
+
+    ~Responders() {
+        stop_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        for (const auto &s : sockets_) {
+            close(s.fd);
+        }
+        for (int fd : {stray_, other_port_}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    size_t requests() const { return requests_; }
+
+private:
+    struct Socket {
+        int fd;
+        uint16_t port;
+        Mode mode;
+    };
+
+    void serve() {
+        std::vector<pollfd> fds;
+        for (const auto &s : sockets_) {
+            fds.push_back(pollfd{s.fd, POLLIN, 0});
+        }
+        while (!stop_) {
+            if (poll(fds.data(), fds.size(), 50) <= 0) {
+                continue;
+            }
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (!fds[i].revents) {
+                    continue;
+                }
+                const Socket &s = sockets_[i];
+                char buf[2048];
+                sockaddr_in from{};
+                socklen_t from_len = sizeof(from);
+                ssize_t n = recvfrom(s.fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+                if (n <= 0) {
+                    continue;
+                }
+                ++requests_;
+                std::string out = reply_for(s.port, std::string(buf, static_cast<size_t>(n)), s.mode);
+                int via = s.port == 1900 && s.mode == Mode::Absent ? other_port_ : s.fd;
+                auto to = reinterpret_cast<sockaddr *>(&from);
+                sendto(via, out.data(), out.size(), 0, to, from_len);
+                if (s.port == 53 && s.mode == Mode::Echo) {
+                    sendto(s.fd, out.data(), out.size(), 0, to, from_len);
+                    sendto(stray_, out.data(), out.size(), 0, to, from_len);
+                }
+            }
+        }
+    }
+
+    std::vector<Socket> sockets_;
+    int stray_ = -1;
+    int other_port_ = -1;
+    std::atomic<size_t> requests_{0};
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+static std::string field(const HttpRecord &rec, const std::string &name) {
+    for (const auto &f : rec.fields) {
+        if (f.first == name) {
+            return f.second;
+        }
+    }
+    return "<missing>";
+}
+
+static void test_services() {
+    CHECK_EQ(std::string(udp_service(53)), "dns");
+    CHECK_EQ(std::string(udp_service(443)), "quic");
+    CHECK(udp_service(80) == nullptr);
+    CHECK_EQ(udp_service_list(), "53 (dns), 123 (ntp), 161 (snmp), 443 (quic), 500 (ike), 1900 (ssdp)");
+}
+
+static void test_probe(const Responders &responders) {
+    TargetSet targets;
+    targets.add(loopback(2), loopback(4));
+    std::vector<uint16_t> ports(std::begin(kPorts), std::end(kPorts));
+    std::map<std::string, HttpRecord> records;
+    UdpScanStats stats = probe_udp(targets, ports, 1000, 0.5, 4, nullptr, [&](std::vector<HttpRecord> &batch) {
+        CHECK(batch.size() <= 4);
+        for (auto &rec : batch) {
+            std::string key = rec.ip + ":" + std::to_string(rec.port);
+            CHECK(records.emplace(key, std::move(rec)).second);
+        }
+    });
+    CHECK_EQ(stats.probes, 18u);
+    CHECK_EQ(stats.failed, 0u);
+    CHECK_EQ(responders.requests(), 18u);
+    // 18 answers, a repeated DNS answer and one from outside the targets.
+    CHECK_EQ(stats.replies, 20u);
+    CHECK_EQ(stats.services, 7u);
+    CHECK_EQ(stats.unmatched, 12u);
+    CHECK_EQ(records.size(), 7u);
+
+    auto record = [&](const std::string &key) -> const HttpRecord & {
+        static const HttpRecord none;
+        auto it = records.find(key);
+        CHECK(it != records.end());
+        return it == records.end() ? none : it->second;
+    };
+    const HttpRecord &dns = record("127.0.0.2:53");
+    CHECK_EQ(dns.module, "dns");
+    CHECK_EQ(dns.title, "9.18-test");
+    CHECK_EQ(field(dns, "udp"), "53/dns");
+    CHECK_EQ(field(dns, "rcode"), "NOERROR");
+    const HttpRecord &ntp = record("127.0.0.2:123");
+    CHECK_EQ(ntp.title, "NTP stratum 2");
+    CHECK_EQ(field(ntp, "refid"), "192.0.2.1");
+    CHECK_EQ(record("127.0.0.2:161").title, "Linux test 6.1");
+    const HttpRecord &ike = record("127.0.0.2:500");
+    CHECK_EQ(ike.title, "IKEv1 Main Mode");
+    CHECK_EQ(field(ike, "notify"), "NO-PROPOSAL-CHOSEN");
+    CHECK_EQ(field(record("127.0.0.2:443"), "versions"), "v1,v2");
+    CHECK_EQ(record("127.0.0.2:1900").title, "Test/1.0 UPnP/1.0");
+    // Answered from another port, still filed under 1900.
+    CHECK_EQ(record("127.0.0.4:1900").module, "ssdp");
+}
+
+static void test_want(const Responders &responders) {
+    TargetSet targets;
+    targets.add(loopback(2), loopback(4));
+    size_t before = responders.requests();
+    size_t records = 0;
+    UdpScanStats stats = probe_udp(
+        targets, {123, 161}, 0, 0.3, 100, [](uint32_t ip, uint16_t port) { return ip == loopback(2) || port == 161; },
+        [&](std::vector<HttpRecord> &batch) { records += batch.size(); });
+    CHECK_EQ(stats.probes, 4u);
+    CHECK_EQ(responders.requests() - before, 4u);
+    CHECK_EQ(stats.services, 2u);
+    CHECK_EQ(stats.unmatched, 2u);
+    CHECK_EQ(records, 2u);
+}
+
+int main() {
+    test_services();
+    Responders responders;
+    if (!responders.start()) {
+        std::cout << "skipped: the service ports on 127.0.0.x are not available" << std::endl;
+        return check_result();
+    }
+    test_probe(responders);
+    test_want(responders);
+    return check_result();
+}
+
+#else
+
+int main() {
+    std::cout << "skipped: UDP probing is POSIX-only" << std::endl;
+    return 0;
+}
+
+#endif
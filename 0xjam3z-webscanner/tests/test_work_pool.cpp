@@ -0,0 +1,133 @@
+#include "check.hpp"
+
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// WorkPool and OrderedTasks: results commit in submission order, one at a
+// time and within the window, for every pool size including none; tasks that
+// wait on nested work do not deadlock; every task submitted from outside runs.
+
+// Uneven work so tasks finish out of order.
+static uint64_t spin(uint64_t rounds) {
+    uint64_t h = 1469598103934665603ull;
+    for (uint64_t i = 0; i < rounds; ++i) {
+        h = (h ^ i) * 1099511628211ull;
+    }
+    return h;
+}
+
+static void test_ordered(unsigned threads, size_t window) {
+    WorkPool pool;
+    if (threads) {
+        pool.start(threads);
+    }
+    std::string out;
+    std::string expected;
+    std::atomic<int> committing{0};
+    std::atomic<size_t> in_flight{0};
+    std::atomic<size_t> max_in_flight{0};
+    bool overlapped = false;
+    {
+        OrderedTasks<std::string> tasks(
+            pool,
+            [&](std::string &text) {
+                overlapped |= committing.fetch_add(1) != 0;
+                out += text;
+                --in_flight;
+                committing.fetch_sub(1);
+            },
+            window);
+        for (size_t i = 0; i < 3000; ++i) {
+            expected += std::to_string(i) + ",";
+            tasks.submit([&, i](std::string &text) {
+                size_t now = ++in_flight;
+                size_t seen = max_in_flight.load();
+                while (now > seen && !max_in_flight.compare_exchange_weak(seen, now)) {
+                }
+                // Every 7th task is much slower than its neighbours; the hash keeps the spin.
+                uint64_t h = spin(i % 7 == 0 ? 20000 : 50 * (i % 5));
+                text = std::to_string(i) + (h == 0 ? "!" : ",");
+            });
+        }
+        tasks.wait();
+        CHECK_EQ(out, expected);
+        // wait() again with nothing outstanding returns at once.
+        tasks.wait();
+    }
+    CHECK(!overlapped);
+    size_t limit = window ? window : 4 * std::max(1u, pool.size());
+    CHECK(max_in_flight.load() <= limit);
+}
+
+// Outer tasks that each run an inner ordered batch and wait for it on the worker.
+static void test_nested(unsigned threads) {
+    WorkPool pool;
+    pool.start(threads);
+    std::string out;
+    std::string expected;
+    {
+        OrderedTasks<std::string> outer(pool, [&](std::string &text) { out += text; });
+        for (int i = 0; i < 40; ++i) {
+            for (int j = 0; j < 25; ++j) {
+                expected += std::to_string(i * 100 + j) + " ";
+            }
+            outer.submit([&pool, i](std::string &text) {
+                OrderedTasks<std::string> inner(pool, [&](std::string &part) { text += part; });
+                for (int j = 0; j < 25; ++j) {
+                    inner.submit([i, j](std::string &part) {
+                        spin(j % 3 ? 100 : 5000);
+                        part = std::to_string(i * 100 + j) + " ";
+                    });
+                }
+                inner.wait();
+            });
+        }
+    }
+    CHECK_EQ(out, expected);
+}
+
+static void test_external_submitters(unsigned threads) {
+    WorkPool pool;
+    pool.start(threads);
+    std::atomic<size_t> done{0};
+    std::atomic<uint64_t> sum{0};
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < 4; ++t) {
+        submitters.emplace_back([&, t] {
+            for (int i = 0; i < 500; ++i) {
+                pool.submit([&, value = t * 1000 + i] {
+                    sum += static_cast<uint64_t>(value);
+                    ++done;
+                });
+            }
+        });
+    }
+    for (auto &t : submitters) {
+        t.join();
+    }
+    pool.wait_until([&] { return done.load() == 2000; });
+    CHECK_EQ(done.load(), 2000u);
+    // sum over t of (1000 * t * 500 + 0 + ... + 499)
+    CHECK_EQ(sum.load(), 500u * 1000 * (0 + 1 + 2 + 3) + 4u * (499 * 500 / 2));
+    CHECK(!pool.run_one());
+}
+
+int main() {
+    for (unsigned threads : {0u, 1u, 2u, 4u, 8u}) {
+        test_ordered(threads, 0);
+        test_ordered(threads, 3);
+    }
+    for (unsigned threads : {1u, 3u}) {
+        test_nested(threads);
+        test_external_submitters(threads);
+    }
+    WorkPool pool;
+    pool.start(0);
+    CHECK(pool.size() >= 1);
+    return check_result();
+}
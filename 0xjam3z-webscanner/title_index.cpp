@@ -0,0 +1,483 @@
+#include "title_index.hpp"
+
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static constexpr char kMagic[8] = {'J', '3', 'Z', 'I', 'D', 'X', '0', '1'};
+static constexpr const char *kSegmentExtension = ".j3zi";
+
+// Headers worth searching; the rest (dates, cookies, etags) differ per response
+// and would only bloat the index.
+static const char *const kIndexedHeaders[] = {
+    "server", "x-powered-by", "x-generator", "x-aspnet-version", "www-authenticate", "location", "via",
+};
+
+static char ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static void lower_into(std::string_view in, std::string &out) {
+    out.resize(in.size());
+    std::transform(in.begin(), in.end(), out.begin(), ascii_lower);
+}
+
+static uint32_t trigram(const char *p) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8 | static_cast<unsigned char>(p[2]);
+}
+
+// Distinct trigrams of an already lower-cased string.
+static std::vector<uint32_t> trigrams(std::string_view lower) {
+    std::vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= lower.size(); ++i) {
+        grams.push_back(trigram(lower.data() + i));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+static void put_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static bool get_varint(const char *&p, const char *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fixed-width fields are little-endian regardless of the host.
+static void put_le(std::string &out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out += static_cast<char>(v >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+// count, [keys], count + 1 offsets, data.
+static void put_table(std::string &out, const std::vector<std::string> &items,
+                      const std::vector<uint32_t> *keys = nullptr) {
+    put_le(out, items.size(), 8);
+    if (keys) {
+        for (uint32_t key : *keys) {
+            put_le(out, key, 4);
+        }
+    }
+    uint64_t offset = 0;
+    put_le(out, 0, 8);
+    for (const auto &item : items) {
+        offset += item.size();
+        put_le(out, offset, 8);
+    }
+    for (const auto &item : items) {
+        out += item;
+    }
+}
+
+uint16_t TitleIndexWriter::add_scan(const std::string &label) {
+    scans_.push_back(label);
+    return static_cast<uint16_t>(scans_.size() - 1);
+}
+
+void TitleIndexWriter::add_text(IndexedKind kind, std::string value, const Entry &entry) {
+    std::string key(1, static_cast<char>(kind));
+    key += value;
+    auto it = text_ids_.find(key);
+    if (it == text_ids_.end()) {
+        it = text_ids_.emplace(std::move(key), static_cast<uint32_t>(texts_.size())).first;
+        texts_.push_back({kind, std::move(value), {}});
+    }
+    texts_[it->second].entries.push_back(entry);
+    ++entries_;
+}
+
+void TitleIndexWriter::add(uint16_t scan, const HttpRecord &rec) {
+    if (rec.ip.empty()) {
+        return;
+    }
+    auto ip = ip_ids_.find(rec.ip);
+    if (ip == ip_ids_.end()) {
+        ip = ip_ids_.emplace(rec.ip, static_cast<uint32_t>(ips_.size())).first;
+        ips_.push_back(rec.ip);
+    }
+    Entry entry{ip->second, rec.port, scan};
+    if (!rec.title.empty()) {
+        add_text(IndexedKind::Title, rec.title, entry);
+    }
+    for (const auto &header : rec.headers) {
+        for (const char *name : kIndexedHeaders) {
+            if (header.first == name && !header.second.empty()) {
+                add_text(IndexedKind::Header, header.first + ": " + header.second, entry);
+                break;
+            }
+        }
+    }
+}
+
+// Length of the title at the start of `rest`: format_record follows it with
+// " - <key>: <value>" fields, and keys never hold spaces.
+static size_t title_length(std::string_view rest) {
+    for (size_t dash = rest.find(" - "); dash != std::string_view::npos; dash = rest.find(" - ", dash + 1)) {
+        size_t key = dash + 3;
+        size_t colon = rest.find(": ", key);
+        if (colon != std::string_view::npos && colon > key &&
+            rest.substr(key, colon - key).find(' ') == std::string_view::npos) {
+            return dash;
+        }
+    }
+    return rest.size();
+}
+
+bool TitleIndexWriter::add_file(const fs::path &file, uint16_t scan, WorkPool *pool) {
+    if (file.extension() == ".json" && pool) {
+        uint16_t port = zgrab_port_from_filename(file);
+        OrderedTasks<std::vector<HttpRecord>> tasks(*pool, [&](std::vector<HttpRecord> &batch) {
+            for (const auto &rec : batch) {
+                add(scan, rec);
+            }
+        });
+        return for_each_line_chunk(file, 256 * 1024, [&](std::string &chunk) {
+            tasks.submit([port, chunk = std::move(chunk)](std::vector<HttpRecord> &batch) {
+                parse_zgrab_chunk(chunk, port, batch);
+                batch.erase(std::remove_if(batch.begin(), batch.end(),
+                                           [](const HttpRecord &rec) { return rec.status != "success"; }),
+                            batch.end());
+            });
+        });
+    }
+    if (file.extension() == ".json") {
+        return for_each_zgrab_batch(file, zgrab_port_from_filename(file), 512, [&](std::vector<HttpRecord> &batch) {
+            for (const auto &rec : batch) {
+                if (rec.status == "success") {
+                    add(scan, rec);
+                }
+            }
+        });
+    }
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "Failed to read " << file << std::endl;
+        return false;
+    }
+    // "IP: <ip>[ - Host: <name>] - Title: <title>[ - <key>: <value>]..."
+    std::string line;
+    HttpRecord rec;
+    while (std::getline(in, line)) {
+        size_t title = line.find(" - Title: ");
+        if (line.compare(0, 4, "IP: ") != 0 || title == std::string::npos) {
+            continue;
+        }
+        std::string_view rest = std::string_view(line).substr(title + 10);
+        rest = rest.substr(0, title_length(rest));
+        if (rest == "No title found") {
+            continue;
+        }
+        rec.ip = line.substr(4, line.find(" - ", 4) - 4);
+        rec.title = std::string(rest);
+        add(scan, rec);
+    }
+    return true;
+}
+
+bool TitleIndexWriter::write(const fs::path &file) const {
+    std::vector<std::string> texts;
+    std::vector<std::string> entries;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+    texts.reserve(texts_.size());
+    entries.reserve(texts_.size());
+    std::string lower;
+    for (uint32_t id = 0; id < texts_.size(); ++id) {
+        const Text &text = texts_[id];
+        texts.push_back(static_cast<char>(text.kind) + text.value);
+        std::string encoded;
+        for (const auto &entry : text.entries) {
+            put_varint(encoded, entry.ip);
+            put_varint(encoded, entry.port);
+            put_varint(encoded, entry.scan);
+        }
+        entries.push_back(std::move(encoded));
+        lower_into(text.value, lower);
+        for (uint32_t gram : trigrams(lower)) {
+            // Ids arrive in order, so every list is already sorted.
+            postings[gram].push_back(id);
+        }
+    }
+
+    std::vector<uint32_t> keys;
+    keys.reserve(postings.size());
+    for (const auto &entry : postings) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> lists;
+    lists.reserve(keys.size());
+    for (uint32_t key : keys) {
+        std::string encoded;
+        uint32_t prev = 0;
+        for (uint32_t id : postings[key]) {
+            put_varint(encoded, id - prev);
+            prev = id;
+        }
+        lists.push_back(std::move(encoded));
+    }
+
+    std::string out(kMagic, sizeof(kMagic));
+    put_table(out, scans_);
+    put_table(out, ips_);
+    put_table(out, texts);
+    put_table(out, entries);
+    put_table(out, lists, &keys);
+
+    // Written aside and renamed so searches never see half a segment.
+    fs::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f || !f.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+            std::cerr << "Failed to write " << tmp << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, file, ec);
+    if (ec) {
+        std::cerr << "Failed to rename " << tmp << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+TitleIndexSegment::~TitleIndexSegment() {
+#ifndef _WIN32
+    if (mapped_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+}
+
+bool TitleIndexSegment::open(const fs::path &file) {
+#ifndef _WIN32
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data_ = static_cast<const char *>(map);
+            size_ = static_cast<size_t>(st.st_size);
+            mapped_ = true;
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+    if (!mapped_) {
+        std::ifstream in(file, std::ios::binary);
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+    uint64_t pos = sizeof(kMagic);
+    if (size_ < pos || std::memcmp(data_, kMagic, sizeof(kMagic)) != 0 || !read_table(pos, scans_) ||
+        !read_table(pos, ips_) || !read_table(pos, texts_) || !read_table(pos, entries_) ||
+        !read_table(pos, postings_, &gram_keys_) || entries_.count != texts_.count) {
+        std::cerr << "Not a title index segment: " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TitleIndexSegment::read_table(uint64_t &pos, Table &table, uint64_t *keys) const {
+    if (size_ - pos < 8) {
+        return false;
+    }
+    table.count = get_le(data_ + pos, 8);
+    pos += 8;
+    uint64_t key_bytes = keys ? 4 * table.count : 0;
+    if (table.count > size_ / 8 || size_ - pos < key_bytes + 8 * (table.count + 1)) {
+        return false;
+    }
+    if (keys) {
+        *keys = pos;
+    }
+    table.offsets = pos + key_bytes;
+    table.data = table.offsets + 8 * (table.count + 1);
+    uint64_t length = get_le(data_ + table.data - 8, 8);
+    if (length > size_ - table.data) {
+        return false;
+    }
+    pos = table.data + length;
+    return true;
+}
+
+std::string_view TitleIndexSegment::item(const Table &table, uint64_t index) const {
+    uint64_t begin = get_le(data_ + table.offsets + 8 * index, 8);
+    uint64_t end = get_le(data_ + table.offsets + 8 * (index + 1), 8);
+    return std::string_view(data_ + table.data + begin, end - begin);
+}
+
+// Sequential reader over one delta-encoded posting list.
+struct PostingCursor {
+    const char *p = nullptr;
+    const char *end = nullptr;
+    uint64_t value = 0;
+    bool valid = false;
+
+    explicit PostingCursor(std::string_view list) : p(list.data()), end(list.data() + list.size()) { advance(); }
+
+    void advance() {
+        uint64_t delta = 0;
+        valid = get_varint(p, end, delta);
+        value += delta;
+    }
+};
+
+std::vector<uint32_t> TitleIndexSegment::candidates(std::string_view needle) const {
+    std::vector<std::string_view> lists;
+    for (uint32_t gram : trigrams(needle)) {
+        uint64_t lo = 0;
+        uint64_t hi = postings_.count;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (get_le(data_ + gram_keys_ + 4 * mid, 4) < gram) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == postings_.count || get_le(data_ + gram_keys_ + 4 * lo, 4) != gram) {
+            return {};
+        }
+        lists.push_back(item(postings_, lo));
+    }
+    // Shortest list first bounds the work for everything after it.
+    std::sort(lists.begin(), lists.end(),
+              [](std::string_view a, std::string_view b) { return a.size() < b.size(); });
+    std::vector<uint32_t> ids;
+    for (PostingCursor cur(lists.front()); cur.valid; cur.advance()) {
+        ids.push_back(static_cast<uint32_t>(cur.value));
+    }
+    for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+        PostingCursor cur(lists[i]);
+        size_t kept = 0;
+        for (uint32_t id : ids) {
+            while (cur.valid && cur.value < id) {
+                cur.advance();
+            }
+            if (!cur.valid) {
+                break;
+            }
+            if (cur.value == id) {
+                ids[kept++] = id;
+            }
+        }
+        ids.resize(kept);
+    }
+    return ids;
+}
+
+void TitleIndexSegment::emit(uint32_t text, std::string_view value, size_t limit,
+                             std::vector<TitleMatch> &out) const {
+    std::string_view encoded = item(entries_, text);
+    const char *p = encoded.data();
+    const char *end = p + encoded.size();
+    uint64_t ip = 0;
+    uint64_t port = 0;
+    uint64_t scan = 0;
+    while (out.size() < limit && get_varint(p, end, ip) && get_varint(p, end, port) && get_varint(p, end, scan)) {
+        if (ip >= ips_.count || scan >= scans_.count) {
+            break;
+        }
+        TitleMatch match;
+        match.scan = std::string(item(scans_, scan));
+        match.ip = std::string(item(ips_, ip));
+        match.port = static_cast<uint16_t>(port);
+        match.kind = static_cast<IndexedKind>(value[0]);
+        match.text = std::string(value.substr(1));
+        out.push_back(std::move(match));
+    }
+}
+
+void TitleIndexSegment::search(std::string_view needle, size_t limit, std::vector<TitleMatch> &out) const {
+    std::string lower_needle;
+    lower_into(needle, lower_needle);
+    std::string lower;
+    auto check = [&](uint32_t id) {
+        std::string_view value = item(texts_, id);
+        if (value.empty()) {
+            return;
+        }
+        lower_into(value.substr(1), lower);
+        if (lower.find(lower_needle) != std::string::npos) {
+            emit(id, value, limit, out);
+        }
+    };
+    if (lower_needle.size() < 3) {
+        // Too short for a trigram: every text is a candidate.
+        for (uint32_t id = 0; id < texts_.count && out.size() < limit; ++id) {
+            check(id);
+        }
+        return;
+    }
+    for (uint32_t id : candidates(lower_needle)) {
+        if (out.size() >= limit) {
+            break;
+        }
+        check(id);
+    }
+}
+
+std::vector<fs::path> title_index_segments(const fs::path &dir) {
+    std::vector<fs::path> segments;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == kSegmentExtension) {
+            segments.push_back(entry.path());
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+fs::path next_title_index_segment(const fs::path &dir) {
+    unsigned long last = 0;
+    for (const auto &segment : title_index_segments(dir)) {
+        last = std::max(last, std::strtoul(segment.stem().string().c_str(), nullptr, 10));
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08lu%s", last + 1, kSegmentExtension);
+    return dir / name;
+}
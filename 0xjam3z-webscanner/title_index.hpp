@@ -0,0 +1,116 @@
+#pragma once
+
+#include "parsers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Trigram index over the titles and selected headers of past scans, stored as
+// immutable segment files in one directory: each `index add` writes a new
+// segment and searches read them all.
+//
+// Distinct texts are interned per segment. Every lower-cased trigram maps to
+// the sorted ids of the texts containing it, delta- and varint-encoded, and
+// every text maps to its (ip, port, scan) entries. A substring query intersects
+// the postings of its trigrams, shortest first, and confirms the candidates
+// against the stored text.
+
+enum class IndexedKind : uint8_t { Title = 0, Header = 1 };
+
+class WorkPool;
+
+class TitleIndexWriter {
+public:
+    // Scans are numbered within the segment; the label is what searches print.
+    uint16_t add_scan(const std::string &label);
+    void add(uint16_t scan, const HttpRecord &rec);
+    // zgrab2 JSON output or an `opendomains` file. The latter has no ports or
+    // headers, and its title ends where the appended fields begin; lines with
+    // no title are skipped. JSON is decoded on
+    // `pool` when given; entries are added in file order either way.
+    bool add_file(const std::filesystem::path &file, uint16_t scan, WorkPool *pool = nullptr);
+
+    size_t texts() const { return texts_.size(); }
+    size_t entries() const { return entries_; }
+    bool write(const std::filesystem::path &file) const;
+
+private:
+    struct Entry {
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        uint16_t scan = 0;
+    };
+    struct Text {
+        IndexedKind kind = IndexedKind::Title;
+        std::string value;
+        std::vector<Entry> entries;
+    };
+
+    void add_text(IndexedKind kind, std::string value, const Entry &entry);
+
+    std::vector<std::string> scans_;
+    std::vector<std::string> ips_;
+    std::unordered_map<std::string, uint32_t> ip_ids_;
+    std::vector<Text> texts_;
+    // Keyed by kind byte + text.
+    std::unordered_map<std::string, uint32_t> text_ids_;
+    size_t entries_ = 0;
+};
+
+struct TitleMatch {
+    std::string scan;
+    std::string ip;
+    uint16_t port = 0;
+    IndexedKind kind = IndexedKind::Title;
+    std::string text;
+};
+
+// A segment file mapped read-only.
+class TitleIndexSegment {
+public:
+    TitleIndexSegment() = default;
+    TitleIndexSegment(const TitleIndexSegment &) = delete;
+    TitleIndexSegment &operator=(const TitleIndexSegment &) = delete;
+    ~TitleIndexSegment();
+
+    bool open(const std::filesystem::path &file);
+    // Case-insensitive substring search; stops after `limit` matches.
+    void search(std::string_view needle, size_t limit, std::vector<TitleMatch> &out) const;
+
+private:
+    struct Table {
+        uint64_t count = 0;
+        uint64_t offsets = 0; // count + 1 little-endian u64 offsets into data
+        uint64_t data = 0;
+    };
+
+    // `keys`, when given, receives the offset of a u32 key per item stored
+    // between the count and the offsets.
+    bool read_table(uint64_t &pos, Table &table, uint64_t *keys = nullptr) const;
+    std::string_view item(const Table &table, uint64_t index) const;
+    // Ids of the texts holding every trigram of the lower-cased needle.
+    std::vector<uint32_t> candidates(std::string_view needle) const;
+    void emit(uint32_t text, std::string_view value, size_t limit, std::vector<TitleMatch> &out) const;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buffer_;
+    Table scans_;
+    Table ips_;
+    Table texts_;
+    Table entries_;
+    // One item per trigram, in key order.
+    Table postings_;
+    uint64_t gram_keys_ = 0;
+};
+
+// Segment files of an index directory, oldest first.
+std::vector<std::filesystem::path> title_index_segments(const std::filesystem::path &dir);
+// Name for the next segment in dir.
+std::filesystem::path next_title_index_segment(const std::filesystem::path &dir);
@@ -0,0 +1,497 @@
+#include "tools.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct ToolSpec {
+    std::string name;
+    std::string exe_name;
+    std::string default_url;
+    // Overrides the clone URL, e.g. a local bare repository on air-gapped workers.
+    const char *url_env;
+};
+
+static std::string tool_url(const ToolSpec &spec) {
+    const char *env = std::getenv(spec.url_env);
+    return env && *env ? env : spec.default_url;
+}
+
+fs::path tool_cache_dir() {
+    if (const char *env = std::getenv("JAM3Z_TOOL_CACHE"); env && *env) {
+        return env;
+    }
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return fs::path(xdg) / "0xjam3z-scanner" / "tools";
+    }
+#ifdef _WIN32
+    const char *home = std::getenv("LOCALAPPDATA");
+#else
+    const char *home = std::getenv("HOME");
+#endif
+    return fs::path(home ? home : ".") / ".cache" / "0xjam3z-scanner" / "tools";
+}
+
+static unsigned build_jobs() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static std::string first_line(const std::string &text) {
+    return trim(text.substr(0, text.find('\n')));
+}
+
+// Identifies the toolchain a binary was built with; part of the cache key.
+static std::string compiler_identity(const ToolSpec &spec) {
+    std::string id;
+    if (spec.name == "zgrab2") {
+        id = first_line(capture_command("go version").value_or("go unknown"));
+    } else {
+        const char *cc = std::getenv("CC");
+        std::string compiler = cc && *cc ? cc : "cc";
+        id = first_line(capture_command(compiler + " --version 2>&1").value_or(compiler + " unknown"));
+    }
+#ifndef _WIN32
+    id += " " + first_line(capture_command("uname -sm").value_or(""));
+#endif
+    return id;
+}
+
+static std::optional<std::string> remote_head(const std::string &url) {
+    auto out = capture_command("git ls-remote " + quote_path(url) + " HEAD");
+    if (!out) {
+        return std::nullopt;
+    }
+    std::string commit = out->substr(0, out->find_first_of(" \t\n"));
+    if (commit.size() != 40) {
+        return std::nullopt;
+    }
+    return commit;
+}
+
+static std::optional<std::string> checkout_head(const fs::path &repo_dir) {
+    auto out = capture_command("git -C " + quote_path(repo_dir.string()) + " rev-parse HEAD");
+    if (!out) {
+        return std::nullopt;
+    }
+    std::string commit = trim(*out);
+    return commit.size() == 40 ? std::optional<std::string>(commit) : std::nullopt;
+}
+
+static fs::path cache_entry(const ToolSpec &spec, const std::string &commit, const std::string &compiler) {
+    uint64_t key = fnv1a64(spec.name + '\0' + commit + '\0' + compiler);
+    return tool_cache_dir() / (spec.name + "-" + hex64(key));
+}
+
+static std::string read_meta(const fs::path &entry, const std::string &field) {
+    std::ifstream in(entry / "meta");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind(field + "=", 0) == 0) {
+            return line.substr(field.size() + 1);
+        }
+    }
+    return {};
+}
+
+// Without network access the commit cannot be resolved; fall back to the most
+// recent cached build made with the same toolchain.
+static std::optional<fs::path> newest_cached_build(const ToolSpec &spec, const std::string &compiler) {
+    std::error_code ec;
+    std::optional<fs::path> best;
+    fs::file_time_type best_time;
+    for (const auto &entry : fs::directory_iterator(tool_cache_dir(), ec)) {
+        if (entry.path().filename().string().rfind(spec.name + "-", 0) != 0 ||
+            read_meta(entry.path(), "compiler") != compiler || !fs::exists(entry.path() / spec.exe_name)) {
+            continue;
+        }
+        auto when = fs::last_write_time(entry.path() / spec.exe_name, ec);
+        if (!best || when > best_time) {
+            best = entry.path();
+            best_time = when;
+        }
+    }
+    return best;
+}
+
+static bool install_binary(const fs::path &from, const fs::path &to) {
+    std::error_code ec;
+    fs::create_directories(to.parent_path(), ec);
+    fs::path tmp = to;
+    tmp += ".tmp";
+    fs::copy_file(from, tmp, fs::copy_options::overwrite_existing, ec);
+    if (!ec) {
+        fs::permissions(tmp, fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec |
+                                 fs::perms::others_read | fs::perms::others_exec, ec);
+        fs::rename(tmp, to, ec);
+    }
+    if (ec) {
+        std::cerr << "Failed to install " << from << " to " << to << ": " << ec.message() << std::endl;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+static void store_in_cache(const ToolSpec &spec, const fs::path &binary, const fs::path &entry,
+                           const std::string &commit, const std::string &compiler, const std::string &url) {
+    std::error_code ec;
+    fs::create_directories(entry, ec);
+    if (ec || !install_binary(binary, entry / spec.exe_name)) {
+        std::cerr << "Could not cache " << spec.name << " build in " << entry << std::endl;
+        return;
+    }
+    std::ofstream meta(entry / "meta");
+    meta << "tool=" << spec.name << "\n"
+         << "commit=" << commit << "\n"
+         << "compiler=" << compiler << "\n"
+         << "url=" << url << "\n";
+}
+
+static bool build_masscan(const fs::path &repo_dir, const fs::path &base_dir, const fs::path &out) {
+#ifdef _WIN32
+    std::cerr << "masscan requires a Windows build toolchain. Build it in " << repo_dir << " and place the binary in "
+              << (base_dir / "bin") << "." << std::endl;
+    (void)out;
+    return false;
+#else
+    (void)base_dir;
+    if (!run_command("make -j" + std::to_string(build_jobs()) + " -C " + quote_path(repo_dir.string()))) {
+        std::cerr << "Failed to build masscan." << std::endl;
+        return false;
+    }
+    fs::path built = repo_dir / "bin" / "masscan";
+    if (!fs::exists(built)) {
+        std::cerr << "masscan build did not produce expected binary." << std::endl;
+        return false;
+    }
+    return install_binary(built, out);
+#endif
+}
+
+static bool build_zgrab2(const fs::path &repo_dir, const fs::path &base_dir, const fs::path &out) {
+    (void)base_dir;
+    fs::create_directories(out.parent_path());
+    std::string go_build = "go build -p " + std::to_string(build_jobs()) + " -o " + quote_path(out.string()) + " ./cmd/zgrab2";
+#ifdef _WIN32
+    std::string build_cmd = "cd /d " + quote_path(repo_dir.string()) + " && " + go_build;
+#else
+    std::string build_cmd = "cd " + quote_path(repo_dir.string()) + " && " + go_build;
+#endif
+    if (!run_command(build_cmd)) {
+        std::cerr << "Failed to build zgrab2. Ensure Go is installed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+using BuildFn = bool (*)(const fs::path &repo_dir, const fs::path &base_dir, const fs::path &out);
+
+static std::optional<std::string> ensure_tool(const ToolSpec &spec, const fs::path &base_dir, bool no_download,
+                                              BuildFn build) {
+    if (auto found = find_in_path(spec.exe_name)) {
+        return found;
+    }
+
+    fs::path local_bin = base_dir / "bin" / spec.exe_name;
+    if (fs::exists(local_bin)) {
+        return local_bin.string();
+    }
+
+    if (no_download) {
+        std::cerr << spec.name << " not found and downloads disabled." << std::endl;
+        return std::nullopt;
+    }
+
+    std::string url = tool_url(spec);
+    fs::path repo_dir = base_dir / "third_party" / spec.name;
+    std::string compiler = compiler_identity(spec);
+
+    std::optional<std::string> commit = fs::exists(repo_dir) ? checkout_head(repo_dir) : remote_head(url);
+    if (commit) {
+        fs::path entry = cache_entry(spec, *commit, compiler);
+        if (fs::exists(entry / spec.exe_name)) {
+            std::cout << "Using cached " << spec.name << " " << commit->substr(0, 12) << " from " << entry << std::endl;
+            return install_binary(entry / spec.exe_name, local_bin) ? std::optional<std::string>(local_bin.string())
+                                                                    : std::nullopt;
+        }
+    } else if (!fs::exists(repo_dir)) {
+        if (auto cached = newest_cached_build(spec, compiler)) {
+            std::cout << "Cannot reach " << url << "; using cached " << spec.name << " "
+                      << read_meta(*cached, "commit").substr(0, 12) << std::endl;
+            return install_binary(*cached / spec.exe_name, local_bin) ? std::optional<std::string>(local_bin.string())
+                                                                      : std::nullopt;
+        }
+    }
+
+    fs::create_directories(repo_dir.parent_path());
+    if (!fs::exists(repo_dir)) {
+        if (!run_command("git clone " + quote_path(url) + " " + quote_path(repo_dir.string()))) {
+            std::cerr << "Failed to clone " << spec.name << "." << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    if (!build(repo_dir, base_dir, local_bin)) {
+        return std::nullopt;
+    }
+
+    if (auto built_commit = checkout_head(repo_dir)) {
+        store_in_cache(spec, local_bin, cache_entry(spec, *built_commit, compiler), *built_commit, compiler, url);
+    }
+    return local_bin.string();
+}
+
+std::optional<std::string> ensure_masscan(const fs::path &base_dir, bool no_download) {
+#ifdef _WIN32
+    static const ToolSpec spec{"masscan", "masscan.exe", "https://github.com/robertdavidgraham/masscan.git",
+                               "JAM3Z_MASSCAN_URL"};
+#else
+    static const ToolSpec spec{"masscan", "masscan", "https://github.com/robertdavidgraham/masscan.git",
+                               "JAM3Z_MASSCAN_URL"};
+#endif
+    return ensure_tool(spec, base_dir, no_download, build_masscan);
+}
+
+std::optional<std::string> ensure_zgrab2(const fs::path &base_dir, bool no_download) {
+#ifdef _WIN32
+    static const ToolSpec spec{"zgrab2", "zgrab2.exe", "https://github.com/zmap/zgrab2.git", "JAM3Z_ZGRAB2_URL"};
+#else
+    static const ToolSpec spec{"zgrab2", "zgrab2", "https://github.com/zmap/zgrab2.git", "JAM3Z_ZGRAB2_URL"};
+#endif
+    return ensure_tool(spec, base_dir, no_download, build_zgrab2);
+}
+
+bool ToolInfo::has(const std::string &cap) const {
+    return std::find(caps.begin(), caps.end(), cap) != caps.end();
+}
+
+struct FileStamp {
+    uint64_t inode = 0;
+    int64_t mtime_ns = 0;
+    uint64_t size = 0;
+};
+
+static std::optional<FileStamp> stat_file(const std::string &path) {
+    FileStamp stamp;
+#ifdef _WIN32
+    std::error_code ec;
+    auto when = fs::last_write_time(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    stamp.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count();
+    stamp.size = fs::file_size(path, ec);
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return std::nullopt;
+    }
+    stamp.inode = static_cast<uint64_t>(st.st_ino);
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+#endif
+    return stamp;
+}
+
+ToolResolutionCache::ToolResolutionCache(const fs::path &base_dir, bool refresh) {
+    const char *path_env = std::getenv("PATH");
+    std::string key = base_dir.string() + '\n' + (path_env ? path_env : "");
+    file_ = tool_cache_dir() / "resolve" / hex64(fnv1a64(key));
+    if (refresh) {
+        return;
+    }
+
+    std::ifstream in(file_);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> cols;
+        std::istringstream iss(line);
+        std::string col;
+        while (std::getline(iss, col, '\t')) {
+            cols.push_back(col);
+        }
+        if (cols.size() < 7) {
+            continue;
+        }
+        Entry entry;
+        entry.info.path = cols[1];
+        entry.inode = std::strtoull(cols[2].c_str(), nullptr, 10);
+        entry.mtime_ns = std::strtoll(cols[3].c_str(), nullptr, 10);
+        entry.size = std::strtoull(cols[4].c_str(), nullptr, 10);
+        entry.info.version = cols[5];
+        std::istringstream caps(cols[6]);
+        while (std::getline(caps, col, ',')) {
+            if (!col.empty()) {
+                entry.info.caps.push_back(col);
+            }
+        }
+        entries_[cols[0]] = std::move(entry);
+    }
+}
+
+std::optional<ToolInfo> ToolResolutionCache::lookup(const std::string &tool) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(tool);
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    auto stamp = stat_file(it->second.info.path);
+    if (!stamp || stamp->inode != it->second.inode || stamp->mtime_ns != it->second.mtime_ns ||
+        stamp->size != it->second.size) {
+        return std::nullopt;
+    }
+    return it->second.info;
+}
+
+void ToolResolutionCache::store(const std::string &tool, const ToolInfo &info) {
+    auto stamp = stat_file(info.path);
+    if (!stamp) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry &entry = entries_[tool];
+    entry.info = info;
+    entry.inode = stamp->inode;
+    entry.mtime_ns = stamp->mtime_ns;
+    entry.size = stamp->size;
+    dirty_ = true;
+}
+
+void ToolResolutionCache::save() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_) {
+        return;
+    }
+    std::error_code ec;
+    fs::create_directories(file_.parent_path(), ec);
+    fs::path tmp = file_;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp);
+        if (!out) {
+            return;
+        }
+        out << "# tool\tpath\tinode\tmtime_ns\tsize\tversion\tcaps\n";
+        for (const auto &[tool, entry] : entries_) {
+            std::string caps;
+            for (const auto &cap : entry.info.caps) {
+                caps += (caps.empty() ? "" : ",") + cap;
+            }
+            out << tool << '\t' << entry.info.path << '\t' << entry.inode << '\t' << entry.mtime_ns << '\t'
+                << entry.size << '\t' << entry.info.version << '\t' << caps << '\n';
+        }
+    }
+    fs::rename(tmp, file_, ec);
+}
+
+#ifdef _WIN32
+static const char *const kNoInput = " < NUL";
+#else
+static const char *const kNoInput = " < /dev/null";
+#endif
+
+static std::array<int, 3> version_tuple(const std::string &version) {
+    std::array<int, 3> v{0, 0, 0};
+    size_t pos = version.find_first_of("0123456789");
+    for (size_t i = 0; i < v.size() && pos < version.size(); ++i) {
+        v[i] = std::atoi(version.c_str() + pos);
+        pos = version.find('.', pos);
+        if (pos == std::string::npos || pos + 1 >= version.size() ||
+            !std::isdigit(static_cast<unsigned char>(version[pos + 1]))) {
+            break;
+        }
+        ++pos;
+    }
+    return v;
+}
+
+static ToolInfo probe_masscan(const std::string &path) {
+    ToolInfo info;
+    info.path = path;
+    // "Masscan version 1.3.2 ( https://github.com/robertdavidgraham/masscan )"
+    std::string out = capture_command(quote_path(path) + " --version 2>&1" + kNoInput, false).value_or("");
+    size_t at = out.find("version ");
+    auto words = at == std::string::npos ? std::vector<std::string>() : split_ws(out.substr(at + 8));
+    info.version = words.empty() ? "unknown" : words.front();
+    std::string help = capture_command(quote_path(path) + " --help 2>&1" + kNoInput, false).value_or("");
+    auto v = version_tuple(info.version);
+    auto mentions = [&](const char *flag) { return help.find(flag) != std::string::npos; };
+    if (mentions("-oB") || v >= std::array<int, 3>{1, 0, 0}) {
+        info.caps.push_back("oB");
+    }
+    if (mentions("--banners") || v >= std::array<int, 3>{1, 0, 0}) {
+        info.caps.push_back("banners");
+    }
+    if (v >= std::array<int, 3>{1, 0, 4}) {
+        info.caps.push_back("stdout");
+    }
+    if (v >= std::array<int, 3>{1, 3, 0}) {
+        info.caps.push_back("ipv6");
+    }
+    return info;
+}
+
+static ToolInfo probe_zgrab2(const std::string &path) {
+    ToolInfo info;
+    info.path = path;
+    auto version = capture_command(quote_path(path) + " --version 2>&1" + kNoInput);
+    info.version = version ? first_line(*version) : "unknown";
+    std::string help = capture_command(quote_path(path) + " --help 2>&1" + kNoInput, false).value_or("");
+    // --input-file defaults to "-", i.e. targets can be streamed over stdin.
+    if (help.find("input-file") != std::string::npos) {
+        info.caps.push_back("stdin");
+    }
+    if (help.find("multiple") != std::string::npos) {
+        info.caps.push_back("multiple");
+    }
+    return info;
+}
+
+using EnsureFn = std::optional<std::string> (*)(const fs::path &, bool);
+using ProbeFn = ToolInfo (*)(const std::string &);
+
+static std::optional<ToolInfo> resolve_tool(const std::string &name, EnsureFn ensure, ProbeFn probe,
+                                            const fs::path &base_dir, bool no_download, ToolResolutionCache &cache) {
+    if (auto cached = cache.lookup(name)) {
+        return cached;
+    }
+    auto path = ensure(base_dir, no_download);
+    if (!path) {
+        return std::nullopt;
+    }
+    ToolInfo info = probe(*path);
+    std::string caps;
+    for (const auto &cap : info.caps) {
+        caps += (caps.empty() ? "" : ",") + cap;
+    }
+    std::cout << "Resolved " << name << " " << info.version << " at " << info.path
+              << (caps.empty() ? "" : " [" + caps + "]") << std::endl;
+    cache.store(name, info);
+    return info;
+}
+
+std::optional<ToolInfo> resolve_masscan(const fs::path &base_dir, bool no_download, ToolResolutionCache &cache) {
+    return resolve_tool("masscan", ensure_masscan, probe_masscan, base_dir, no_download, cache);
+}
+
+std::optional<ToolInfo> resolve_zgrab2(const fs::path &base_dir, bool no_download, ToolResolutionCache &cache) {
+    return resolve_tool("zgrab2", ensure_zgrab2, probe_zgrab2, base_dir, no_download, cache);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Resolve masscan/zgrab2: PATH, then ./bin, then the shared build cache, and
+// finally clone + build. Safe to call concurrently for different tools.
+std::optional<std::string> ensure_masscan(const std::filesystem::path &base_dir, bool no_download);
+std::optional<std::string> ensure_zgrab2(const std::filesystem::path &base_dir, bool no_download);
+
+// Content-addressed store for built tools, shared by every checkout on the host:
+// $JAM3Z_TOOL_CACHE, else $XDG_CACHE_HOME/0xjam3z-scanner/tools, else
+// ~/.cache/0xjam3z-scanner/tools.
+std::filesystem::path tool_cache_dir();
+
+// A resolved tool plus what it was probed to support, e.g. "stdin" for a zgrab2
+// that reads targets from standard input or "oB" for masscan binary output.
+struct ToolInfo {
+    std::string path;
+    std::string version;
+    std::vector<std::string> caps;
+
+    bool has(const std::string &cap) const;
+};
+
+// Remembers resolved tools per (base_dir, PATH) together with the binary's inode,
+// mtime and size. A hit costs one stat() per tool instead of a PATH walk and a
+// version probe; any change to the binary invalidates the entry.
+class ToolResolutionCache {
+public:
+    ToolResolutionCache(const std::filesystem::path &base_dir, bool refresh);
+
+    std::optional<ToolInfo> lookup(const std::string &tool) const;
+    void store(const std::string &tool, const ToolInfo &info);
+    // Writes the cache back if anything changed.
+    void save() const;
+
+private:
+    struct Entry {
+        ToolInfo info;
+        uint64_t inode = 0;
+        int64_t mtime_ns = 0;
+        uint64_t size = 0;
+    };
+
+    std::filesystem::path file_;
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    bool dirty_ = false;
+};
+
+std::optional<ToolInfo> resolve_masscan(const std::filesystem::path &base_dir, bool no_download,
+                                        ToolResolutionCache &cache);
+std::optional<ToolInfo> resolve_zgrab2(const std::filesystem::path &base_dir, bool no_download,
+                                       ToolResolutionCache &cache);
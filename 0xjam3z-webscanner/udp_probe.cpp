@@ -0,0 +1,694 @@
+#include "udp_probe.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Datagrams per sendmmsg/recvmmsg call, and the most sent in one burst.
+static constexpr size_t kUdpBatch = 64;
+// Replies are spread over this many source ports' receive buffers.
+static constexpr size_t kUdpSockets = 4;
+// Room for an SSDP reply with all its headers; longer replies are cut.
+static constexpr size_t kReplyBytes = 2048;
+// Servers drop client QUIC datagrams shorter than this.
+static constexpr size_t kQuicDatagram = 1200;
+
+using UdpDecoder = bool (*)(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec);
+
+struct UdpProbe {
+    const char *service;
+    uint16_t port;
+    std::string payload;
+    // The cookie goes here big-endian; only the bits in cookie_mask are echoed.
+    size_t cookie_offset;
+    size_t cookie_len;
+    uint64_t cookie_mask;
+    UdpDecoder decode;
+};
+
+template <size_t N>
+static std::string bytes(const char (&data)[N]) {
+    return std::string(data, N - 1);
+}
+
+static uint16_t read16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+static uint32_t read32(const uint8_t *p) {
+    return static_cast<uint32_t>(read16(p)) << 16 | read16(p + 2);
+}
+
+static uint64_t read64(const uint8_t *p) {
+    return static_cast<uint64_t>(read32(p)) << 32 | read32(p + 4);
+}
+
+// splitmix64 over the destination, keyed per run, so a reply proves which
+// probe it answers without the probe being remembered.
+static uint64_t probe_cookie(uint64_t key, uint32_t ip, uint16_t port) {
+    uint64_t z = key ^ (static_cast<uint64_t>(ip) << 16 | port);
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Service-supplied text as one output-safe line.
+static std::string printable(std::string_view text) {
+    std::string out;
+    for (char c : text.substr(0, 256)) {
+        bool control = static_cast<unsigned char>(c) < 0x20 || c == 0x7f;
+        if (!control) {
+            out += c;
+        } else if (!out.empty() && out.back() != ' ') {
+            out += ' ';
+        }
+    }
+    return trim(out);
+}
+
+static std::string_view as_text(const uint8_t *data, size_t len) {
+    return std::string_view(reinterpret_cast<const char *>(data), len);
+}
+
+static bool skip_dns_name(const uint8_t *msg, size_t len, size_t &pos) {
+    while (pos < len) {
+        uint8_t label = msg[pos];
+        if ((label & 0xc0) == 0xc0) {
+            pos += 2;
+            return pos <= len;
+        }
+        pos += 1 + static_cast<size_t>(label);
+        if (label == 0) {
+            return pos <= len;
+        }
+    }
+    return false;
+}
+
+// version.bind TXT CH: any answer shows a DNS server; many also give their version.
+static bool decode_dns(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec) {
+    if (len < 12 || read16(msg) != cookie || !(msg[2] & 0x80)) {
+        return false;
+    }
+    static const char *const kRcodes[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED"};
+    unsigned rcode = msg[3] & 0x0f;
+    std::string rcode_name = rcode < 6 ? kRcodes[rcode] : std::to_string(rcode);
+    rec.fields.emplace_back("rcode", rcode_name);
+    rec.fields.emplace_back("recursion", msg[3] & 0x80 ? "available" : "no");
+    size_t pos = 12;
+    bool ok = true;
+    for (uint16_t i = 0, n = read16(msg + 4); ok && i < n; ++i) {
+        ok = skip_dns_name(msg, len, pos) && pos + 4 <= len;
+        pos += 4;
+    }
+    for (uint16_t i = 0, n = read16(msg + 6); ok && i < n; ++i) {
+        if (!skip_dns_name(msg, len, pos) || pos + 10 > len) {
+            break;
+        }
+        uint16_t type = read16(msg + pos);
+        size_t rdlength = read16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlength > len) {
+            break;
+        }
+        if (type == 16 && rdlength > 0) {
+            rec.title = printable(as_text(msg + pos + 1, std::min<size_t>(msg[pos], rdlength - 1)));
+            break;
+        }
+        pos += rdlength;
+    }
+    if (rec.title.empty()) {
+        rec.title = "DNS " + rcode_name;
+    }
+    return true;
+}
+
+// Mode 3 client request; the server copies our transmit time into its origin time.
+static bool decode_ntp(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec) {
+    if (len < 48 || (msg[0] & 7) != 4 || read64(msg + 24) != cookie) {
+        return false;
+    }
+    unsigned stratum = msg[1];
+    // Strata 0 and 1 carry a kiss code or clock name, the rest the upstream's address.
+    std::string refid = stratum <= 1 ? printable(as_text(msg + 12, 4)) : format_ipv4(read32(msg + 12));
+    rec.title = "NTP stratum " + std::to_string(stratum);
+    rec.fields.emplace_back("version", std::to_string(msg[0] >> 3 & 7));
+    if (!refid.empty()) {
+        rec.fields.emplace_back("refid", refid);
+    }
+    return true;
+}
+
+// One BER element at pos: its tag and the extent of its value. pos moves past it.
+static bool read_ber(const uint8_t *msg, size_t len, size_t &pos, uint8_t &tag, size_t &value, size_t &value_len) {
+    if (pos + 2 > len) {
+        return false;
+    }
+    tag = msg[pos++];
+    size_t n = msg[pos++];
+    if (n & 0x80) {
+        size_t digits = n & 0x7f;
+        if (digits == 0 || digits > 3 || pos + digits > len) {
+            return false;
+        }
+        n = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            n = n << 8 | msg[pos++];
+        }
+    }
+    if (n > len - pos) {
+        return false;
+    }
+    value = pos;
+    value_len = n;
+    pos += n;
+    return true;
+}
+
+// Reads the next element of a sequence, expecting `want`; for constructed
+// elements pos moves inside it.
+static bool enter_ber(const uint8_t *msg, size_t len, size_t &pos, uint8_t want, size_t &value, size_t &value_len) {
+    uint8_t tag = 0;
+    if (!read_ber(msg, len, pos, tag, value, value_len) || tag != want) {
+        return false;
+    }
+    if (tag & 0x20) {
+        pos = value;
+    }
+    return true;
+}
+
+static bool read_ber_int(const uint8_t *msg, size_t len, size_t &pos, uint64_t &out) {
+    size_t value = 0;
+    size_t value_len = 0;
+    if (!enter_ber(msg, len, pos, 0x02, value, value_len) || value_len == 0 || value_len > 8) {
+        return false;
+    }
+    out = 0;
+    for (size_t i = 0; i < value_len; ++i) {
+        out = out << 8 | msg[value + i];
+    }
+    return true;
+}
+
+// SNMPv2c GetRequest for sysDescr.0 with community "public".
+static bool decode_snmp(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec) {
+    size_t pos = 0;
+    size_t value = 0;
+    size_t value_len = 0;
+    uint64_t version = 0;
+    uint64_t request_id = 0;
+    uint64_t error = 0;
+    uint64_t error_index = 0;
+    if (!enter_ber(msg, len, pos, 0x30, value, value_len) || !read_ber_int(msg, len, pos, version) ||
+        !enter_ber(msg, len, pos, 0x04, value, value_len) || !enter_ber(msg, len, pos, 0xa2, value, value_len) ||
+        !read_ber_int(msg, len, pos, request_id) || request_id != cookie ||
+        !read_ber_int(msg, len, pos, error) || !read_ber_int(msg, len, pos, error_index)) {
+        return false;
+    }
+    rec.fields.emplace_back("community", "public");
+    if (error != 0) {
+        rec.fields.emplace_back("error", std::to_string(error));
+    }
+    uint8_t tag = 0;
+    if (enter_ber(msg, len, pos, 0x30, value, value_len) && enter_ber(msg, len, pos, 0x30, value, value_len) &&
+        enter_ber(msg, len, pos, 0x06, value, value_len) && read_ber(msg, len, pos, tag, value, value_len) &&
+        tag == 0x04) {
+        rec.title = printable(as_text(msg + value, value_len));
+    }
+    if (rec.title.empty()) {
+        rec.title = "SNMP";
+    }
+    return true;
+}
+
+// M-SEARCH for everything; the answer is an HTTP response over UDP.
+static bool decode_ssdp(const uint8_t *msg, size_t len, uint64_t, HttpRecord &rec) {
+    std::string_view text = as_text(msg, len);
+    if (text.substr(0, 5) != "HTTP/") {
+        return false;
+    }
+    size_t space = text.find(' ');
+    rec.status_code = space == std::string_view::npos ? 0 : std::atoi(std::string(text.substr(space + 1, 3)).c_str());
+    size_t pos = text.find('\n');
+    while (pos != std::string_view::npos && pos + 1 < text.size()) {
+        size_t end = text.find('\n', pos + 1);
+        std::string_view line = text.substr(pos + 1, end == std::string_view::npos ? end : end - pos - 1);
+        pos = end;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string name = to_lower(std::string(line.substr(0, colon)));
+        std::string value = printable(line.substr(colon + 1));
+        if (name == "server") {
+            rec.title = value;
+        } else if (name == "location" || name == "usn") {
+            rec.fields.emplace_back(name, value);
+        }
+    }
+    if (rec.title.empty()) {
+        rec.title = "SSDP";
+    }
+    return true;
+}
+
+// IKEv1 Main Mode proposal; the responder echoes our SPI even when it refuses it.
+static bool decode_ike(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec) {
+    if (len < 28 || read64(msg) != cookie) {
+        return false;
+    }
+    unsigned major = msg[17] >> 4;
+    uint8_t exchange = msg[18];
+    rec.title = "IKEv" + std::to_string(major);
+    switch (exchange) {
+    case 2:
+        rec.title += " Main Mode";
+        break;
+    case 4:
+        rec.title += " Aggressive Mode";
+        break;
+    case 5:
+    case 37:
+        rec.title += " Informational";
+        break;
+    case 34:
+        rec.title += " IKE_SA_INIT";
+        break;
+    default:
+        rec.title += " exchange " + std::to_string(exchange);
+        break;
+    }
+    if (major != 1 || (msg[19] & 1)) {
+        return true;
+    }
+    // Unencrypted IKEv1 payloads: a notification says why the proposal was refused.
+    size_t vendor_ids = 0;
+    uint8_t next = msg[16];
+    for (size_t pos = 28; next != 0 && pos + 4 <= len;) {
+        size_t length = read16(msg + pos + 2);
+        if (length < 4 || pos + length > len) {
+            break;
+        }
+        if (next == 11 && length >= 12) {
+            uint16_t type = read16(msg + pos + 10);
+            rec.fields.emplace_back("notify", type == 14 ? "NO-PROPOSAL-CHOSEN" : std::to_string(type));
+        } else if (next == 13) {
+            ++vendor_ids;
+        }
+        next = msg[pos];
+        pos += length;
+    }
+    if (vendor_ids) {
+        rec.fields.emplace_back("vendor_ids", std::to_string(vendor_ids));
+    }
+    return true;
+}
+
+static std::string quic_version_name(uint32_t version) {
+    if (version == 1) {
+        return "v1";
+    }
+    if (version == 0x6b3343cf) {
+        return "v2";
+    }
+    if ((version >> 8) == 0xff0000) {
+        return "draft-" + std::to_string(version & 0xff);
+    }
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%08x", version);
+    return hex;
+}
+
+// A long-header packet of an unused version draws a Version Negotiation
+// packet listing the versions the server speaks, with our DCID as its SCID.
+static bool decode_quic(const uint8_t *msg, size_t len, uint64_t cookie, HttpRecord &rec) {
+    if (len < 7 || !(msg[0] & 0x80) || read32(msg + 1) != 0) {
+        return false;
+    }
+    size_t pos = 6 + static_cast<size_t>(msg[5]);
+    if (pos + 9 > len || msg[pos] != 8 || read64(msg + pos + 1) != cookie) {
+        return false;
+    }
+    std::string versions;
+    for (pos += 9; pos + 4 <= len; pos += 4) {
+        uint32_t version = read32(msg + pos);
+        // Reserved 0x?a?a?a?a versions only exercise version negotiation.
+        if ((version & 0x0f0f0f0f) != 0x0a0a0a0a) {
+            versions += (versions.empty() ? "" : ",") + quic_version_name(version);
+        }
+    }
+    rec.title = "QUIC";
+    rec.fields.emplace_back("versions", versions);
+    return true;
+}
+
+static std::vector<UdpProbe> make_probes() {
+    std::vector<UdpProbe> probes;
+    probes.push_back({"dns", 53,
+                      bytes("\0\0\0\0\0\x01\0\0\0\0\0\0"
+                            "\x07version\x04"
+                            "bind\0\0\x10\0\x03"),
+                      0, 2, 0xffff, decode_dns});
+    std::string ntp(48, '\0');
+    ntp[0] = 0x23; // version 4, mode 3
+    probes.push_back({"ntp", 123, ntp, 40, 8, ~0ull, decode_ntp});
+    probes.push_back({"snmp", 161,
+                      bytes("\x30\x29\x02\x01\x01\x04\x06"
+                            "public"
+                            "\xa0\x1c\x02\x04\0\0\0\0\x02\x01\0\x02\x01\0"
+                            "\x30\x0e\x30\x0c\x06\x08\x2b\x06\x01\x02\x01\x01\x01\0\x05\0"),
+                      17, 4, 0x7fffffff, decode_snmp});
+    probes.push_back({"ssdp", 1900,
+                      "M-SEARCH * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nMAN: \"ssdp:discover\"\r\n"
+                      "MX: 1\r\nST: ssdp:all\r\n\r\n",
+                      0, 0, 0, decode_ssdp});
+    // AES-128/SHA1/PSK/MODP-2048, the most widely accepted legacy proposal.
+    probes.push_back({"ike", 500,
+                      bytes("\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01\x10\x02\0\0\0\0\0\0\0\0\x54"
+                            "\0\0\0\x38\0\0\0\x01\0\0\0\x01"
+                            "\0\0\0\x2c\x01\x01\0\x01"
+                            "\0\0\0\x24\x01\x01\0\0"
+                            "\x80\x01\0\x07\x80\x0e\0\x80\x80\x02\0\x02\x80\x03\0\x01"
+                            "\x80\x04\0\x0e\x80\x0b\0\x01\x80\x0c\x70\x80"),
+                      0, 8, ~0ull, decode_ike});
+    std::string quic = bytes("\xc0\x1a\x2a\x3a\x4a\x08\0\0\0\0\0\0\0\0\0");
+    quic.resize(kQuicDatagram, '\0');
+    probes.push_back({"quic", 443, quic, 6, 8, ~0ull, decode_quic});
+    return probes;
+}
+
+static const std::vector<UdpProbe> &udp_probes() {
+    static const std::vector<UdpProbe> probes = make_probes();
+    return probes;
+}
+
+static const UdpProbe *probe_for(uint16_t port) {
+    for (const auto &probe : udp_probes()) {
+        if (probe.port == port) {
+            return &probe;
+        }
+    }
+    return nullptr;
+}
+
+const char *udp_service(uint16_t port) {
+    const UdpProbe *probe = probe_for(port);
+    return probe ? probe->service : nullptr;
+}
+
+std::string udp_service_list() {
+    std::vector<const UdpProbe *> probes;
+    for (const auto &probe : udp_probes()) {
+        probes.push_back(&probe);
+    }
+    std::sort(probes.begin(), probes.end(), [](const UdpProbe *a, const UdpProbe *b) { return a->port < b->port; });
+    std::string out;
+    for (const UdpProbe *probe : probes) {
+        out += (out.empty() ? "" : ", ") + std::to_string(probe->port) + " (" + probe->service + ")";
+    }
+    return out;
+}
+
+#ifdef _WIN32
+
+UdpScanStats probe_udp(const TargetSet &, const std::vector<uint16_t> &, double, double, size_t,
+                       const std::function<bool(uint32_t, uint16_t)> &,
+                       const std::function<void(std::vector<HttpRecord> &)> &) {
+    std::cerr << "UDP probing is not available on Windows." << std::endl;
+    return {};
+}
+
+#else
+
+#ifdef __linux__
+using Message = mmsghdr;
+
+static int send_messages(int fd, Message *msgs, unsigned count) {
+    return sendmmsg(fd, msgs, count, 0);
+}
+
+static int recv_messages(int fd, Message *msgs, unsigned count) {
+    return recvmmsg(fd, msgs, count, MSG_DONTWAIT, nullptr);
+}
+#else
+// One call per datagram where sendmmsg/recvmmsg are missing.
+struct Message {
+    msghdr msg_hdr;
+    unsigned msg_len;
+};
+
+static int send_messages(int fd, Message *msgs, unsigned count) {
+    unsigned done = 0;
+    for (; done < count; ++done) {
+        ssize_t n = sendmsg(fd, &msgs[done].msg_hdr, 0);
+        if (n < 0) {
+            break;
+        }
+        msgs[done].msg_len = static_cast<unsigned>(n);
+    }
+    return done > 0 ? static_cast<int>(done) : -1;
+}
+
+static int recv_messages(int fd, Message *msgs, unsigned count) {
+    unsigned done = 0;
+    for (; done < count; ++done) {
+        ssize_t n = recvmsg(fd, &msgs[done].msg_hdr, MSG_DONTWAIT);
+        if (n < 0) {
+            break;
+        }
+        msgs[done].msg_len = static_cast<unsigned>(n);
+    }
+    return done > 0 ? static_cast<int>(done) : -1;
+}
+#endif
+
+static int open_udp_socket() {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // Replies arrive in bursts between our reads.
+    int rcvbuf = 8 << 20;
+    int sndbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    if (bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+UdpScanStats probe_udp(const TargetSet &targets, const std::vector<uint16_t> &ports, double rate, double wait,
+                       size_t batch_size, const std::function<bool(uint32_t ip, uint16_t port)> &want,
+                       const std::function<void(std::vector<HttpRecord> &)> &fn) {
+    UdpScanStats stats;
+    std::vector<pollfd> fds;
+    for (size_t i = 0; i < kUdpSockets; ++i) {
+        int fd = open_udp_socket();
+        if (fd >= 0) {
+            fds.push_back(pollfd{fd, POLLIN, 0});
+        }
+    }
+    if (fds.empty()) {
+        std::cerr << "Cannot open UDP sockets: " << std::strerror(errno) << std::endl;
+        return stats;
+    }
+    std::random_device seed;
+    uint64_t key = static_cast<uint64_t>(seed()) << 32 | seed();
+    bool ssdp = std::find(ports.begin(), ports.end(), uint16_t{1900}) != ports.end();
+
+    std::vector<HttpRecord> batch;
+    // Services already written; SSDP devices and some DNS servers answer more than once.
+    std::unordered_set<uint64_t> seen;
+    auto on_reply = [&](const sockaddr_in &from, const uint8_t *data, size_t len) {
+        ++stats.replies;
+        uint32_t ip = ntohl(from.sin_addr.s_addr);
+        uint16_t port = ntohs(from.sin_port);
+        const UdpProbe *probe = std::find(ports.begin(), ports.end(), port) != ports.end() ? probe_for(port) : nullptr;
+        // SSDP devices often answer from another port.
+        if (!probe && ssdp && as_text(data, len).substr(0, 5) == "HTTP/") {
+            port = 1900;
+            probe = probe_for(port);
+        }
+        HttpRecord rec;
+        if (!probe || !targets.contains(ip) ||
+            !probe->decode(data, len, probe_cookie(key, ip, port) & probe->cookie_mask, rec)) {
+            ++stats.unmatched;
+            return;
+        }
+        if (!seen.insert(static_cast<uint64_t>(ip) << 16 | port).second) {
+            return;
+        }
+        ++stats.services;
+        rec.ip = format_ipv4(ip);
+        rec.port = port;
+        rec.module = probe->service;
+        rec.status = "success";
+        rec.has_body = true;
+        rec.fields.insert(rec.fields.begin(), {"udp", std::to_string(port) + "/" + probe->service});
+        batch.push_back(std::move(rec));
+        if (batch.size() >= batch_size) {
+            fn(batch);
+            batch.clear();
+        }
+    };
+
+    std::vector<uint8_t> replies(kUdpBatch * kReplyBytes);
+    std::vector<Message> in(kUdpBatch);
+    std::vector<iovec> in_iov(kUdpBatch);
+    std::vector<sockaddr_in> from(kUdpBatch);
+    auto drain = [&](int fd) {
+        for (;;) {
+            for (size_t i = 0; i < kUdpBatch; ++i) {
+                in_iov[i] = iovec{replies.data() + i * kReplyBytes, kReplyBytes};
+                in[i] = Message{};
+                in[i].msg_hdr.msg_name = &from[i];
+                in[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                in[i].msg_hdr.msg_iov = &in_iov[i];
+                in[i].msg_hdr.msg_iovlen = 1;
+            }
+            int n = recv_messages(fd, in.data(), kUdpBatch);
+            for (int i = 0; i < n; ++i) {
+                on_reply(from[i], replies.data() + static_cast<size_t>(i) * kReplyBytes, in[i].msg_len);
+            }
+            if (n < static_cast<int>(kUdpBatch)) {
+                return;
+            }
+        }
+    };
+    // Reads whatever arrives within `seconds`.
+    auto poll_replies = [&](double seconds) {
+        int timeout = static_cast<int>(seconds * 1000);
+        if (poll(fds.data(), fds.size(), timeout) <= 0) {
+            if (timeout == 0 && seconds > 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            }
+            return;
+        }
+        for (const auto &p : fds) {
+            if (p.revents) {
+                drain(p.fd);
+            }
+        }
+    };
+
+    // Bursts of at most 10 ms of the rate, so a low rate is not sent in clumps.
+    size_t burst = rate > 0 ? std::clamp<size_t>(static_cast<size_t>(rate / 100), 1, kUdpBatch) : kUdpBatch;
+    std::vector<std::string> payloads(kUdpBatch);
+    std::vector<sockaddr_in> dests(kUdpBatch);
+    std::vector<iovec> out_iov(kUdpBatch);
+    std::vector<Message> out(kUdpBatch);
+    size_t next_fd = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto send_burst = [&](size_t count) {
+        if (rate > 0) {
+            for (;;) {
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                double ahead = static_cast<double>(stats.probes) / rate - elapsed;
+                if (ahead <= 0) {
+                    break;
+                }
+                poll_replies(ahead);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            out_iov[i] = iovec{payloads[i].data(), payloads[i].size()};
+            out[i] = Message{};
+            out[i].msg_hdr.msg_name = &dests[i];
+            out[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            out[i].msg_hdr.msg_iov = &out_iov[i];
+            out[i].msg_hdr.msg_iovlen = 1;
+        }
+        int fd = fds[next_fd++ % fds.size()].fd;
+        for (size_t sent = 0; sent < count;) {
+            int n = send_messages(fd, out.data() + sent, static_cast<unsigned>(count - sent));
+            if (n > 0) {
+                sent += static_cast<size_t>(n);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == EINTR) {
+                // The send queue is full: read replies while it drains.
+                pollfd writable{fd, POLLOUT, 0};
+                poll(&writable, 1, 10);
+                poll_replies(0);
+            } else {
+                // This destination is refused (unroutable, broadcast); carry on past it.
+                ++stats.failed;
+                ++sent;
+            }
+        }
+        stats.probes += count;
+        poll_replies(0);
+    };
+
+    for (uint16_t port : ports) {
+        const UdpProbe *probe = probe_for(port);
+        if (!probe) {
+            continue;
+        }
+        std::fill(payloads.begin(), payloads.end(), probe->payload);
+        size_t count = 0;
+        for (const auto &range : targets.ranges()) {
+            for (uint64_t ip = range.start; ip <= range.end; ++ip) {
+                if (want && !want(static_cast<uint32_t>(ip), port)) {
+                    continue;
+                }
+                uint64_t cookie = probe_cookie(key, static_cast<uint32_t>(ip), port) & probe->cookie_mask;
+                for (size_t i = 0; i < probe->cookie_len; ++i) {
+                    payloads[count][probe->cookie_offset + i] =
+                        static_cast<char>(cookie >> (8 * (probe->cookie_len - 1 - i)));
+                }
+                dests[count] = sockaddr_in{};
+                dests[count].sin_family = AF_INET;
+                dests[count].sin_port = htons(port);
+                dests[count].sin_addr.s_addr = htonl(static_cast<uint32_t>(ip));
+                if (++count == burst) {
+                    send_burst(count);
+                    count = 0;
+                }
+            }
+        }
+        if (count > 0) {
+            send_burst(count);
+        }
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(wait);
+    for (;;) {
+        double left = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            break;
+        }
+        poll_replies(std::min(left, 0.1));
+    }
+    if (!batch.empty()) {
+        fn(batch);
+    }
+    for (const auto &p : fds) {
+        close(p.fd);
+    }
+    return stats;
+}
+
+#endif
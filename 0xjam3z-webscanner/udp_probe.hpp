@@ -0,0 +1,39 @@
+#pragma once
+
+#include "parsers.hpp"
+#include "targets.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The service probed on a UDP port, or nullptr when there is no payload for it:
+// dns (53), ike (500), ntp (123), snmp (161), ssdp (1900), quic (443).
+const char *udp_service(uint16_t port);
+// "53 (dns), 123 (ntp), ..." for error messages.
+std::string udp_service_list();
+
+struct UdpScanStats {
+    uint64_t probes = 0;
+    // Sends the kernel refused, e.g. for an unroutable address.
+    uint64_t failed = 0;
+    uint64_t replies = 0;
+    // Replies that carried no valid cookie or did not decode.
+    uint64_t unmatched = 0;
+    uint64_t services = 0;
+};
+
+// Sends one probe per (IPv4 target, port) at up to `rate` packets a second,
+// in sendmmsg batches spread over a few sockets, and reads replies with
+// recvmmsg while sending and for `wait` seconds after the last probe. Nothing
+// is kept per probe: each payload carries a keyed hash of its destination in a
+// field the service echoes (DNS id, NTP origin time, SNMP request-id, IKE SPI,
+// QUIC connection id), which a reply must match. SSDP echoes nothing, so its
+// replies are only checked against the targets. Every service that answers
+// becomes one record, handed to `fn` in batches. `want`, when set, skips
+// targets it rejects.
+UdpScanStats probe_udp(const TargetSet &targets, const std::vector<uint16_t> &ports, double rate, double wait,
+                       size_t batch_size, const std::function<bool(uint32_t ip, uint16_t port)> &want,
+                       const std::function<void(std::vector<HttpRecord> &)> &fn);
@@ -0,0 +1,668 @@
+#include "vhost.hpp"
+
+#include "common.hpp"
+#include "coro.hpp"
+#include "event_loop.hpp"
+#include "http.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <optional>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef JAM3Z_HAVE_OPENSSL
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+static uint64_t endpoint_key(uint32_t ip, uint16_t port) {
+    return static_cast<uint64_t>(ip) << 16 | port;
+}
+
+void VhostQueue::observe(const std::vector<HttpRecord> &batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &rec : batch) {
+        uint32_t ip = 0;
+        if (rec.status != "success" || !parse_ipv4(rec.ip, ip)) {
+            continue;
+        }
+        Endpoint &endpoint = endpoints_[endpoint_key(ip, rec.port)];
+        endpoint.tls = endpoint.tls || rec.port == 443 || rec.cert;
+        if (rec.domain.empty()) {
+            if (!endpoint.has_default) {
+                endpoint.has_default = true;
+                endpoint.default_fingerprint = response_fingerprint(rec);
+                endpoint.default_prefix_fingerprint = response_prefix_fingerprint(rec);
+            }
+        } else {
+            endpoint.grabbed.insert(to_lower(rec.domain));
+        }
+        if (rec.cert) {
+            for (const auto &name : rec.cert->names) {
+                // A wildcard SAN names no host in particular.
+                if (name.find('*') == std::string::npos) {
+                    names_[ip].push_back(to_lower(name));
+                }
+            }
+        }
+    }
+}
+
+void VhostQueue::add_name(uint32_t ip, const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    names_[ip].push_back(to_lower(name));
+}
+
+std::vector<VhostGroup> VhostQueue::take_groups() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : names_) {
+        auto &names = entry.second;
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+    }
+    std::vector<VhostGroup> groups;
+    for (const auto &entry : endpoints_) {
+        uint32_t ip = static_cast<uint32_t>(entry.first >> 16);
+        auto names = names_.find(ip);
+        if (names == names_.end()) {
+            continue;
+        }
+        const Endpoint &endpoint = entry.second;
+        VhostGroup group;
+        group.ip = ip;
+        group.port = static_cast<uint16_t>(entry.first & 0xffff);
+        group.tls = endpoint.tls;
+        group.has_default = endpoint.has_default;
+        group.default_fingerprint = endpoint.default_fingerprint;
+        group.default_prefix_fingerprint = endpoint.default_prefix_fingerprint;
+        for (const auto &name : names->second) {
+            if (!endpoint.grabbed.count(name)) {
+                group.names.push_back(name);
+            }
+        }
+        if (!group.names.empty()) {
+            groups.push_back(std::move(group));
+        }
+    }
+    endpoints_.clear();
+    names_.clear();
+    std::sort(groups.begin(), groups.end(), [](const VhostGroup &a, const VhostGroup &b) {
+        return endpoint_key(a.ip, a.port) < endpoint_key(b.ip, b.port);
+    });
+    return groups;
+}
+
+bool native_tls_supported() {
+#if defined(JAM3Z_HAVE_OPENSSL) && !defined(_WIN32)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef _WIN32
+VhostStats probe_vhosts(std::vector<VhostGroup>, size_t, double, size_t,
+                        const std::function<void(std::vector<HttpRecord> &)> &) {
+    std::cerr << "Virtual-host probing is not available on Windows." << std::endl;
+    return {};
+}
+
+VhostStats grab_endpoints(std::vector<VhostGroup>, size_t, double, size_t,
+                          const std::function<void(std::vector<HttpRecord> &)> &) {
+    std::cerr << "The native HTTP client is not available on Windows." << std::endl;
+    return {};
+}
+#else
+
+// True when a certificate for `sans` is valid for `name`, i.e. a browser
+// would send a request for `name` over the connection.
+static bool cert_covers(const std::vector<std::string> &sans, const std::string &name) {
+    size_t dot = name.find('.');
+    for (const auto &san : sans) {
+        if (san == name) {
+            return true;
+        }
+        if (san.size() > 2 && san[0] == '*' && san[1] == '.' && dot != std::string::npos && dot > 0 &&
+            name.compare(dot, std::string::npos, san, 1, std::string::npos) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef JAM3Z_HAVE_OPENSSL
+static std::string x509_name_text(X509_NAME *name) {
+    std::string text;
+    BIO *bio = BIO_new(BIO_s_mem());
+    if (!bio) {
+        return text;
+    }
+    X509_NAME_print_ex(bio, name, 0, XN_FLAG_SEP_CPLUS_SPC | ASN1_STRFLGS_RFC2253);
+    char *data = nullptr;
+    long len = BIO_get_mem_data(bio, &data);
+    text.assign(data, static_cast<size_t>(len));
+    BIO_free(bio);
+    return text;
+}
+
+// The leaf certificate in the form zgrab2 reports it.
+static CertInfo read_certificate(X509 *peer) {
+    CertInfo cert;
+    cert.subject = x509_name_text(X509_get_subject_name(peer));
+    cert.issuer = x509_name_text(X509_get_issuer_name(peer));
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (X509_digest(peer, EVP_sha256(), digest, &digest_len)) {
+        static const char hex[] = "0123456789abcdef";
+        for (unsigned int k = 0; k < digest_len; ++k) {
+            cert.fingerprint_sha256 += hex[digest[k] >> 4];
+            cert.fingerprint_sha256 += hex[digest[k] & 15];
+        }
+    }
+    std::tm tm{};
+    if (ASN1_TIME_to_tm(X509_get0_notAfter(peer), &tm)) {
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        cert.not_after = buf;
+    }
+    auto *sans = static_cast<GENERAL_NAMES *>(X509_get_ext_d2i(peer, NID_subject_alt_name, nullptr, nullptr));
+    for (int k = 0; sans && k < sk_GENERAL_NAME_num(sans); ++k) {
+        const GENERAL_NAME *entry = sk_GENERAL_NAME_value(sans, k);
+        if (entry->type == GEN_DNS) {
+            const ASN1_STRING *dns = entry->d.dNSName;
+            cert.names.emplace_back(reinterpret_cast<const char *>(ASN1_STRING_get0_data(dns)),
+                                    static_cast<size_t>(ASN1_STRING_length(dns)));
+        }
+    }
+    GENERAL_NAMES_free(sans);
+    return cert;
+}
+#endif
+
+// One connection to a group's endpoint, plain or TLS. Its fd's timeout covers
+// whichever step is in progress.
+struct VhostConnection {
+    explicit VhostConnection(EventLoop &loop) : io(loop) {}
+    ~VhostConnection() {
+        close();
+#ifdef JAM3Z_HAVE_OPENSSL
+        SSL_SESSION_free(session);
+#endif
+    }
+    VhostConnection(const VhostConnection &) = delete;
+    VhostConnection &operator=(const VhostConnection &) = delete;
+
+    void close() {
+#ifdef JAM3Z_HAVE_OPENSSL
+        SSL_free(ssl);
+        ssl = nullptr;
+#endif
+        io.close();
+        requests = 0;
+        sni.clear();
+        cert.reset();
+        cert_names.clear();
+    }
+
+    AsyncFd io;
+    size_t requests = 0;
+    std::string sni;
+    std::vector<std::string> cert_names;
+    std::optional<CertInfo> cert;
+#ifdef JAM3Z_HAVE_OPENSSL
+    SSL *ssl = nullptr;
+    // Kept across the group's reconnects, so later handshakes resume.
+    SSL_SESSION *session = nullptr;
+#endif
+};
+
+// Every probe is a coroutine on one event loop: `connections` workers each
+// take a group and request its names in turn, reading top to bottom where a
+// callback state machine would hop between handlers.
+class VhostProber {
+public:
+    using Sink = std::function<void(std::vector<HttpRecord> &)>;
+
+    // `fold`: drop responses equal to the default page and merge identical ones.
+    VhostProber(std::vector<VhostGroup> groups, size_t connections, double timeout, size_t batch_size,
+                const Sink &fn, bool fold)
+        : groups_(std::move(groups)), connections_(std::max<size_t>(1, connections)), timeout_(timeout),
+          batch_size_(batch_size), fn_(fn), fold_(fold) {}
+    ~VhostProber();
+    VhostProber(const VhostProber &) = delete;
+    VhostProber &operator=(const VhostProber &) = delete;
+
+    VhostStats run();
+
+private:
+    enum class Io { Done, Wait, Closed, Error };
+    enum class Open { Ok, Failed, Unreachable };
+
+    struct Response {
+        HttpRecord rec;
+        std::vector<std::string> aliases;
+    };
+
+    // A group's records so far, with identical responses folded together.
+    struct Results {
+        std::vector<Response> responses;
+        std::unordered_map<uint64_t, size_t> by_fingerprint;
+    };
+
+    Task<> worker();
+    Task<> probe_group(VhostGroup &group);
+    // False when the endpoint cannot be reached at all.
+    Task<bool> probe_name(const VhostGroup &group, const std::string &name, VhostConnection &conn, Results &results);
+    // Unreachable: refused, unroutable or timed out on connect. Failed: the TLS
+    // handshake did not complete, which can be down to the name's SNI.
+    Task<Open> open(VhostConnection &conn, const VhostGroup &group, const std::string &name);
+    Task<bool> handshake(VhostConnection &conn, const std::string &name);
+    Task<bool> write_all(VhostConnection &conn, std::string_view data);
+    // Reads until `response` holds a whole response. `received` turns true with
+    // the first byte.
+    Task<bool> read_response(VhostConnection &conn, HttpResponseParser &response, bool &received);
+
+    // Outside the coroutines so the record is not part of every frame.
+    void on_response(const VhostGroup &group, const std::string &name, VhostConnection &conn,
+                     HttpResponseParser &response, Results &results);
+    // `partial`: the body was only decoded up to its title.
+    void record(const VhostGroup &group, Results &results, HttpRecord rec, bool partial);
+    void emit(HttpRecord rec);
+
+    Io io_write(VhostConnection &conn, std::string_view data, size_t &n, unsigned &wait);
+    Io io_read(VhostConnection &conn, char *buf, size_t cap, size_t &n, unsigned &wait);
+
+    EventLoop loop_;
+    std::vector<VhostGroup> groups_;
+    size_t next_group_ = 0;
+    size_t connections_;
+    double timeout_;
+    size_t batch_size_;
+    const Sink &fn_;
+    bool fold_;
+    std::vector<HttpRecord> pending_;
+    VhostStats stats_;
+    // Shared by every connection: a read is fed to its parser before the
+    // coroutine suspends again, so no frame carries a buffer of its own.
+    char read_buf_[16384];
+#ifdef JAM3Z_HAVE_OPENSSL
+    SSL_CTX *ctx_ = nullptr;
+#endif
+};
+
+// Pause between socket() attempts while the process is out of descriptors.
+static constexpr double kFdWait = 0.05;
+
+VhostProber::~VhostProber() {
+#ifdef JAM3Z_HAVE_OPENSSL
+    SSL_CTX_free(ctx_);
+#endif
+}
+
+VhostStats VhostProber::run() {
+#ifdef JAM3Z_HAVE_OPENSSL
+    ctx_ = SSL_CTX_new(TLS_client_method());
+    if (!ctx_) {
+        std::cerr << "Failed to create a TLS context." << std::endl;
+        return stats_;
+    }
+    // A scanner talks to whatever is out there: no verification, old ciphers allowed.
+    SSL_CTX_set_verify(ctx_, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_security_level(ctx_, 0);
+    SSL_CTX_set_options(ctx_, SSL_OP_LEGACY_SERVER_CONNECT);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT);
+#endif
+    for (size_t i = 0; i < std::min(connections_, groups_.size()); ++i) {
+        spawn(worker());
+    }
+    loop_.run();
+    if (!pending_.empty()) {
+        fn_(pending_);
+        pending_.clear();
+    }
+    return stats_;
+}
+
+Task<> VhostProber::worker() {
+    while (next_group_ < groups_.size()) {
+        co_await probe_group(groups_[next_group_++]);
+    }
+}
+
+Task<> VhostProber::probe_group(VhostGroup &group) {
+    ++stats_.groups;
+    VhostConnection conn(loop_);
+    Results results;
+    for (size_t next = 0; next < group.names.size(); ++next) {
+        if (!co_await probe_name(group, group.names[next], conn, results)) {
+            // Refused or unreachable: every other name would fail the same way.
+            stats_.failed += group.names.size() - next;
+            break;
+        }
+    }
+    conn.close();
+    for (auto &response : results.responses) {
+        if (!response.aliases.empty()) {
+            std::string aliases;
+            for (const auto &alias : response.aliases) {
+                aliases += aliases.empty() ? "" : ", ";
+                aliases += alias;
+            }
+            response.rec.fields.emplace_back("aliases", std::move(aliases));
+        }
+        emit(std::move(response.rec));
+    }
+}
+
+Task<bool> VhostProber::probe_name(const VhostGroup &group, const std::string &name, VhostConnection &conn,
+                                   Results &results) {
+    if (conn.io.is_open() && group.tls && !cert_covers(conn.cert_names, name)) {
+        // A browser would not send this name over the connection: reconnect with
+        // it as SNI, resuming the session.
+        conn.close();
+    }
+    HttpResponseParser response;
+    bool retried = false;
+    bool own_connection = false;
+    for (;;) {
+        if (!conn.io.is_open()) {
+            Open opened = co_await open(conn, group, name);
+            if (opened == Open::Unreachable) {
+                co_return false;
+            }
+            if (opened == Open::Failed) {
+                // Rejected SNI names end here; the next name gets a fresh connection.
+                ++stats_.failed;
+                co_return true;
+            }
+        }
+        std::string request = build_http_request(name.empty() ? format_ipv4(group.ip) : name, true);
+        ++conn.requests;
+        ++stats_.requests;
+        conn.io.set_timeout(timeout_);
+        response.reset();
+        bool received = false;
+        if (!co_await write_all(conn, request) || !co_await read_response(conn, response, received)) {
+            bool stale = conn.requests > 1 && !received && !retried;
+            conn.close();
+            if (stale) {
+                // The server closed an idle keep-alive connection as the request went out.
+                retried = true;
+                continue;
+            }
+            ++stats_.failed;
+            co_return true;
+        }
+        if (group.tls && response.status_code() == 421 && conn.sni != name && !own_connection) {
+            // Misdirected: the server routes by SNI after all.
+            own_connection = true;
+            conn.close();
+            continue;
+        }
+        break;
+    }
+    on_response(group, name, conn, response, results);
+    co_return true;
+}
+
+void VhostProber::on_response(const VhostGroup &group, const std::string &name, VhostConnection &conn,
+                              HttpResponseParser &response, Results &results) {
+#ifdef JAM3Z_HAVE_OPENSSL
+    if (conn.ssl && !conn.session) {
+        // TLS 1.3 tickets arrive after the handshake, so this is the first point one is usable.
+        conn.session = SSL_get1_session(conn.ssl);
+    }
+#endif
+    HttpRecord rec;
+    rec.ip = format_ipv4(group.ip);
+    rec.domain = name;
+    rec.port = group.port;
+    fill_http_record(response, rec);
+    rec.cert = conn.cert;
+    record(group, results, std::move(rec), response.partial_body());
+    if (!response.keep_alive()) {
+        conn.close();
+    }
+}
+
+Task<VhostProber::Open> VhostProber::open(VhostConnection &conn, const VhostGroup &group, const std::string &name) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    for (double waited = 0; fd < 0 && (errno == EMFILE || errno == ENFILE) && waited < timeout_;
+         waited += kFdWait) {
+        // Out of descriptors: the other probes free theirs as they finish.
+        co_await sleep_for(loop_, kFdWait);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd < 0) {
+        co_return Open::Unreachable;
+    }
+    conn.io.reset(fd);
+    conn.io.set_timeout(timeout_);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(group.port);
+    addr.sin_addr.s_addr = htonl(group.ip);
+    if (co_await async_connect(conn.io, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        conn.close();
+        co_return Open::Unreachable;
+    }
+    ++stats_.connections;
+    if (group.tls && !co_await handshake(conn, name)) {
+        conn.close();
+        co_return Open::Failed;
+    }
+    co_return Open::Ok;
+}
+
+Task<bool> VhostProber::handshake(VhostConnection &conn, const std::string &name) {
+#ifdef JAM3Z_HAVE_OPENSSL
+    conn.ssl = SSL_new(ctx_);
+    if (!conn.ssl) {
+        co_return false;
+    }
+    SSL_set_fd(conn.ssl, conn.io.fd());
+    conn.sni = name;
+    if (!name.empty()) {
+        SSL_set_tlsext_host_name(conn.ssl, name.c_str());
+    }
+    if (conn.session) {
+        SSL_set_session(conn.ssl, conn.session);
+    }
+    for (;;) {
+        ERR_clear_error();
+        int r = SSL_connect(conn.ssl);
+        if (r == 1) {
+            break;
+        }
+        int err = SSL_get_error(conn.ssl, r);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+            co_return false;
+        }
+        if (!co_await conn.io.wait(err == SSL_ERROR_WANT_READ ? EventLoop::kRead : EventLoop::kWrite)) {
+            co_return false;
+        }
+    }
+    if (X509 *peer = SSL_get_peer_certificate(conn.ssl)) {
+        conn.cert = read_certificate(peer);
+        for (const auto &san : conn.cert->names) {
+            conn.cert_names.push_back(to_lower(san));
+        }
+        X509_free(peer);
+    }
+    co_return true;
+#else
+    (void)conn;
+    (void)name;
+    co_return false;
+#endif
+}
+
+Task<bool> VhostProber::write_all(VhostConnection &conn, std::string_view data) {
+    while (!data.empty()) {
+        size_t n = 0;
+        unsigned wait = 0;
+        Io io = io_write(conn, data, n, wait);
+        if (io == Io::Done) {
+            data.remove_prefix(n);
+        } else if (io != Io::Wait || !co_await conn.io.wait(wait)) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+Task<bool> VhostProber::read_response(VhostConnection &conn, HttpResponseParser &response, bool &received) {
+    for (;;) {
+        size_t n = 0;
+        unsigned wait = 0;
+        switch (io_read(conn, read_buf_, sizeof(read_buf_), n, wait)) {
+        case Io::Done:
+            received = true;
+            if (!response.feed(std::string_view(read_buf_, n))) {
+                co_return false;
+            }
+            if (response.done()) {
+                co_return true;
+            }
+            break;
+        case Io::Wait:
+            if (!co_await conn.io.wait(wait)) {
+                co_return false;
+            }
+            break;
+        case Io::Closed:
+            co_return response.finish();
+        case Io::Error:
+            co_return false;
+        }
+    }
+}
+
+VhostProber::Io VhostProber::io_write(VhostConnection &conn, std::string_view data, size_t &n, unsigned &wait) {
+#ifdef JAM3Z_HAVE_OPENSSL
+    if (conn.ssl) {
+        ERR_clear_error();
+        int r = SSL_write(conn.ssl, data.data(), static_cast<int>(data.size()));
+        if (r > 0) {
+            n = static_cast<size_t>(r);
+            return Io::Done;
+        }
+        int err = SSL_get_error(conn.ssl, r);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            wait = err == SSL_ERROR_WANT_READ ? EventLoop::kRead : EventLoop::kWrite;
+            return Io::Wait;
+        }
+        return Io::Error;
+    }
+#endif
+    ssize_t r = ::send(conn.io.fd(), data.data(), data.size(), MSG_NOSIGNAL);
+    if (r > 0) {
+        n = static_cast<size_t>(r);
+        return Io::Done;
+    }
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        wait = EventLoop::kWrite;
+        return Io::Wait;
+    }
+    return Io::Error;
+}
+
+VhostProber::Io VhostProber::io_read(VhostConnection &conn, char *buf, size_t cap, size_t &n, unsigned &wait) {
+#ifdef JAM3Z_HAVE_OPENSSL
+    if (conn.ssl) {
+        ERR_clear_error();
+        int r = SSL_read(conn.ssl, buf, static_cast<int>(cap));
+        if (r > 0) {
+            n = static_cast<size_t>(r);
+            return Io::Done;
+        }
+        int err = SSL_get_error(conn.ssl, r);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            wait = err == SSL_ERROR_WANT_READ ? EventLoop::kRead : EventLoop::kWrite;
+            return Io::Wait;
+        }
+        return err == SSL_ERROR_ZERO_RETURN ? Io::Closed : Io::Error;
+    }
+#endif
+    ssize_t r = ::recv(conn.io.fd(), buf, cap, 0);
+    if (r > 0) {
+        n = static_cast<size_t>(r);
+        return Io::Done;
+    }
+    if (r == 0) {
+        return Io::Closed;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        wait = EventLoop::kRead;
+        return Io::Wait;
+    }
+    return Io::Error;
+}
+
+void VhostProber::record(const VhostGroup &group, Results &results, HttpRecord rec, bool partial) {
+    if (!fold_) {
+        results.responses.push_back({std::move(rec), {}});
+        return;
+    }
+    // A cut-short body is compared on what was read of it.
+    uint64_t fingerprint = partial ? response_prefix_fingerprint(rec) : response_fingerprint(rec);
+    uint64_t default_fingerprint = partial ? group.default_prefix_fingerprint : group.default_fingerprint;
+    if (group.has_default && fingerprint == default_fingerprint) {
+        ++stats_.same_as_default;
+        return;
+    }
+    auto it = results.by_fingerprint.find(fingerprint);
+    if (it != results.by_fingerprint.end()) {
+        results.responses[it->second].aliases.push_back(std::move(rec.domain));
+        ++stats_.duplicates;
+        return;
+    }
+    results.by_fingerprint.emplace(fingerprint, results.responses.size());
+    results.responses.push_back({std::move(rec), {}});
+}
+
+void VhostProber::emit(HttpRecord rec) {
+    pending_.push_back(std::move(rec));
+    if (pending_.size() >= batch_size_) {
+        fn_(pending_);
+        pending_.clear();
+    }
+}
+
+VhostStats probe_vhosts(std::vector<VhostGroup> groups, size_t connections, double timeout, size_t batch_size,
+                        const std::function<void(std::vector<HttpRecord> &)> &fn) {
+#ifndef JAM3Z_HAVE_OPENSSL
+    size_t skipped = 0;
+    auto tls = std::stable_partition(groups.begin(), groups.end(), [](const VhostGroup &g) { return !g.tls; });
+    for (auto it = tls; it != groups.end(); ++it) {
+        skipped += it->names.size();
+    }
+    if (skipped) {
+        std::cerr << "This build has no TLS support; skipping " << skipped << " names on TLS ports." << std::endl;
+    }
+    groups.erase(tls, groups.end());
+#endif
+    VhostProber prober(std::move(groups), connections, timeout, batch_size, fn, true);
+    return prober.run();
+}
+
+VhostStats grab_endpoints(std::vector<VhostGroup> groups, size_t connections, double timeout, size_t batch_size,
+                          const std::function<void(std::vector<HttpRecord> &)> &fn) {
+    VhostProber prober(std::move(groups), connections, timeout, batch_size, fn, false);
+    return prober.run();
+}
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "parsers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// One open endpoint and every name still to be requested from it.
+struct VhostGroup {
+    uint32_t ip = 0;
+    uint16_t port = 0;
+    bool tls = false;
+    // An empty name requests the bare address: Host is the IP and no SNI is sent.
+    std::vector<std::string> names;
+    // Response to the bare-IP grab, if one was seen.
+    bool has_default = false;
+    uint64_t default_fingerprint = 0;
+    // The same up to the end of the title, for compressed responses decoded only that far.
+    uint64_t default_prefix_fingerprint = 0;
+};
+
+// Collects what virtual-host probing needs from the first pass: open
+// endpoints, their default-vhost responses, certificate SANs, and which
+// (endpoint, name) pairs zgrab2 already grabbed. Other names (input
+// hostnames, PTR) are added per address.
+class VhostQueue {
+public:
+    // Pipeline stage, called from the parse workers.
+    void observe(const std::vector<HttpRecord> &batch);
+    void add_name(uint32_t ip, const std::string &name);
+
+    // Work grouped by endpoint so each group can share connections.
+    std::vector<VhostGroup> take_groups();
+
+private:
+    struct Endpoint {
+        bool tls = false;
+        bool has_default = false;
+        uint64_t default_fingerprint = 0;
+        uint64_t default_prefix_fingerprint = 0;
+        std::unordered_set<std::string> grabbed;
+    };
+
+    mutable std::mutex mutex_;
+    // Keyed by ip << 16 | port.
+    std::unordered_map<uint64_t, Endpoint> endpoints_;
+    std::unordered_map<uint32_t, std::vector<std::string>> names_;
+};
+
+struct VhostStats {
+    size_t groups = 0;
+    size_t requests = 0;
+    size_t connections = 0;
+    size_t failed = 0;
+    // Answered exactly like the bare IP, so not written.
+    size_t same_as_default = 0;
+    // Folded into an earlier name's record as an alias.
+    size_t duplicates = 0;
+};
+
+// Requests every name of every group with that name as Host and SNI, keeping
+// up to `connections` groups in flight with one connection each. Requests for
+// a group reuse a keep-alive connection; over TLS, only for names the
+// presented certificate covers. Other names reconnect, resuming the TLS
+// session. Records that differ from the default vhost are handed to `fn` in
+// batches, with identical responses merged into an "aliases" field.
+VhostStats probe_vhosts(std::vector<VhostGroup> groups, size_t connections, double timeout, size_t batch_size,
+                        const std::function<void(std::vector<HttpRecord> &)> &fn);
+
+// The same client as a plain grab, standing in for masscan + zgrab2 on small
+// scans: one record per answered (endpoint, name), nothing merged or dropped.
+// Endpoints that refuse or time out on connect yield no records, as closed
+// ports yield none from masscan.
+VhostStats grab_endpoints(std::vector<VhostGroup> groups, size_t connections, double timeout, size_t batch_size,
+                          const std::function<void(std::vector<HttpRecord> &)> &fn);
+
+// Whether the native client speaks TLS in this build.
+bool native_tls_supported();
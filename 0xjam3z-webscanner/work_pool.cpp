@@ -0,0 +1,120 @@
+#include "work_pool.hpp"
+
+#include <chrono>
+
+// The pool the current thread works for, and its deque there.
+static thread_local const WorkPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : threads_) {
+        t.join();
+    }
+}
+
+void WorkPool::start(unsigned threads) {
+    if (!threads_.empty()) {
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i] { run(i); });
+    }
+}
+
+void WorkPool::submit(std::function<void()> task) {
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    size_t index = current_pool == this ? current_worker : next_++ % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Under the sleep lock so a worker about to wait cannot miss it.
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_;
+    }
+    wake_.notify_one();
+}
+
+bool WorkPool::take(size_t self, std::function<void()> &task) {
+    if (queued_ == 0) {
+        return false;
+    }
+    size_t n = workers_.size();
+    if (self < n) {
+        Worker &own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    size_t first = self < n ? self + 1 : next_++;
+    for (size_t i = 0; i < n; ++i) {
+        Worker &victim = *workers_[(first + i) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkPool::run_one() {
+    std::function<void()> task;
+    if (!take(current_pool == this ? current_worker : workers_.size(), task)) {
+        return false;
+    }
+    task();
+    progress_.notify_all();
+    return true;
+}
+
+void WorkPool::wait_until(const std::function<bool()> &done) {
+    while (!done()) {
+        if (!run_one()) {
+            // Woken when any task finishes; the timeout covers a notify that
+            // lands between the check and the wait.
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            progress_.wait_for(lock, std::chrono::milliseconds(5));
+        }
+    }
+}
+
+void WorkPool::run(size_t self) {
+    current_pool = this;
+    current_worker = self;
+    std::function<void()> task;
+    for (;;) {
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+            progress_.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing executor for the CPU stages (zgrab2 decoding, titles, --where,
+// plugins, index building). Each worker has its own deque: it runs its newest
+// task first and, when that runs dry, steals the oldest task of another worker,
+// so one batch of 1 MB bodies does not hold up the cores behind it.
+class WorkPool {
+public:
+    WorkPool() = default;
+    ~WorkPool();
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    // 0 for one worker per core. Until started, submit() runs tasks inline.
+    void start(unsigned threads);
+    unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+    // From a worker the task goes on that worker's deque, otherwise round-robin.
+    void submit(std::function<void()> task);
+    // Runs one queued task on the calling thread; false when there was none.
+    bool run_one();
+    // Runs queued tasks on the calling thread until `done` holds, so a thread
+    // waiting on the pool never sits idle while there is work.
+    void wait_until(const std::function<bool()> &done);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(size_t self, std::function<void()> &task);
+    void run(size_t self);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable progress_;
+    bool stop_ = false;
+};
+
+// Tasks on a pool whose results are committed in submission order, one at a
+// time, by whichever thread completes the next one due. At most `window` tasks
+// are outstanding; submit() helps the pool while the window is full, which keeps
+// a fast reader from buffering a whole file ahead of the workers.
+template <typename T>
+class OrderedTasks {
+public:
+    OrderedTasks(WorkPool &pool, std::function<void(T &)> commit, size_t window = 0)
+        : pool_(pool), commit_(std::move(commit)), window_(window ? window : 4 * std::max(1u, pool.size())) {}
+    ~OrderedTasks() { wait(); }
+    OrderedTasks(const OrderedTasks &) = delete;
+    OrderedTasks &operator=(const OrderedTasks &) = delete;
+
+    void submit(std::function<void(T &)> task) {
+        pool_.wait_until([this] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return issued_ - committed_ < window_;
+        });
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ticket = issued_++;
+            slots_.emplace_back();
+        }
+        pool_.submit([this, ticket, task = std::move(task)] {
+            T value{};
+            task(value);
+            finish(ticket, std::move(value));
+        });
+    }
+
+    // Returns once every submitted task has run and been committed.
+    void wait() {
+        pool_.wait_until([this] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return committed_ == issued_ && !committing_;
+        });
+    }
+
+private:
+    void finish(uint64_t ticket, T value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slots_[static_cast<size_t>(ticket - committed_)] = std::move(value);
+        if (committing_) {
+            return;
+        }
+        committing_ = true;
+        while (!slots_.empty() && slots_.front()) {
+            T item = std::move(*slots_.front());
+            slots_.pop_front();
+            ++committed_;
+            lock.unlock();
+            commit_(item);
+            lock.lock();
+        }
+        committing_ = false;
+    }
+
+    WorkPool &pool_;
+    std::function<void(T &)> commit_;
+    size_t window_;
+    std::mutex mutex_;
+    // Results of tickets committed_ onwards; empty until their task is done.
+    std::deque<std::optional<T>> slots_;
+    uint64_t issued_ = 0;
+    uint64_t committed_ = 0;
+    bool committing_ = false;
+};